@@ -5,4 +5,6 @@ TARGET = ministudio
 SUBDIRS += \
 	libs \
 	ministudio \
+	rawconvert \
+	tests \
 
@@ -0,0 +1,259 @@
+#include "AudioCapture.hpp"
+
+#include "AudioRing.hpp"
+#include "FrameClock.hpp"
+
+#include <QThread>
+#include <QDebug>
+
+#include <alsa/asoundlib.h>
+
+#include <cerrno>
+
+
+namespace
+{
+	// Who reads the ring, the capture thread itself or the armed consumer
+	enum Consumer {
+		Unclaimed=0
+		, Claiming
+		, Claimed
+	};
+}
+
+
+class AudioCaptureThread: public QThread
+{
+	private:
+		AudioCapture *mCapture;
+
+	public:
+		explicit AudioCaptureThread(AudioCapture *capture)
+			: mCapture(capture)
+		{
+
+		}
+
+		void run() override
+		{
+			mCapture->work();
+		}
+};
+
+
+AudioCapture::AudioCapture(QString device, unsigned int rate, int channels, int periodMs, int bufferMs)
+	: mDevice(device)
+	, mRate(qMax(8000u, rate))
+	, mChannels(qBound(1, channels, 8))
+	, mPeriodMs(qMax(1, periodMs))
+	, mPeriodFrames(0)
+	, mBufferMs(qMax(100, bufferMs))
+	, mPcm(nullptr)
+	, mRing(nullptr)
+	, mThread(nullptr)
+	, mStopping(0)
+	, mConsumer(Unclaimed)
+	, mPrerollMs(0)
+	, mPrerollChunks(0)
+	, mPeriods(0)
+	, mXruns(0)
+	, mOverruns(0)
+{
+
+}
+
+AudioCapture::~AudioCapture()
+{
+	stop();
+	delete mRing;
+	mRing=nullptr;
+}
+
+
+bool AudioCapture::start()
+{
+	if(nullptr!=mThread) {
+		return true;
+	}
+	int err=snd_pcm_open(&mPcm, mDevice.toLocal8Bit().constData(), SND_PCM_STREAM_CAPTURE, 0);
+	if(err<0) {
+		qWarning()<<"ERROR: Could not open audio device"<<mDevice<<":"<<snd_strerror(err);
+		mPcm=nullptr;
+		return false;
+	}
+	// A device buffer of a few periods, with ALSA converting rate and channels where the hardware can't
+	err=snd_pcm_set_params(mPcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED, static_cast<unsigned int>(mChannels), mRate, 1, static_cast<unsigned int>(mPeriodMs*4*1000));
+	snd_pcm_uframes_t bufferFrames=0;
+	snd_pcm_uframes_t periodFrames=0;
+	if(err>=0) {
+		err=snd_pcm_get_params(mPcm, &bufferFrames, &periodFrames);
+	}
+	if(err<0) {
+		qWarning()<<"ERROR: Could not set up audio device"<<mDevice<<":"<<snd_strerror(err);
+		snd_pcm_close(mPcm);
+		mPcm=nullptr;
+		return false;
+	}
+	mPeriodFrames=qMax(1, static_cast<int>(periodFrames));
+	const int framesPerMs=static_cast<int>(mRate)/1000;
+	mPrerollChunks=(mPrerollMs*framesPerMs+mPeriodFrames-1)/mPeriodFrames;
+	// Room for the consumer to fall behind on top of the preroll it starts with
+	const int chunks=((mBufferMs+mPrerollMs)*framesPerMs)/mPeriodFrames;
+	if(nullptr==mRing || mRing->chunkFrames()!=mPeriodFrames || mRing->capacity()<chunks) {
+		delete mRing;
+		mRing=new AudioRing(chunks, mPeriodFrames, mChannels);
+	}
+	mScratch.resize(mPeriodFrames*mChannels);
+	qDebug()<<"AUDIO: capturing from"<<mDevice<<mRate<<"Hz"<<mChannels<<"channels, period"<<mPeriodFrames<<"buffer"<<bufferFrames<<"frames";
+	mStopping.store(0);
+	mThread=new AudioCaptureThread(this);
+	mThread->setObjectName("AudioCapture");
+	mThread->start(QThread::TimeCriticalPriority);
+	return true;
+}
+
+
+void AudioCapture::stop()
+{
+	if(nullptr==mThread) {
+		return;
+	}
+	mStopping.store(1);
+	// A blocked read returns within a period
+	mThread->wait();
+	delete mThread;
+	mThread=nullptr;
+	snd_pcm_close(mPcm);
+	mPcm=nullptr;
+	qDebug()<<"AUDIO: stopped"<<stats();
+}
+
+
+bool AudioCapture::isRunning()
+{
+	return nullptr!=mThread;
+}
+
+
+void AudioCapture::work()
+{
+	bool warned=false;
+	while(0==mStopping.load()) {
+		if(Claiming==mConsumer.loadAcquire()) {
+			// Fails if the consumer disarmed again in the meantime
+			mConsumer.testAndSetOrdered(Claiming, Claimed);
+		}
+		const int consumer=mConsumer.loadAcquire();
+		if(Unclaimed==consumer) {
+			// Nobody reads the ring, keep only the preroll
+			while(mRing->size()>mPrerollChunks && nullptr!=mRing->beginRead()) {
+				mRing->endRead();
+			}
+		}
+		const bool keep=(Unclaimed!=consumer || mPrerollChunks>0);
+		AudioRing::Chunk *chunk=keep?mRing->beginWrite():nullptr;
+		if(keep && nullptr==chunk) {
+			// The consumer is behind, keep the device running and lose this period
+			mOverruns.fetchAndAddRelaxed(1);
+		}
+		qint16 *samples=(nullptr!=chunk)?chunk->samples:mScratch.data();
+		snd_pcm_sframes_t frames=snd_pcm_readi(mPcm, samples, static_cast<snd_pcm_uframes_t>(mPeriodFrames));
+		const qint64 now=FrameClock::now();
+		if(frames<0) {
+			if(-EPIPE==frames) {
+				mXruns.fetchAndAddRelaxed(1);
+				if(!warned) {
+					warned=true;
+					qWarning()<<"AUDIO: capture overrun, audio was lost";
+				}
+			}
+			const int err=snd_pcm_recover(mPcm, static_cast<int>(frames), 1);
+			if(err<0) {
+				qWarning()<<"ERROR: Audio capture failed:"<<snd_strerror(err);
+				break;
+			}
+			continue;
+		}
+		if(0==frames) {
+			continue;
+		}
+		mPeriods.fetchAndAddRelaxed(1);
+		// Frames still in the device were captured after the ones just read
+		snd_pcm_sframes_t delay=0;
+		if(snd_pcm_delay(mPcm, &delay)<0 || delay<0) {
+			delay=0;
+		}
+		const qint64 latency=(qint64(delay)+frames)*1000000000/mRate;
+		mLatency.add(latency);
+		if(nullptr!=chunk) {
+			chunk->timestamp=now-latency;
+			chunk->frames=static_cast<int>(frames);
+			mRing->endWrite();
+		}
+	}
+}
+
+
+void AudioCapture::setPreroll(int ms)
+{
+	mPrerollMs=qMax(0, ms);
+}
+
+
+void AudioCapture::setArmed(bool armed)
+{
+	if(armed) {
+		mConsumer.testAndSetOrdered(Unclaimed, Claiming);
+	} else {
+		mConsumer.fetchAndStoreOrdered(Unclaimed);
+	}
+}
+
+
+bool AudioCapture::isClaimed()
+{
+	return Claimed==mConsumer.loadAcquire();
+}
+
+
+AudioRing *AudioCapture::ring()
+{
+	return mRing;
+}
+
+
+unsigned int AudioCapture::rate()
+{
+	return mRate;
+}
+
+
+int AudioCapture::channels()
+{
+	return mChannels;
+}
+
+
+quint64 AudioCapture::xruns()
+{
+	return mXruns.load();
+}
+
+
+quint64 AudioCapture::overruns()
+{
+	return mOverruns.load();
+}
+
+
+LatencyMeter &AudioCapture::latency()
+{
+	return mLatency;
+}
+
+
+QString AudioCapture::stats()
+{
+	return QString("device=%1 periods=%2 xruns=%3 overruns=%4 latency=(%5)")
+		   .arg(mDevice).arg(mPeriods.load()).arg(mXruns.load()).arg(mOverruns.load()).arg(mLatency.stats());
+}
@@ -0,0 +1,88 @@
+#ifndef AUDIOCAPTURE_HPP
+#define AUDIOCAPTURE_HPP
+
+#include "LatencyMeter.hpp"
+
+#include <QString>
+#include <QVector>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+class QThread;
+class AudioRing;
+typedef struct _snd_pcm snd_pcm_t;
+
+/*
+  Captures 16 bit PCM from an ALSA device on its own thread.
+
+  Every period read is stamped with the capture time of its first frame on
+  the same steady clock as the video frames (FrameClock), worked out from
+  the time of the read and the frames the device still holds. While armed
+  the periods are read straight into the AudioRing, otherwise the device
+  keeps running so arming is instant, and its data is thrown away except
+  for the last preroll's worth, which stays in the ring for the next
+  recording to start with.
+
+  Until a consumer is armed the capture thread owns both ends of the ring
+  and trims the oldest periods itself. Arming hands the read side over at
+  the next period read, isClaimed() tells the consumer when that happened.
+
+  The "null" device captures silence, which is enough to run it on a box
+  without a sound card.
+*/
+class AudioCapture
+{
+	private:
+		QString mDevice;
+		unsigned int mRate;
+		int mChannels;
+		int mPeriodMs;
+		int mPeriodFrames;
+		int mBufferMs;
+		snd_pcm_t *mPcm;
+		AudioRing *mRing;
+		QVector<qint16> mScratch;
+		QThread *mThread;
+		QAtomicInt mStopping;
+		QAtomicInt mConsumer;
+		int mPrerollMs;
+		int mPrerollChunks;
+		QAtomicInteger<quint64> mPeriods;
+		QAtomicInteger<quint64> mXruns;
+		QAtomicInteger<quint64> mOverruns;
+		LatencyMeter mLatency;
+
+	public:
+		// bufferMs is how much audio the ring holds for the consumer
+		explicit AudioCapture(QString device="default", unsigned int rate=48000, int channels=2, int periodMs=10, int bufferMs=2000);
+		virtual ~AudioCapture();
+
+	public:
+		bool start();
+		void stop();
+		bool isRunning();
+
+		// Audio kept in the ring while disarmed, for a video preroll. Takes effect on start()
+		void setPreroll(int ms);
+		// Arm once the consumer is ready to read, disarm after its last read
+		void setArmed(bool armed);
+		// Whether the armed consumer may read the ring yet
+		bool isClaimed();
+		AudioRing *ring();
+		unsigned int rate();
+		int channels();
+
+		// Periods the device overran before they were read
+		quint64 xruns();
+		// Periods dropped because the ring was full
+		quint64 overruns();
+		// From capture to the period being read off the device
+		LatencyMeter &latency();
+		QString stats();
+
+	private:
+		friend class AudioCaptureThread;
+		void work();
+};
+
+#endif // AUDIOCAPTURE_HPP
@@ -0,0 +1,84 @@
+#include "AudioRing.hpp"
+
+
+AudioRing::AudioRing(int chunks, int chunkFrames, int channels)
+	: mChunkFrames(qMax(1, chunkFrames))
+	, mChannels(qMax(1, channels))
+	, mMask(0)
+	, mWritten(0)
+	, mRead(0)
+{
+	int count=2;
+	while(count<chunks) {
+		count<<=1;
+	}
+	mMask=quint32(count-1);
+	mSamples.resize(count*mChunkFrames*mChannels);
+	mChunks.resize(count);
+	for(int i=0; i<count; ++i) {
+		mChunks[i]=Chunk{0, 0, mSamples.data()+i*mChunkFrames*mChannels};
+	}
+}
+
+AudioRing::~AudioRing()
+{
+
+}
+
+
+AudioRing::Chunk *AudioRing::beginWrite()
+{
+	const quint32 written=mWritten.load();
+	if(written-mRead.loadAcquire()>=quint32(mChunks.size())) {
+		return nullptr;
+	}
+	return &mChunks[int(written&mMask)];
+}
+
+
+void AudioRing::endWrite()
+{
+	// Publishes the chunk's contents along with it
+	mWritten.storeRelease(mWritten.load()+1);
+}
+
+
+const AudioRing::Chunk *AudioRing::beginRead()
+{
+	const quint32 read=mRead.load();
+	if(mWritten.loadAcquire()==read) {
+		return nullptr;
+	}
+	return &mChunks[int(read&mMask)];
+}
+
+
+void AudioRing::endRead()
+{
+	// Hands the slot back only once the consumer is done with it
+	mRead.storeRelease(mRead.load()+1);
+}
+
+
+int AudioRing::size() const
+{
+	return int(mWritten.loadAcquire()-mRead.loadAcquire());
+}
+
+
+int AudioRing::capacity() const
+{
+	return mChunks.size();
+}
+
+
+int AudioRing::chunkFrames() const
+{
+	return mChunkFrames;
+}
+
+
+int AudioRing::channels() const
+{
+	return mChannels;
+}
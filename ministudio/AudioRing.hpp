@@ -0,0 +1,59 @@
+#ifndef AUDIORING_HPP
+#define AUDIORING_HPP
+
+#include <QVector>
+#include <QAtomicInteger>
+
+/*
+  Lock-free single producer, single consumer ring of audio chunks.
+
+  All memory is allocated up front. Each slot holds up to chunkFrames
+  interleaved 16 bit frames and the capture time of its first frame in ns
+  on the FrameClock. The producer fills a slot in place between
+  beginWrite() and endWrite(), the consumer reads one in place between
+  beginRead() and endRead(). Neither side ever blocks or takes a lock, a
+  full ring makes beginWrite() return nullptr and the producer drops the
+  chunk.
+*/
+class AudioRing
+{
+	public:
+		struct Chunk {
+			// Capture time of the first frame
+			qint64 timestamp;
+			int frames;
+			qint16 *samples;
+		};
+
+	private:
+		QVector<qint16> mSamples;
+		QVector<Chunk> mChunks;
+		int mChunkFrames;
+		int mChannels;
+		quint32 mMask;
+		// Both only ever grow and wrap around, the slot is the count masked by the power of two number of slots
+		QAtomicInteger<quint32> mWritten;
+		QAtomicInteger<quint32> mRead;
+
+	public:
+		// chunks is rounded up to a power of two
+		explicit AudioRing(int chunks, int chunkFrames, int channels);
+		virtual ~AudioRing();
+
+	public:
+		// Producer side. The chunk returned is the producer's until endWrite()
+		Chunk *beginWrite();
+		void endWrite();
+
+		// Consumer side. The chunk returned is the consumer's until endRead()
+		const Chunk *beginRead();
+		void endRead();
+
+		// Chunks waiting to be read
+		int size() const;
+		int capacity() const;
+		int chunkFrames() const;
+		int channels() const;
+};
+
+#endif // AUDIORING_HPP
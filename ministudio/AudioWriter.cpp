@@ -0,0 +1,260 @@
+#include "AudioWriter.hpp"
+
+#include "AudioCapture.hpp"
+#include "AudioRing.hpp"
+#include "FrameClock.hpp"
+
+#include <QThread>
+#include <QProcess>
+#include <QDebug>
+
+#include <cstring>
+
+
+class AudioWriterThread: public QThread
+{
+	private:
+		AudioWriter *mWriter;
+
+	public:
+		explicit AudioWriterThread(AudioWriter *writer)
+			: mWriter(writer)
+		{
+
+		}
+
+		void run() override
+		{
+			mWriter->work();
+		}
+};
+
+
+namespace
+{
+	const int WAV_HEADER_SIZE=44;
+
+	void appendLE(QByteArray &out, quint32 value, int bytes)
+	{
+		for(int i=0; i<bytes; ++i) {
+			out.append(static_cast<char>((value>>(8*i))&0xff));
+		}
+	}
+}
+
+
+AudioWriter::AudioWriter(AudioCapture *capture, const QString &filename, qint64 start)
+	: mCapture(capture)
+	, mFile(filename)
+	, mStart(start)
+	, mThread(nullptr)
+	, mStopping(0)
+	, mPlaced(false)
+	, mWritten(0)
+	, mDrift(0.0)
+	, mTolerance(capture->rate()/1000.0)
+	, mPadded(0)
+	, mRepeated(0)
+	, mDropped(0)
+	, mCut(0)
+{
+	if(!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qWarning()<<"ERROR: Could not create"<<filename<<":"<<mFile.errorString();
+		return;
+	}
+	writeHeader();
+	mCapture->setArmed(true);
+	mThread=new AudioWriterThread(this);
+	mThread->setObjectName("AudioWriter");
+	mThread->start();
+}
+
+AudioWriter::~AudioWriter()
+{
+	finish();
+}
+
+
+void AudioWriter::work()
+{
+	const unsigned long periodMs=qMax(1ul, static_cast<unsigned long>(mCapture->ring()->chunkFrames()*1000/mCapture->rate()));
+	while(0==mStopping.load()) {
+		if(!drain()) {
+			// Nothing to wake on without a lock, so poll at half the period
+			QThread::msleep(qMax(1ul, periodMs/2));
+		}
+	}
+}
+
+
+bool AudioWriter::drain()
+{
+	if(!mCapture->isClaimed()) {
+		// The capture thread still trims the ring, it is ours from its next period
+		return false;
+	}
+	AudioRing *ring=mCapture->ring();
+	const int channels=ring->channels();
+	const qint64 rate=mCapture->rate();
+	bool any=false;
+	const AudioRing::Chunk *chunk=nullptr;
+	while(nullptr!=(chunk=ring->beginRead())) {
+		any=true;
+		mLatency.add(FrameClock::since(chunk->timestamp));
+		// Where the timestamp puts the chunk's first frame in the file
+		const qint64 expected=(chunk->timestamp-mStart)*rate/1000000000;
+		const qint64 gap=expected-qint64(mWritten);
+		int first=0;
+		int frames=chunk->frames;
+		if(expected+frames<=0 || (mPlaced && gap<=-frames)) {
+			// From before the recording started, or left over from an earlier one
+			mCut+=frames;
+			frames=0;
+		} else if(!mPlaced) {
+			mPlaced=true;
+			if(gap>0) {
+				writeSilence(gap);
+			} else {
+				first=static_cast<int>(-gap);
+				mCut+=first;
+			}
+		} else if(gap>rate/10) {
+			// A hole after an xrun or a full ring, keep what follows in place
+			writeSilence(gap);
+			mDrift=0.0;
+		} else {
+			// Positive when more has been written than the timestamps account for
+			mDrift=mDrift*0.95-gap*0.05;
+			if(mDrift>mTolerance && frames>1) {
+				frames--;
+				mDropped++;
+				mDrift-=1.0;
+			} else if(mDrift<-mTolerance) {
+				write(chunk->samples, 1);
+				mRepeated++;
+				mDrift+=1.0;
+			}
+		}
+		if(frames>first) {
+			write(chunk->samples+first*channels, frames-first);
+		}
+		ring->endRead();
+	}
+	if(!mBuffer.isEmpty()) {
+		if(mBuffer.size()!=mFile.write(mBuffer)) {
+			qWarning()<<"ERROR: Could not write audio to"<<mFile.fileName()<<":"<<mFile.errorString();
+		}
+		mBuffer.clear();
+	}
+	return any;
+}
+
+
+void AudioWriter::write(const qint16 *samples, int frames)
+{
+	// WAV is little endian like the samples from the device
+	mBuffer.append(reinterpret_cast<const char *>(samples), frames*mCapture->channels()*int(sizeof(qint16)));
+	mWritten+=quint64(frames);
+}
+
+
+void AudioWriter::writeSilence(qint64 frames)
+{
+	mBuffer.append(QByteArray(static_cast<int>(frames*mCapture->channels()*sizeof(qint16)), '\0'));
+	mWritten+=quint64(frames);
+	mPadded+=quint64(frames);
+}
+
+
+void AudioWriter::writeHeader()
+{
+	const quint32 channels=static_cast<quint32>(mCapture->channels());
+	const quint32 rate=mCapture->rate();
+	const quint32 dataBytes=static_cast<quint32>(qMin<quint64>(0xffffffffu-WAV_HEADER_SIZE, mWritten*channels*sizeof(qint16)));
+	QByteArray header;
+	header.append("RIFF");
+	appendLE(header, dataBytes+WAV_HEADER_SIZE-8, 4);
+	header.append("WAVEfmt ");
+	appendLE(header, 16, 4);
+	// PCM, 16 bit
+	appendLE(header, 1, 2);
+	appendLE(header, channels, 2);
+	appendLE(header, rate, 4);
+	appendLE(header, rate*channels*2, 4);
+	appendLE(header, channels*2, 2);
+	appendLE(header, 16, 2);
+	header.append("data");
+	appendLE(header, dataBytes, 4);
+	mFile.seek(0);
+	mFile.write(header);
+}
+
+
+void AudioWriter::finish()
+{
+	if(!mFile.isOpen()) {
+		return;
+	}
+	if(nullptr!=mThread) {
+		mStopping.store(1);
+		mThread->wait();
+		delete mThread;
+		mThread=nullptr;
+	}
+	// Whatever the capture thread has put in the ring by now
+	drain();
+	// Only after the last read, from here on the capture thread trims the ring again
+	mCapture->setArmed(false);
+	writeHeader();
+	mFile.close();
+	qDebug()<<"AUDIO: finished"<<mFile.fileName()<<stats();
+}
+
+
+QString AudioWriter::filename()
+{
+	return mFile.fileName();
+}
+
+
+qreal AudioWriter::duration()
+{
+	return qreal(mWritten)/mCapture->rate();
+}
+
+
+quint64 AudioWriter::padded()
+{
+	return mPadded;
+}
+
+
+QString AudioWriter::stats()
+{
+	return QString("seconds=%1 padded=%2 cut=%3 repeated=%4 dropped=%5 latency=(%6)")
+		   .arg(duration(), 0, 'f', 2).arg(mPadded).arg(mCut).arg(mRepeated).arg(mDropped).arg(mLatency.stats());
+}
+
+
+bool AudioWriter::mux(const QString &video, const QString &audio)
+{
+	const QString muxed=video+".muxing.mkv";
+	QStringList args;
+	args<<"-hide_banner"<<"-nostats"<<"-loglevel"<<"error"<<"-y";
+	args<<"-i"<<video<<"-i"<<audio;
+	// Video as it is, audio losslessly compressed
+	args<<"-map"<<"0:v"<<"-map"<<"1:a"<<"-c:v"<<"copy"<<"-c:a"<<"flac"<<muxed;
+	const int code=QProcess::execute("ffmpeg", args);
+	if(0!=code) {
+		qWarning()<<"ERROR: Could not mux"<<audio<<"into"<<video<<", ffmpeg exited with"<<code;
+		QFile::remove(muxed);
+		return false;
+	}
+	if(!QFile::remove(video) || !QFile::rename(muxed, video)) {
+		qWarning()<<"ERROR: Could not replace"<<video<<"with"<<muxed;
+		return false;
+	}
+	QFile::remove(audio);
+	qDebug()<<"AUDIO: muxed into"<<video;
+	return true;
+}
@@ -0,0 +1,79 @@
+#ifndef AUDIOWRITER_HPP
+#define AUDIOWRITER_HPP
+
+#include "LatencyMeter.hpp"
+
+#include <QString>
+#include <QFile>
+#include <QByteArray>
+#include <QAtomicInt>
+
+class QThread;
+class AudioCapture;
+
+/*
+  Writes the audio of a recording into a WAV file next to the video.
+
+  Sample 0 of the file is the capture time of the recording's first video
+  frame, so audio and video line up without any editing. Periods are
+  placed by their capture timestamps: silence fills time where audio is
+  missing (before the device was armed, after an xrun), and audio from
+  before the start is cut.
+
+  The sound card's clock and the steady clock drift apart by some ppm.
+  The difference between where the timestamps say the audio belongs and
+  how much has been written is smoothed, and once it exceeds a millisecond
+  single frames are dropped or repeated until it is back, which is
+  inaudible at that rate.
+
+  Reads the capture's ring on its own thread. finish() drains what is left
+  and completes the file.
+*/
+class AudioWriter
+{
+	private:
+		AudioCapture *mCapture;
+		QFile mFile;
+		qint64 mStart;
+		QThread *mThread;
+		QAtomicInt mStopping;
+		QByteArray mBuffer;
+		bool mPlaced;
+		quint64 mWritten;
+		qreal mDrift;
+		qreal mTolerance;
+		quint64 mPadded;
+		quint64 mRepeated;
+		quint64 mDropped;
+		quint64 mCut;
+		LatencyMeter mLatency;
+
+	public:
+		// start is the capture time of the first video frame, from FrameClock
+		explicit AudioWriter(AudioCapture *capture, const QString &filename, qint64 start);
+		virtual ~AudioWriter();
+
+	public:
+		// Drain the ring, complete the WAV header and close. Blocks until done
+		void finish();
+		QString filename();
+		// Seconds of audio written
+		qreal duration();
+		// Frames of silence written where there was no audio
+		quint64 padded();
+		QString stats();
+
+	public:
+		// Put the WAV into the video file as a second track, replacing it. For use once both are finished
+		static bool mux(const QString &video, const QString &audio);
+
+	private:
+		friend class AudioWriterThread;
+		void work();
+		bool drain();
+		void write(const qint16 *samples, int frames);
+		void writeSilence(qint64 frames);
+		void writeHeader();
+};
+
+#endif // AUDIOWRITER_HPP
@@ -0,0 +1,300 @@
+#include "BlendEngine.hpp"
+
+#include <QVarLengthArray>
+#include <QAtomicInt>
+#include <QDebug>
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLEND_X86
+#include <immintrin.h>
+#define BLEND_TARGET(T) __attribute__((target(T)))
+#endif
+
+namespace
+{
+	QAtomicInt sPath(-1);
+
+	BlendEngine::Path bestPath()
+	{
+#ifdef BLEND_X86
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2")) {
+			return BlendEngine::AVX2;
+		}
+		if(__builtin_cpu_supports("sse2")) {
+			return BlendEngine::SSE2;
+		}
+#endif
+		return BlendEngine::Scalar;
+	}
+
+	// x*a/255 for two channels packed as 0x00XX00YY. Rounds exactly like mulAlpha() below
+	inline quint32 mulPair(quint32 x, quint32 a)
+	{
+		quint32 t=x*a+0x00800080;
+		return ((t+((t>>8)&0x00ff00ff))>>8)&0x00ff00ff;
+	}
+
+	inline quint32 byteMul(quint32 x, quint32 a)
+	{
+		return mulPair(x&0x00ff00ff, a) | (mulPair((x>>8)&0x00ff00ff, a)<<8);
+	}
+
+	inline quint32 sourceOver(quint32 d, quint32 s, quint32 alpha)
+	{
+		if(alpha<255) {
+			s=byteMul(s, alpha);
+		}
+		const quint32 sa=s>>24;
+		if(255==sa) {
+			return s;
+		}
+		if(0==sa && 0==s) {
+			return d;
+		}
+		return s+byteMul(d, 255-sa);
+	}
+
+#ifdef BLEND_X86
+	// x*a/255 in 16 bit lanes, x and a in 0..255
+	BLEND_TARGET("sse2") inline __m128i mulAlpha(__m128i x, __m128i a)
+	{
+		const __m128i t=_mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(0x80));
+		return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+	}
+
+	BLEND_TARGET("sse2") inline __m128i broadcastAlpha(__m128i x)
+	{
+		return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	BLEND_TARGET("avx2") inline __m256i mulAlpha256(__m256i x, __m256i a)
+	{
+		const __m256i t=_mm256_add_epi16(_mm256_mullo_epi16(x, a), _mm256_set1_epi16(0x80));
+		return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+	}
+
+	BLEND_TARGET("avx2") inline __m256i broadcastAlpha256(__m256i x)
+	{
+		return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	}
+#endif
+}
+
+
+bool BlendEngine::canBlend(const QImage &dst, const QImage &src, const QTransform &t)
+{
+	if(QImage::Format_ARGB32_Premultiplied!=dst.format()) {
+		return false;
+	}
+	// RGB32 sources are made opaque as they are read, see blend()
+	if(QImage::Format_ARGB32_Premultiplied!=src.format() && QImage::Format_RGB32!=src.format()) {
+		return false;
+	}
+	// No rotation, shear, projection or mirroring
+	if(t.type()>QTransform::TxScale) {
+		return false;
+	}
+	return t.m11()>0.0 && t.m22()>0.0;
+}
+
+
+bool BlendEngine::blend(QImage &dst, const QImage &src, const QTransform &t, qreal opacity, const QRect &clip)
+{
+	if(!canBlend(dst, src, t)) {
+		return false;
+	}
+	const quint32 alpha=static_cast<quint32>(qBound(0, qRound(opacity*255.0), 255));
+	if(0==alpha || src.isNull() || dst.isNull()) {
+		return true;
+	}
+	const qreal sx=t.m11(), sy=t.m22(), dx=t.dx(), dy=t.dy();
+	// Same sampling as QPainter: a destination pixel is covered when its centre maps inside the source
+	const int left=static_cast<int>(std::ceil(dx-0.5));
+	const int top=static_cast<int>(std::ceil(dy-0.5));
+	const int right=static_cast<int>(std::ceil(dx+src.width()*sx-0.5));
+	const int bottom=static_cast<int>(std::ceil(dy+src.height()*sy-0.5));
+	QRect area=QRect(left, top, right-left, bottom-top).intersected(dst.rect());
+	if(!clip.isNull()) {
+		area=area.intersected(clip);
+	}
+	if(area.isEmpty()) {
+		return true;
+	}
+	const int w=area.width();
+	const int lastX=src.width()-1, lastY=src.height()-1;
+	// The top byte of RGB32 is padding, which the X11 grabbers leave 0. The kernels take it as alpha, so force it opaque
+	const quint32 pad=(QImage::Format_RGB32==src.format())?0xff000000:0;
+	QVarLengthArray<quint32, 2048> row(w);
+	if(1.0==sx) {
+		// Translation only on x, rows can be blended straight from the source
+		const int ox=static_cast<int>(std::floor(0.5-dx));
+		for(int y=area.top(); y<=area.bottom(); ++y) {
+			const int srcY=qBound(0, static_cast<int>(std::floor((y+0.5-dy)/sy)), lastY);
+			const quint32 *s=reinterpret_cast<const quint32 *>(src.constScanLine(srcY))+area.left()+ox;
+			if(0!=pad) {
+				for(int i=0; i<w; ++i) {
+					row[i]=s[i]|pad;
+				}
+				s=row.constData();
+			}
+			quint32 *d=reinterpret_cast<quint32 *>(dst.scanLine(y))+area.left();
+			blendRow(d, s, w, alpha);
+		}
+		return true;
+	}
+	QVarLengthArray<int, 2048> columns(w);
+	for(int i=0; i<w; ++i) {
+		columns[i]=qBound(0, static_cast<int>(std::floor((area.left()+i+0.5-dx)/sx)), lastX);
+	}
+	int rowY=-1;
+	for(int y=area.top(); y<=area.bottom(); ++y) {
+		const int srcY=qBound(0, static_cast<int>(std::floor((y+0.5-dy)/sy)), lastY);
+		if(srcY!=rowY) {
+			// Upscaled layers repeat source rows, gather each one only once
+			const quint32 *s=reinterpret_cast<const quint32 *>(src.constScanLine(srcY));
+			for(int i=0; i<w; ++i) {
+				row[i]=s[columns[i]]|pad;
+			}
+			rowY=srcY;
+		}
+		quint32 *d=reinterpret_cast<quint32 *>(dst.scanLine(y))+area.left();
+		blendRow(d, row.constData(), w, alpha);
+	}
+	return true;
+}
+
+
+BlendEngine::Path BlendEngine::path()
+{
+	int p=sPath.load();
+	if(p<0) {
+		p=bestPath();
+		sPath.testAndSetOrdered(-1, p);
+		qDebug()<<"BLEND ENGINE: using"<<pathName();
+	}
+	return static_cast<Path>(sPath.load());
+}
+
+
+QString BlendEngine::pathName()
+{
+	switch(path()) {
+		case AVX2: return "avx2";
+		case SSE2: return "sse2";
+		default: return "scalar";
+	}
+}
+
+
+void BlendEngine::setPath(Path p)
+{
+	const Path best=bestPath();
+	sPath.store((p<=best)?p:Scalar);
+}
+
+
+void BlendEngine::blendRow(quint32 *dst, const quint32 *src, int count, quint32 alpha)
+{
+	switch(path()) {
+		case AVX2: blendRowAVX2(dst, src, count, alpha); break;
+		case SSE2: blendRowSSE2(dst, src, count, alpha); break;
+		default: blendRowScalar(dst, src, count, alpha); break;
+	}
+}
+
+
+void BlendEngine::blendRowScalar(quint32 *dst, const quint32 *src, int count, quint32 alpha)
+{
+	for(int i=0; i<count; ++i) {
+		dst[i]=sourceOver(dst[i], src[i], alpha);
+	}
+}
+
+
+#ifdef BLEND_X86
+
+BLEND_TARGET("sse2") void BlendEngine::blendRowSSE2(quint32 *dst, const quint32 *src, int count, quint32 alpha)
+{
+	const __m128i zero=_mm_setzero_si128();
+	const __m128i full=_mm_set1_epi16(255);
+	const __m128i global=_mm_set1_epi16(static_cast<short>(alpha));
+	const __m128i alphaMask=_mm_set1_epi32(static_cast<int>(0xff000000));
+	int i=0;
+	for(; i+4<=count; i+=4) {
+		__m128i s=_mm_loadu_si128(reinterpret_cast<const __m128i *>(src+i));
+		if(255==alpha) {
+			const int opaque=_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), alphaMask));
+			if(0xffff==opaque) {
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i), s);
+				continue;
+			}
+		}
+		if(0xffff==_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero))) {
+			continue;
+		}
+		__m128i sLo=_mm_unpacklo_epi8(s, zero);
+		__m128i sHi=_mm_unpackhi_epi8(s, zero);
+		if(alpha<255) {
+			sLo=mulAlpha(sLo, global);
+			sHi=mulAlpha(sHi, global);
+		}
+		const __m128i d=_mm_loadu_si128(reinterpret_cast<const __m128i *>(dst+i));
+		const __m128i dLo=mulAlpha(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(full, broadcastAlpha(sLo)));
+		const __m128i dHi=mulAlpha(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(full, broadcastAlpha(sHi)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i), _mm_packus_epi16(_mm_add_epi16(sLo, dLo), _mm_add_epi16(sHi, dHi)));
+	}
+	blendRowScalar(dst+i, src+i, count-i, alpha);
+}
+
+
+BLEND_TARGET("avx2") void BlendEngine::blendRowAVX2(quint32 *dst, const quint32 *src, int count, quint32 alpha)
+{
+	const __m256i zero=_mm256_setzero_si256();
+	const __m256i full=_mm256_set1_epi16(255);
+	const __m256i global=_mm256_set1_epi16(static_cast<short>(alpha));
+	const __m256i alphaMask=_mm256_set1_epi32(static_cast<int>(0xff000000));
+	int i=0;
+	for(; i+8<=count; i+=8) {
+		__m256i s=_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src+i));
+		if(255==alpha) {
+			const int opaque=_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(s, alphaMask), alphaMask));
+			if(-1==opaque) {
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst+i), s);
+				continue;
+			}
+		}
+		if(-1==_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero))) {
+			continue;
+		}
+		// unpack/pack work per 128 bit lane, so the pixel order survives the round trip
+		__m256i sLo=_mm256_unpacklo_epi8(s, zero);
+		__m256i sHi=_mm256_unpackhi_epi8(s, zero);
+		if(alpha<255) {
+			sLo=mulAlpha256(sLo, global);
+			sHi=mulAlpha256(sHi, global);
+		}
+		const __m256i d=_mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst+i));
+		const __m256i dLo=mulAlpha256(_mm256_unpacklo_epi8(d, zero), _mm256_sub_epi16(full, broadcastAlpha256(sLo)));
+		const __m256i dHi=mulAlpha256(_mm256_unpackhi_epi8(d, zero), _mm256_sub_epi16(full, broadcastAlpha256(sHi)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst+i), _mm256_packus_epi16(_mm256_add_epi16(sLo, dLo), _mm256_add_epi16(sHi, dHi)));
+	}
+	blendRowSSE2(dst+i, src+i, count-i, alpha);
+}
+
+#else
+
+void BlendEngine::blendRowSSE2(quint32 *dst, const quint32 *src, int count, quint32 alpha)
+{
+	blendRowScalar(dst, src, count, alpha);
+}
+
+
+void BlendEngine::blendRowAVX2(quint32 *dst, const quint32 *src, int count, quint32 alpha)
+{
+	blendRowScalar(dst, src, count, alpha);
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef BLENDENGINE_HPP
+#define BLENDENGINE_HPP
+
+#include <QImage>
+#include <QTransform>
+#include <QRect>
+
+/*
+  Fast path for compositing axis aligned image layers.
+
+  Blends a premultiplied (or RGB32, whose padding byte is ignored) source
+  over a premultiplied ARGB32 destination with a global opacity. The
+  source may be translated and scaled (nearest neighbour, like QPainter
+  without SmoothPixmapTransform) but not rotated or sheared.
+
+  The row kernels come in scalar, SSE2 and AVX2 flavours. The best one the
+  CPU supports is picked at runtime.
+*/
+class BlendEngine
+{
+	public:
+		enum Path {
+			Scalar
+			, SSE2
+			, AVX2
+		};
+
+	public:
+		// Whether blend() can handle this combination, if not use QPainter
+		static bool canBlend(const QImage &dst, const QImage &src, const QTransform &t);
+		// Blend src over dst. Returns false without touching dst if the combination is not supported
+		static bool blend(QImage &dst, const QImage &src, const QTransform &t, qreal opacity, const QRect &clip=QRect());
+
+		static Path path();
+		static QString pathName();
+		// Force a specific kernel, for comparing them. Falls back to scalar if the CPU lacks support
+		static void setPath(Path path);
+
+	public:
+		// Premultiplied source over for count pixels. alpha is the global opacity in the range 0..255
+		static void blendRow(quint32 *dst, const quint32 *src, int count, quint32 alpha);
+		static void blendRowScalar(quint32 *dst, const quint32 *src, int count, quint32 alpha);
+		static void blendRowSSE2(quint32 *dst, const quint32 *src, int count, quint32 alpha);
+		static void blendRowAVX2(quint32 *dst, const quint32 *src, int count, quint32 alpha);
+};
+
+#endif // BLENDENGINE_HPP
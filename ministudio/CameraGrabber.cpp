@@ -7,6 +7,14 @@
 
 
 #include "CLVideoFilter.hpp"
+#include "YuvConverter.hpp"
+#include "FrameBufferPool.hpp"
+#include "FormatNegotiator.hpp"
+#include "FrameClock.hpp"
+
+#include <QVideoSurfaceFormat>
+
+#include <cstring>
 
 
 
@@ -16,6 +24,8 @@
 CameraGrabber::CameraGrabber(QObject *parent)
 	: QAbstractVideoSurface(parent)
 	, clFilter(nullptr)
+	, mScale(SCALE_ONE)
+	, mFailed(0)
 {
 	//qDebug()<<"CameraGrabber ctor";
 }
@@ -63,27 +73,159 @@ bool CameraGrabber::present(const QVideoFrame &frame)
 {
 	//qDebug()<<"camframe";
 	if (frame.isValid()) {
+		const qint64 captured=FrameClock::now();
 		QVideoFrame cloneFrame(frame);
 		cloneFrame.map(QAbstractVideoBuffer::ReadOnly);
 
-
-
-
-		if(nullptr==clFilter) {
-			clFilter = new CLVideoFilter();
-		}
-
 		QSharedPointer<QImage> image;
-		if(nullptr!=clFilter) {
-			image=clFilter->run(&cloneFrame);
+		YuvConverter::Layout layout=YuvConverter::NV12;
+		if(yuvLayout(cloneFrame.pixelFormat(), layout)) {
+			// The GPU filter only takes RGB, so YUV is converted here
+			image=convertYuv(cloneFrame, layout);
 		} else {
-			image=QSharedPointer<QImage> (new QImage(cloneFrame.bits(), cloneFrame.width(), cloneFrame.height(), QVideoFrame::imageFormatFromPixelFormat(cloneFrame .pixelFormat())));
+			if(nullptr==clFilter) {
+				clFilter = new CLVideoFilter();
+			}
+			if(nullptr!=clFilter) {
+				image=clFilter->run(&cloneFrame);
+			}
+			if(image.isNull()) {
+				image=copyFrame(cloneFrame);
+			}
 		}
-		emit frameAvailable(image);
 		cloneFrame.unmap();
+		if(!image.isNull()) {
+			qreal scale=1.0;
+			image=scaleFrame(FormatNegotiator::globalInstance()->convert(image, FormatNegotiator::CameraStage), scale);
+			// From here on the frame is only shared, never copied or modified
+			mMailbox.publish(image, captured, scale);
+		} else {
+			mFailed.fetchAndAddRelaxed(1);
+		}
 		return true;
 	} else {
 		qWarning()<<"frame was invalid";
 	}
+	mFailed.fetchAndAddRelaxed(1);
 	return false;
 }
+
+
+CameraMailbox &CameraGrabber::mailbox()
+{
+	return mMailbox;
+}
+
+
+void CameraGrabber::setScale(qreal scale)
+{
+	mScale.store(qBound(1, qRound(scale*SCALE_ONE), SCALE_ONE));
+}
+
+
+quint64 CameraGrabber::failed()
+{
+	return mFailed.load();
+}
+
+
+bool CameraGrabber::yuvLayout(QVideoFrame::PixelFormat format, YuvConverter::Layout &layout)
+{
+	switch(format) {
+		case QVideoFrame::Format_NV12: layout=YuvConverter::NV12; return true;
+		case QVideoFrame::Format_NV21: layout=YuvConverter::NV21; return true;
+		case QVideoFrame::Format_YUYV: layout=YuvConverter::YUYV; return true;
+		case QVideoFrame::Format_UYVY: layout=YuvConverter::UYVY; return true;
+		case QVideoFrame::Format_YUV420P: layout=YuvConverter::I420; return true;
+		case QVideoFrame::Format_YV12: layout=YuvConverter::YV12; return true;
+		default: return false;
+	}
+}
+
+
+YuvConverter::Matrix CameraGrabber::yuvMatrix(int height) const
+{
+	switch(surfaceFormat().yCbCrColorSpace()) {
+		case QVideoSurfaceFormat::YCbCr_BT709:
+		case QVideoSurfaceFormat::YCbCr_xvYCC709: return YuvConverter::BT709;
+		case QVideoSurfaceFormat::YCbCr_JPEG: return YuvConverter::BT601Full;
+		case QVideoSurfaceFormat::YCbCr_BT601:
+		case QVideoSurfaceFormat::YCbCr_xvYCC601: return YuvConverter::BT601;
+		default:
+			// Drivers rarely say, go by the usual convention of SD vs HD
+			return (height>=720)?YuvConverter::BT709:YuvConverter::BT601;
+	}
+}
+
+
+QSharedPointer<QImage> CameraGrabber::convertYuv(const QVideoFrame &frame, YuvConverter::Layout layout)
+{
+	const uchar *planes[3]={nullptr, nullptr, nullptr};
+	int strides[3]={0, 0, 0};
+	const int count=qMin(3, frame.planeCount());
+	for(int i=0; i<count; ++i) {
+		planes[i]=frame.bits(i);
+		strides[i]=frame.bytesPerLine(i);
+	}
+	if(1==count && YuvConverter::planeCount(layout)>1) {
+		// Some backends map planar frames as one block, work out where the chroma starts
+		const int h=frame.height();
+		strides[0]=frame.bytesPerLine();
+		planes[1]=planes[0]+strides[0]*h;
+		if(YuvConverter::planeCount(layout)>2) {
+			strides[1]=strides[2]=strides[0]/2;
+			planes[2]=planes[1]+strides[1]*((h+1)/2);
+		} else {
+			strides[1]=strides[0];
+		}
+	}
+	QSharedPointer<QImage> image=FrameBufferPool::globalInstance()->acquire(frame.size(), QImage::Format_ARGB32_Premultiplied);
+	if(!YuvConverter::convert(layout, yuvMatrix(frame.height()), planes, strides, *image)) {
+		qWarning()<<"ERROR: Could not convert"<<YuvConverter::layoutName(layout)<<"camera frame";
+		image.clear();
+	}
+	return image;
+}
+
+
+QSharedPointer<QImage> CameraGrabber::copyFrame(const QVideoFrame &frame)
+{
+	const QImage::Format format=QVideoFrame::imageFormatFromPixelFormat(frame.pixelFormat());
+	if(QImage::Format_Invalid==format) {
+		qWarning()<<"ERROR: Unsupported camera pixel format"<<frame.pixelFormat();
+		return QSharedPointer<QImage>();
+	}
+	// The mapping goes away with the frame, so this is the one copy made of it
+	const QImage mapped(frame.bits(), frame.width(), frame.height(), frame.bytesPerLine(), format);
+	FormatNegotiator *formats=FormatNegotiator::globalInstance();
+	if(!formats->accepts(FormatNegotiator::CameraStage, format)) {
+		return QSharedPointer<QImage>(new QImage(formats->convert(mapped, FormatNegotiator::CameraStage)));
+	}
+	QSharedPointer<QImage> image=FrameBufferPool::globalInstance()->acquire(mapped.size(), format);
+	const int bytes=qMin(mapped.bytesPerLine(), image->bytesPerLine());
+	for(int y=0; y<mapped.height(); ++y) {
+		memcpy(image->scanLine(y), mapped.constScanLine(y), bytes);
+	}
+	return image;
+}
+
+
+QSharedPointer<QImage> CameraGrabber::scaleFrame(QSharedPointer<QImage> image, qreal &scale)
+{
+	// Read once, the GUI may change it any time
+	const int requested=mScale.load();
+	scale=1.0;
+	if(requested>=SCALE_ONE) {
+		return image;
+	}
+	const QSize size(qMax(1, (image->width()*requested+SCALE_ONE/2)/SCALE_ONE), qMax(1, (image->height()*requested+SCALE_ONE/2)/SCALE_ONE));
+	if(size==image->size()) {
+		return image;
+	}
+	QSharedPointer<QImage> scaled=FrameBufferPool::globalInstance()->acquire(size, image->format());
+	if(!mScaler.scale(*image, *scaled)) {
+		return image;
+	}
+	scale=qreal(requested)/SCALE_ONE;
+	return scaled;
+}
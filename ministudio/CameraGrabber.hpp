@@ -5,6 +5,13 @@
 #include <QList>
 #include <QSharedPointer>
 
+#include "YuvConverter.hpp"
+#include "CameraMailbox.hpp"
+#include "ImageScaler.hpp"
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
 
 class CLVideoFilter;
 
@@ -17,13 +24,33 @@ class CameraGrabber : public QAbstractVideoSurface
 private:
 
 	CLVideoFilter *clFilter;
+	CameraMailbox mMailbox;
+	ImageScaler mScaler;
+	// Requested scale in 1/SCALE_ONE units, written by the GUI and read where frames are presented
+	QAtomicInt mScale;
+	static const int SCALE_ONE=65536;
+	QAtomicInteger<quint64> mFailed;
 public:
 	explicit CameraGrabber(QObject *parent = 0);
 	QList<QVideoFrame::PixelFormat> supportedPixelFormats(QAbstractVideoBuffer::HandleType handleType) const;
 	bool present(const QVideoFrame &frame);
 
+	// Every frame presented is published here, for the render loop to take
+	CameraMailbox &mailbox();
+
+	// Scale frames down by this much before publishing them, for showing them smaller. 1.0 or more keeps them as they are
+	void setScale(qreal scale);
+	// Frames that were invalid or could not be converted
+	quint64 failed();
+
+private:
+	static bool yuvLayout(QVideoFrame::PixelFormat format, YuvConverter::Layout &layout);
+	YuvConverter::Matrix yuvMatrix(int height) const;
+	QSharedPointer<QImage> convertYuv(const QVideoFrame &frame, YuvConverter::Layout layout);
+	QSharedPointer<QImage> copyFrame(const QVideoFrame &frame);
+	QSharedPointer<QImage> scaleFrame(QSharedPointer<QImage> image, qreal &scale);
+
 signals:
-	void frameAvailable(QSharedPointer<QImage> frame);
 
 public slots:
 
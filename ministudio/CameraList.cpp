@@ -8,6 +8,17 @@
 #include <QCamera>
 
 #include <QMediaMetaData>
+#include <QDir>
+#include <QFile>
+
+#if defined(Q_OS_LINUX)
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#endif
 
 
 Q_DECLARE_METATYPE(QCameraInfo)
@@ -16,7 +27,26 @@ Q_DECLARE_METATYPE(QCameraInfo)
 CameraList::CameraList(QObject *parent)
 	: QObject(parent)
 {
-	setUpDeviceTimer(5000);
+	if(!setUpDeviceWatcher()) {
+		setUpDeviceTimer(5000);
+	}
+}
+
+
+bool CameraList::setUpDeviceWatcher()
+{
+	if(!deviceWatcher.start()) {
+		qWarning()<<"Camera hot plug events unavailable, polling instead";
+		return false;
+	}
+	if(!connect(&deviceWatcher, &VideoDeviceWatcher::deviceChanged, this, &CameraList::onDeviceChanged)){
+		qWarning()<<"ERROR: could not connect";
+	}
+	if(!connect(&deviceWatcher, &VideoDeviceWatcher::eventsLost, this, &CameraList::onDeviceEventsLost)){
+		qWarning()<<"ERROR: could not connect";
+	}
+	scanDevices();
+	return true;
 }
 
 
@@ -34,31 +64,39 @@ void CameraList::setUpDeviceTimer(const quint64 ms)
 
 QString CameraList::toSpecStanzas(QString space){
 	QString out="";
-	for(QList<QCameraInfo>::iterator it=deviceList.begin(),e=deviceList.end();it!=e;++it){
-		const QCameraInfo dev=*it;
+	for(QList<Device>::iterator it=deviceList.begin(),e=deviceList.end();it!=e;++it){
+		const Device dev=*it;
 		out+=space+"camera {\n";
-		out+=space+"\ttype=\""+dev.description()+"\"\n";
-		out+=space+"\tid=\""+dev.deviceName()+"\"\n";
-		out+=space+"\t// Position="+(QCamera::BackFace==dev.position()?"BackFace":QCamera::FrontFace==dev.position()?"FrontFace":"Unspecified")+"\n";
-		out+=space+"\t// Orientation="+QString::number(dev.orientation())+" degrees\n";
+		out+=space+"\ttype=\""+dev.description+"\"\n";
+		out+=space+"\tid=\""+dev.name+"\"\n";
 		out+=space+"}\n\n";
 	}
 	return out;
 }
 
-QString CameraList::deviceListToHash(QList<QCameraInfo> devices){
+QList<CameraList::Device> CameraList::devices() const
+{
+	return deviceList;
+}
+
+QString CameraList::deviceListToHash(QList<Device> devices){
 	QString summary="";
-	for(QList<QCameraInfo>::iterator it=devices.begin(),e=devices.end();it!=e;++it){
-		const QCameraInfo dev=*it;
+	for(QList<Device>::iterator it=devices.begin(),e=devices.end();it!=e;++it){
+		const Device dev=*it;
 		//qDebug()<<"CAM: "<<cameraInfo.description() << cameraInfo.deviceName();
-		summary+=dev.description()+dev.deviceName();
+		summary+=dev.description+dev.name;
 	}
 	return utility::toHash(summary);
 }
 
 void CameraList::onDevChangeTimer()
 {
-	deviceList=QCameraInfo::availableCameras();
+	// This opens every camera, which is why it is only the fallback
+	deviceList.clear();
+	const QList<QCameraInfo> cameras=QCameraInfo::availableCameras();
+	for(const QCameraInfo &info:cameras){
+		deviceList<<Device{info.deviceName(), info.description()};
+	}
 	QString deviceListHashNew=deviceListToHash(deviceList);
 	if(deviceListHashNew!=deviceListHash){
 		deviceListHash=deviceListHashNew;
@@ -67,3 +105,101 @@ void CameraList::onDevChangeTimer()
 }
 
 
+
+
+void CameraList::onDeviceChanged(QString path)
+{
+	bool retry=false;
+	if(updateDevice(path, retry)){
+		emit cameraDevicesChanged();
+	}
+	if(retry){
+		// udev sets up permissions shortly after the node appears, look again once it should be done
+		QTimer::singleShot(1000, this, [this, path]() {
+			bool again=false;
+			if(updateDevice(path, again)){
+				emit cameraDevicesChanged();
+			}
+		});
+	}
+}
+
+
+void CameraList::onDeviceEventsLost()
+{
+	const QString before=deviceListToHash(deviceList);
+	scanDevices();
+	if(deviceListToHash(deviceList)!=before){
+		emit cameraDevicesChanged();
+	}
+}
+
+
+void CameraList::scanDevices()
+{
+	deviceList.clear();
+	const QStringList nodes=QDir("/dev").entryList(QStringList()<<"video*", QDir::System, QDir::Name);
+	for(const QString &node:nodes){
+		bool retry=false;
+		updateDevice("/dev/"+node, retry);
+	}
+	deviceListHash=deviceListToHash(deviceList);
+}
+
+
+bool CameraList::updateDevice(const QString &path, bool &retry)
+{
+	Device device;
+	const bool present=probeDevice(path, device, retry);
+	for(int i=0;i<deviceList.size();++i){
+		if(deviceList[i].name==path){
+			if(present && deviceList[i].description==device.description){
+				return false;
+			}
+			deviceList.removeAt(i);
+			if(present){
+				deviceList.insert(i, device);
+			}
+			deviceListHash=deviceListToHash(deviceList);
+			return true;
+		}
+	}
+	if(!present){
+		return false;
+	}
+	deviceList<<device;
+	deviceListHash=deviceListToHash(deviceList);
+	return true;
+}
+
+
+bool CameraList::probeDevice(const QString &path, Device &device, bool &retry)
+{
+	retry=false;
+	device=Device{path, QString()};
+#if defined(Q_OS_LINUX)
+	// Only this node is opened, and only long enough to ask what it is
+	const int fd=::open(QFile::encodeName(path).constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(fd<0){
+		retry=(EACCES==errno || EPERM==errno || EBUSY==errno);
+		return false;
+	}
+	struct v4l2_capability caps;
+	memset(&caps, 0, sizeof(caps));
+	const bool ok=(0==ioctl(fd, VIDIOC_QUERYCAP, &caps));
+	::close(fd);
+	if(!ok){
+		return false;
+	}
+	const quint32 deviceCaps=(0!=(caps.capabilities & V4L2_CAP_DEVICE_CAPS))?caps.device_caps:caps.capabilities;
+	// Cameras usually come with a metadata node as well, which is no camera
+	if(0==(deviceCaps & (V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_CAPTURE_MPLANE))){
+		return false;
+	}
+	device.description=QString::fromUtf8(reinterpret_cast<const char *>(caps.card), static_cast<int>(strnlen(reinterpret_cast<const char *>(caps.card), sizeof(caps.card))));
+	return true;
+#else
+	Q_UNUSED(path);
+	return false;
+#endif
+}
@@ -2,32 +2,60 @@
 #define CAMERALIST_HPP
 
 
+#include "VideoDeviceWatcher.hpp"
+
 #include <QTimer>
 #include <QCameraInfo>
 
 
+/*
+  Keeps the list of cameras up to date.
 
+  Where device nodes can be watched (see VideoDeviceWatcher) only the node
+  an event is about is looked at again, so a camera being plugged in shows
+  up within milliseconds without opening every other camera. Elsewhere the
+  whole list is polled through QCameraInfo.
+*/
 class CameraList: public QObject
 {
 		Q_OBJECT
+	public:
+		// V4L2 has no notion of where a camera faces, so unlike QCameraInfo there is no position or orientation
+		struct Device {
+			QString name;
+			QString description;
+		};
+
 	private:
 		QTimer devChangeTimer;
 		QString deviceListHash;
-		QList<QCameraInfo>  deviceList;
+		QList<Device>  deviceList;
+		VideoDeviceWatcher deviceWatcher;
 
 	public:
 		CameraList(QObject *parent=0);
 	public:
+		// Watch device nodes for changes. Returns false where that isn't possible
+		bool setUpDeviceWatcher();
+		// Poll all devices every ms, for when they can't be watched
 		void setUpDeviceTimer(const quint64 ms=5000);
 		QString toSpecStanzas(QString space="");
+		QList<Device> devices() const;
 
 	private:
-		QString deviceListToHash(QList<QCameraInfo> devices);
+		QString deviceListToHash(QList<Device> devices);
+		// Probe every device node, used when watching starts and when events were lost
+		void scanDevices();
+		// Probe one device node and update the list. Returns true if the list changed, sets retry if the node wasn't ready yet
+		bool updateDevice(const QString &path, bool &retry);
+		static bool probeDevice(const QString &path, Device &device, bool &retry);
 
 
 	private slots:
 
 		void onDevChangeTimer();
+		void onDeviceChanged(QString path);
+		void onDeviceEventsLost();
 
 	signals:
 
@@ -0,0 +1,76 @@
+#include "CameraMailbox.hpp"
+
+
+CameraMailbox::CameraMailbox()
+	: mMiddle(1)
+	, mBack(0)
+	, mSequence(0)
+	, mFront(2)
+	, mPublished(0)
+	, mTaken(0)
+	, mOverwritten(0)
+{
+	for(Frame &slot:mSlots) {
+		slot.captured=0;
+		slot.sequence=0;
+		slot.scale=1.0;
+	}
+}
+
+CameraMailbox::~CameraMailbox()
+{
+}
+
+
+void CameraMailbox::publish(QSharedPointer<QImage> image, qint64 captured, qreal scale)
+{
+	Frame &slot=mSlots[mBack];
+	slot.image=image;
+	slot.captured=captured;
+	slot.scale=scale;
+	slot.sequence=++mSequence;
+	// Ordered, so the slot is complete before the consumer can swap it in
+	const int old=mMiddle.fetchAndStoreOrdered(mBack|Fresh);
+	if(0!=(old&Fresh)) {
+		mOverwritten.fetchAndAddRelaxed(1);
+	}
+	mBack=old&IndexMask;
+	// Whatever the slot held is stale, let its buffer go back to the pool now rather than on the next publish
+	mSlots[mBack].image.clear();
+	mPublished.fetchAndAddRelaxed(1);
+}
+
+
+CameraMailbox::Frame CameraMailbox::take()
+{
+	if(0!=(mMiddle.loadAcquire()&Fresh)) {
+		const int old=mMiddle.fetchAndStoreOrdered(mFront);
+		mFront=old&IndexMask;
+		mTaken.fetchAndAddRelaxed(1);
+	}
+	return mSlots[mFront];
+}
+
+
+quint64 CameraMailbox::published()
+{
+	return mPublished.load();
+}
+
+
+quint64 CameraMailbox::taken()
+{
+	return mTaken.load();
+}
+
+
+quint64 CameraMailbox::overwritten()
+{
+	return mOverwritten.load();
+}
+
+
+QString CameraMailbox::stats()
+{
+	return QString("published=%1 taken=%2 overwritten=%3").arg(published()).arg(taken()).arg(overwritten());
+}
@@ -0,0 +1,75 @@
+#ifndef CAMERAMAILBOX_HPP
+#define CAMERAMAILBOX_HPP
+
+#include <QSharedPointer>
+#include <QImage>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QString>
+
+/*
+  Lock-free single producer, single consumer "latest value" mailbox for
+  camera frames.
+
+  The capture side publishes each converted frame, the render loop takes
+  whatever was published last. Frames are never modified once published,
+  so both sides only ever pass references around and the pixels are never
+  copied. A frame that is replaced before the render loop took it is
+  dropped, which is the point: the compositor always gets the newest frame
+  and never waits for the camera.
+
+  Three slots are shared as a triple buffer. At any time one belongs to the
+  producer, one to the consumer and one sits in the middle, and the two
+  sides swap theirs with the middle one atomically. Since a slot is only
+  ever touched by its owner the shared pointers in it need no lock.
+*/
+class CameraMailbox
+{
+	public:
+		struct Frame {
+			QSharedPointer<QImage> image;
+			// When the frame was captured, see FrameClock
+			qint64 captured;
+			// Counts up from 1 with every frame published, 0 for no frame
+			quint64 sequence;
+			// How much the frame was scaled down from the camera's resolution, 1.0 for not at all
+			qreal scale;
+		};
+
+	private:
+		enum {
+			IndexMask=3
+			, Fresh=4
+		};
+
+		Frame mSlots[3];
+		// Index of the middle slot, with Fresh set when it holds a frame the consumer hasn't seen
+		QAtomicInt mMiddle;
+		// Owned by the producer
+		int mBack;
+		quint64 mSequence;
+		// Owned by the consumer
+		int mFront;
+		QAtomicInteger<quint64> mPublished;
+		QAtomicInteger<quint64> mTaken;
+		QAtomicInteger<quint64> mOverwritten;
+
+	public:
+		explicit CameraMailbox();
+		virtual ~CameraMailbox();
+
+	public:
+		// Producer side. The image must not be modified afterwards
+		void publish(QSharedPointer<QImage> image, qint64 captured, qreal scale=1.0);
+
+		// Consumer side. The newest frame published, which is the same as last time when nothing new arrived
+		Frame take();
+
+		quint64 published();
+		quint64 taken();
+		// Frames replaced before the consumer took them
+		quint64 overwritten();
+		QString stats();
+};
+
+#endif // CAMERAMAILBOX_HPP
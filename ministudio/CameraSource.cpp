@@ -0,0 +1,195 @@
+#include "CameraSource.hpp"
+
+#include "CameraGrabber.hpp"
+#include "CameraMailbox.hpp"
+#include "FrameClock.hpp"
+
+#include <QThread>
+#include <QCamera>
+#include <QCameraInfo>
+#include <QDebug>
+
+
+class CameraSourceThread: public QThread
+{
+	private:
+		CameraSource *mSource;
+
+	public:
+		explicit CameraSourceThread(CameraSource *source)
+			: mSource(source)
+		{
+
+		}
+
+		void run() override
+		{
+			mSource->open();
+			exec();
+			mSource->close();
+		}
+};
+
+
+CameraSource::CameraSource(const CameraList::Device &device, int layerID)
+	: mDevice(device)
+	, mName(device.description.isEmpty()?device.name:device.description)
+	, mLayerID(layerID)
+	, mGrabber(new CameraGrabber())
+	, mCamera(nullptr)
+	, mThread(nullptr)
+	, mSwitch()
+	, mLastPublished(0)
+	, mLastOverwritten(0)
+	, mLastStats(FrameClock::now())
+{
+}
+
+CameraSource::~CameraSource()
+{
+	stop();
+	delete mGrabber;
+	mGrabber=nullptr;
+}
+
+
+void CameraSource::start()
+{
+	if(nullptr!=mThread) {
+		return;
+	}
+	mThread=new CameraSourceThread(this);
+	mThread->setObjectName("Camera "+mName);
+	// Frames are presented to the grabber on the thread it lives on
+	mGrabber->moveToThread(mThread);
+	mThread->start(QThread::HighPriority);
+}
+
+
+void CameraSource::stop()
+{
+	if(nullptr==mThread) {
+		return;
+	}
+	mThread->quit();
+	mThread->wait();
+	delete mThread;
+	mThread=nullptr;
+	qDebug()<<"CAMERA"<<mName<<"stopped"<<mGrabber->mailbox().stats();
+}
+
+
+void CameraSource::open()
+{
+	// Created on the source's thread so the camera's events are handled there
+	mCamera=new QCamera(mDevice.name.toUtf8());
+	QCamera *camera=mCamera;
+	const QString name=mName;
+	if(!QObject::connect(camera, static_cast<void(QCamera::*)(QCamera::Error)>(&QCamera::error), [camera, name](QCamera::Error) {
+		qWarning()<<"ERROR: Camera"<<name<<"error:"<<camera->errorString();
+	})) {
+		qWarning()<<"ERROR: Could not connect camera error";
+	}
+	if(!QObject::connect(camera, &QCamera::stateChanged, [name](QCamera::State state) {
+		qDebug()<<"Camera"<<name<<"state changed:"<<state;
+	})) {
+		qWarning()<<"ERROR: Could not connect camera state change";
+	}
+	mCamera->setViewfinder(mGrabber);
+	QCameraViewfinderSettings viewfinderSettings;
+	//viewfinderSettings.setResolution(640, 480); 	viewfinderSettings.setMinimumFrameRate(0.0); 	viewfinderSettings.setMaximumFrameRate(30.0);
+	mCamera->setViewfinderSettings(viewfinderSettings);
+	mCamera->setCaptureMode(QCamera::CaptureVideo);
+	mCamera->start();
+	qDebug()<<"CAMERA"<<mName<<"started on"<<mDevice.name;
+}
+
+
+void CameraSource::close()
+{
+	mCamera->stop();
+	delete mCamera;
+	mCamera=nullptr;
+}
+
+
+QString CameraSource::name() const
+{
+	return mName;
+}
+
+
+QString CameraSource::deviceName() const
+{
+	return mDevice.name;
+}
+
+
+int CameraSource::layerID() const
+{
+	return mLayerID;
+}
+
+
+CameraMailbox &CameraSource::mailbox()
+{
+	return mGrabber->mailbox();
+}
+
+
+AnimatedSwitch &CameraSource::layerSwitch()
+{
+	return mSwitch;
+}
+
+
+void CameraSource::setScale(qreal scale)
+{
+	mGrabber->setScale(scale);
+}
+
+
+QString CameraSource::stats()
+{
+	CameraMailbox &mailbox=mGrabber->mailbox();
+	const qint64 now=FrameClock::now();
+	const quint64 published=mailbox.published();
+	const quint64 overwritten=mailbox.overwritten();
+	const qreal seconds=qMax<qint64>(1, now-mLastStats)/1e9;
+	const QString out=QString("%1: fps=%2 dropped=%3 failed=%4 (%5)")
+					  .arg(mName).arg((published-mLastPublished)/seconds, 0, 'f', 1).arg(overwritten-mLastOverwritten)
+					  .arg(mGrabber->failed()).arg(mailbox.stats());
+	mLastPublished=published;
+	mLastOverwritten=overwritten;
+	mLastStats=now;
+	return out;
+}
+
+
+QList<CameraList::Device> CameraSource::find(const QStringList &devices, const QList<CameraList::Device> &available)
+{
+	QList<CameraList::Device> out;
+	QStringList wanted=devices;
+	if(wanted.isEmpty()) {
+		// The system's default camera, as before cameras could be selected. Only asked for when none are
+		const QCameraInfo info=QCameraInfo::defaultCamera();
+		if(info.isNull()) {
+			return out;
+		}
+		wanted<<info.deviceName();
+	}
+	for(const QString &device:wanted) {
+		bool found=false;
+		for(const CameraList::Device &info:available) {
+			if(info.name==device || info.description==device) {
+				out<<info;
+				found=true;
+				break;
+			}
+		}
+		if(!found) {
+			qWarning()<<"ERROR: Camera"<<device<<"not found";
+		}
+	}
+	return out;
+}
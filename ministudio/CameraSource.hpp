@@ -0,0 +1,72 @@
+#ifndef CAMERASOURCE_HPP
+#define CAMERASOURCE_HPP
+
+#include "AnimatedSwitch.hpp"
+#include "CameraList.hpp"
+
+#include <QString>
+#include <QAtomicInteger>
+
+class QThread;
+class QCamera;
+class CameraGrabber;
+class CameraMailbox;
+
+/*
+  One camera feeding the live scene.
+
+  Each source runs its camera on a thread of its own, with an event loop,
+  so QtMultimedia presents frames there and the format conversion and
+  scaling in CameraGrabber happen there too. The render loop only takes
+  the newest frame from the source's mailbox, which costs it the same
+  whether there is one camera or several.
+
+  The switch fades the source's layer in and out of the scene. It belongs
+  to the render loop like the other layer switches.
+*/
+class CameraSource
+{
+	private:
+		CameraList::Device mDevice;
+		QString mName;
+		int mLayerID;
+		CameraGrabber *mGrabber;
+		QCamera *mCamera;
+		QThread *mThread;
+		AnimatedSwitch mSwitch;
+		// Render loop side bookkeeping for stats()
+		quint64 mLastPublished;
+		quint64 mLastOverwritten;
+		qint64 mLastStats;
+
+	public:
+		explicit CameraSource(const CameraList::Device &device, int layerID);
+		virtual ~CameraSource();
+
+	public:
+		void start();
+		void stop();
+
+		QString name() const;
+		QString deviceName() const;
+		int layerID() const;
+		CameraMailbox &mailbox();
+		AnimatedSwitch &layerSwitch();
+		// See CameraGrabber::setScale()
+		void setScale(qreal scale);
+
+		// Frames per second published and frames dropped since the last call, then the totals. Call from one thread only
+		QString stats();
+
+	public:
+		// The cameras named by device name or description, in that order, or the default camera for an empty list. Looked up
+		// in available, the list CameraList keeps, as asking QtMultimedia opens every camera there is
+		static QList<CameraList::Device> find(const QStringList &devices, const QList<CameraList::Device> &available);
+
+	private:
+		friend class CameraSourceThread;
+		void open();
+		void close();
+};
+
+#endif // CAMERASOURCE_HPP
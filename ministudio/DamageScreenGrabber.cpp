@@ -0,0 +1,221 @@
+#include "DamageScreenGrabber.hpp"
+
+#include <QScreen>
+#include <QDebug>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xdamage.h>
+
+// Above this many rectangles a single bounding rectangle is cheaper to pull than many tiny round trips
+#define MAX_DAMAGE_RECTS (64)
+
+
+struct DamageSurface
+{
+	QImage image;
+	// XImage header wrapping the pixels of image so XGetSubImage can write straight into it
+	XImage *header;
+	// What changed on screen since this surface was last refreshed
+	QRegion pending;
+};
+
+
+static void releaseUnsharedImage(void *data)
+{
+	XDestroyImage(static_cast<XImage *>(data));
+}
+
+
+DamageScreenGrabber::DamageScreenGrabber(int maxSurfaces)
+	: ScreenGrabber()
+	, mDisplay(nullptr)
+	, mRoot(0)
+	, mDamageHandle(0)
+	, mDamageParts(0)
+	, mMaxSurfaces(qMax(2, maxSurfaces))
+	, mPulledPixels(0)
+	, mGrabCount(0)
+{
+
+}
+
+DamageScreenGrabber::~DamageScreenGrabber()
+{
+	release();
+}
+
+
+bool DamageScreenGrabber::init(QScreen *screen)
+{
+	release();
+	if(!ScreenGrabber::init(screen)) {
+		return false;
+	}
+	mDisplay=XOpenDisplay(nullptr);
+	if(nullptr==mDisplay) {
+		qWarning()<<"ERROR: Could not open X display for damage grabber";
+		return false;
+	}
+	int eventBase=0, errorBase=0;
+	if(!XFixesQueryExtension(mDisplay, &eventBase, &errorBase) || !XDamageQueryExtension(mDisplay, &eventBase, &errorBase)) {
+		qWarning()<<"ERROR: X server does not support XDamage/XFixes";
+		release();
+		return false;
+	}
+	mRoot=DefaultRootWindow(mDisplay);
+	const qreal dpr=screen->devicePixelRatio();
+	const QRect geometry=screen->geometry();
+	mOrigin=QPoint(geometry.x()*dpr, geometry.y()*dpr);
+	mSize=QSize(geometry.width()*dpr, geometry.height()*dpr);
+	mDamageHandle=XDamageCreate(mDisplay, mRoot, XDamageReportNonEmpty);
+	mDamageParts=XFixesCreateRegion(mDisplay, nullptr, 0);
+	if(nullptr==freeSurface()) {
+		qWarning()<<"ERROR: Unsupported X visual for damage grabber";
+		release();
+		return false;
+	}
+	mDamage=QRegion(QRect(QPoint(0,0), mSize));
+	qDebug()<<"Damage grabber ready for"<<mSize;
+	return true;
+}
+
+
+void DamageScreenGrabber::release()
+{
+	for(DamageSurface *surface:mSurfaces) {
+		// The pixels belong to the QImage, only the header is ours to free
+		surface->header->data=nullptr;
+		XDestroyImage(surface->header);
+		delete surface;
+	}
+	mSurfaces.clear();
+	if(nullptr!=mDisplay) {
+		if(0!=mDamageHandle) {
+			XDamageDestroy(mDisplay, mDamageHandle);
+			mDamageHandle=0;
+		}
+		if(0!=mDamageParts) {
+			XFixesDestroyRegion(mDisplay, mDamageParts);
+			mDamageParts=0;
+		}
+		XCloseDisplay(mDisplay);
+		mDisplay=nullptr;
+	}
+	if(mGrabCount>0 && !mSize.isEmpty()) {
+		const qreal screenPixels=mSize.width()*mSize.height();
+		qDebug()<<"Damage grabber pulled"<<(mPulledPixels/(screenPixels*mGrabCount))*100.0<<"% of the screen per grab on average";
+		mGrabCount=0;
+		mPulledPixels=0;
+	}
+}
+
+
+QRegion DamageScreenGrabber::fetchDamage()
+{
+	// Drain the notifications, only the damage accumulated on the server matters
+	while(XPending(mDisplay)>0) {
+		XEvent ev;
+		XNextEvent(mDisplay, &ev);
+	}
+	XDamageSubtract(mDisplay, mDamageHandle, None, mDamageParts);
+	int count=0;
+	XRectangle *rects=XFixesFetchRegion(mDisplay, mDamageParts, &count);
+	QRegion region;
+	for(int i=0; i<count; ++i) {
+		region+=QRect(rects[i].x-mOrigin.x(), rects[i].y-mOrigin.y(), rects[i].width, rects[i].height);
+	}
+	if(nullptr!=rects) {
+		XFree(rects);
+	}
+	return region.intersected(QRect(QPoint(0,0), mSize));
+}
+
+
+DamageSurface *DamageScreenGrabber::freeSurface()
+{
+	for(DamageSurface *surface:mSurfaces) {
+		// Detached means no frame downstream holds a copy of these pixels anymore
+		if(surface->image.isDetached()) {
+			return surface;
+		}
+	}
+	if(mSurfaces.size()>=mMaxSurfaces) {
+		return nullptr;
+	}
+	const int scr=DefaultScreen(mDisplay);
+	DamageSurface *surface=new DamageSurface;
+	surface->image=QImage(mSize, QImage::Format_RGB32);
+	surface->header=XCreateImage(mDisplay, DefaultVisual(mDisplay, scr), DefaultDepth(mDisplay, scr), ZPixmap, 0, reinterpret_cast<char *>(surface->image.bits()), mSize.width(), mSize.height(), 32, surface->image.bytesPerLine());
+	if(nullptr==surface->header || 32!=surface->header->bits_per_pixel) {
+		if(nullptr!=surface->header) {
+			surface->header->data=nullptr;
+			XDestroyImage(surface->header);
+		}
+		delete surface;
+		return nullptr;
+	}
+	// A new surface has never seen the screen
+	surface->pending=QRegion(QRect(QPoint(0,0), mSize));
+	mSurfaces<<surface;
+	return surface;
+}
+
+
+bool DamageScreenGrabber::refresh(DamageSurface &surface)
+{
+	QVector<QRect> rects;
+	if(surface.pending.rectCount()>MAX_DAMAGE_RECTS) {
+		rects<<surface.pending.boundingRect();
+	} else {
+		rects=surface.pending.rects();
+	}
+	// The surface is detached so this will not reallocate, but keep the header honest anyway
+	surface.header->data=reinterpret_cast<char *>(surface.image.bits());
+	for(const QRect &r:rects) {
+		if(nullptr==XGetSubImage(mDisplay, mRoot, mOrigin.x()+r.x(), mOrigin.y()+r.y(), r.width(), r.height(), AllPlanes, ZPixmap, surface.header, r.x(), r.y())) {
+			qWarning()<<"ERROR: XGetSubImage failed for "<<r;
+			return false;
+		}
+		mPulledPixels+=r.width()*r.height();
+	}
+	surface.pending=QRegion();
+	return true;
+}
+
+
+QSharedPointer<QImage> DamageScreenGrabber::grab()
+{
+	QSharedPointer<QImage> out;
+	if(nullptr==mDisplay) {
+		return out;
+	}
+	const QRegion fresh=fetchDamage();
+	for(DamageSurface *surface:mSurfaces) {
+		surface->pending+=fresh;
+	}
+	mGrabCount++;
+	mDamage=fresh;
+	DamageSurface *surface=freeSurface();
+	if(nullptr!=surface) {
+		if(refresh(*surface)) {
+			// Shares the surface pixels, which keeps the surface out of rotation until the frame is done with it
+			out=QSharedPointer<QImage>(new QImage(surface->image));
+		}
+	} else {
+		// Every surface is still in flight, fall back to a full grab for this frame
+		XImage *image=XGetImage(mDisplay, mRoot, mOrigin.x(), mOrigin.y(), mSize.width(), mSize.height(), AllPlanes, ZPixmap);
+		if(nullptr!=image) {
+			mPulledPixels+=mSize.width()*mSize.height();
+			out=QSharedPointer<QImage>(new QImage(reinterpret_cast<uchar *>(image->data), image->width, image->height, image->bytes_per_line, QImage::Format_RGB32, releaseUnsharedImage, image));
+		}
+	}
+	return out;
+}
+
+
+QString DamageScreenGrabber::name()
+{
+	return "xdamage";
+}
@@ -0,0 +1,57 @@
+#ifndef DAMAGESCREENGRABBER_HPP
+#define DAMAGESCREENGRABBER_HPP
+
+#include "ScreenGrabber.hpp"
+
+#include <QVector>
+#include <QSize>
+#include <QPoint>
+
+struct _XDisplay;
+struct DamageSurface;
+
+/*
+  Incremental X11 screen grabber driven by the XDamage extension.
+
+  Keeps a small set of persistent screen surfaces. Each surface remembers
+  which parts of the screen changed since it was last refreshed, and a grab
+  only pulls those rectangles from the X server (XGetSubImage straight into
+  the surface). The cost of a grab therefore scales with how much of the
+  screen moves rather than with its resolution.
+
+  A surface is refreshed only while nobody downstream holds a copy of it,
+  so frames still being rendered never see their pixels change.
+
+  damage() reports the region that changed since the previous grab.
+*/
+class DamageScreenGrabber: public ScreenGrabber
+{
+	private:
+		_XDisplay *mDisplay;
+		unsigned long mRoot;
+		unsigned long mDamageHandle;
+		unsigned long mDamageParts;
+		QPoint mOrigin;
+		QSize mSize;
+		int mMaxSurfaces;
+		QVector<DamageSurface *> mSurfaces;
+		quint64 mPulledPixels;
+		quint64 mGrabCount;
+
+	public:
+		explicit DamageScreenGrabber(int maxSurfaces=6);
+		virtual ~DamageScreenGrabber();
+
+	public:
+		bool init(QScreen *screen) override;
+		QSharedPointer<QImage> grab() override;
+		QString name() override;
+
+	private:
+		void release();
+		QRegion fetchDamage();
+		DamageSurface *freeSurface();
+		bool refresh(DamageSurface &surface);
+};
+
+#endif // DAMAGESCREENGRABBER_HPP
@@ -0,0 +1,211 @@
+#include "EncoderSink.hpp"
+
+#include <QProcess>
+#include <QFile>
+#include <QStandardPaths>
+#include <QDebug>
+
+
+EncoderSink::EncoderSink(QString codec, int bitrate, QString preset, QString program)
+	: mProgram(program)
+	, mCodec(codec)
+	, mBitrate(bitrate)
+	, mPreset(preset)
+	, mFirstTimestamp(-1)
+	, mProcess(nullptr)
+	, mMaxBacklog(4)
+	, mMaxWait(20)
+	, mWarnedSize(false)
+{
+
+}
+
+EncoderSink::~EncoderSink()
+{
+	close();
+}
+
+
+QStringList EncoderSink::arguments(const QSize &size, qreal fps)
+{
+	QStringList args;
+	args<<"-hide_banner"<<"-nostats"<<"-loglevel"<<"error"<<"-y";
+	// ARGB32 in memory on little endian is B,G,R,A. Composited frames are opaque so premultiplied is the same
+	args<<"-f"<<"rawvideo"<<"-pixel_format"<<"bgra";
+	args<<"-video_size"<<QString("%1x%2").arg(size.width()).arg(size.height());
+	args<<"-framerate"<<QString::number(fps);
+	args<<"-i"<<"-";
+	args<<"-c:v"<<mCodec;
+	const bool lossless=("ffv1"==mCodec || "huffyuv"==mCodec || "utvideo"==mCodec);
+	if(lossless) {
+		args<<"-pix_fmt"<<"bgr0";
+	} else {
+		if(mBitrate>0) {
+			args<<"-b:v"<<QString("%1k").arg(mBitrate);
+		}
+		if(!mPreset.isEmpty() && mCodec.startsWith("libx26")) {
+			args<<"-preset"<<mPreset<<"-tune"<<"zerolatency";
+		}
+		args<<"-pix_fmt"<<"yuv420p";
+	}
+	args<<mEncodedFilename;
+	return args;
+}
+
+
+bool EncoderSink::open(const QString &basePath, const QSize &size, qreal fps)
+{
+	close();
+	mSize=size;
+	mWarnedSize=false;
+	mFilename=basePath+"/recording.mkv";
+	mEncodedFilename=basePath+"/recording.cfr.mkv";
+	mTimecodesFilename=basePath+"/recording.timecodes.txt";
+	mTimecodes="# timestamp format v2\n";
+	mFirstTimestamp=-1;
+	mProcess=new QProcess();
+	mProcess->setStandardOutputFile(QProcess::nullDevice());
+	mProcess->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+	const QStringList args=arguments(size, fps);
+	qDebug()<<"ENCODER: starting"<<mProgram<<args.join(" ");
+	mProcess->start(mProgram, args, QIODevice::WriteOnly);
+	if(!mProcess->waitForStarted(5000)) {
+		qWarning()<<"ERROR: Could not start encoder"<<mProgram<<":"<<mProcess->errorString();
+		delete mProcess;
+		mProcess=nullptr;
+		return false;
+	}
+	return true;
+}
+
+
+bool EncoderSink::write(const Frame &frame)
+{
+	const QImage &image=frame.image;
+	if(!isOpen()) {
+		mDropped.fetchAndAddRelaxed(1);
+		return false;
+	}
+	if(image.size()!=mSize || 32!=image.depth()) {
+		if(!mWarnedSize) {
+			qWarning()<<"ERROR: Encoder expected"<<mSize<<"32 bit frames, got"<<image.size()<<image.format();
+			mWarnedSize=true;
+		}
+		mDropped.fetchAndAddRelaxed(1);
+		return false;
+	}
+	const qint64 frameBytes=qint64(image.bytesPerLine())*image.height();
+	if(mProcess->bytesToWrite()>frameBytes*mMaxBacklog) {
+		mProcess->waitForBytesWritten(mMaxWait);
+		if(mProcess->bytesToWrite()>frameBytes*mMaxBacklog) {
+			// ffmpeg is not keeping up, better a skipped frame than a stalled writer queue
+			mDropped.fetchAndAddRelaxed(1);
+			return false;
+		}
+	}
+	if(frameBytes!=mProcess->write(reinterpret_cast<const char *>(image.constBits()), frameBytes)) {
+		qWarning()<<"ERROR: Could not write frame to encoder:"<<mProcess->errorString();
+		mDropped.fetchAndAddRelaxed(1);
+		return false;
+	}
+	// Hand the data to the pipe now, there is no event loop on the writer thread to do it later
+	mProcess->waitForBytesWritten(0);
+	// Only frames that made it into the pipe get a timestamp, so dropped frames just make the previous one last longer
+	if(mFirstTimestamp<0) {
+		mFirstTimestamp=frame.timestamp;
+	}
+	mTimecodes+=QByteArray::number((frame.timestamp-mFirstTimestamp)/1e6, 'f', 3)+"\n";
+	mWritten.fetchAndAddRelaxed(1);
+	mBytes.fetchAndAddRelaxed(frameBytes);
+	return true;
+}
+
+
+void EncoderSink::close()
+{
+	if(nullptr==mProcess) {
+		return;
+	}
+	mProcess->closeWriteChannel();
+	if(!mProcess->waitForFinished(30000)) {
+		qWarning()<<"ERROR: Encoder did not finish, killing it";
+		mProcess->kill();
+		mProcess->waitForFinished(1000);
+	} else if(QProcess::NormalExit!=mProcess->exitStatus() || 0!=mProcess->exitCode()) {
+		qWarning()<<"ERROR: Encoder exited with code"<<mProcess->exitCode();
+	}
+	delete mProcess;
+	mProcess=nullptr;
+	applyTimecodes();
+	qDebug()<<"ENCODER: finished"<<mFilename<<stats();
+}
+
+
+void EncoderSink::applyTimecodes()
+{
+	QFile timecodes(mTimecodesFilename);
+	if(!timecodes.open(QIODevice::WriteOnly | QIODevice::Truncate) || mTimecodes.size()!=timecodes.write(mTimecodes)) {
+		qWarning()<<"ERROR: Could not write"<<mTimecodesFilename<<":"<<timecodes.errorString();
+	}
+	timecodes.close();
+	mTimecodes.clear();
+	const QString mkvmerge=QStandardPaths::findExecutable("mkvmerge");
+	if(!mkvmerge.isEmpty() && mFirstTimestamp>=0) {
+		QStringList args;
+		args<<"--quiet"<<"-o"<<mFilename<<"--timestamps"<<("0:"+mTimecodesFilename)<<mEncodedFilename;
+		// mkvmerge exits with 1 for warnings, the output is still good
+		const int code=QProcess::execute(mkvmerge, args);
+		if(0==code || 1==code) {
+			QFile::remove(mEncodedFilename);
+			return;
+		}
+		qWarning()<<"ERROR: mkvmerge exited with code"<<code<<", keeping the constant frame rate recording";
+		QFile::remove(mFilename);
+	} else {
+		qDebug()<<"ENCODER: mkvmerge not found, recording keeps the nominal frame rate, real timing is in"<<mTimecodesFilename;
+	}
+	if(!QFile::rename(mEncodedFilename, mFilename)) {
+		qWarning()<<"ERROR: Could not rename"<<mEncodedFilename<<"to"<<mFilename;
+	}
+}
+
+
+void EncoderSink::moveToThread(QThread *thread)
+{
+	if(nullptr!=mProcess) {
+		mProcess->moveToThread(thread);
+	}
+}
+
+
+bool EncoderSink::isOpen()
+{
+	return nullptr!=mProcess && QProcess::Running==mProcess->state();
+}
+
+
+QString EncoderSink::name()
+{
+	return "encoder";
+}
+
+
+QVector<QImage::Format> EncoderSink::formats()
+{
+	QVector<QImage::Format> formats;
+	formats<<QImage::Format_ARGB32_Premultiplied<<QImage::Format_RGB32<<QImage::Format_ARGB32;
+	return formats;
+}
+
+
+void EncoderSink::setBacklog(int frames, int waitMs)
+{
+	mMaxBacklog=qMax(1, frames);
+	mMaxWait=qMax(0, waitMs);
+}
+
+
+QString EncoderSink::filename()
+{
+	return mFilename;
+}
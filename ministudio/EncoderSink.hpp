@@ -0,0 +1,71 @@
+#ifndef ENCODERSINK_HPP
+#define ENCODERSINK_HPP
+
+#include "FrameSink.hpp"
+
+#include <QStringList>
+
+class QProcess;
+
+/*
+  Records into a single video file by piping raw BGRA frames to a local
+  ffmpeg process.
+
+  The codec, bitrate (kbit/s) and preset are passed through to ffmpeg, so
+  anything it supports works ("libx264", "libx265", "ffv1", ...). Lossless
+  codecs ignore the bitrate, and the preset is only passed to codecs that
+  have one.
+
+  ffmpeg gets a bounded backlog of frames in the pipe. When it falls
+  further behind, write() waits a short while and then drops the frame
+  rather than stalling the caller.
+
+  Raw video on a pipe has no timestamps, so ffmpeg encodes at the nominal
+  frame rate into recording.cfr.mkv while the capture time of every frame
+  written goes into recording.timecodes.txt (mkvmerge v2 format). On close
+  the video is remuxed with mkvmerge to those timestamps into a variable
+  frame rate recording.mkv. Without mkvmerge the constant rate file is
+  kept as recording.mkv next to the timecodes.
+*/
+class EncoderSink: public FrameSink
+{
+	private:
+		QString mProgram;
+		QString mCodec;
+		int mBitrate;
+		QString mPreset;
+		QString mFilename;
+		QString mEncodedFilename;
+		QString mTimecodesFilename;
+		QByteArray mTimecodes;
+		qint64 mFirstTimestamp;
+		QSize mSize;
+		QProcess *mProcess;
+		int mMaxBacklog;
+		int mMaxWait;
+		bool mWarnedSize;
+
+	public:
+		explicit EncoderSink(QString codec="libx264", int bitrate=8000, QString preset="ultrafast", QString program="ffmpeg");
+		virtual ~EncoderSink();
+
+	public:
+		bool open(const QString &basePath, const QSize &size, qreal fps) override;
+		bool write(const Frame &frame) override;
+		void close() override;
+		bool isOpen() override;
+		QString name() override;
+		QVector<QImage::Format> formats() override;
+		void moveToThread(QThread *thread) override;
+
+		// How many frames may wait in the pipe, and how long write() waits for room before dropping
+		void setBacklog(int frames, int waitMs);
+
+		QString filename();
+
+	private:
+		QStringList arguments(const QSize &size, qreal fps);
+		void applyTimecodes();
+};
+
+#endif // ENCODERSINK_HPP
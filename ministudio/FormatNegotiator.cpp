@@ -0,0 +1,409 @@
+#include "FormatNegotiator.hpp"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QAtomicInt>
+#include <QDebug>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FORMAT_X86
+#include <immintrin.h>
+#define FORMAT_TARGET(T) __attribute__((target(T)))
+#endif
+
+namespace
+{
+	QAtomicInt sPath(-1);
+
+	FormatNegotiator::Path bestPath()
+	{
+#ifdef FORMAT_X86
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("sse2")) {
+			return FormatNegotiator::SSE2;
+		}
+#endif
+		return FormatNegotiator::Scalar;
+	}
+
+	// x*a/255 for two channels packed as 0x00XX00YY
+	inline quint32 mulPair(quint32 x, quint32 a)
+	{
+		quint32 t=x*a+0x00800080;
+		return ((t+((t>>8)&0x00ff00ff))>>8)&0x00ff00ff;
+	}
+
+	inline quint32 premultiply(quint32 p)
+	{
+		const quint32 a=p>>24;
+		if(255==a) {
+			return p;
+		}
+		return (a<<24) | mulPair(p&0x00ff00ff, a) | (mulPair((p>>8)&0x000000ff, a)<<8);
+	}
+
+	inline quint32 unpremultiply(quint32 p)
+	{
+		const quint32 a=p>>24;
+		if(255==a || 0==a) {
+			return p;
+		}
+		const quint32 r=qMin<quint32>(255, (((p>>16)&0xff)*255+a/2)/a);
+		const quint32 g=qMin<quint32>(255, (((p>>8)&0xff)*255+a/2)/a);
+		const quint32 b=qMin<quint32>(255, ((p&0xff)*255+a/2)/a);
+		return (a<<24) | (r<<16) | (g<<8) | b;
+	}
+
+	inline quint32 swapRedBlue(quint32 p)
+	{
+		return (p&0xff00ff00) | ((p>>16)&0xff) | ((p&0xff)<<16);
+	}
+
+	void premultiplyRowScalar(quint32 *dst, const quint32 *src, int count)
+	{
+		for(int i=0; i<count; ++i) {
+			dst[i]=premultiply(src[i]);
+		}
+	}
+
+	void unpremultiplyRowScalar(quint32 *dst, const quint32 *src, int count, quint32 forceAlpha)
+	{
+		for(int i=0; i<count; ++i) {
+			dst[i]=unpremultiply(src[i]) | forceAlpha;
+		}
+	}
+
+	void swapRedBlueRowScalar(quint32 *dst, const quint32 *src, int count)
+	{
+		for(int i=0; i<count; ++i) {
+			dst[i]=swapRedBlue(src[i]);
+		}
+	}
+
+	void opaqueRowScalar(quint32 *dst, const quint32 *src, int count)
+	{
+		for(int i=0; i<count; ++i) {
+			dst[i]=src[i] | 0xff000000;
+		}
+	}
+
+#ifdef FORMAT_X86
+	FORMAT_TARGET("sse2") void premultiplyRowSSE2(quint32 *dst, const quint32 *src, int count)
+	{
+		int i=0;
+		const __m128i zero=_mm_setzero_si128();
+		const __m128i alphaMask=_mm_set1_epi32(static_cast<int>(0xff000000));
+		// Multiply colour lanes by alpha and the alpha lane by 255, which leaves it as is
+		const __m128i colourLanes=_mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+		const __m128i alphaLane=_mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+		const __m128i half=_mm_set1_epi16(0x80);
+		for(; i+4<=count; i+=4) {
+			const __m128i s=_mm_loadu_si128(reinterpret_cast<const __m128i *>(src+i));
+			if(0xffff==_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), alphaMask))) {
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i), s);
+				continue;
+			}
+			__m128i lo=_mm_unpacklo_epi8(s, zero);
+			__m128i hi=_mm_unpackhi_epi8(s, zero);
+			const __m128i aLo=_mm_or_si128(_mm_and_si128(_mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)), colourLanes), alphaLane);
+			const __m128i aHi=_mm_or_si128(_mm_and_si128(_mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)), colourLanes), alphaLane);
+			lo=_mm_add_epi16(_mm_mullo_epi16(lo, aLo), half);
+			hi=_mm_add_epi16(_mm_mullo_epi16(hi, aHi), half);
+			lo=_mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+			hi=_mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i), _mm_packus_epi16(lo, hi));
+		}
+		premultiplyRowScalar(dst+i, src+i, count-i);
+	}
+
+	FORMAT_TARGET("sse2") void unpremultiplyRowSSE2(quint32 *dst, const quint32 *src, int count, quint32 forceAlpha)
+	{
+		int i=0;
+		// Composited frames are opaque almost everywhere, so only the check is vectorised
+		const __m128i alphaMask=_mm_set1_epi32(static_cast<int>(0xff000000));
+		for(; i+4<=count; i+=4) {
+			const __m128i s=_mm_loadu_si128(reinterpret_cast<const __m128i *>(src+i));
+			if(0xffff==_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), alphaMask))) {
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i), s);
+				continue;
+			}
+			unpremultiplyRowScalar(dst+i, src+i, 4, forceAlpha);
+		}
+		unpremultiplyRowScalar(dst+i, src+i, count-i, forceAlpha);
+	}
+
+	FORMAT_TARGET("sse2") void swapRedBlueRowSSE2(quint32 *dst, const quint32 *src, int count)
+	{
+		int i=0;
+		const __m128i keep=_mm_set1_epi32(static_cast<int>(0xff00ff00));
+		const __m128i low=_mm_set1_epi32(0x000000ff);
+		for(; i+4<=count; i+=4) {
+			const __m128i s=_mm_loadu_si128(reinterpret_cast<const __m128i *>(src+i));
+			const __m128i r=_mm_and_si128(_mm_srli_epi32(s, 16), low);
+			const __m128i b=_mm_slli_epi32(_mm_and_si128(s, low), 16);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i), _mm_or_si128(_mm_and_si128(s, keep), _mm_or_si128(r, b)));
+		}
+		swapRedBlueRowScalar(dst+i, src+i, count-i);
+	}
+
+	FORMAT_TARGET("sse2") void opaqueRowSSE2(quint32 *dst, const quint32 *src, int count)
+	{
+		int i=0;
+		const __m128i alphaMask=_mm_set1_epi32(static_cast<int>(0xff000000));
+		for(; i+4<=count; i+=4) {
+			const __m128i s=_mm_loadu_si128(reinterpret_cast<const __m128i *>(src+i));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i), _mm_or_si128(s, alphaMask));
+		}
+		opaqueRowScalar(dst+i, src+i, count-i);
+	}
+#endif
+
+	void premultiplyRow(quint32 *dst, const quint32 *src, int count)
+	{
+#ifdef FORMAT_X86
+		if(FormatNegotiator::SSE2==FormatNegotiator::path()) {
+			premultiplyRowSSE2(dst, src, count);
+			return;
+		}
+#endif
+		premultiplyRowScalar(dst, src, count);
+	}
+
+	void unpremultiplyRow(quint32 *dst, const quint32 *src, int count, quint32 forceAlpha)
+	{
+#ifdef FORMAT_X86
+		if(FormatNegotiator::SSE2==FormatNegotiator::path()) {
+			unpremultiplyRowSSE2(dst, src, count, forceAlpha);
+			return;
+		}
+#endif
+		unpremultiplyRowScalar(dst, src, count, forceAlpha);
+	}
+
+	void swapRedBlueRow(quint32 *dst, const quint32 *src, int count)
+	{
+#ifdef FORMAT_X86
+		if(FormatNegotiator::SSE2==FormatNegotiator::path()) {
+			swapRedBlueRowSSE2(dst, src, count);
+			return;
+		}
+#endif
+		swapRedBlueRowScalar(dst, src, count);
+	}
+
+	// The padding byte of RGB32 is not always 0xff, the X11 grabbers leave it 0
+	void opaqueRow(quint32 *dst, const quint32 *src, int count)
+	{
+#ifdef FORMAT_X86
+		if(FormatNegotiator::SSE2==FormatNegotiator::path()) {
+			opaqueRowSSE2(dst, src, count);
+			return;
+		}
+#endif
+		opaqueRowScalar(dst, src, count);
+	}
+
+	void rgb888Row(quint32 *dst, const uchar *src, int count)
+	{
+		for(int i=0; i<count; ++i, src+=3) {
+			dst[i]=0xff000000 | (quint32(src[0])<<16) | (quint32(src[1])<<8) | quint32(src[2]);
+		}
+	}
+}
+
+
+FormatNegotiator::FormatNegotiator()
+	: mConversions(0)
+	, mFallbacks(0)
+	, mImplicit(0)
+	, mFrames(0)
+	, mFramesWithImplicit(0)
+	, mLastFrameImplicit(0)
+{
+	// What the screen grabbers deliver
+	mAccepted[CaptureStage]<<QImage::Format_RGB32<<QImage::Format_ARGB32_Premultiplied;
+	// What camera frames are turned into before they reach the compositor
+	mAccepted[CameraStage]<<QImage::Format_ARGB32_Premultiplied<<QImage::Format_RGB32;
+	// Layer images BlendEngine and the raster engine take without converting. Output is premultiplied
+	mAccepted[CompositorStage]<<QImage::Format_ARGB32_Premultiplied<<QImage::Format_RGB32;
+	// QPixmap::fromImage() uploads these without converting
+	mAccepted[PreviewStage]<<QImage::Format_ARGB32_Premultiplied<<QImage::Format_RGB32;
+	// The PNG writer converts premultiplied images internally
+	mAccepted[RecorderStage]<<QImage::Format_ARGB32<<QImage::Format_RGB32;
+}
+
+FormatNegotiator::~FormatNegotiator()
+{
+
+}
+
+
+void FormatNegotiator::declare(Stage stage, const QVector<QImage::Format> &formats)
+{
+	if(stage<0 || stage>=StageCount || formats.isEmpty()) {
+		qWarning()<<"ERROR: Invalid format declaration for stage"<<stage;
+		return;
+	}
+	QWriteLocker lock(&mLock);
+	mAccepted[stage]=formats;
+}
+
+
+bool FormatNegotiator::accepts(Stage stage, QImage::Format format)
+{
+	QReadLocker lock(&mLock);
+	return mAccepted[stage].contains(format);
+}
+
+
+QImage::Format FormatNegotiator::preferred(Stage stage)
+{
+	QReadLocker lock(&mLock);
+	return mAccepted[stage].first();
+}
+
+
+QImage FormatNegotiator::convert(const QImage &image, Stage stage, bool deep)
+{
+	if(image.isNull() || accepts(stage, image.format())) {
+		return deep?image.copy():image;
+	}
+	mConversions.fetchAndAddRelaxed(1);
+	QImage out(image.size(), preferred(stage));
+	if(!convertRows(image, out)) {
+		mFallbacks.fetchAndAddRelaxed(1);
+		out=image.convertToFormat(preferred(stage));
+	}
+	return out;
+}
+
+
+QSharedPointer<QImage> FormatNegotiator::convert(QSharedPointer<QImage> image, Stage stage)
+{
+	if(image.isNull() || image->isNull() || accepts(stage, image->format())) {
+		return image;
+	}
+	return QSharedPointer<QImage>(new QImage(convert(*image, stage)));
+}
+
+
+bool FormatNegotiator::convertRows(const QImage &src, QImage &dst)
+{
+	const QImage::Format from=src.format();
+	const QImage::Format to=dst.format();
+	const int w=src.width();
+	for(int y=0; y<src.height(); ++y) {
+		const uchar *s=src.constScanLine(y);
+		const quint32 *s32=reinterpret_cast<const quint32 *>(s);
+		quint32 *d=reinterpret_cast<quint32 *>(dst.scanLine(y));
+		if(QImage::Format_ARGB32==from && QImage::Format_ARGB32_Premultiplied==to) {
+			premultiplyRow(d, s32, w);
+		} else if(QImage::Format_RGBA8888==from && QImage::Format_ARGB32_Premultiplied==to) {
+			swapRedBlueRow(d, s32, w);
+			premultiplyRow(d, d, w);
+		} else if((QImage::Format_RGBA8888_Premultiplied==from && QImage::Format_ARGB32_Premultiplied==to)
+				  || (QImage::Format_RGBX8888==from && (QImage::Format_RGB32==to || QImage::Format_ARGB32_Premultiplied==to))) {
+			swapRedBlueRow(d, s32, w);
+		} else if(QImage::Format_ARGB32_Premultiplied==from && QImage::Format_ARGB32==to) {
+			unpremultiplyRow(d, s32, w, 0);
+		} else if(QImage::Format_ARGB32_Premultiplied==from && QImage::Format_RGB32==to) {
+			unpremultiplyRow(d, s32, w, 0xff000000);
+		} else if(QImage::Format_RGB32==from && (QImage::Format_ARGB32_Premultiplied==to || QImage::Format_ARGB32==to)) {
+			opaqueRow(d, s32, w);
+		} else if(QImage::Format_RGB888==from && (QImage::Format_RGB32==to || QImage::Format_ARGB32_Premultiplied==to)) {
+			rgb888Row(d, s, w);
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void FormatNegotiator::noteImplicit(Stage stage, QImage::Format format)
+{
+	if(0==mImplicit.fetchAndAddRelaxed(1)) {
+		qDebug()<<"FORMAT: first implicit conversion, format"<<format<<"into"<<stageName(stage);
+	}
+}
+
+
+void FormatNegotiator::frameDone(int implicitConversions)
+{
+	mFrames.fetchAndAddRelaxed(1);
+	mLastFrameImplicit.store(implicitConversions);
+	if(implicitConversions>0) {
+		mFramesWithImplicit.fetchAndAddRelaxed(1);
+	}
+}
+
+
+quint64 FormatNegotiator::conversions()
+{
+	return mConversions.load();
+}
+
+
+quint64 FormatNegotiator::implicitConversions()
+{
+	return mImplicit.load();
+}
+
+
+int FormatNegotiator::lastFrameImplicit()
+{
+	return mLastFrameImplicit.load();
+}
+
+
+QString FormatNegotiator::stats()
+{
+	return QString("conversions=%1 fallbacks=%2 implicit=%3 frames=%4 framesWithImplicit=%5 lastFrameImplicit=%6")
+		   .arg(mConversions.load()).arg(mFallbacks.load()).arg(mImplicit.load())
+		   .arg(mFrames.load()).arg(mFramesWithImplicit.load()).arg(mLastFrameImplicit.load());
+}
+
+
+FormatNegotiator *FormatNegotiator::globalInstance()
+{
+	static FormatNegotiator *negotiator=new FormatNegotiator();
+	return negotiator;
+}
+
+
+FormatNegotiator::Path FormatNegotiator::path()
+{
+	int p=sPath.load();
+	if(p<0) {
+		p=bestPath();
+		sPath.testAndSetOrdered(-1, p);
+		qDebug()<<"FORMAT: using"<<pathName();
+	}
+	return static_cast<Path>(sPath.load());
+}
+
+
+QString FormatNegotiator::pathName()
+{
+	return (SSE2==path())?"sse2":"scalar";
+}
+
+
+void FormatNegotiator::setPath(Path p)
+{
+	const Path best=bestPath();
+	sPath.store((p<=best)?p:Scalar);
+}
+
+
+QString FormatNegotiator::stageName(Stage stage)
+{
+	switch(stage) {
+		case CaptureStage: return "capture";
+		case CameraStage: return "camera";
+		case CompositorStage: return "compositor";
+		case PreviewStage: return "preview";
+		case RecorderStage: return "recorder";
+		default: return "unknown";
+	}
+}
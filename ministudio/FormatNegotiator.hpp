@@ -0,0 +1,90 @@
+#ifndef FORMATNEGOTIATOR_HPP
+#define FORMATNEGOTIATOR_HPP
+
+#include <QImage>
+#include <QSharedPointer>
+#include <QVector>
+#include <QReadWriteLock>
+#include <QAtomicInteger>
+
+
+/*
+  Keeps track of which pixel formats each stage of the pipeline works in.
+
+  Every stage declares the QImage formats it takes without converting, the
+  first one being its preferred format. Images crossing into a stage go
+  through convert(), which is the one place conversions happen. Common
+  conversions have SSE2 row kernels, picked at runtime like BlendEngine.
+  Anything else falls back to QImage::convertToFormat() and is counted as
+  such.
+
+  Stages that hand an image to Qt in a format they don't accept (making
+  QPainter or an image writer convert behind our back) report it with
+  noteImplicit(). FrameScene sums those per frame, so the implicit
+  conversions per frame can be watched and driven to zero.
+*/
+class FormatNegotiator
+{
+	public:
+		enum Stage {
+			CaptureStage
+			, CameraStage
+			, CompositorStage
+			, PreviewStage
+			, RecorderStage
+			, StageCount
+		};
+
+		enum Path {
+			Scalar
+			, SSE2
+		};
+
+	private:
+		QReadWriteLock mLock;
+		QVector<QImage::Format> mAccepted[StageCount];
+		QAtomicInteger<quint64> mConversions;
+		QAtomicInteger<quint64> mFallbacks;
+		QAtomicInteger<quint64> mImplicit;
+		QAtomicInteger<quint64> mFrames;
+		QAtomicInteger<quint64> mFramesWithImplicit;
+		QAtomicInt mLastFrameImplicit;
+
+	public:
+		explicit FormatNegotiator();
+		virtual ~FormatNegotiator();
+
+	public:
+		// Replace the formats a stage accepts, preferred first
+		void declare(Stage stage, const QVector<QImage::Format> &formats);
+		bool accepts(Stage stage, QImage::Format format);
+		QImage::Format preferred(Stage stage);
+
+		// Bring an image into a format the stage accepts. Accepted images are returned as is, or as a deep copy if asked to
+		QImage convert(const QImage &image, Stage stage, bool deep=false);
+		QSharedPointer<QImage> convert(QSharedPointer<QImage> image, Stage stage);
+
+		// An image in a format the stage does not accept was handed to Qt, which will convert it silently
+		void noteImplicit(Stage stage, QImage::Format format);
+		// Called once per rendered frame with the implicit conversions it caused
+		void frameDone(int implicitConversions);
+
+		quint64 conversions();
+		quint64 implicitConversions();
+		int lastFrameImplicit();
+		QString stats();
+
+	public:
+		static FormatNegotiator *globalInstance();
+		static QString stageName(Stage stage);
+
+		static Path path();
+		static QString pathName();
+		// Force a specific kernel, for comparing them. Falls back to scalar if the CPU lacks support
+		static void setPath(Path path);
+
+	private:
+		bool convertRows(const QImage &src, QImage &dst);
+};
+
+#endif // FORMATNEGOTIATOR_HPP
@@ -0,0 +1,114 @@
+#include "FrameBufferPool.hpp"
+
+#include <QMutexLocker>
+#include <QDebug>
+
+
+FrameBufferPool::FrameBufferPool(int maxFreePerKey)
+	: mMaxFreePerKey(maxFreePerKey)
+	, mHits(0)
+	, mMisses(0)
+	, mOutstanding(0)
+{
+
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+	clear();
+}
+
+
+quint64 FrameBufferPool::key(const QSize &size, QImage::Format format)
+{
+	return (quint64(format)<<48) | (quint64(size.width() & 0xFFFFFF)<<24) | quint64(size.height() & 0xFFFFFF);
+}
+
+
+QSharedPointer<QImage> FrameBufferPool::acquire(const QSize &size, QImage::Format format)
+{
+	QImage *image=nullptr;
+	{
+		QMutexLocker lock(&mMutex);
+		QList<QImage *> &free=mFree[key(size, format)];
+		while(nullptr==image && !free.isEmpty()) {
+			image=free.takeLast();
+			// Someone kept an implicitly shared copy, painting into it would trigger a full detach copy anyway
+			if(!image->isDetached()) {
+				delete image;
+				image=nullptr;
+			}
+		}
+	}
+	if(nullptr!=image) {
+		mHits.fetchAndAddRelaxed(1);
+	} else {
+		mMisses.fetchAndAddRelaxed(1);
+		image=new QImage(size, format);
+	}
+	mOutstanding.fetchAndAddRelaxed(1);
+	return QSharedPointer<QImage>(image, [this](QImage *im) {
+		recycle(im);
+	});
+}
+
+
+void FrameBufferPool::recycle(QImage *image)
+{
+	mOutstanding.fetchAndAddRelaxed(-1);
+	if(nullptr==image) {
+		return;
+	}
+	{
+		QMutexLocker lock(&mMutex);
+		QList<QImage *> &free=mFree[key(image->size(), image->format())];
+		if(free.size()<mMaxFreePerKey) {
+			free.append(image);
+			image=nullptr;
+		}
+	}
+	delete image;
+}
+
+
+void FrameBufferPool::clear()
+{
+	QMutexLocker lock(&mMutex);
+	for(QList<QImage *> &free:mFree) {
+		qDeleteAll(free);
+		free.clear();
+	}
+	mFree.clear();
+}
+
+
+quint64 FrameBufferPool::hits()
+{
+	return mHits.load();
+}
+
+
+quint64 FrameBufferPool::misses()
+{
+	return mMisses.load();
+}
+
+
+qint64 FrameBufferPool::outstanding()
+{
+	return mOutstanding.load();
+}
+
+
+QString FrameBufferPool::stats()
+{
+	return QString("hits=%1 misses=%2 outstanding=%3").arg(hits()).arg(misses()).arg(outstanding());
+}
+
+
+FrameBufferPool *FrameBufferPool::globalInstance()
+{
+	// Intentionally leaked, buffers may still come back after static destruction has started
+	static FrameBufferPool *pool=new FrameBufferPool();
+	return pool;
+}
@@ -0,0 +1,54 @@
+#ifndef FRAMEBUFFERPOOL_HPP
+#define FRAMEBUFFERPOOL_HPP
+
+#include <QImage>
+#include <QSharedPointer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QAtomicInteger>
+
+
+/*
+  Thread safe pool of full frame images keyed on size and format.
+
+  acquire() hands out a QSharedPointer whose deleter returns the image to
+  the pool instead of freeing it, so steady state streaming recycles the
+  same few buffers instead of allocating a full frame every time.
+
+  Recycled buffers keep whatever was drawn into them last. A pool must
+  outlive every buffer it handed out, which is why the global instance is
+  never destroyed.
+*/
+class FrameBufferPool
+{
+	private:
+		QMutex mMutex;
+		QHash<quint64, QList<QImage *> > mFree;
+		int mMaxFreePerKey;
+		QAtomicInteger<quint64> mHits;
+		QAtomicInteger<quint64> mMisses;
+		QAtomicInteger<qint64> mOutstanding;
+
+	public:
+		explicit FrameBufferPool(int maxFreePerKey=8);
+		virtual ~FrameBufferPool();
+
+	public:
+		QSharedPointer<QImage> acquire(const QSize &size, QImage::Format format);
+		void clear();
+
+		quint64 hits();
+		quint64 misses();
+		qint64 outstanding();
+		QString stats();
+
+	public:
+		static FrameBufferPool *globalInstance();
+
+	private:
+		void recycle(QImage *image);
+		static quint64 key(const QSize &size, QImage::Format format);
+};
+
+#endif // FRAMEBUFFERPOOL_HPP
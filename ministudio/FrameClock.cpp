@@ -0,0 +1,25 @@
+#include "FrameClock.hpp"
+
+#include <QDateTime>
+
+#include <chrono>
+
+
+qint64 FrameClock::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+qint64 FrameClock::since(qint64 timestamp)
+{
+	return now()-timestamp;
+}
+
+
+qint64 FrameClock::toEpochMs(qint64 timestamp)
+{
+	// Taken once, so every timestamp maps the same way even if the wall clock is adjusted later
+	static const qint64 offset=QDateTime::currentMSecsSinceEpoch()-now()/1000000;
+	return timestamp/1000000+offset;
+}
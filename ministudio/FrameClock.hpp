@@ -0,0 +1,25 @@
+#ifndef FRAMECLOCK_HPP
+#define FRAMECLOCK_HPP
+
+#include <QtGlobal>
+
+/*
+  The clock frames are timed by.
+
+  Capture timestamps are nanoseconds on the steady (monotonic) clock, so
+  they never jump when the wall clock is adjusted and differences between
+  them are exact. They are only meaningful relative to each other, use
+  toEpochMs() where a time of day is needed.
+*/
+class FrameClock
+{
+	public:
+		// Nanoseconds on the steady clock
+		static qint64 now();
+		// Nanoseconds elapsed since a timestamp from now()
+		static qint64 since(qint64 timestamp);
+		// Wall clock time for a timestamp from now(), in ms since epoch
+		static qint64 toEpochMs(qint64 timestamp);
+};
+
+#endif // FRAMECLOCK_HPP
@@ -1,12 +1,50 @@
 #include "FrameScene.hpp"
 
+#include "FrameBufferPool.hpp"
+#include "LayerCache.hpp"
+#include "FormatNegotiator.hpp"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QSemaphore>
 #include <QDebug>
 
-FrameScene::FrameScene(quint64 id, QString outputFilename,  QSize resolution)
+#include <functional>
+
+namespace
+{
+	class BandTask: public QRunnable
+	{
+		private:
+			std::function<void()> mWork;
+			QSemaphore &mDone;
+
+		public:
+			BandTask(std::function<void()> work, QSemaphore &done)
+				: mWork(work)
+				, mDone(done)
+			{
+				setAutoDelete(true);
+			}
+
+			void run() override
+			{
+				mWork();
+				mDone.release();
+			}
+	};
+}
+
+FrameScene::FrameScene(quint64 id, QSize resolution)
 	: QObject(nullptr)
 	, mID(id)
-	, mOutputFilename(outputFilename)
+	, mCaptured(0)
+	, mState(Queued)
 	, mResolution(resolution)
+	, mDamage(QRect(QPoint(0,0), resolution))
+	, mBands(1)
+	, mImplicitConversions(0)
+	, mPlan(RenderPlan::acquire())
 {
 	setAutoDelete(true);
 
@@ -15,46 +53,122 @@ FrameScene::FrameScene(quint64 id, QString outputFilename,  QSize resolution)
 
 FrameScene::~FrameScene()
 {
-	for(Layer *l:mLayers){
-		delete l;
-	}
-	mLayers.clear();
+	RenderPlan::recycle(mPlan);
+	mPlan=nullptr;
 	//qDebug()<<"FRAME" <<mID<<" deleted";
 }
 
+bool FrameScene::cancel()
+{
+	if(!mState.testAndSetOrdered(Queued, Cancelling)) {
+		return false;
+	}
+	// Let go of the layer images right away instead of when a worker gets around to us
+	mPlan->reset();
+	mState.storeRelease(Cancelled);
+	return true;
+}
+
+
 void FrameScene::run()
 {
+	if(!mState.testAndSetOrdered(Queued, Running)) {
+		// Wait for cancel() to finish with the layers before we get deleted
+		while(Cancelled!=mState.loadAcquire()) {
+			QThread::yieldCurrentThread();
+		}
+		emit renderFinished(this);
+		return;
+	}
 	//qDebug()<<"Rendering Framescene:";
-	QSharedPointer<QImage> out(new QImage(mResolution, QImage::Format_ARGB32));
-	QPainter painter(out.data());
+	QSharedPointer<QImage> out=FrameBufferPool::globalInstance()->acquire(mResolution, QImage::Format_ARGB32_Premultiplied);
+	const int bands=qBound(1, mBands, qMax(1, out->height()));
+	if(1==bands) {
+		renderBand(*out, QPoint(0,0));
+	} else {
+		// Each band is its own QImage over a slice of the rows, as a paint device only takes one painter at a time
+		uchar *bits=out->bits();
+		const int stride=out->bytesPerLine();
+		QList<QImage> parts;
+		QList<QPoint> origins;
+		for(int i=0; i<bands; ++i) {
+			const int top=(out->height()*i)/bands;
+			const int bottom=(out->height()*(i+1))/bands;
+			parts<<QImage(bits+top*stride, out->width(), bottom-top, stride, out->format());
+			origins<<QPoint(0, top);
+		}
+		QSemaphore done;
+		for(int i=1; i<bands; ++i) {
+			QImage *part=&parts[i];
+			const QPoint origin=origins[i];
+			bandPool()->start(new BandTask([this, part, origin]() {
+				renderBand(*part, origin);
+			}, done));
+		}
+		renderBand(parts[0], origins[0]);
+		done.acquire(bands-1);
+	}
+
+	FormatNegotiator::globalInstance()->frameDone(mImplicitConversions.load());
+	emit renderComplete(mID, out, mCaptured, mDamage);
+	emit renderFinished(this);
+}
+
+
+void FrameScene::renderBand(QImage &band, const QPoint &origin)
+{
+	const QTransform shift=QTransform::fromTranslate(-origin.x(), -origin.y());
+	QPainter painter(&band);
 	//painter.setRenderHints((QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::SmoothPixmapTransform | QPainter::HighQualityAntialiasing));
-	for(QString name: mLayersOrder){
-		if(mLayers.contains(name)){
-			Layer *layer=mLayers[name];
-			if(nullptr!=layer && layer->opacity()>0.0){
-				//qDebug()<<" + LAYER "<<name;
-				painter.setTransform(layer->transform(), false);
+	// Other bands walk the same plan at the same time, it is only read here
+	for(int i=0, n=mPlan->size(); i<n; ++i){
+		Layer *layer=mPlan->layer(i);
+		if(nullptr!=layer && layer->opacity()>0.0){
+			if(layer->retained()){
+				LayerCache::globalInstance()->render(*this, *layer, band, painter, origin);
+			}
+			else if(!layer->blend(*this, band, origin)){
+				painter.setTransform(layer->transform()*shift, false);
 				layer->render(*this, painter);
 			}
 		}
 	}
+}
 
-	if(""!=mOutputFilename){
-		out->save(mOutputFilename);
+
+QRegion FrameScene::coverage(int exceptID)
+{
+	QRegion region;
+	for(int i=0, n=mPlan->size(); i<n; ++i){
+		Layer *layer=mPlan->layer(i);
+		if(nullptr!=layer && exceptID!=mPlan->record(i).id){
+			// A pixel extra all round for edges QPainter touches
+			region+=layer->transform().mapRect(QRectF(layer->bounds(*this))).toAlignedRect().adjusted(-1, -1, 1, 1);
+		}
 	}
-	emit renderComplete(mID, out);
+	return region.intersected(QRect(QPoint(0,0), mResolution));
 }
 
 
-void FrameScene::addImageLayer(QString name, QSharedPointer<QImage> image, qreal opacity, QTransform trans){
-	mLayersOrder<<name;
-	mLayers[name]=new ImageLayer(image, opacity, trans);
+void FrameScene::noteImplicitConversion(QImage::Format format)
+{
+	mImplicitConversions.fetchAndAddRelaxed(1);
+	FormatNegotiator::globalInstance()->noteImplicit(FormatNegotiator::CompositorStage, format);
 }
 
 
-void FrameScene::addTitleLayer(QString name, QString title, QString subTitle, qreal opacity, QTransform trans){
-	mLayersOrder<<name;
-	mLayers[name]=new TitleLayer(title, subTitle, opacity, trans);
+QThreadPool *FrameScene::bandPool()
+{
+	static QThreadPool *pool=new QThreadPool();
+	return pool;
 }
 
 
+void FrameScene::addImageLayer(int id, QSharedPointer<QImage> image, qreal opacity, QTransform trans, bool retained){
+	mPlan->addImageLayer(id, image, opacity, trans, retained);
+}
+
+
+void FrameScene::addTitleLayer(int id, QString title, QString subTitle, qreal opacity, QTransform trans){
+	mPlan->addTitleLayer(id, title, subTitle, opacity, trans);
+}
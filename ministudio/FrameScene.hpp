@@ -2,43 +2,112 @@
 #define FRAMESCENE_HPP
 
 #include "Layer.hpp"
+#include "RenderPlan.hpp"
 
 
 #include <QRunnable>
-#include <QStringList>
-#include <QMap>
 #include <QImage>
 #include <QPainter>
 #include <QRectF>
+#include <QRegion>
 #include <QSharedPointer>
+#include <QAtomicInt>
 
+class QThreadPool;
 
 class FrameScene : public QObject, public QRunnable
 {
 		Q_OBJECT
+	public:
+		enum State {
+			Queued
+			, Running
+			, Cancelling
+			, Cancelled
+		};
+
 	private:
 		quint64 mID;
-		QString mOutputFilename;
+		qint64 mCaptured;
+		QAtomicInt mState;
 		QSize mResolution;
-		QStringList mLayersOrder;
-		QMap<QString, Layer *> mLayers;
+		QRegion mDamage;
+		int mBands;
+		QAtomicInt mImplicitConversions;
+		RenderPlan *mPlan;
 
 	public:
-		explicit FrameScene(quint64 id, QString outputFilename,  QSize resolution);
+		explicit FrameScene(quint64 id, QSize resolution);
 		virtual ~FrameScene();
 
-		void addImageLayer(QString name, QSharedPointer<QImage> image, qreal opacity=1.0, QTransform trans=QTransform());
-		void addTitleLayer(QString name, QString title, QString subTitle, qreal opacity=1.0, QTransform trans=QTransform());
+		// id is one of RenderPlan::LayerID
+		void addImageLayer(int id, QSharedPointer<QImage> image, qreal opacity=1.0, QTransform trans=QTransform(), bool retained=false);
+		void addTitleLayer(int id, QString title, QString subTitle, qreal opacity=1.0, QTransform trans=QTransform());
 		void run() override;
+		// Prevent the scene from rendering and release its layers. Fails if rendering already started
+		bool cancel();
+
+		quint64 id()
+		{
+			return mID;
+		}
 
 		const QSize &resolution()
 		{
 			return mResolution;
 		}
 
+		// When the content of the frame was captured, see FrameClock
+		void setCaptureTime(qint64 captured)
+		{
+			mCaptured=captured;
+		}
+
+		qint64 captureTime()
+		{
+			return mCaptured;
+		}
+
+		// The part of the frame that may differ from the frame before, handed on with the rendered frame
+		void setDamage(const QRegion &damage)
+		{
+			mDamage=damage;
+		}
+
+		const QRegion &damage()
+		{
+			return mDamage;
+		}
+
+		// The area of the frame covered by layers other than the one with exceptID
+		QRegion coverage(int exceptID);
+
+		// Split the frame in this many horizontal bands that are composited concurrently
+		void setBands(int bands)
+		{
+			mBands=bands;
+		}
+
+		int bands()
+		{
+			return mBands;
+		}
+
+		// A layer handed Qt an image in a format the compositor does not accept
+		void noteImplicitConversion(QImage::Format format);
+
+	private:
+		// Composite every layer into band, which covers the part of the frame starting at origin
+		void renderBand(QImage &band, const QPoint &origin);
+
+		// Workers for the bands, separate from the pool running the scenes so waiting on bands can't starve it
+		static QThreadPool *bandPool();
+
 	signals:
 
-		void renderComplete(quint64 id, QSharedPointer<QImage> im);
+		void renderComplete(quint64 id, QSharedPointer<QImage> im, qint64 captured, QRegion damage);
+		// Emitted from the worker thread right before the scene is deleted, whether it rendered or was cancelled
+		void renderFinished(FrameScene *scene);
 };
 
 #endif // FRAMESCENE_HPP
@@ -0,0 +1,57 @@
+#include "FrameSink.hpp"
+
+
+FrameSink::FrameSink()
+	: mWritten(0)
+	, mDropped(0)
+	, mBytes(0)
+{
+
+}
+
+FrameSink::~FrameSink()
+{
+
+}
+
+
+void FrameSink::sync()
+{
+
+}
+
+
+bool FrameSink::ordered()
+{
+	return true;
+}
+
+
+void FrameSink::moveToThread(QThread *thread)
+{
+	(void)thread;
+}
+
+
+quint64 FrameSink::written()
+{
+	return mWritten.load();
+}
+
+
+quint64 FrameSink::dropped()
+{
+	return mDropped.load();
+}
+
+
+quint64 FrameSink::bytes()
+{
+	return mBytes.load();
+}
+
+
+QString FrameSink::stats()
+{
+	return QString("%1: written=%2 dropped=%3 bytes=%4").arg(name()).arg(written()).arg(dropped()).arg(bytes());
+}
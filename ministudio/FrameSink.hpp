@@ -0,0 +1,73 @@
+#ifndef FRAMESINK_HPP
+#define FRAMESINK_HPP
+
+#include <QImage>
+#include <QRegion>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include <QAtomicInteger>
+
+class QThread;
+
+/*
+  Destination for recorded frames.
+
+  A sink is opened once per recording with the frame size and rate, then
+  receives the composited frames. Sinks may block in write(), sync() and
+  close(), so they are driven by a FrameWriter on its own threads, never
+  from the render pool or the GUI thread.
+
+  Ordered sinks get their frames one at a time in recording order. Other
+  sinks may get write() calls from several writer threads at once.
+*/
+class FrameSink
+{
+	public:
+		struct Frame {
+			// Position in the recording, starting at 1
+			quint64 index;
+			// Live frame id
+			quint64 id;
+			// Capture time in ns on the steady clock, see FrameClock. Only differences between frames mean anything
+			qint64 timestamp;
+			QImage image;
+			// With hasDamage set, only the parts of the frame in damage can differ from the frame with id-1
+			QRegion damage;
+			bool hasDamage;
+		};
+
+	protected:
+		QAtomicInteger<quint64> mWritten;
+		QAtomicInteger<quint64> mDropped;
+		QAtomicInteger<quint64> mBytes;
+
+	public:
+		explicit FrameSink();
+		virtual ~FrameSink();
+
+	public:
+		// Start a recording into the directory basePath
+		virtual bool open(const QString &basePath, const QSize &size, qreal fps) = 0;
+		// Returns false if the frame was not recorded
+		virtual bool write(const Frame &frame) = 0;
+		// Make what was written so far durable
+		virtual void sync();
+		// Finish the recording, flushing whatever is pending
+		virtual void close() = 0;
+		virtual bool isOpen() = 0;
+		virtual QString name() = 0;
+		// The pixel formats write() takes without converting, preferred first
+		virtual QVector<QImage::Format> formats() = 0;
+		// Whether frames must be written one at a time and in order
+		virtual bool ordered();
+		// The sink is about to be closed on another thread, move anything with thread affinity there
+		virtual void moveToThread(QThread *thread);
+
+		quint64 written();
+		quint64 dropped();
+		quint64 bytes();
+		virtual QString stats();
+};
+
+#endif // FRAMESINK_HPP
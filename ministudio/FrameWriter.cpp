@@ -0,0 +1,255 @@
+#include "FrameWriter.hpp"
+
+#include "FormatNegotiator.hpp"
+#include "FrameClock.hpp"
+
+#include <QThread>
+#include <QMutexLocker>
+#include <QDebug>
+
+
+class FrameWriterThread: public QThread
+{
+	private:
+		FrameWriter *mWriter;
+
+	public:
+		explicit FrameWriterThread(FrameWriter *writer)
+			: mWriter(writer)
+		{
+
+		}
+
+		void run() override
+		{
+			mWriter->work();
+		}
+};
+
+
+FrameWriter::FrameWriter(FrameSink *sink, const QString &basePath, const QSize &size, qreal fps, int threads, int maxQueue)
+	: mSink(sink)
+	, mBasePath(basePath)
+	, mSize(size)
+	, mFps(fps)
+	, mMaxQueue(qMax(1, maxQueue))
+	, mMaxDepth(0)
+	, mRunning(0)
+	, mStopping(false)
+	, mOpened(false)
+	, mReady(false)
+	, mOpenFailed(false)
+	, mLagging(false)
+	, mNextIndex(1)
+	, mSubmitted(0)
+	, mRejected(0)
+	, mSyncFrames(16)
+	, mSyncInterval(1000)
+	, mUnsynced(0)
+	, mLastSync(0)
+	, mLastLag(0)
+{
+	mClock.start();
+	if(mSink->ordered()) {
+		threads=1;
+	}
+	mRunning=qMax(1, threads);
+	for(int i=0; i<mRunning; ++i) {
+		QThread *thread=new FrameWriterThread(this);
+		thread->setObjectName(QString("FrameWriter%1").arg(i));
+		mThreads<<thread;
+		thread->start(QThread::LowPriority);
+	}
+}
+
+FrameWriter::~FrameWriter()
+{
+	finish();
+	delete mSink;
+	mSink=nullptr;
+}
+
+
+bool FrameWriter::submit(quint64 id, QSharedPointer<QImage> image, qint64 captured, const QRegion *damage)
+{
+	QMutexLocker lock(&mMutex);
+	if(mStopping || image.isNull()) {
+		return false;
+	}
+	mSubmitted++;
+	if(mQueue.size()>=mMaxQueue) {
+		mRejected++;
+		if(!mLagging) {
+			mLagging=true;
+			qWarning()<<"WRITER: queue full, dropping frames. Lag"<<(mClock.elapsed()-mQueue.first().queued)<<"ms";
+		}
+		return false;
+	}
+	if(mLagging && mQueue.size()<mMaxQueue/2) {
+		mLagging=false;
+		qDebug()<<"WRITER: caught up after dropping"<<mRejected<<"frames in total";
+	}
+	mQueue<<Job{id, image, mClock.elapsed(), captured, (nullptr!=damage)?*damage:QRegion(), nullptr!=damage};
+	mMaxDepth=qMax(mMaxDepth, mQueue.size());
+	mWakeWriters.wakeOne();
+	return true;
+}
+
+
+bool FrameWriter::submitWait(quint64 id, QSharedPointer<QImage> image, qint64 captured)
+{
+	QMutexLocker lock(&mMutex);
+	while(!mStopping && mQueue.size()>=mMaxQueue) {
+		mRoom.wait(&mMutex);
+	}
+	if(mStopping || image.isNull()) {
+		return false;
+	}
+	mSubmitted++;
+	mQueue<<Job{id, image, mClock.elapsed(), captured, QRegion(), false};
+	mMaxDepth=qMax(mMaxDepth, mQueue.size());
+	mWakeWriters.wakeOne();
+	return true;
+}
+
+
+void FrameWriter::work()
+{
+	QMutexLocker lock(&mMutex);
+	if(!mOpened) {
+		// The sink lives on the writer threads, so the first one in opens it
+		mOpened=true;
+		lock.unlock();
+		const bool ok=mSink->open(mBasePath, mSize, mFps);
+		lock.relock();
+		mOpenFailed=!ok;
+		if(!ok) {
+			qWarning()<<"ERROR: Could not open"<<mSink->name()<<"recording in"<<mBasePath;
+		}
+		mLastSync=mClock.elapsed();
+		mReady=true;
+		mWakeWriters.wakeAll();
+	}
+	while(!mReady) {
+		mWakeWriters.wait(&mMutex);
+	}
+	while(true) {
+		const qint64 now=mClock.elapsed();
+		if(mUnsynced>0 && (mUnsynced>=mSyncFrames || (now-mLastSync)>=mSyncInterval)) {
+			mUnsynced=0;
+			mLastSync=now;
+			lock.unlock();
+			mSink->sync();
+			lock.relock();
+			continue;
+		}
+		if(mQueue.isEmpty()) {
+			if(mStopping) {
+				break;
+			}
+			mWakeWriters.wait(&mMutex, static_cast<unsigned long>(qMax<qint64>(1, mSyncInterval)));
+			continue;
+		}
+		Job job=mQueue.takeFirst();
+		const quint64 index=mNextIndex++;
+		mRoom.wakeAll();
+		lock.unlock();
+		bool ok=false;
+		if(!mOpenFailed) {
+			const FrameSink::Frame frame{index, job.id, job.timestamp, FormatNegotiator::globalInstance()->convert(*job.image, FormatNegotiator::RecorderStage), job.damage, job.hasDamage};
+			job.image.clear();
+			ok=mSink->write(frame);
+			if(ok && job.timestamp>0) {
+				mLatency.add(FrameClock::since(job.timestamp));
+			}
+		}
+		lock.relock();
+		mLastLag=mClock.elapsed()-job.queued;
+		if(ok) {
+			mUnsynced++;
+		}
+	}
+	// The last thread out closes the sink, on a writer thread like everything else done to it
+	if(0==--mRunning) {
+		lock.unlock();
+		mSink->close();
+	}
+}
+
+
+void FrameWriter::finish()
+{
+	{
+		QMutexLocker lock(&mMutex);
+		if(mThreads.isEmpty()) {
+			return;
+		}
+		mStopping=true;
+		mWakeWriters.wakeAll();
+		mRoom.wakeAll();
+	}
+	for(QThread *thread:mThreads) {
+		thread->wait();
+		delete thread;
+	}
+	mThreads.clear();
+	qDebug()<<"WRITER: finished"<<stats();
+}
+
+
+void FrameWriter::setSyncBatch(int frames, qint64 intervalMs)
+{
+	QMutexLocker lock(&mMutex);
+	mSyncFrames=qMax(1, frames);
+	mSyncInterval=qMax<qint64>(1, intervalMs);
+}
+
+
+FrameSink *FrameWriter::sink()
+{
+	return mSink;
+}
+
+
+int FrameWriter::queueDepth()
+{
+	QMutexLocker lock(&mMutex);
+	return mQueue.size();
+}
+
+
+int FrameWriter::maxQueueDepth()
+{
+	QMutexLocker lock(&mMutex);
+	return mMaxDepth;
+}
+
+
+qint64 FrameWriter::lag()
+{
+	QMutexLocker lock(&mMutex);
+	return mQueue.isEmpty()?mLastLag:(mClock.elapsed()-mQueue.first().queued);
+}
+
+
+qreal FrameWriter::throughput()
+{
+	const qint64 ms=mClock.elapsed();
+	return (ms>0)?(mSink->written()*1000.0/ms):0.0;
+}
+
+
+LatencyMeter &FrameWriter::latency()
+{
+	return mLatency;
+}
+
+
+QString FrameWriter::stats()
+{
+	const qint64 ms=qMax<qint64>(1, mClock.elapsed());
+	const qreal mbps=mSink->bytes()*1000.0/ms/(1024.0*1024.0);
+	return QString("%1 queue=%2 maxQueue=%3 rejected=%4 lag=%5ms fps=%6 MB/s=%7 latency=(%8)")
+		   .arg(mSink->stats()).arg(queueDepth()).arg(maxQueueDepth()).arg(mRejected)
+		   .arg(lag()).arg(throughput(), 0, 'f', 1).arg(mbps, 0, 'f', 1).arg(mLatency.stats());
+}
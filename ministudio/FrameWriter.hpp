@@ -0,0 +1,100 @@
+#ifndef FRAMEWRITER_HPP
+#define FRAMEWRITER_HPP
+
+#include "FrameSink.hpp"
+#include "LatencyMeter.hpp"
+
+#include <QSharedPointer>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+class QThread;
+
+/*
+  Persistence stage between the live pipeline and a FrameSink.
+
+  submit() only queues the frame and returns, the sink is driven by the
+  writer's own threads (one for ordered sinks). The queue is bounded, when
+  the disk can't keep up frames are dropped at the writer and show up as
+  writer lag and drops, instead of stalling rendering or the preview.
+
+  Sinks are synced in batches, every syncFrames frames or syncInterval ms
+  whichever comes first.
+
+  The sink is opened, written and closed on the writer threads, and owned
+  by the writer.
+*/
+class FrameWriter
+{
+	private:
+		struct Job {
+			quint64 id;
+			QSharedPointer<QImage> image;
+			qint64 queued;
+			qint64 timestamp;
+			QRegion damage;
+			bool hasDamage;
+		};
+
+		FrameSink *mSink;
+		QString mBasePath;
+		QSize mSize;
+		qreal mFps;
+		QList<QThread *> mThreads;
+		QMutex mMutex;
+		QWaitCondition mWakeWriters;
+		QWaitCondition mRoom;
+		QList<Job> mQueue;
+		int mMaxQueue;
+		int mMaxDepth;
+		int mRunning;
+		bool mStopping;
+		bool mOpened;
+		bool mReady;
+		bool mOpenFailed;
+		bool mLagging;
+		quint64 mNextIndex;
+		quint64 mSubmitted;
+		quint64 mRejected;
+		int mSyncFrames;
+		qint64 mSyncInterval;
+		int mUnsynced;
+		qint64 mLastSync;
+		qint64 mLastLag;
+		QElapsedTimer mClock;
+		LatencyMeter mLatency;
+
+	public:
+		explicit FrameWriter(FrameSink *sink, const QString &basePath, const QSize &size, qreal fps, int threads=2, int maxQueue=16);
+		virtual ~FrameWriter();
+
+	public:
+		// Queue a frame for writing, captured is its capture time from FrameClock. Returns false if the queue was full and the frame dropped
+		// damage is what may differ from the frame with the id before, if known
+		bool submit(quint64 id, QSharedPointer<QImage> image, qint64 captured, const QRegion *damage=nullptr);
+		// Queue a frame captured earlier, waiting for room instead of dropping it
+		bool submitWait(quint64 id, QSharedPointer<QImage> image, qint64 captured);
+		// Write what is queued, close the sink and stop the threads. Blocks until done
+		void finish();
+
+		void setSyncBatch(int frames, qint64 intervalMs);
+
+		FrameSink *sink();
+		int queueDepth();
+		int maxQueueDepth();
+		// Age in ms of the oldest frame waiting, or of the last one written
+		qint64 lag();
+		// Frames per second written since the writer started
+		qreal throughput();
+		// From capture to the frame written by the sink
+		LatencyMeter &latency();
+		QString stats();
+
+	private:
+		friend class FrameWriterThread;
+		void work();
+};
+
+#endif // FRAMEWRITER_HPP
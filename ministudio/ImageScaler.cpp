@@ -0,0 +1,322 @@
+#include "ImageScaler.hpp"
+
+#include <QAtomicInt>
+#include <QDebug>
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCALER_X86
+#include <immintrin.h>
+#define SCALER_TARGET(T) __attribute__((target(T)))
+#endif
+
+namespace
+{
+	QAtomicInt sPath(-1);
+
+	ImageScaler::Path bestPath()
+	{
+#ifdef SCALER_X86
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2")) {
+			return ImageScaler::AVX2;
+		}
+		if(__builtin_cpu_supports("sse2")) {
+			return ImageScaler::SSE2;
+		}
+#endif
+		return ImageScaler::Scalar;
+	}
+
+	inline quint32 average(quint32 a, quint32 b)
+	{
+		// Per byte (a+b+1)>>1, without carries crossing into the next byte
+		return (a|b)-(((a^b)>>1)&0x7f7f7f7f);
+	}
+
+	inline quint32 mix(quint32 a, quint32 b, int weight)
+	{
+		quint32 out=0;
+		for(int shift=0; shift<32; shift+=8) {
+			const quint32 ca=(a>>shift)&0xff;
+			const quint32 cb=(b>>shift)&0xff;
+			out|=((ca*(256-weight)+cb*weight+128)>>8)<<shift;
+		}
+		return out;
+	}
+
+	void halveRowScalar(quint32 *dst, const quint32 *row0, const quint32 *row1, int count)
+	{
+		for(int i=0; i<count; ++i) {
+			dst[i]=average(average(row0[i*2], row1[i*2]), average(row0[i*2+1], row1[i*2+1]));
+		}
+	}
+
+	void mixRowsScalar(quint32 *dst, const quint32 *row0, const quint32 *row1, int count, int weight)
+	{
+		for(int i=0; i<count; ++i) {
+			dst[i]=mix(row0[i], row1[i], weight);
+		}
+	}
+
+	void sampleRowScalar(quint32 *dst, const quint32 *src, const int *x, const int *fx, int count)
+	{
+		for(int i=0; i<count; ++i) {
+			dst[i]=mix(src[x[i]], src[x[i]+1], fx[i]);
+		}
+	}
+
+#ifdef SCALER_X86
+	SCALER_TARGET("sse2") void halveRowSSE2(quint32 *dst, const quint32 *row0, const quint32 *row1, int count)
+	{
+		int i=0;
+		for(; i+4<=count; i+=4) {
+			const __m128i a=_mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row0+i*2)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1+i*2)));
+			const __m128i b=_mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row0+i*2+4)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1+i*2+4)));
+			// Even and odd pixels side by side, then averaged
+			const __m128 fa=_mm_castsi128_ps(a);
+			const __m128 fb=_mm_castsi128_ps(b);
+			const __m128i even=_mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+			const __m128i odd=_mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i), _mm_avg_epu8(even, odd));
+		}
+		halveRowScalar(dst+i, row0+i*2, row1+i*2, count-i);
+	}
+
+	SCALER_TARGET("sse2") inline __m128i mix4(__m128i a, __m128i b, __m128i wa, __m128i wb)
+	{
+		const __m128i zero=_mm_setzero_si128();
+		const __m128i round=_mm_set1_epi16(128);
+		// Both weighted channels sum to at most 255*256, which fits 16 bits unsigned
+		__m128i lo=_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), wa), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), wb));
+		__m128i hi=_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), wa), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), wb));
+		lo=_mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+		hi=_mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+		return _mm_packus_epi16(lo, hi);
+	}
+
+	SCALER_TARGET("sse2") void mixRowsSSE2(quint32 *dst, const quint32 *row0, const quint32 *row1, int count, int weight)
+	{
+		const __m128i wa=_mm_set1_epi16(static_cast<short>(256-weight));
+		const __m128i wb=_mm_set1_epi16(static_cast<short>(weight));
+		int i=0;
+		for(; i+4<=count; i+=4) {
+			const __m128i a=_mm_loadu_si128(reinterpret_cast<const __m128i *>(row0+i));
+			const __m128i b=_mm_loadu_si128(reinterpret_cast<const __m128i *>(row1+i));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i), mix4(a, b, wa, wb));
+		}
+		mixRowsScalar(dst+i, row0+i, row1+i, count-i, weight);
+	}
+
+	SCALER_TARGET("sse2") void sampleRowSSE2(quint32 *dst, const quint32 *src, const int *x, const int *fx, int count)
+	{
+		int i=0;
+		for(; i+2<=count; i+=2) {
+			// Left neighbours of two output pixels in a, right ones in b, weights per pixel
+			qint64 p0;
+			qint64 p1;
+			memcpy(&p0, src+x[i], 8);
+			memcpy(&p1, src+x[i+1], 8);
+			const __m128i pairs=_mm_set_epi64x(p1, p0);
+			const __m128i a=_mm_shuffle_epi32(pairs, _MM_SHUFFLE(2, 0, 2, 0));
+			const __m128i b=_mm_shuffle_epi32(pairs, _MM_SHUFFLE(3, 1, 3, 1));
+			const short w0=static_cast<short>(fx[i]);
+			const short w1=static_cast<short>(fx[i+1]);
+			const __m128i wb=_mm_set_epi16(w1, w1, w1, w1, w0, w0, w0, w0);
+			const __m128i wa=_mm_sub_epi16(_mm_set1_epi16(256), wb);
+			_mm_storel_epi64(reinterpret_cast<__m128i *>(dst+i), mix4(a, b, wa, wb));
+		}
+		sampleRowScalar(dst+i, src, x+i, fx+i, count-i);
+	}
+
+	SCALER_TARGET("avx2") void halveRowAVX2(quint32 *dst, const quint32 *row0, const quint32 *row1, int count)
+	{
+		int i=0;
+		for(; i+8<=count; i+=8) {
+			const __m256i a=_mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(row0+i*2)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row1+i*2)));
+			const __m256i b=_mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(row0+i*2+8)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row1+i*2+8)));
+			const __m256 fa=_mm256_castsi256_ps(a);
+			const __m256 fb=_mm256_castsi256_ps(b);
+			const __m256i even=_mm256_castps_si256(_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+			const __m256i odd=_mm256_castps_si256(_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+			// The shuffles work per 128 bit lane, which leaves the 64 bit quarters in the order 0 2 1 3
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst+i), _mm256_permute4x64_epi64(_mm256_avg_epu8(even, odd), _MM_SHUFFLE(3, 1, 2, 0)));
+		}
+		halveRowSSE2(dst+i, row0+i*2, row1+i*2, count-i);
+	}
+
+	SCALER_TARGET("avx2") void mixRowsAVX2(quint32 *dst, const quint32 *row0, const quint32 *row1, int count, int weight)
+	{
+		const __m256i zero=_mm256_setzero_si256();
+		const __m256i round=_mm256_set1_epi16(128);
+		const __m256i wa=_mm256_set1_epi16(static_cast<short>(256-weight));
+		const __m256i wb=_mm256_set1_epi16(static_cast<short>(weight));
+		int i=0;
+		for(; i+8<=count; i+=8) {
+			const __m256i a=_mm256_loadu_si256(reinterpret_cast<const __m256i *>(row0+i));
+			const __m256i b=_mm256_loadu_si256(reinterpret_cast<const __m256i *>(row1+i));
+			__m256i lo=_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), wa), _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), wb));
+			__m256i hi=_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), wa), _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), wb));
+			lo=_mm256_srli_epi16(_mm256_add_epi16(lo, round), 8);
+			hi=_mm256_srli_epi16(_mm256_add_epi16(hi, round), 8);
+			// Unpacking and packing within each lane undo each other, so pixels stay in order
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst+i), _mm256_packus_epi16(lo, hi));
+		}
+		mixRowsSSE2(dst+i, row0+i, row1+i, count-i, weight);
+	}
+#endif
+}
+
+
+ImageScaler::ImageScaler()
+{
+}
+
+ImageScaler::~ImageScaler()
+{
+}
+
+
+bool ImageScaler::scale(const QImage &src, QImage &dst)
+{
+	if(src.isNull() || dst.isNull() || src.format()!=dst.format() || 32!=src.depth()) {
+		qWarning()<<"ERROR: Can only scale between 32 bit images of the same format";
+		return false;
+	}
+	if(dst.width()>src.width() || dst.height()>src.height()) {
+		qWarning()<<"ERROR: ImageScaler only scales down";
+		return false;
+	}
+	// Halve while that keeps at least the target size. Levels are sized up front, growing them later would move the one being read
+	int levels=0;
+	for(int w=src.width(), h=src.height(); w>=dst.width()*2 && h>=dst.height()*2; w/=2, h/=2) {
+		levels++;
+	}
+	if(mLevels.size()<levels) {
+		mLevels.resize(levels);
+	}
+	const QImage *from=&src;
+	for(int level=0; level<levels; ++level) {
+		QImage &half=mLevels[level];
+		const QSize size(from->width()/2, from->height()/2);
+		if(half.size()!=size || half.format()!=src.format()) {
+			half=QImage(size, src.format());
+		}
+		for(int y=0; y<size.height(); ++y) {
+			halveRow(reinterpret_cast<quint32 *>(half.scanLine(y)), reinterpret_cast<const quint32 *>(from->constScanLine(y*2)), reinterpret_cast<const quint32 *>(from->constScanLine(y*2+1)), size.width());
+		}
+		from=&half;
+	}
+	const int w=dst.width();
+	if(from->size()==dst.size()) {
+		for(int y=0; y<dst.height(); ++y) {
+			memcpy(dst.scanLine(y), from->constScanLine(y), static_cast<size_t>(w)*4);
+		}
+		return true;
+	}
+	// Bilinear for the rest, rows mixed first, then sampled across
+	prepare(from->size(), dst.size());
+	quint32 *row=mRow.data();
+	const int fw=from->width();
+	for(int y=0; y<dst.height(); ++y) {
+		const quint32 *row0=reinterpret_cast<const quint32 *>(from->constScanLine(mY[y]));
+		const quint32 *row1=reinterpret_cast<const quint32 *>(from->constScanLine(qMin(mY[y]+1, from->height()-1)));
+		mixRows(row, row0, row1, fw, mFy[y]);
+		// Samples at the right edge read one past the row, which repeats the last pixel
+		row[fw]=row[fw-1];
+		sampleRow(reinterpret_cast<quint32 *>(dst.scanLine(y)), row, mX.constData(), mFx.constData(), w);
+	}
+	return true;
+}
+
+
+void ImageScaler::prepare(const QSize &from, const QSize &to)
+{
+	if(from==mFrom && to==mTo) {
+		return;
+	}
+	mFrom=from;
+	mTo=to;
+	// Pixel centres line up, positions outside the source clamp to its edge
+	auto axis=[](int src, int dst, QVector<int> &pos, QVector<int> &weight) {
+		pos.resize(dst);
+		weight.resize(dst);
+		const qreal step=qreal(src)/dst;
+		for(int i=0; i<dst; ++i) {
+			const qreal s=qBound<qreal>(0.0, (i+0.5)*step-0.5, src-1);
+			const int p=static_cast<int>(s);
+			pos[i]=p;
+			weight[i]=static_cast<int>((s-p)*256.0+0.5);
+		}
+	};
+	axis(from.width(), to.width(), mX, mFx);
+	axis(from.height(), to.height(), mY, mFy);
+	mRow.resize(from.width()+1);
+}
+
+
+ImageScaler::Path ImageScaler::path()
+{
+	int p=sPath.load();
+	if(p<0) {
+		p=bestPath();
+		sPath.testAndSetOrdered(-1, p);
+		qDebug()<<"IMAGE SCALER: using"<<pathName();
+	}
+	return static_cast<Path>(sPath.load());
+}
+
+
+QString ImageScaler::pathName()
+{
+	switch(path()) {
+		case AVX2: return "avx2";
+		case SSE2: return "sse2";
+		default: return "scalar";
+	}
+}
+
+
+void ImageScaler::setPath(Path p)
+{
+	const Path best=bestPath();
+	sPath.store((p<=best)?p:Scalar);
+}
+
+
+void ImageScaler::halveRow(quint32 *dst, const quint32 *row0, const quint32 *row1, int count)
+{
+	switch(path()) {
+#ifdef SCALER_X86
+		case AVX2: halveRowAVX2(dst, row0, row1, count); break;
+		case SSE2: halveRowSSE2(dst, row0, row1, count); break;
+#endif
+		default: halveRowScalar(dst, row0, row1, count); break;
+	}
+}
+
+
+void ImageScaler::mixRows(quint32 *dst, const quint32 *row0, const quint32 *row1, int count, int weight)
+{
+	switch(path()) {
+#ifdef SCALER_X86
+		case AVX2: mixRowsAVX2(dst, row0, row1, count, weight); break;
+		case SSE2: mixRowsSSE2(dst, row0, row1, count, weight); break;
+#endif
+		default: mixRowsScalar(dst, row0, row1, count, weight); break;
+	}
+}
+
+
+void ImageScaler::sampleRow(quint32 *dst, const quint32 *src, const int *x, const int *fx, int count)
+{
+	switch(path()) {
+#ifdef SCALER_X86
+		// Gathering two pixels per output doesn't get faster with wider vectors
+		case AVX2:
+		case SSE2: sampleRowSSE2(dst, src, x, fx, count); break;
+#endif
+		default: sampleRowScalar(dst, src, x, fx, count); break;
+	}
+}
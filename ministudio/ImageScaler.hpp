@@ -0,0 +1,68 @@
+#ifndef IMAGESCALER_HPP
+#define IMAGESCALER_HPP
+
+#include <QImage>
+#include <QVector>
+#include <QSize>
+
+/*
+  Fast downscaling of premultiplied (or opaque RGB32) images.
+
+  The source is halved with a 2x2 box filter for as long as it stays at
+  least twice the target size, which averages every source pixel like an
+  area filter would. What is left is scaled bilinearly, by less than two,
+  to the exact target size.
+
+  Both stages have scalar, SSE2 and AVX2 row kernels, picked at runtime
+  like BlendEngine. They all use the same integer maths and give identical
+  results. Averages round up, like pavgb.
+
+  An instance keeps the intermediate images and the bilinear coefficients
+  between calls, so scaling a stream of frames of the same size allocates
+  nothing. Use one instance per thread.
+*/
+class ImageScaler
+{
+	public:
+		enum Path {
+			Scalar
+			, SSE2
+			, AVX2
+		};
+
+	private:
+		QVector<QImage> mLevels;
+		QSize mFrom;
+		QSize mTo;
+		QVector<int> mX;
+		QVector<int> mFx;
+		QVector<int> mY;
+		QVector<int> mFy;
+		QVector<quint32> mRow;
+
+	public:
+		explicit ImageScaler();
+		virtual ~ImageScaler();
+
+	public:
+		// Scale src into dst, at dst's size which must be no larger than src's. Both must have the same 32 bit format
+		bool scale(const QImage &src, QImage &dst);
+
+		static Path path();
+		static QString pathName();
+		// Force a specific kernel, for comparing them. Falls back to scalar if the CPU lacks support
+		static void setPath(Path path);
+
+	public:
+		// count pixels, each the average of two pixels from each of row0 and row1
+		static void halveRow(quint32 *dst, const quint32 *row0, const quint32 *row1, int count);
+		// count pixels of row0 and row1 mixed, weight 0..256 being how much of row1
+		static void mixRows(quint32 *dst, const quint32 *row0, const quint32 *row1, int count, int weight);
+		// count pixels sampled from src, pixel i between src[x[i]] and src[x[i]+1] by weight fx[i]
+		static void sampleRow(quint32 *dst, const quint32 *src, const int *x, const int *fx, int count);
+
+	private:
+		void prepare(const QSize &from, const QSize &to);
+};
+
+#endif // IMAGESCALER_HPP
@@ -0,0 +1,80 @@
+#include "LatencyMeter.hpp"
+
+#include <limits>
+
+
+LatencyMeter::LatencyMeter()
+	: mCount(0)
+	, mSum(0)
+	, mMin(std::numeric_limits<qint64>::max())
+	, mMax(std::numeric_limits<qint64>::min())
+	, mLast(0)
+{
+
+}
+
+LatencyMeter::~LatencyMeter()
+{
+
+}
+
+
+void LatencyMeter::add(qint64 ns)
+{
+	for(qint64 min=mMin.load(); ns<min && !mMin.testAndSetRelaxed(min, ns); min=mMin.load()) {
+	}
+	for(qint64 max=mMax.load(); ns>max && !mMax.testAndSetRelaxed(max, ns); max=mMax.load()) {
+	}
+	mSum.fetchAndAddRelaxed(ns);
+	mLast.store(ns);
+	// Counted last, so a sample that shows in the count is in the sum too
+	mCount.fetchAndAddRelease(1);
+}
+
+
+void LatencyMeter::reset()
+{
+	mCount.store(0);
+	mSum.store(0);
+	mMin.store(std::numeric_limits<qint64>::max());
+	mMax.store(std::numeric_limits<qint64>::min());
+	mLast.store(0);
+}
+
+
+quint64 LatencyMeter::count()
+{
+	return mCount.load();
+}
+
+
+qreal LatencyMeter::mean()
+{
+	const quint64 count=mCount.loadAcquire();
+	return (count>0)?(mSum.load()/1e6/count):0.0;
+}
+
+
+qreal LatencyMeter::min()
+{
+	return (mCount.loadAcquire()>0)?(mMin.load()/1e6):0.0;
+}
+
+
+qreal LatencyMeter::max()
+{
+	return (mCount.loadAcquire()>0)?(mMax.load()/1e6):0.0;
+}
+
+
+qreal LatencyMeter::last()
+{
+	return mLast.load()/1e6;
+}
+
+
+QString LatencyMeter::stats()
+{
+	return QString("n=%1 mean=%2ms min=%3ms max=%4ms last=%5ms").arg(count())
+		   .arg(mean(), 0, 'f', 2).arg(min(), 0, 'f', 2).arg(max(), 0, 'f', 2).arg(last(), 0, 'f', 2);
+}
@@ -0,0 +1,39 @@
+#ifndef LATENCYMETER_HPP
+#define LATENCYMETER_HPP
+
+#include <QAtomicInteger>
+#include <QString>
+
+/*
+  Running statistics over latencies in nanoseconds, such as the time from
+  a frame's capture to it being shown or written. Thread safe and lock
+  free, so real time threads like the audio capture can feed it. A reader
+  may see a sample in some of the figures and not yet in the others.
+*/
+class LatencyMeter
+{
+	private:
+		QAtomicInteger<quint64> mCount;
+		QAtomicInteger<qint64> mSum;
+		QAtomicInteger<qint64> mMin;
+		QAtomicInteger<qint64> mMax;
+		QAtomicInteger<qint64> mLast;
+
+	public:
+		explicit LatencyMeter();
+		virtual ~LatencyMeter();
+
+	public:
+		void add(qint64 ns);
+		void reset();
+
+		quint64 count();
+		// In milliseconds
+		qreal mean();
+		qreal min();
+		qreal max();
+		qreal last();
+		QString stats();
+};
+
+#endif // LATENCYMETER_HPP
@@ -1,13 +1,16 @@
 #include "Layer.hpp"
 #include "FrameScene.hpp"
+#include "BlendEngine.hpp"
+#include "FormatNegotiator.hpp"
 
 
 
 
-Layer::Layer(QString name, qreal opacity, QTransform transform)
+Layer::Layer(QString name, qreal opacity, QTransform transform, bool retained)
 	: mName(name)
 	, mOpacity(opacity)
 	, mTransform(transform)
+	, mRetained(retained)
 {
 
 }
@@ -30,11 +33,22 @@ QTransform &Layer::transform(){
 	return mTransform;
 }
 
+bool Layer::retained(){
+	return mRetained;
+}
+
+bool Layer::blend(FrameScene &fs, QImage &dst, const QPoint &origin){
+	(void)fs;
+	(void)dst;
+	(void)origin;
+	return false;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
-ImageLayer::ImageLayer(QSharedPointer<QImage> image, qreal opacity, QTransform transform)
-	: Layer("Image", opacity, transform)
+ImageLayer::ImageLayer(QSharedPointer<QImage> image, qreal opacity, QTransform transform, bool retained)
+	: Layer(QStringLiteral("Image"), opacity, transform, retained)
 	, mImage(image)
 {
 
@@ -46,8 +60,10 @@ ImageLayer::~ImageLayer(){
 
 void ImageLayer::render(FrameScene &fs, QPainter &p)
 {
-	(void)fs;
 	if(!mImage.isNull()){
+		if(!FormatNegotiator::globalInstance()->accepts(FormatNegotiator::CompositorStage, mImage->format())){
+			fs.noteImplicitConversion(mImage->format());
+		}
 		p.setOpacity(mOpacity);
 		p.drawImage(QPointF(0,0),*mImage);
 	}
@@ -56,12 +72,33 @@ void ImageLayer::render(FrameScene &fs, QPainter &p)
 	}
 }
 
+bool ImageLayer::blend(FrameScene &fs, QImage &dst, const QPoint &origin)
+{
+	(void)fs;
+	if(mImage.isNull()){
+		return false;
+	}
+	return BlendEngine::blend(dst, *mImage, mTransform*QTransform::fromTranslate(-origin.x(), -origin.y()), mOpacity);
+}
+
+QString ImageLayer::cacheKey()
+{
+	// QImage::cacheKey() changes whenever the pixels are modified
+	return QString("image:%1").arg(mImage.isNull()?0:mImage->cacheKey());
+}
+
+QRect ImageLayer::bounds(FrameScene &fs)
+{
+	(void)fs;
+	return mImage.isNull()?QRect():mImage->rect();
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
 TitleLayer::TitleLayer(QString title, QString subTitle, qreal opacity, QTransform transform)
-	: Layer("Title", opacity, transform)
+	: Layer(QStringLiteral("Title"), opacity, transform, true)
 	, mTitle(title)
 	, mSubTitle(subTitle)
 {
@@ -95,3 +132,19 @@ void TitleLayer::render(FrameScene &fs, QPainter &p)
 	p.setFont(font);
 	p.drawText(hh,sz.height()-h*2+hh*0.85, mSubTitle);
 }
+
+QString TitleLayer::cacheKey()
+{
+	// One pass of arg(), so placeholders in the text stay as they are. The length keeps title and subtitle apart whatever they contain
+	return QString("title:%1:%2%3").arg(QString::number(mTitle.size()), mTitle, mSubTitle);
+}
+
+QRect TitleLayer::bounds(FrameScene &fs)
+{
+	const QSize &sz=fs.resolution();
+	const quint32 h=sz.height()/10;
+	const quint32 w=(sz.width()*8)/10;
+	const quint32 hh=h*1.5;
+	const quint32 shadowOffset=h/7;
+	return QRect(0,sz.height()-h*2,w+shadowOffset,hh+shadowOffset);
+}
@@ -15,9 +15,10 @@ class Layer{
 		QString mName;
 		qreal mOpacity;
 		QTransform mTransform;
+		bool mRetained;
 	public:
 
-		explicit Layer(QString name, qreal opacity=1.0, QTransform transform=QTransform());
+		explicit Layer(QString name, qreal opacity=1.0, QTransform transform=QTransform(), bool retained=false);
 		virtual ~Layer();
 
 	public:
@@ -25,8 +26,16 @@ class Layer{
 		QString name();
 		qreal opacity();
 		QTransform &transform();
+		// Retained layers are pre-rendered once into a LayerCache tile and blitted from there
+		bool retained();
 
 		virtual void render(FrameScene &fs, QPainter &p) = 0;
+		// Composite straight into dst, which sits at origin in the frame, without a QPainter. Returns false if the layer can't, so render() is used instead
+		virtual bool blend(FrameScene &fs, QImage &dst, const QPoint &origin);
+		// Identifies the content of the layer, excluding opacity and transform
+		virtual QString cacheKey() = 0;
+		// The untransformed area touched by render()
+		virtual QRect bounds(FrameScene &fs) = 0;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -35,11 +44,14 @@ class ImageLayer: public Layer{
 	private:
 		QSharedPointer<QImage> mImage;
 	public:
-		explicit ImageLayer(QSharedPointer<QImage> image, qreal opacity=1.0, QTransform transform=QTransform());
+		explicit ImageLayer(QSharedPointer<QImage> image=QSharedPointer<QImage>(), qreal opacity=1.0, QTransform transform=QTransform(), bool retained=false);
 
 		virtual ~ImageLayer();
 
 		void render(FrameScene &fs, QPainter &p) override;
+		bool blend(FrameScene &fs, QImage &dst, const QPoint &origin) override;
+		QString cacheKey() override;
+		QRect bounds(FrameScene &fs) override;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -50,11 +62,13 @@ class TitleLayer: public Layer{
 		QString  mSubTitle;
 
 	public:
-		explicit TitleLayer(QString title, QString subTitle, qreal opacity=1.0, QTransform transform=QTransform());
+		explicit TitleLayer(QString title=QString(), QString subTitle=QString(), qreal opacity=1.0, QTransform transform=QTransform());
 
 		virtual ~TitleLayer();
 	public:
 		void render(FrameScene &fs, QPainter &p) override;
+		QString cacheKey() override;
+		QRect bounds(FrameScene &fs) override;
 };
 
 
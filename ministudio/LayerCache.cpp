@@ -0,0 +1,133 @@
+#include "LayerCache.hpp"
+
+#include "Layer.hpp"
+#include "FrameScene.hpp"
+#include "BlendEngine.hpp"
+
+#include <QPainter>
+#include <QMutexLocker>
+#include <QDebug>
+
+
+LayerCache::LayerCache(int maxTiles)
+	: mMaxTiles(qMax(1, maxTiles))
+	, mTick(0)
+	, mHits(0)
+	, mMisses(0)
+{
+
+}
+
+LayerCache::~LayerCache()
+{
+	clear();
+}
+
+
+bool LayerCache::lookup(const QString &key, Tile &tile)
+{
+	QMutexLocker lock(&mMutex);
+	auto it=mTiles.find(key);
+	if(mTiles.end()==it) {
+		return false;
+	}
+	it.value().lastUsed=++mTick;
+	tile=it.value();
+	return true;
+}
+
+
+void LayerCache::insert(const QString &key, const Tile &tile)
+{
+	QMutexLocker lock(&mMutex);
+	if(!mTiles.contains(key) && mTiles.size()>=mMaxTiles) {
+		// Evict the least recently used tile, typically a step of a fade that is long over
+		auto oldest=mTiles.begin();
+		for(auto it=mTiles.begin(), e=mTiles.end(); it!=e; ++it) {
+			if(it.value().lastUsed<oldest.value().lastUsed) {
+				oldest=it;
+			}
+		}
+		mTiles.erase(oldest);
+	}
+	Tile stored=tile;
+	stored.lastUsed=++mTick;
+	mTiles.insert(key, stored);
+}
+
+
+void LayerCache::render(FrameScene &fs, Layer &layer, QImage &dst, QPainter &p, const QPoint &origin)
+{
+	const QTransform &t=layer.transform();
+	const QTransform shift=QTransform::fromTranslate(-origin.x(), -origin.y());
+	if(!t.isAffine()) {
+		p.setTransform(t*shift, false);
+		layer.render(fs, p);
+		p.setTransform(shift, false);
+		return;
+	}
+	// Translation is applied when blitting, everything else is baked into the tile
+	const QTransform linear(t.m11(), t.m12(), t.m21(), t.m22(), 0.0, 0.0);
+	const QRect bounds=layer.bounds(fs);
+	// The content key is appended, not passed to arg(), so a % in it can't be taken for a placeholder
+	const QString key=QString("%1|%2,%3,%4,%5|%6,%7,%8,%9|")
+					  .arg(layer.opacity())
+					  .arg(t.m11()).arg(t.m12()).arg(t.m21()).arg(t.m22())
+					  .arg(bounds.x()).arg(bounds.y()).arg(bounds.width()).arg(bounds.height())
+					  +layer.cacheKey();
+	Tile tile;
+	if(lookup(key, tile)) {
+		mHits.fetchAndAddRelaxed(1);
+	} else {
+		mMisses.fetchAndAddRelaxed(1);
+		const QRect deviceRect=linear.mapRect(bounds);
+		tile.offset=deviceRect.topLeft();
+		tile.image=QImage(deviceRect.size(), QImage::Format_ARGB32_Premultiplied);
+		tile.image.fill(Qt::transparent);
+		if(!deviceRect.isEmpty()) {
+			QPainter tp(&tile.image);
+			tp.translate(-deviceRect.x(), -deviceRect.y());
+			tp.setTransform(linear, true);
+			layer.render(fs, tp);
+		}
+		insert(key, tile);
+	}
+	p.setTransform(shift, false);
+	const QPoint pos=QPoint(qRound(t.dx()), qRound(t.dy()))+tile.offset;
+	if(!BlendEngine::blend(dst, tile.image, QTransform::fromTranslate(pos.x()-origin.x(), pos.y()-origin.y()), 1.0)) {
+		p.setOpacity(1.0);
+		p.drawImage(pos, tile.image);
+	}
+}
+
+
+void LayerCache::clear()
+{
+	QMutexLocker lock(&mMutex);
+	mTiles.clear();
+}
+
+
+quint64 LayerCache::hits()
+{
+	return mHits.load();
+}
+
+
+quint64 LayerCache::misses()
+{
+	return mMisses.load();
+}
+
+
+QString LayerCache::stats()
+{
+	return QString("hits=%1 misses=%2").arg(hits()).arg(misses());
+}
+
+
+LayerCache *LayerCache::globalInstance()
+{
+	static LayerCache *cache=new LayerCache();
+	return cache;
+}
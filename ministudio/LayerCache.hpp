@@ -0,0 +1,62 @@
+#ifndef LAYERCACHE_HPP
+#define LAYERCACHE_HPP
+
+#include <QImage>
+#include <QPoint>
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInteger>
+
+class FrameScene;
+class Layer;
+class QPainter;
+
+/*
+  Retained mode cache for static overlay layers (logo, title).
+
+  A layer is pre-rendered once into a premultiplied tile with its opacity and
+  the linear part of its transform baked in. Following frames with the same
+  content, opacity and transform just blit the tile at the (rounded)
+  translation, so a sliding title still hits the cache.
+
+  Thread safe, FrameScenes on different pool threads share one cache.
+*/
+class LayerCache
+{
+	private:
+		struct Tile {
+			QImage image;
+			QPoint offset;
+			quint64 lastUsed;
+		};
+
+		QMutex mMutex;
+		QHash<QString, Tile> mTiles;
+		int mMaxTiles;
+		quint64 mTick;
+		QAtomicInteger<quint64> mHits;
+		QAtomicInteger<quint64> mMisses;
+
+	public:
+		explicit LayerCache(int maxTiles=16);
+		virtual ~LayerCache();
+
+	public:
+		// Render the layer through the cache into dst, which p paints on and which sits at origin in the frame.
+		// The painter transform is left at the plain origin offset
+		void render(FrameScene &fs, Layer &layer, QImage &dst, QPainter &p, const QPoint &origin=QPoint());
+		void clear();
+
+		quint64 hits();
+		quint64 misses();
+		QString stats();
+
+	public:
+		static LayerCache *globalInstance();
+
+	private:
+		bool lookup(const QString &key, Tile &tile);
+		void insert(const QString &key, const Tile &tile);
+};
+
+#endif // LAYERCACHE_HPP
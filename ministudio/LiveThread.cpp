@@ -1,7 +1,25 @@
 #include "LiveThread.hpp"
 
 #include "FrameScene.hpp"
-#include "CameraGrabber.hpp"
+#include "CameraSource.hpp"
+#include "CameraMailbox.hpp"
+#include "ScreenGrabber.hpp"
+#include "FrameBufferPool.hpp"
+#include "RenderQueue.hpp"
+#include "LayerCache.hpp"
+#include "FormatNegotiator.hpp"
+#include "EncoderSink.hpp"
+#include "PngSink.hpp"
+#include "QoiSink.hpp"
+#include "RawSink.hpp"
+#include "TileSink.hpp"
+#include "FrameWriter.hpp"
+#include "PrerollRing.hpp"
+#include "SegmentedSink.hpp"
+#include "RecordingFinalizer.hpp"
+#include "FrameClock.hpp"
+#include "AudioCapture.hpp"
+#include "AudioWriter.hpp"
 
 #include <QScreen>
 #include <QGuiApplication>
@@ -11,10 +29,14 @@
 #include <QDir>
 #include <QDateTime>
 #include <QDebug>
-#include <QCamera>
-#include <QCameraInfo>
+#include <QMutexLocker>
 #include <QEasingCurve>
 
+// The camera picture in picture at a PIP size of 1.0, as a fraction of its resolution
+static const qreal PIP_SCALE=0.4;
+// How often per camera frame rates and drops are logged while live
+static const qint64 CAMERA_STATS_INTERVAL=10000000000LL;
+
 
 LiveThread::LiveThread()
 	: mFrameNumber(0)
@@ -22,62 +44,148 @@ LiveThread::LiveThread()
 	, mLastTime(0)
 	, lastCompletedFrame(0)
 	, mIsSaving(false)
-	, mCamera(nullptr)
-	, mCameraGrabber(nullptr)
+	, mScreenGrabberType("xshm")
+	, mRenderBands(1)
+	, mRecordingFormat("png")
+	, mEncoderCodec("libx264")
+	, mEncoderBitrate(8000)
+	, mEncoderPreset("ultrafast")
+	, mQoiLevel(1)
+	, mTileSize(64)
+	, mTileKeyframeInterval(300)
+	, mWriterThreads(2)
+	, mWriterQueue(16)
+	, mWriter(nullptr)
+	, mPrerollSeconds(0.0)
+	, mPrerollMegabytes(256)
+	, mPreroll(nullptr)
+	, mSegmentSeconds(0.0)
+	, mSegmentMegabytes(0)
+	, mJournalInterval(0)
+	, mAudio(nullptr)
+	, mAudioWriter(nullptr)
+	, mFrameRate(15.0)
+	, mCamerasChanged(false)
+	, mCameraEnabled(false)
+	, mRenderQueue(new RenderQueue(nullptr, this))
+	, mReorder(1)
+	, mReorderTimer(this)
 	, mLastCameraOpacity(1.0)
 	, mMagLevel(1.0)
 	, mPIPSize(1.0)
 	, mScreenSwitch()
 	, mMagSwitch(QEasingCurve::OutBack, QEasingCurve::OutQuad, 100.0, 500.0)
-	, mCameraSwitch()
 	, mTitleSwitch(QEasingCurve::OutBounce, QEasingCurve::OutCubic)
 	, mLogoSwitch()
 	, mHold(false)
 {
 	init();
+	if(!connect(mRenderQueue, &RenderQueue::frameDropped, this, &LiveThread::onFrameDropped, Qt::QueuedConnection)) {
+		qWarning()<<"ERROR: Could not connect frame dropped";
+	}
+	// Flushes frames stuck behind a frame that never finished once no more frames arrive
+	if(!connect(&mReorderTimer, &QTimer::timeout, this, &LiveThread::onReorderTimer)) {
+		qWarning()<<"ERROR: Could not connect reorder timer";
+	}
+	mReorderTimer.setTimerType(Qt::CoarseTimer);
+	mReorderTimer.start(50);
 }
 
 LiveThread::~LiveThread()
 {
-
-	delete mCameraGrabber;
-	delete mCamera;
+	qDebug()<<"Reorder buffer: "<<mReorder.stats();
+	closeWriter();
+	delete mPreroll;
+	mPreroll=nullptr;
+	delete mAudio;
+	mAudio=nullptr;
+
+	QMutexLocker lock(&mCamerasMutex);
+	qDeleteAll(mCameras);
+	mCameras.clear();
 }
 
 void LiveThread::init()
 {
 	qDebug()<<"LIVE INIT";
-	mCamera=new QCamera(QCameraInfo::defaultCamera());
-	if(!connect(mCamera, SIGNAL(error(QCamera::Error)), this, SLOT(onCameraError(QCamera::Error)))) {
-		qWarning()<<"ERROR: Could not connect camera error ";
-	}
+	// Cameras are opened by setCameras()
+}
+
 
-	if(!connect(mCamera, SIGNAL(stateChanged(QCamera::State)), this, SLOT(onCameraStateChanged(QCamera::State)))) {
-		qWarning()<<"ERROR: Could not connect camera state change ";
+void LiveThread::setCameras(QStringList devices, QList<CameraList::Device> available)
+{
+	if(!isRunning()) {
+		openCameras(devices, available);
+		return;
 	}
-	mCameraGrabber=new CameraGrabber();
-	if(!connect(mCameraGrabber, &CameraGrabber::frameAvailable, this, &LiveThread::onCameraFrameReady )) {
-		qWarning()<<"ERROR: Could not connect camera grabber";
+	QMutexLocker lock(&mCamerasMutex);
+	mPendingCameras=devices;
+	mPendingAvailable=available;
+	mCamerasChanged=true;
+}
+
+
+void LiveThread::applyCameras()
+{
+	QStringList devices;
+	QList<CameraList::Device> available;
+	{
+		QMutexLocker lock(&mCamerasMutex);
+		if(!mCamerasChanged) {
+			return;
+		}
+		mCamerasChanged=false;
+		devices=mPendingCameras;
+		available=mPendingAvailable;
 	}
-	mCamera->setViewfinder(mCameraGrabber);
+	openCameras(devices, available);
+}
 
-	QCameraViewfinderSettings viewfinderSettings;
-	//viewfinderSettings.setResolution(640, 480); 	viewfinderSettings.setMinimumFrameRate(0.0); 	viewfinderSettings.setMaximumFrameRate(30.0);
-	mCamera->setViewfinderSettings(viewfinderSettings);
-	mCamera->setCaptureMode(QCamera::CaptureVideo);
-	mCamera->start();
+
+void LiveThread::openCameras(const QStringList &devices, const QList<CameraList::Device> &available)
+{
+	const QList<CameraList::Device> found=CameraSource::find(devices, available);
+	QList<CameraSource *> old;
+	{
+		QMutexLocker lock(&mCamerasMutex);
+		bool same=(found.size()==mCameras.size());
+		for(int i=0; same && i<found.size(); ++i) {
+			same=(found[i].name==mCameras[i]->deviceName());
+		}
+		if(same && !mCameras.isEmpty()) {
+			// Some other camera came or went, leave the running ones alone
+			return;
+		}
+		old=mCameras;
+		mCameras.clear();
+	}
+	// Stopping waits for each capture thread, so it is done without holding up the slots. Only one thread opens cameras
+	// at a time, the render loop while it runs, so the list stays empty until refilled below
+	qDeleteAll(old);
+	QMutexLocker lock(&mCamerasMutex);
+	for(const CameraList::Device &device:found) {
+		// Frames are picked up from the source's mailbox by the render loop
+		CameraSource *source=new CameraSource(device, RenderPlan::cameraLayerID(mCameras.size()));
+		source->setScale(PIP_SCALE*mPIPSize);
+		source->layerSwitch().setEnabled(mCameraSourceEnabled.value(mCameras.size(), mCameraEnabled));
+		source->start();
+		mCameras<<source;
+	}
+	if(mCameras.isEmpty()) {
+		qWarning()<<"ERROR: No camera found";
+	}
 }
 
 #ifdef Q_OS_WIN
 #include <windows.h> // for Sleep
 #endif
-void qSleep(quint32 ms)
+void qSleep(qint64 ns)
 {
 
 #ifdef Q_OS_WIN
-	Sleep(uint(ms));
+	Sleep(uint(ns / 1000000));
 #else
-	struct timespec ts = { ms / 1000, (ms % 1000) * 1000 * 1000 };
+	struct timespec ts = { time_t(ns / 1000000000), long(ns % 1000000000) };
 	nanosleep(&ts, NULL);
 #endif
 }
@@ -97,50 +205,80 @@ void LiveThread::run()
 	redPaint.fillRect(red->rect(),Qt::red);
 
 
-	QSharedPointer<QImage> logoImage(new QImage("/home/lennart/octomy_tv_logo.png"));
+	FormatNegotiator *formats=FormatNegotiator::globalInstance();
+	QSharedPointer<QImage> logoImage(new QImage(formats->convert(QImage("/home/lennart/octomy_tv_logo.png"), FormatNegotiator::CompositorStage)));
 
 	QTransform logoTrans;
 	logoTrans.translate(0.9*screen->size().width()-logoImage->width(),0.1*screen->size().height());
 
 
+	// Camera frames arrive already scaled to the picture in picture size, see onPIPSizeChange()
 	QTransform pipTrans;
-	pipTrans.scale(0.4,0.4);
-	pipTrans.translate(0.1*screen->size().width(),0.1*screen->size().height());
+	pipTrans.translate(PIP_SCALE*0.1*screen->size().width(), PIP_SCALE*0.1*screen->size().height());
 
-	QSharedPointer<QImage> magFrame(new QImage(QSize(200,200), QImage::Format_ARGB32)) ;
+	QSharedPointer<QImage> magFrame(new QImage(QSize(200,200), QImage::Format_ARGB32_Premultiplied)) ;
 	magFrame->fill(0x00000000);
 	QPainter magPaint(magFrame.data());
 	magPaint.fillRect(magFrame->rect(),Qt::green);
 
-	QPixmap grabPixmap;
+	ScreenGrabber *grabber=ScreenGrabber::create(screen, mScreenGrabberType);
+	QSharedPointer<QImage> screenGrab;
+	const qint64 frameInterval=1000.0/(screen->refreshRate()/4);
+	mRenderQueue->setFrameBudget(frameInterval);
+	mFrameRate=1000.0/qMax<qint64>(1, frameInterval);
+	const qint64 frameIntervalNs=frameInterval*1000000;
+	qint64 lastCameraStats=FrameClock::now();
 	while(!mDone) {
-		const quint64 now=QDateTime::currentMSecsSinceEpoch();
-		const qint64 interval=now-mLastTime;
+		// Only the render loop touches the sources while it runs
+		applyCameras();
+		const qint64 now=FrameClock::now();
+		if(now-lastCameraStats>=CAMERA_STATS_INTERVAL) {
+			lastCameraStats=now;
+			QMutexLocker lock(&mCamerasMutex);
+			for(CameraSource *source:mCameras) {
+				qDebug()<<"Camera "<<source->stats();
+			}
+		}
+		// Animations run in ms
+		const qint64 interval=(now-mLastTime)/1000000;
 		QPoint mousePos = QCursor::pos();
-		if(!mHold) {
-			grabPixmap = screen->grabWindow(0);
+		QRegion screenDamage;
+		if(!mHold || screenGrab.isNull()) {
+			screenGrab = formats->convert(grabber->grab(), FormatNegotiator::CompositorStage);
+			screenDamage = grabber->damage();
 		}
-		if(!grabPixmap.isNull()) {
-			QImage img=grabPixmap.toImage();
-			QImage  *imgCopy=new QImage(img);
-			QSharedPointer<QImage> screenGrab(imgCopy);
-			QString framePath;
-			if(mIsSaving) {
-				mFrameNumber++;
-				framePath=mBasePath+QString("/frame_%1.png").arg(mFrameNumber, 6, 10, QChar('0'));
-				//qDebug()<<"FRAME: "<<framePath;
-			}
-			FrameScene *frame=new FrameScene(mFrameNumber, framePath, screenGrab->size());
-			frame->addImageLayer("screen", screenGrab);
-			if(!mLastCameraFrame.isNull()) {
-				qreal val=mCameraSwitch.update(interval);
-				if(mCameraSwitch.value()>0.0) {
+		const qint64 captured=FrameClock::now();
+		if(!screenGrab.isNull()) {
+			mFrameNumber++;
+			FrameScene *frame=new FrameScene(mFrameNumber, screenGrab->size());
+			frame->setCaptureTime(captured);
+			frame->setBands(mRenderBands);
+			frame->addImageLayer(RenderPlan::ScreenLayerID, screenGrab);
+			// Cameras are stacked down the left side, each below the one before
+			qreal pipTop=0.0;
+			mCamerasMutex.lock();
+			for(CameraSource *source:mCameras) {
+				const CameraMailbox::Frame camera=source->mailbox().take();
+				if(camera.image.isNull()) {
+					continue;
+				}
+				AnimatedSwitch &cameraSwitch=source->layerSwitch();
+				qreal val=cameraSwitch.update(interval);
+				if(cameraSwitch.value()>0.0) {
 					QTransform pip2(pipTrans);
-					pip2.scale(mPIPSize, mPIPSize);
-					QSharedPointer<QImage> camCop(new QImage(*mLastCameraFrame.data()));
-					frame->addImageLayer("camera", camCop, mLastCameraOpacity*val, pip2);
+					// Only frames scaled for an earlier size, or not at all, need scaling here
+					qreal residual=PIP_SCALE*mPIPSize/camera.scale;
+					if(qAbs(residual-1.0)<0.01) {
+						residual=1.0;
+					}
+					pip2.translate(0.0, pipTop);
+					pip2.scale(residual, residual);
+					// Camera frames are never modified once published, so the scene shares the grabber's buffer
+					frame->addImageLayer(source->layerID(), camera.image, mLastCameraOpacity*val, pip2);
+					pipTop+=camera.image->height()*residual+PIP_SCALE*0.1*screen->size().height();
 				}
 			}
+			mCamerasMutex.unlock();
 			{
 				qreal val=mMagSwitch.update(interval);
 				if(mMagSwitch.value()>0.0) {
@@ -157,7 +295,7 @@ void LiveThread::run()
 					magPaint.setOpacity(0.2*val);
 					magPaint.fillRect(magFrame->rect(), Qt::red);
 
-					frame->addImageLayer("magnifier", magFrame, val, magTrans);
+					frame->addImageLayer(RenderPlan::MagnifierLayerID, magFrame, val, magTrans);
 				}
 			}
 			{
@@ -165,27 +303,50 @@ void LiveThread::run()
 				if(mTitleSwitch.value()>0.0) {
 					QTransform titleTrans;
 					titleTrans.translate((-1.0+val)*frame->resolution().width(),0.0);
-					frame->addTitleLayer("title", mCaption, mSubCaption, 1.0, titleTrans);
+					frame->addTitleLayer(RenderPlan::TitleLayerID, mCaption, mSubCaption, 1.0, titleTrans);
 				}
 			}
 			{
 				qreal val=mLogoSwitch.update(interval);
 				if(mLogoSwitch.value()>0.0) {
-					frame->addImageLayer("logo", logoImage, val, logoTrans);
+					frame->addImageLayer(RenderPlan::LogoLayerID, logoImage, val, logoTrans, true);
 				}
 			}
+			// Besides what the grabber saw change, overlays may differ wherever they are now or were in the frame before
+			const QRegion coverage=frame->coverage(RenderPlan::ScreenLayerID);
+			frame->setDamage(screenDamage|coverage|mLastCoverage);
+			mLastCoverage=coverage;
 			connect(frame, &FrameScene::renderComplete, this, &LiveThread::onFrameRenderComplete, (Qt::ConnectionType)(Qt::QueuedConnection | Qt::UniqueConnection));
-			QThreadPool::globalInstance()->start(frame);
+			mRenderQueue->submit(frame);
 		} else {
 			qWarning()<<"ERROR: grab failed";
 		}
 		mLastTime=now;
-		const qint64 left=(1000.0/(screen->refreshRate()/4))-interval;
+		// Sleep what is left of the frame interval after the work done for this frame
+		const qint64 left=frameIntervalNs-FrameClock::since(now);
 		if(left>0) {
 			//	qDebug()<<"SLEEPING "<<left;
 			qSleep(left);
 		}
 	}
+	// Images still in flight keep their own reference to the grabber's buffers
+	screenGrab.clear();
+	mRenderQueue->waitForIdle();
+	delete grabber;
+	qDebug()<<"Frame buffer pool: "<<FrameBufferPool::globalInstance()->stats();
+	qDebug()<<"Render queue: "<<mRenderQueue->stats();
+	qDebug()<<"Layer cache: "<<LayerCache::globalInstance()->stats();
+	qDebug()<<"Pixel formats: "<<formats->stats();
+	qDebug()<<"Capture to render latency: "<<mRenderLatency.stats();
+	qDebug()<<"Capture to preview latency: "<<mPreviewLatency.stats();
+	mCamerasMutex.lock();
+	for(CameraSource *source:mCameras) {
+		qDebug()<<"Camera "<<source->stats();
+	}
+	mCamerasMutex.unlock();
+	if(nullptr!=mAudio) {
+		qDebug()<<"Audio capture: "<<mAudio->stats();
+	}
 	clear();
 }
 
@@ -193,39 +354,144 @@ void LiveThread::run()
 void LiveThread::clear()
 {
 	QScreen *screen = QGuiApplication::primaryScreen();
-	QSharedPointer<QImage> im(new QImage(screen->size(), QImage::Format_ARGB32));
+	QSharedPointer<QImage> im(new QImage(screen->size(), FormatNegotiator::globalInstance()->preferred(FormatNegotiator::PreviewStage)));
 	im->fill(0xff000000);
-	emit frameRendered(lastCompletedFrame+1, im);
+	emit frameRendered(lastCompletedFrame+1, im, FrameClock::now());
+}
+
+void LiveThread::emitFrames(const QList<ReorderBuffer::Frame> &frames)
+{
+	for(const ReorderBuffer::Frame &frame:frames) {
+		if(! mDone) {
+			lastCompletedFrame=frame.id;
+			//qDebug()<<"live:thread complete "<<frame.id;
+			if(frame.captured>0) {
+				mRenderLatency.add(FrameClock::since(frame.captured));
+			}
+			if(mIsSaving) {
+				recordFrame(frame.id, frame.image, frame.captured, frame.damage);
+			} else if(mPrerollSeconds>0.0) {
+				if(nullptr==mPreroll) {
+					mPreroll=new PrerollRing(mPrerollSeconds, qint64(mPrerollMegabytes)*1024*1024, mQoiLevel);
+				}
+				mPreroll->push(frame.id, frame.image, frame.captured);
+			}
+			emit frameRendered(frame.id, frame.image, frame.captured);
+			// The preview is connected directly, so by now the frame has been handed to it
+			if(frame.captured>0) {
+				mPreviewLatency.add(FrameClock::since(frame.captured));
+			}
+		}
+	}
 }
 
-void LiveThread::onFrameRenderComplete(quint64 id, QSharedPointer<QImage> im)
+
+void LiveThread::recordFrame(quint64 id, QSharedPointer<QImage> frame, qint64 captured, const QRegion &damage)
 {
-	if(! mDone && id>=lastCompletedFrame) {
-		lastCompletedFrame=id;
-		//qDebug()<<"live:thread complete "<<id;
-		emit frameRendered(id, im);
+	if(frame.isNull()) {
+		return;
 	}
+	if(nullptr==mWriter) {
+		// Segments are opened by the writer, possibly after this thread is gone, so the factory works on copies
+		const QString format=mRecordingFormat;
+		const QString codec=mEncoderCodec;
+		const int bitrate=mEncoderBitrate;
+		const QString preset=mEncoderPreset;
+		const int qoiLevel=mQoiLevel;
+		const int tileSize=mTileSize;
+		const int keyframeInterval=mTileKeyframeInterval;
+		const bool journaled=(mJournalInterval>0);
+		SegmentedSink::Factory factory=[=]() -> FrameSink * {
+			if("video"==format) {
+				return new EncoderSink(codec, bitrate, preset);
+			} else if("raw"==format) {
+				return new RawSink(1<<20, 64, journaled);
+			} else if("qoi"==format) {
+				return new QoiSink(qoiLevel);
+			} else if("tiles"==format) {
+				return new TileSink(tileSize, keyframeInterval, qoiLevel, journaled);
+			}
+			return new PngSink();
+		};
+		FrameSink *sink=nullptr;
+		if(mSegmentSeconds>0.0 || mSegmentMegabytes>0) {
+			sink=new SegmentedSink(factory, mSegmentSeconds, mSegmentMegabytes);
+		} else {
+			sink=factory();
+		}
+		FormatNegotiator::globalInstance()->declare(FormatNegotiator::RecorderStage, sink->formats());
+		mWriter=new FrameWriter(sink, mBasePath, frame->size(), mFrameRate, mWriterThreads, mWriterQueue);
+		if(journaled) {
+			// Journals are committed on sync, so the sync interval is the most a crash can lose
+			mWriter->setSyncBatch(16, mJournalInterval);
+		}
+		// Audio starts with the first frame written, which is the oldest in the preroll if there is one
+		qint64 start=(nullptr!=mPreroll)?mPreroll->oldest():-1;
+		if(start<0) {
+			start=captured;
+		}
+		if(nullptr!=mPreroll) {
+			mPreroll->startDrain(mWriter);
+		}
+		if(nullptr!=mAudio && mAudio->isRunning()) {
+			mAudioWriter=new AudioWriter(mAudio, mBasePath+"/recording.wav", start);
+		}
+	}
+	// Frames queue up behind the preroll until it has all been written
+	if(nullptr!=mPreroll && mPreroll->push(id, frame, captured)) {
+		return;
+	}
+	mWriter->submit(id, frame, captured, &damage);
 }
 
 
+void LiveThread::closeWriter()
+{
+	if(nullptr!=mPreroll) {
+		mPreroll->stopDrain();
+	}
+	if(nullptr!=mAudioWriter) {
+		// Only takes the last few periods from the ring
+		mAudioWriter->finish();
+	}
+	if(nullptr!=mWriter) {
+		// Flushing and closing can take a while, don't hold up the live thread or the GUI for it
+		RecordingFinalizer::globalInstance()->finish(mWriter);
+		mWriter=nullptr;
+	}
+	if(nullptr!=mAudioWriter) {
+		// A single video file gets the audio as a second track once the finalizer is done with it, everything else keeps the WAV next to it
+		if("video"==mRecordingFormat && mSegmentSeconds<=0.0 && mSegmentMegabytes<=0) {
+			const QString video=mBasePath+"/recording.mkv";
+			const QString audio=mAudioWriter->filename();
+			RecordingFinalizer::globalInstance()->post([video, audio]() {
+				AudioWriter::mux(video, audio);
+			});
+		}
+		delete mAudioWriter;
+		mAudioWriter=nullptr;
+	}
+}
 
-void LiveThread::onCameraFrameReady(QSharedPointer<QImage> im)
+void LiveThread::onFrameRenderComplete(quint64 id, QSharedPointer<QImage> im, qint64 captured, QRegion damage)
 {
-	//qDebug()<<"GOT CAM FRAME";
-	mLastCameraFrame=QSharedPointer<QImage>(new QImage(*im.data()));
+	emitFrames(mReorder.push(id, im, captured, damage));
 }
 
 
-void LiveThread::onCameraError(QCamera::Error)
+void LiveThread::onFrameDropped(quint64 id)
 {
-	qWarning()<<"ERROR: Camera error: "<<mCamera->errorString();
+	emitFrames(mReorder.drop(id));
 }
 
-void LiveThread::onCameraStateChanged(QCamera::State state)
+
+void LiveThread::onReorderTimer()
 {
-	qDebug()<<"Camera state changed: "<<state;
+	emitFrames(mReorder.poll());
 }
 
+
+
 void LiveThread::onCameraOpacityChange(qreal opacity)
 {
 	//qDebug()<<"GOT CAM OPACITY "<<opacity;
@@ -236,20 +502,31 @@ void LiveThread::onCameraOpacityChange(qreal opacity)
 void LiveThread::stop()
 {
 	mDone=true;
+	mRenderQueue->abort();
+}
+
+QString LiveThread::recordingsPath()
+{
+	QString path = QStandardPaths::writableLocation(QStandardPaths::MoviesLocation);
+	if (path.isEmpty()) {
+		path = QDir::currentPath();
+	}
+	return path;
 }
 
+
 void LiveThread::setSaving(bool saving)
 {
 	if(mIsSaving!=saving && saving) {
-		mBasePath = QStandardPaths::writableLocation(QStandardPaths::MoviesLocation);
-		if (mBasePath.isEmpty()) {
-			mBasePath = QDir::currentPath();
-		}
+		mBasePath = recordingsPath();
 		mBasePath+=QString("/MiniStudio_"+QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss")+QString((""==mProjectName)?"":("_"+mProjectName)));
 
 		QDir initialDir(mBasePath);
 		initialDir.mkpath(mBasePath);
 	}
+	if(!saving) {
+		closeWriter();
+	}
 	mIsSaving=saving;
 }
 
@@ -271,6 +548,133 @@ void LiveThread::setSubTitle(QString name)
 }
 
 
+void LiveThread::setScreenGrabberType(QString type)
+{
+	mScreenGrabberType=type;
+}
+
+
+void LiveThread::setMaxFramesInFlight(int max)
+{
+	mRenderQueue->setMaxInFlight(max);
+}
+
+
+void LiveThread::setFrameDropPolicy(QString policy)
+{
+	mRenderQueue->setDropPolicy(RenderQueue::policyFromString(policy));
+}
+
+
+void LiveThread::setReorderWindow(int window)
+{
+	mReorder.setWindow(window);
+}
+
+
+void LiveThread::setReorderLatency(int ms)
+{
+	mReorder.setMaxLatency(ms);
+}
+
+
+void LiveThread::setRenderBands(int bands)
+{
+	mRenderBands=qMax(1, bands);
+}
+
+
+void LiveThread::setRecordingFormat(QString format)
+{
+	mRecordingFormat=format;
+}
+
+
+void LiveThread::setEncoderCodec(QString codec)
+{
+	mEncoderCodec=codec;
+}
+
+
+void LiveThread::setEncoderBitrate(int kbps)
+{
+	mEncoderBitrate=kbps;
+}
+
+
+void LiveThread::setEncoderPreset(QString preset)
+{
+	mEncoderPreset=preset;
+}
+
+
+void LiveThread::setQoiLevel(int level)
+{
+	mQoiLevel=level;
+}
+
+
+void LiveThread::setTileSize(int pixels)
+{
+	mTileSize=pixels;
+}
+
+
+void LiveThread::setTileKeyframeInterval(int frames)
+{
+	mTileKeyframeInterval=frames;
+}
+
+
+void LiveThread::setWriterThreads(int threads)
+{
+	mWriterThreads=qMax(1, threads);
+}
+
+
+void LiveThread::setWriterQueue(int frames)
+{
+	mWriterQueue=qMax(1, frames);
+}
+
+
+void LiveThread::setPreroll(qreal seconds, int megabytes)
+{
+	mPrerollSeconds=qMax(0.0, seconds);
+	mPrerollMegabytes=qMax(1, megabytes);
+}
+
+
+void LiveThread::setSegmentLimits(qreal seconds, int megabytes)
+{
+	mSegmentSeconds=qMax(0.0, seconds);
+	mSegmentMegabytes=qMax(0, megabytes);
+}
+
+
+void LiveThread::setJournalInterval(int ms)
+{
+	mJournalInterval=qMax(0, ms);
+}
+
+
+void LiveThread::setAudioCapture(QString device, int rate, int channels)
+{
+	delete mAudio;
+	mAudio=nullptr;
+	if(!device.isEmpty()) {
+		// Runs from now on, so the device is settled by the time recording starts
+		mAudio=new AudioCapture(device, static_cast<unsigned int>(qMax(8000, rate)), channels);
+		// Keeps the preroll's audio too, so a recording starting with it has sound from its first frame
+		mAudio->setPreroll(qRound(mPrerollSeconds*1000));
+		if(!mAudio->start()) {
+			delete mAudio;
+			mAudio=nullptr;
+		}
+	}
+}
+
+
 void LiveThread::onMagLevelChange(qreal level)
 {
 	mMagLevel=level;
@@ -296,12 +700,31 @@ void LiveThread::onLogoEnabled(bool en)
 
 void LiveThread::onCameraEnabled(bool en)
 {
-	mCameraSwitch.setEnabled(en);
+	QMutexLocker lock(&mCamerasMutex);
+	mCameraEnabled=en;
+	mCameraSourceEnabled.clear();
+	for(CameraSource *source:mCameras) {
+		source->layerSwitch().setEnabled(en);
+	}
+}
+
+void LiveThread::onCameraSourceEnabled(int index, bool en)
+{
+	QMutexLocker lock(&mCamerasMutex);
+	mCameraSourceEnabled[index]=en;
+	if(index>=0 && index<mCameras.size()) {
+		mCameras[index]->layerSwitch().setEnabled(en);
+	}
 }
 
 void LiveThread::onPIPSizeChange(qreal pipSize)
 {
+	QMutexLocker lock(&mCamerasMutex);
 	mPIPSize=pipSize;
+	// Scaling at capture saves carrying and transforming the full frame on every composited frame
+	for(CameraSource *source:mCameras) {
+		source->setScale(PIP_SCALE*mPIPSize);
+	}
 }
 
 
@@ -2,14 +2,27 @@
 #define LIVETHREAD_HPP
 
 #include "AnimatedSwitch.hpp"
+#include "ReorderBuffer.hpp"
+#include "LatencyMeter.hpp"
+#include "CameraList.hpp"
 
 #include <QThread>
+#include <QMutex>
 #include <QImage>
-#include <QCamera>
+#include <QRegion>
+#include <QStringList>
 #include <QSharedPointer>
+#include <QMap>
+#include <QTimer>
 
 
-class CameraGrabber;
+class CameraSource;
+class ScreenGrabber;
+class RenderQueue;
+class FrameWriter;
+class PrerollRing;
+class AudioCapture;
+class AudioWriter;
 
 class LiveThread : public QThread
 {
@@ -17,22 +30,57 @@ class LiveThread : public QThread
 	private:
 		quint64 mFrameNumber;
 		bool mDone;
-		quint64 mLastTime;
+		qint64 mLastTime;
 		quint64 lastCompletedFrame;
 		bool mIsSaving;
 		QString mBasePath;
 		QString mProjectName;
 		QString mCaption;
 		QString mSubCaption;
-		QCamera *mCamera;
-		CameraGrabber *mCameraGrabber;
-		QSharedPointer <QImage> mLastCameraFrame;
+		QString mScreenGrabberType;
+		int mRenderBands;
+		QString mRecordingFormat;
+		QString mEncoderCodec;
+		int mEncoderBitrate;
+		QString mEncoderPreset;
+		int mQoiLevel;
+		int mTileSize;
+		int mTileKeyframeInterval;
+		int mWriterThreads;
+		int mWriterQueue;
+		FrameWriter *mWriter;
+		qreal mPrerollSeconds;
+		int mPrerollMegabytes;
+		PrerollRing *mPreroll;
+		qreal mSegmentSeconds;
+		int mSegmentMegabytes;
+		int mJournalInterval;
+		AudioCapture *mAudio;
+		AudioWriter *mAudioWriter;
+		qreal mFrameRate;
+		// Guards everything down to mCameraSourceEnabled. The GUI thread switches and scales the sources while the render loop
+		// composites them, and asks for other cameras while running, which the render loop then opens
+		QMutex mCamerasMutex;
+		QList<CameraSource *> mCameras;
+		QStringList mPendingCameras;
+		QList<CameraList::Device> mPendingAvailable;
+		bool mCamerasChanged;
+		bool mCameraEnabled;
+		// Sources switched on or off one by one, by index, so they stay that way when the cameras are reopened
+		QMap<int, bool> mCameraSourceEnabled;
+		RenderQueue *mRenderQueue;
+		ReorderBuffer mReorder;
+		LatencyMeter mRenderLatency;
+		LatencyMeter mPreviewLatency;
+		QTimer mReorderTimer;
+		// Where overlays were drawn in the last frame submitted
+		QRegion mLastCoverage;
 		qreal mLastCameraOpacity;
 		qreal mMagLevel;
+		// Guarded by mCamerasMutex too, as the sources are scaled to it
 		qreal mPIPSize;
 		AnimatedSwitch mScreenSwitch;
 		AnimatedSwitch mMagSwitch;
-		AnimatedSwitch mCameraSwitch;
 		AnimatedSwitch mTitleSwitch;
 		AnimatedSwitch mLogoSwitch;
 		bool mHold;
@@ -47,20 +95,55 @@ class LiveThread : public QThread
 		void setProjectName(QString name);
 		void setTitle(QString name);
 		void setSubTitle(QString name);
+		void setScreenGrabberType(QString type);
+		void setMaxFramesInFlight(int max);
+		void setFrameDropPolicy(QString policy);
+		void setReorderWindow(int window);
+		void setReorderLatency(int ms);
+		void setRenderBands(int bands);
+		// "png" and "qoi" write one image per frame, "video" encodes into one file, "raw" stores the frames as they are into one file
+		// and "tiles" stores only the parts of each frame that changed
+		void setRecordingFormat(QString format);
+		void setEncoderCodec(QString codec);
+		void setEncoderBitrate(int kbps);
+		void setEncoderPreset(QString preset);
+		void setQoiLevel(int level);
+		void setTileSize(int pixels);
+		void setTileKeyframeInterval(int frames);
+		void setWriterThreads(int threads);
+		void setWriterQueue(int frames);
+		// Keep the last seconds of frames in at most megabytes of memory, written first when recording starts. 0 seconds turns it off
+		void setPreroll(qreal seconds, int megabytes);
+		// Start a new segment after seconds or megabytes, whichever comes first. 0 means no limit
+		void setSegmentLimits(qreal seconds, int megabytes);
+		// Journal raw and tile recordings, syncing every ms so a crash loses at most that much. 0 turns it off
+		void setJournalInterval(int ms);
+		// Record audio from an ALSA device alongside the video. An empty device turns it off. Set the preroll first
+		void setAudioCapture(QString device, int rate, int channels);
+		// Open the cameras named by device name or description, each a layer of its own. An empty list opens the first camera.
+		// available is CameraList::devices(). Safe to call while running, for when cameras come and go
+		void setCameras(QStringList devices, QList<CameraList::Device> available);
 
 	private:
 
 		void clear();
+		void openCameras(const QStringList &devices, const QList<CameraList::Device> &available);
+		void applyCameras();
+		void emitFrames(const QList<ReorderBuffer::Frame> &frames);
+		void recordFrame(quint64 id, QSharedPointer<QImage> frame, qint64 captured, const QRegion &damage);
+		void closeWriter();
 
 	public:
 		void run() override;
 
+		// Where recordings go, one directory per recording
+		static QString recordingsPath();
+
 	public slots:
-		void onFrameRenderComplete(quint64 id, QSharedPointer<QImage> im);
-		void onCameraFrameReady(QSharedPointer<QImage> im);
+		void onFrameRenderComplete(quint64 id, QSharedPointer<QImage> im, qint64 captured, QRegion damage);
+		void onFrameDropped(quint64 id);
+		void onReorderTimer();
 		void onCameraOpacityChange(qreal opacity);
-		void onCameraError(QCamera::Error error);
-		void onCameraStateChanged(QCamera::State state);
 		void onMagLevelChange(qreal level);
 		void onPIPSizeChange(qreal pipSize);
 		void onHoldEnabled(bool en);
@@ -68,11 +151,14 @@ class LiveThread : public QThread
 		void onTitleEnabled(bool en);
 		void onLogoEnabled(bool en);
 		void onCameraEnabled(bool en);
+		// Switch the index'th camera's layer alone, in the order they were selected
+		void onCameraSourceEnabled(int index, bool en);
 
 
 
 	signals:
-		void frameRendered(quint64 id, QSharedPointer<QImage> im);
+		// captured is when the frame was captured, see FrameClock
+		void frameRendered(quint64 id, QSharedPointer<QImage> im, qint64 captured);
 };
 
 #endif // LIVETHREAD_HPP
@@ -3,8 +3,11 @@
 
 #include "Tascam.hpp"
 #include "LiveThread.hpp"
+#include "RecordingFinalizer.hpp"
+#include "RecordingJournal.hpp"
 #include "StudioConfig.hpp"
 #include "Presentation.hpp"
+#include "CameraList.hpp"
 
 #include "TascamSimulator.hpp"
 
@@ -44,6 +47,7 @@ MiniStudio::MiniStudio(QObject *parent)
 	, mLive(nullptr)
 	, mConf(new StudioConfig())
 	, mPresentation(new Presentation())
+	, mCameraList(new CameraList(this))
 	, mMagEnabled(false)
 	, mMagLevel(1.0)
 	, mPIPSizeEnabled(false)
@@ -51,7 +55,31 @@ MiniStudio::MiniStudio(QObject *parent)
 	, mTitleEnabled(false)
 	, mLogoEnabled(false)
 	, mCameraEnabled(false)
+	, mCameraSourceEnabled(4, false)
 	, mHoldEnabled(false)
+	, mScreenGrabberType("xshm")
+	, mMaxFramesInFlight(4)
+	, mFrameDropPolicy("oldest")
+	, mReorderWindow(8)
+	, mReorderLatency(100)
+	, mRenderBands(1)
+	, mRecordingFormat("png")
+	, mEncoderCodec("libx264")
+	, mEncoderBitrate(8000)
+	, mEncoderPreset("ultrafast")
+	, mQoiLevel(1)
+	, mTileSize(64)
+	, mTileKeyframeInterval(300)
+	, mWriterThreads(2)
+	, mWriterQueue(16)
+	, mPrerollSeconds(0.0)
+	, mPrerollMegabytes(256)
+	, mSegmentSeconds(0.0)
+	, mSegmentMegabytes(0)
+	, mJournalInterval(0)
+	, mAudioDevice("")
+	, mAudioRate(48000)
+	, mAudioChannels(2)
 	, mTrayIcon(new QSystemTrayIcon(this))
 	, sim(new TascamSimulator())
 
@@ -159,6 +187,14 @@ MiniStudio::MiniStudio(QObject *parent)
 		qWarning()<<"ERROR: could not connect studio verbosity";
 	}
 
+	if(!connect(mCameraList, &CameraList::cameraDevicesChanged, this, &MiniStudio::onCameraDevicesChanged)) {
+		qWarning()<<"ERROR: could not connect camera devices changed";
+	}
+
+	if(!connect(mConf, &StudioConfig::camerasSelected, this, &MiniStudio::onCamerasSelected)) {
+		qWarning()<<"ERROR: could not connect studio cameras selected";
+	}
+
 
 
 
@@ -187,7 +223,18 @@ MiniStudio::MiniStudio(QObject *parent)
 
 
 	loadSettings();
+	// The list was scanned before the selection was loaded
+	onCameraDevicesChanged();
 	showConfig(true);
+
+	// Recordings cut short by a crash are repaired from their journals in the background
+	const QString recordings=LiveThread::recordingsPath();
+	RecordingFinalizer::globalInstance()->post([recordings]() {
+		const int recovered=RecordingJournal::recoverAll(recordings);
+		if(recovered>0) {
+			qDebug()<<"JOURNAL: recovered"<<recovered<<"recordings in"<<recordings;
+		}
+	});
 }
 
 
@@ -196,8 +243,20 @@ MiniStudio::~MiniStudio()
 	saveSettings();
 	qDebug()<<"dtor MiniStudio";
 
-	mLive->stop();
-	mLive->wait();
+	if(nullptr!=mLive) {
+		mLive->stop();
+		mLive->wait();
+		delete mLive;
+		mLive=nullptr;
+	}
+	// Stopped threads hand their recording to the finalizer when deleted, which may not have happened yet
+	for(LiveThread *live:mRetiredLive) {
+		live->wait();
+		delete live;
+	}
+	mRetiredLive.clear();
+	// Recordings still being finished have to make it to disk before we exit
+	RecordingFinalizer::globalInstance()->waitForIdle();
 
 	delete mMidi;
 	mMidi=nullptr;
@@ -221,6 +280,30 @@ void MiniStudio::saveSettings()
 		s->setValue("mTitleEnabled",mTitleEnabled);
 		s->setValue("mLogoEnabled",mLogoEnabled);
 		s->setValue("mCameraEnabled",mCameraEnabled);
+		s->setValue("screenGrabber",mScreenGrabberType);
+		s->setValue("maxFramesInFlight",mMaxFramesInFlight);
+		s->setValue("frameDropPolicy",mFrameDropPolicy);
+		s->setValue("reorderWindow",mReorderWindow);
+		s->setValue("reorderLatency",mReorderLatency);
+		s->setValue("renderBands",mRenderBands);
+		s->setValue("recordingFormat",mRecordingFormat);
+		s->setValue("encoderCodec",mEncoderCodec);
+		s->setValue("encoderBitrate",mEncoderBitrate);
+		s->setValue("encoderPreset",mEncoderPreset);
+		s->setValue("qoiLevel",mQoiLevel);
+		s->setValue("tileSize",mTileSize);
+		s->setValue("tileKeyframeInterval",mTileKeyframeInterval);
+		s->setValue("writerThreads",mWriterThreads);
+		s->setValue("writerQueue",mWriterQueue);
+		s->setValue("prerollSeconds",mPrerollSeconds);
+		s->setValue("prerollMegabytes",mPrerollMegabytes);
+		s->setValue("segmentSeconds",mSegmentSeconds);
+		s->setValue("segmentMegabytes",mSegmentMegabytes);
+		s->setValue("journalInterval",mJournalInterval);
+		s->setValue("audioDevice",mAudioDevice);
+		s->setValue("audioRate",mAudioRate);
+		s->setValue("audioChannels",mAudioChannels);
+		s->setValue("cameras",mCameraDevices);
 	}
 }
 
@@ -234,6 +317,30 @@ void MiniStudio::loadSettings()
 		mTitleEnabled=s->value("mTitleEnabled",mTitleEnabled).toBool();
 		mLogoEnabled=s->value("mLogoEnabled",mLogoEnabled).toBool();
 		mCameraEnabled=s->value("mCameraEnabled",mCameraEnabled).toBool();
+		mScreenGrabberType=s->value("screenGrabber",mScreenGrabberType).toString();
+		mMaxFramesInFlight=s->value("maxFramesInFlight",mMaxFramesInFlight).toInt();
+		mFrameDropPolicy=s->value("frameDropPolicy",mFrameDropPolicy).toString();
+		mReorderWindow=s->value("reorderWindow",mReorderWindow).toInt();
+		mReorderLatency=s->value("reorderLatency",mReorderLatency).toInt();
+		mRenderBands=s->value("renderBands",mRenderBands).toInt();
+		mRecordingFormat=s->value("recordingFormat",mRecordingFormat).toString();
+		mEncoderCodec=s->value("encoderCodec",mEncoderCodec).toString();
+		mEncoderBitrate=s->value("encoderBitrate",mEncoderBitrate).toInt();
+		mEncoderPreset=s->value("encoderPreset",mEncoderPreset).toString();
+		mQoiLevel=s->value("qoiLevel",mQoiLevel).toInt();
+		mTileSize=s->value("tileSize",mTileSize).toInt();
+		mTileKeyframeInterval=s->value("tileKeyframeInterval",mTileKeyframeInterval).toInt();
+		mWriterThreads=s->value("writerThreads",mWriterThreads).toInt();
+		mWriterQueue=s->value("writerQueue",mWriterQueue).toInt();
+		mPrerollSeconds=s->value("prerollSeconds",mPrerollSeconds).toReal();
+		mPrerollMegabytes=s->value("prerollMegabytes",mPrerollMegabytes).toInt();
+		mSegmentSeconds=s->value("segmentSeconds",mSegmentSeconds).toReal();
+		mSegmentMegabytes=s->value("segmentMegabytes",mSegmentMegabytes).toInt();
+		mJournalInterval=s->value("journalInterval",mJournalInterval).toInt();
+		mAudioDevice=s->value("audioDevice",mAudioDevice).toString();
+		mAudioRate=s->value("audioRate",mAudioRate).toInt();
+		mAudioChannels=s->value("audioChannels",mAudioChannels).toInt();
+		mCameraDevices=s->value("cameras",mCameraDevices).toStringList();
 	}
 }
 
@@ -597,8 +704,29 @@ void MiniStudio::setRecording(bool run, bool rec)
 			mLive->setProjectName((nullptr!=mConf)?mConf->projectName():"");
 			mLive->setTitle((nullptr!=mConf)?mConf->title():"");
 			mLive->setSubTitle((nullptr!=mConf)?mConf->subTitle():"");
+			mLive->setScreenGrabberType(mScreenGrabberType);
+			mLive->setMaxFramesInFlight(mMaxFramesInFlight);
+			mLive->setFrameDropPolicy(mFrameDropPolicy);
+			mLive->setReorderWindow(mReorderWindow);
+			mLive->setReorderLatency(mReorderLatency);
+			mLive->setRenderBands(mRenderBands);
+			mLive->setRecordingFormat(mRecordingFormat);
+			mLive->setEncoderCodec(mEncoderCodec);
+			mLive->setEncoderBitrate(mEncoderBitrate);
+			mLive->setEncoderPreset(mEncoderPreset);
+			mLive->setQoiLevel(mQoiLevel);
+			mLive->setTileSize(mTileSize);
+			mLive->setTileKeyframeInterval(mTileKeyframeInterval);
+			mLive->setWriterThreads(mWriterThreads);
+			mLive->setWriterQueue(mWriterQueue);
+			mLive->setPreroll(mPrerollSeconds, mPrerollMegabytes);
+			mLive->setSegmentLimits(mSegmentSeconds, mSegmentMegabytes);
+			mLive->setJournalInterval(mJournalInterval);
+			mLive->setAudioCapture(mAudioDevice, mAudioRate, mAudioChannels);
+			mLive->setCameras(mCameraDevices, mCameraList->devices());
 			mLive->setSaving(rec);
 			mLive->onCameraEnabled(mCameraEnabled);
+			mCameraSourceEnabled.fill(mCameraEnabled);
 			mLive->onLogoEnabled(mLogoEnabled);
 			mLive->onMagEnabled(mMagEnabled);
 			mLive->onMagLevelChange(mMagLevel);
@@ -608,9 +736,18 @@ void MiniStudio::setRecording(bool run, bool rec)
 		}
 	} else {
 		if(nullptr!=mLive) {
-			mLive->stop();
-			mLive->wait();
-			mLive->deleteLater();
+			// Let the live thread wind down on its own, the recording is finished in the background
+			LiveThread *live=mLive;
+			mRetiredLive<<live;
+			if(!connect(live, &QThread::finished, this, [this, live]() {
+				// Deleted right here, a deleteLater() could still be pending when the application exits
+				mRetiredLive.removeAll(live);
+				live->wait();
+				delete live;
+			}, Qt::QueuedConnection)) {
+				qWarning()<<"ERROR: Could not connect live thread finished";
+			}
+			live->stop();
 			mLive=nullptr;
 		}
 	}
@@ -666,8 +803,17 @@ void MiniStudio::onButtonEvent(uint, QString name, bool pressed)
 		if(nullptr!=mLive && pressed) {
 			mCameraEnabled=!mCameraEnabled;
 			mLive->onCameraEnabled(mCameraEnabled);
+			mCameraSourceEnabled.fill(mCameraEnabled);
 			qDebug()<<"camera enabled: "<<mCameraEnabled;
 		}
+	} else if(name.startsWith("Select")) {
+		// Select5 to Select8 switch the cameras one by one, in the order they were selected
+		const int index=name.mid(6).toInt()-5;
+		if(nullptr!=mLive && pressed && index>=0 && index<mCameraSourceEnabled.size()) {
+			mCameraSourceEnabled[index]=!mCameraSourceEnabled[index];
+			mLive->onCameraSourceEnabled(index, mCameraSourceEnabled[index]);
+			qDebug()<<"camera"<<index<<"enabled: "<<mCameraSourceEnabled[index];
+		}
 	} else if("Aux2"==name) {
 		if(nullptr!=mLive && pressed) {
 			mTitleEnabled=!mTitleEnabled;
@@ -755,3 +901,25 @@ void MiniStudio::onVerbosityChange(bool v)
 		mMidi->setVerbose(v);
 	}
 }
+
+
+void MiniStudio::onCameraDevicesChanged()
+{
+	if(nullptr!=mConf) {
+		mConf->setCameraDevices(mCameraList->devices(), mCameraDevices);
+	}
+	// A selected camera may have just been plugged in, or the one in use pulled out
+	if(nullptr!=mLive) {
+		mLive->setCameras(mCameraDevices, mCameraList->devices());
+	}
+}
+
+
+void MiniStudio::onCamerasSelected(QStringList devices)
+{
+	qDebug()<<"CAMERAS: "<<devices;
+	mCameraDevices=devices;
+	if(nullptr!=mLive) {
+		mLive->setCameras(mCameraDevices, mCameraList->devices());
+	}
+}
@@ -15,6 +15,7 @@ class TascamSimulator;
 #include <QPixmap>
 #include <QWidget>
 #include <QMap>
+#include <QStringList>
 #include <QSystemTrayIcon>
 
 QT_BEGIN_NAMESPACE
@@ -32,6 +33,7 @@ class Tascam;
 class LiveThread;
 class StudioConfig;
 class Presentation;
+class CameraList;
 
 namespace drumstick
 {
@@ -54,8 +56,11 @@ private:
 	QMap<uint, QString> mSliderNames;
 	QMap<uint, QString> mKnobNames;
 	LiveThread *mLive;
+	// Stopped live threads still finishing their recording
+	QList<LiveThread *> mRetiredLive;
 	StudioConfig *mConf;
 	Presentation *mPresentation;
+	CameraList *mCameraList;
 	bool mMagEnabled;
 	qreal mMagLevel;
 	bool mPIPSizeEnabled;
@@ -63,7 +68,33 @@ private:
 	bool mTitleEnabled;
 	bool mLogoEnabled;
 	bool mCameraEnabled;
+	// Per camera on top of mCameraEnabled, toggled with Select5 to Select8
+	QVector<bool> mCameraSourceEnabled;
 	bool mHoldEnabled;
+	QString mScreenGrabberType;
+	int mMaxFramesInFlight;
+	QString mFrameDropPolicy;
+	int mReorderWindow;
+	int mReorderLatency;
+	int mRenderBands;
+	QString mRecordingFormat;
+	QString mEncoderCodec;
+	int mEncoderBitrate;
+	QString mEncoderPreset;
+	int mQoiLevel;
+	int mTileSize;
+	int mTileKeyframeInterval;
+	int mWriterThreads;
+	int mWriterQueue;
+	qreal mPrerollSeconds;
+	int mPrerollMegabytes;
+	qreal mSegmentSeconds;
+	int mSegmentMegabytes;
+	int mJournalInterval;
+	QString mAudioDevice;
+	int mAudioRate;
+	int mAudioChannels;
+	QStringList mCameraDevices;
 
 	QSystemTrayIcon *mTrayIcon;
 	TascamSimulator *sim;
@@ -91,6 +122,8 @@ public slots:
 	void onQuitApp();
 	void onShowSimulator();
 	void onVerbosityChange(bool);
+	void onCameraDevicesChanged();
+	void onCamerasSelected(QStringList devices);
 
 
 signals:
@@ -0,0 +1,190 @@
+#include "PngSink.hpp"
+
+#include <QFile>
+#include <QBuffer>
+#include <QImageWriter>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QDebug>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+
+PngSink::PngSink(int compression)
+	: mFps(0.0)
+	, mCompression(compression)
+	, mOpen(false)
+{
+
+}
+
+PngSink::~PngSink()
+{
+	close();
+}
+
+
+bool PngSink::open(const QString &basePath, const QSize &size, qreal fps)
+{
+	(void)size;
+	mBasePath=basePath;
+	mFps=fps;
+	mTimings.clear();
+	mOpen=true;
+	return true;
+}
+
+
+bool PngSink::write(const Frame &frame)
+{
+	QByteArray data;
+	if(!encode(frame, data)) {
+		mDropped.fetchAndAddRelaxed(1);
+		return false;
+	}
+	QFile *file=new QFile(mBasePath+"/"+fileName(frame.index));
+	if(!file->open(QIODevice::WriteOnly) || data.size()!=file->write(data)) {
+		qWarning()<<"ERROR: Could not write"<<file->fileName()<<":"<<file->errorString();
+		delete file;
+		mDropped.fetchAndAddRelaxed(1);
+		return false;
+	}
+	file->flush();
+	mWritten.fetchAndAddRelaxed(1);
+	mBytes.fetchAndAddRelaxed(data.size());
+	QMutexLocker lock(&mMutex);
+	mUnsynced<<file;
+	mTimings<<qMakePair(frame.index, frame.timestamp);
+	return true;
+}
+
+
+void PngSink::sync()
+{
+	QList<QFile *> batch;
+	{
+		QMutexLocker lock(&mMutex);
+		batch.swap(mUnsynced);
+	}
+	for(QFile *file:batch) {
+#if defined(Q_OS_LINUX)
+		::fdatasync(file->handle());
+#elif defined(Q_OS_UNIX)
+		::fsync(file->handle());
+#endif
+		file->close();
+		delete file;
+	}
+}
+
+
+void PngSink::close()
+{
+	sync();
+	if(mOpen) {
+		writeTimings();
+	}
+	mOpen=false;
+}
+
+
+bool PngSink::isOpen()
+{
+	return mOpen;
+}
+
+
+QString PngSink::name()
+{
+	return "png";
+}
+
+
+QVector<QImage::Format> PngSink::formats()
+{
+	// The PNG writer converts premultiplied images internally
+	QVector<QImage::Format> formats;
+	formats<<QImage::Format_ARGB32<<QImage::Format_RGB32;
+	return formats;
+}
+
+
+bool PngSink::ordered()
+{
+	return false;
+}
+
+
+bool PngSink::encode(const Frame &frame, QByteArray &data)
+{
+	data=encodeImage(frame.image, mCompression);
+	if(data.isEmpty()) {
+		qWarning()<<"ERROR: Could not encode frame"<<frame.index<<"as png";
+		return false;
+	}
+	return true;
+}
+
+
+QByteArray PngSink::encodeImage(const QImage &image, int compression)
+{
+	QByteArray data;
+	QBuffer buffer(&data);
+	buffer.open(QIODevice::WriteOnly);
+	QImageWriter writer(&buffer, "png");
+	// The png handler turns quality into a zlib level as (100-quality)*9/91
+	writer.setQuality(100-(compression*91+8)/9);
+	if(!writer.write(image)) {
+		qWarning()<<"ERROR: Could not encode png:"<<writer.errorString();
+		return QByteArray();
+	}
+	return data;
+}
+
+
+QString PngSink::suffix()
+{
+	return "png";
+}
+
+
+QString PngSink::fileName(quint64 index)
+{
+	return QString("frame_%1.%2").arg(index, 6, 10, QChar('0')).arg(suffix());
+}
+
+
+void PngSink::writeTimings()
+{
+	QList<QPair<quint64, qint64> > timings;
+	{
+		QMutexLocker lock(&mMutex);
+		timings.swap(mTimings);
+	}
+	if(timings.isEmpty()) {
+		return;
+	}
+	// Frames may have been written out of order
+	std::sort(timings.begin(), timings.end());
+	QFile file(mBasePath+"/frames.ffconcat");
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qWarning()<<"ERROR: Could not write"<<file.fileName()<<":"<<file.errorString();
+		return;
+	}
+	const qint64 nominal=(mFps>0.0)?qint64(1000000000.0/mFps):0;
+	QTextStream out(&file);
+	out<<"ffconcat version 1.0\n";
+	for(int i=0; i<timings.size(); ++i) {
+		// The last frame has nothing after it to measure against, it is shown for one nominal frame
+		const qint64 duration=(i+1<timings.size())?(timings[i+1].second-timings[i].second):nominal;
+		out<<"file '"<<fileName(timings[i].first)<<"'\n";
+		out<<"duration "<<QString::number(qMax<qint64>(0, duration)/1e9, 'f', 6)<<"\n";
+	}
+	// ffmpeg ignores the duration of the last entry unless it is listed again
+	out<<"file '"<<fileName(timings.last().first)<<"'\n";
+	out.flush();
+}
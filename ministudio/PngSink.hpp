@@ -0,0 +1,67 @@
+#ifndef PNGSINK_HPP
+#define PNGSINK_HPP
+
+#include "FrameSink.hpp"
+
+#include <QMutex>
+#include <QList>
+#include <QPair>
+
+class QFile;
+
+/*
+  Records one frame_NNNNNN.png per frame, like the original recorder.
+
+  Each image is encoded into memory and written with a single write().
+  Files are kept open until the next sync(), which fdatasyncs the whole
+  batch at once instead of paying for a flush per frame. Frames may be
+  written from several threads at once.
+
+  Frames are captured at a variable rate, so on close the capture time of
+  every frame is written into frames.ffconcat, which ffmpeg reads as a
+  variable frame rate input with the real duration of each frame.
+*/
+class PngSink: public FrameSink
+{
+	public:
+		static const int DEFAULT_COMPRESSION=1;
+
+	private:
+		QString mBasePath;
+		QMutex mMutex;
+		QList<QFile *> mUnsynced;
+		// Index and capture time of each frame written
+		QList<QPair<quint64, qint64> > mTimings;
+		qreal mFps;
+		int mCompression;
+		bool mOpen;
+
+	public:
+		// compression is 0..9 as for QImageWriter, lower is faster
+		explicit PngSink(int compression=DEFAULT_COMPRESSION);
+		virtual ~PngSink();
+
+	public:
+		bool open(const QString &basePath, const QSize &size, qreal fps) override;
+		bool write(const Frame &frame) override;
+		void sync() override;
+		void close() override;
+		bool isOpen() override;
+		QString name() override;
+		QVector<QImage::Format> formats() override;
+		bool ordered() override;
+
+		// Encode an image the way write() does. Returns an empty array on failure
+		static QByteArray encodeImage(const QImage &image, int compression=DEFAULT_COMPRESSION);
+
+	protected:
+		// Encode one frame into data. Other image sequence sinks override this and suffix()
+		virtual bool encode(const Frame &frame, QByteArray &data);
+		virtual QString suffix();
+
+	private:
+		QString fileName(quint64 index);
+		void writeTimings();
+};
+
+#endif // PNGSINK_HPP
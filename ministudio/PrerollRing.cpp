@@ -0,0 +1,297 @@
+#include "PrerollRing.hpp"
+
+#include "FrameWriter.hpp"
+#include "QoiCodec.hpp"
+
+#include <QThread>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include <cstring>
+
+
+class PrerollThread: public QThread
+{
+	private:
+		PrerollRing *mRing;
+
+	public:
+		explicit PrerollThread(PrerollRing *ring)
+			: mRing(ring)
+		{
+
+		}
+
+		void run() override
+		{
+			mRing->work();
+		}
+};
+
+
+PrerollRing::PrerollRing(qreal seconds, qint64 maxBytes, int level)
+	: mDuration(qMax<qint64>(1, qint64(seconds*1000000000.0)))
+	, mLevel(level)
+	, mMaxPending(4)
+	, mThread(nullptr)
+	, mMode(Capturing)
+	, mWriter(nullptr)
+	, mSubmitting(false)
+	, mStopping(false)
+	, mCompressing(false)
+	, mUsed(0)
+	, mPushed(0)
+	, mEvicted(0)
+	, mExpired(0)
+	, mLost(0)
+	, mDrained(0)
+{
+	// QByteArray is limited to int sizes
+	mArena.resize(int(qBound<qint64>(1024*1024, maxBytes, 0x7fff0000)));
+	mThread=new PrerollThread(this);
+	mThread->setObjectName("PrerollRing");
+	mThread->start(QThread::LowPriority);
+}
+
+PrerollRing::~PrerollRing()
+{
+	{
+		QMutexLocker lock(&mMutex);
+		mStopping=true;
+		mWake.wakeAll();
+	}
+	mThread->wait();
+	delete mThread;
+	mThread=nullptr;
+	qDebug()<<"PREROLL: finished"<<stats();
+}
+
+
+bool PrerollRing::push(quint64 id, QSharedPointer<QImage> frame, qint64 captured)
+{
+	QMutexLocker lock(&mMutex);
+	if(Idle==mMode) {
+		return false;
+	}
+	if(frame.isNull() || frame->isNull()) {
+		return true;
+	}
+	mPushed++;
+	if(mPending.size()>=mMaxPending) {
+		// Compression can't keep up. Never wait for it, that would stall the live frames
+		if(Draining==mMode) {
+			mLost++;
+		} else {
+			mEvicted++;
+		}
+		return true;
+	}
+	mPending<<Pending{id, captured, frame};
+	mWake.wakeOne();
+	return true;
+}
+
+
+void PrerollRing::startDrain(FrameWriter *writer)
+{
+	QMutexLocker lock(&mMutex);
+	mWriter=writer;
+	if(mEntries.isEmpty() && mPending.isEmpty()) {
+		mMode=Idle;
+		return;
+	}
+	qDebug()<<"PREROLL: writing"<<mEntries.size()<<"frames,"<<(mEntries.isEmpty()?0:(mEntries.last().timestamp-mEntries.first().timestamp)/1000000)<<"ms";
+	mMode=Draining;
+	mWake.wakeAll();
+}
+
+
+void PrerollRing::stopDrain()
+{
+	QMutexLocker lock(&mMutex);
+	if(Capturing!=mMode && mLost>0) {
+		qWarning()<<"PREROLL: lost"<<mLost<<"frames while writing";
+	}
+	mMode=Capturing;
+	mWriter=nullptr;
+	mPending.clear();
+	mEntries.clear();
+	mUsed=0;
+	while(mSubmitting) {
+		mWriterReleased.wait(&mMutex);
+	}
+}
+
+
+void PrerollRing::work()
+{
+	QByteArray scratch;
+	QMutexLocker lock(&mMutex);
+	while(!mStopping) {
+		if(!mPending.isEmpty()) {
+			const Pending pending=mPending.takeFirst();
+			mCompressing=true;
+			lock.unlock();
+			const QImage &image=*pending.image;
+			int size=-1;
+			if(32==image.depth()) {
+				const int needed=QoiCodec::maxSize(image.width(), image.height());
+				if(scratch.size()<needed) {
+					scratch.resize(needed);
+				}
+				size=QoiCodec::encode(image.constBits(), image.width(), image.height(), image.bytesPerLine(), mLevel, reinterpret_cast<uchar *>(scratch.data()));
+			}
+			lock.relock();
+			mCompressing=false;
+			if(size>0) {
+				store(pending, scratch, size);
+			}
+			continue;
+		}
+		if(Draining==mMode && !mEntries.isEmpty() && nullptr!=mWriter) {
+			const Entry entry=mEntries.takeFirst();
+			mUsed-=entry.size;
+			FrameWriter *writer=mWriter;
+			mSubmitting=true;
+			// Only this thread ever writes to the arena, so the entry can be decoded unlocked
+			lock.unlock();
+			const uchar *data=reinterpret_cast<const uchar *>(mArena.constData())+entry.offset;
+			int width=0;
+			int height=0;
+			QSharedPointer<QImage> image;
+			if(QoiCodec::readHeader(data, entry.size, width, height)) {
+				image=QSharedPointer<QImage>(new QImage(width, height, entry.format));
+				if(!QoiCodec::decode(data, entry.size, image->bits(), image->bytesPerLine())) {
+					image.clear();
+				}
+			}
+			const bool ok=!image.isNull() && writer->submitWait(entry.id, image, entry.timestamp);
+			lock.relock();
+			mSubmitting=false;
+			mWriterReleased.wakeAll();
+			if(ok) {
+				mDrained++;
+			} else {
+				mLost++;
+			}
+			continue;
+		}
+		if(Draining==mMode && mEntries.isEmpty()) {
+			// Caught up, from here on frames go straight to the writer
+			mMode=Idle;
+			qDebug()<<"PREROLL: caught up after writing"<<mDrained<<"frames, lost"<<mLost;
+			continue;
+		}
+		mWake.wait(&mMutex);
+	}
+}
+
+
+void PrerollRing::store(const Pending &pending, const QByteArray &scratch, int size)
+{
+	const int offset=allocate(size);
+	if(offset<0) {
+		if(Draining==mMode) {
+			mLost++;
+		} else {
+			mEvicted++;
+		}
+		return;
+	}
+	memcpy(mArena.data()+offset, scratch.constData(), size);
+	mEntries<<Entry{pending.id, pending.timestamp, pending.image->format(), offset, size};
+	mUsed+=size;
+	if(Capturing==mMode) {
+		const qint64 oldest=pending.timestamp-mDuration;
+		while(mEntries.first().timestamp<oldest) {
+			mUsed-=mEntries.first().size;
+			mEntries.removeFirst();
+			mExpired++;
+		}
+	}
+}
+
+
+int PrerollRing::allocate(int size)
+{
+	const int capacity=mArena.size();
+	if(size>capacity) {
+		return -1;
+	}
+	// Entries sit in the arena in the order they came, the free space runs from the end of the newest to the start of the oldest
+	while(!mEntries.isEmpty()) {
+		const Entry &oldest=mEntries.first();
+		const Entry &newest=mEntries.last();
+		const int head=newest.offset+newest.size;
+		if(newest.offset>=oldest.offset) {
+			if(head+size<=capacity) {
+				return head;
+			}
+			if(size<=oldest.offset) {
+				return 0;
+			}
+		} else if(head+size<=oldest.offset) {
+			return head;
+		}
+		mUsed-=oldest.size;
+		mEntries.removeFirst();
+		if(Draining==mMode) {
+			mLost++;
+		} else {
+			mEvicted++;
+		}
+	}
+	return 0;
+}
+
+
+int PrerollRing::frames()
+{
+	QMutexLocker lock(&mMutex);
+	return mEntries.size();
+}
+
+
+int PrerollRing::pending()
+{
+	QMutexLocker lock(&mMutex);
+	return mPending.size()+(mCompressing?1:0);
+}
+
+
+qint64 PrerollRing::bytes()
+{
+	QMutexLocker lock(&mMutex);
+	return mUsed;
+}
+
+
+qint64 PrerollRing::capacity()
+{
+	return mArena.size();
+}
+
+
+qint64 PrerollRing::span()
+{
+	QMutexLocker lock(&mMutex);
+	return mEntries.isEmpty()?0:(mEntries.last().timestamp-mEntries.first().timestamp)/1000000;
+}
+
+
+qint64 PrerollRing::oldest()
+{
+	QMutexLocker lock(&mMutex);
+	if(!mEntries.isEmpty()) {
+		return mEntries.first().timestamp;
+	}
+	return mPending.isEmpty()?-1:mPending.first().timestamp;
+}
+
+
+QString PrerollRing::stats()
+{
+	return QString("frames=%1 span=%2ms bytes=%3/%4 pushed=%5 evicted=%6 expired=%7 drained=%8 lost=%9")
+		   .arg(frames()).arg(span()).arg(bytes()).arg(capacity())
+		   .arg(mPushed).arg(mEvicted).arg(mExpired).arg(mDrained).arg(mLost);
+}
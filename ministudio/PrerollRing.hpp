@@ -0,0 +1,108 @@
+#ifndef PREROLLRING_HPP
+#define PREROLLRING_HPP
+
+#include <QSharedPointer>
+#include <QImage>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+class QThread;
+class FrameWriter;
+
+/*
+  Instant replay. Keeps the last seconds of composited frames, QOI
+  compressed, in a ring of fixed size so a recording can start from before
+  Record was pressed.
+
+  The ring's memory is allocated once up front and never grows. When a
+  frame doesn't fit, the oldest frames are dropped to make room, and frames
+  older than the preroll duration are dropped as they age out. Besides the
+  ring only one frame worth of scratch space and a few frames waiting to
+  be compressed are held.
+
+  Compression runs on the ring's own thread. When recording starts, the
+  ring is drained into the FrameWriter, oldest first, while new frames keep
+  coming in behind the preroll. Once it has caught up push() returns false
+  and frames go straight to the writer again.
+*/
+class PrerollRing
+{
+	private:
+		enum Mode {
+			Capturing
+			, Draining
+			, Idle
+		};
+
+		struct Pending {
+			quint64 id;
+			qint64 timestamp;
+			QSharedPointer<QImage> image;
+		};
+
+		struct Entry {
+			quint64 id;
+			qint64 timestamp;
+			QImage::Format format;
+			int offset;
+			int size;
+		};
+
+		QByteArray mArena;
+		// In ns, like the frame timestamps
+		qint64 mDuration;
+		int mLevel;
+		int mMaxPending;
+		QThread *mThread;
+		QMutex mMutex;
+		QWaitCondition mWake;
+		QWaitCondition mWriterReleased;
+		QList<Pending> mPending;
+		QList<Entry> mEntries;
+		Mode mMode;
+		FrameWriter *mWriter;
+		bool mSubmitting;
+		bool mStopping;
+		bool mCompressing;
+		qint64 mUsed;
+		quint64 mPushed;
+		quint64 mEvicted;
+		quint64 mExpired;
+		quint64 mLost;
+		quint64 mDrained;
+
+	public:
+		// Keep up to seconds of frames in at most maxBytes of memory
+		explicit PrerollRing(qreal seconds, qint64 maxBytes, int level=1);
+		virtual ~PrerollRing();
+
+	public:
+		// Hand a live frame to the ring. Returns false when the frame should go straight to the writer instead
+		// captured is the capture time from FrameClock
+		bool push(quint64 id, QSharedPointer<QImage> frame, qint64 captured);
+		// Start writing the preroll into writer, ahead of the frames pushed from now on
+		void startDrain(FrameWriter *writer);
+		// Stop using the writer, dropping whatever was not written yet. Blocks until the ring is off the writer
+		void stopDrain();
+
+		int frames();
+		// Frames pushed but not stored yet
+		int pending();
+		qint64 bytes();
+		qint64 capacity();
+		// Milliseconds of video held
+		qint64 span();
+		// Capture time of the oldest frame held, -1 when empty
+		qint64 oldest();
+		QString stats();
+
+	private:
+		friend class PrerollThread;
+		void work();
+		void store(const Pending &pending, const QByteArray &scratch, int size);
+		int allocate(int size);
+};
+
+#endif // PREROLLRING_HPP
@@ -0,0 +1,273 @@
+#include "QoiCodec.hpp"
+
+#include <cstring>
+
+namespace
+{
+	const int HEADER_SIZE=14;
+	const uchar PADDING[8]={0, 0, 0, 0, 0, 0, 0, 1};
+
+	const uchar OP_INDEX=0x00;
+	const uchar OP_DIFF=0x40;
+	const uchar OP_LUMA=0x80;
+	const uchar OP_RUN=0xc0;
+	const uchar OP_RGB=0xfe;
+	const uchar OP_RGBA=0xff;
+	// Level 2 only, takes the place of the longest run. Followed by a count byte
+	const uchar OP_UP=0xfd;
+	const uchar MASK=0xc0;
+
+	// Runs shorter than this are cheaper as index or diff ops
+	const int MIN_UP=4;
+
+	inline int hash(quint32 p)
+	{
+		return (((p>>16)&0xff)*3+((p>>8)&0xff)*5+(p&0xff)*7+(p>>24)*11)&63;
+	}
+
+	inline void put32(uchar *out, quint32 v)
+	{
+		out[0]=uchar(v>>24);
+		out[1]=uchar(v>>16);
+		out[2]=uchar(v>>8);
+		out[3]=uchar(v);
+	}
+
+	inline quint32 get32(const uchar *in)
+	{
+		return (quint32(in[0])<<24) | (quint32(in[1])<<16) | (quint32(in[2])<<8) | quint32(in[3]);
+	}
+}
+
+
+int QoiCodec::maxSize(int width, int height)
+{
+	return width*height*5+HEADER_SIZE+int(sizeof(PADDING));
+}
+
+
+int QoiCodec::encode(const uchar *pixels, int width, int height, int stride, int level, uchar *out)
+{
+	level=qBound(0, level, MAX_LEVEL);
+	uchar *o=out;
+	memcpy(o, (2==level)?"msqf":"qoif", 4);
+	put32(o+4, width);
+	put32(o+8, height);
+	o[12]=4;
+	o[13]=0;
+	o+=HEADER_SIZE;
+
+	quint32 index[64]={0};
+	quint32 prev=0xff000000;
+	const int maxRun=(2==level)?61:62;
+	int run=0;
+	for(int y=0; y<height; ++y) {
+		const quint32 *row=reinterpret_cast<const quint32 *>(pixels+y*stride);
+		const quint32 *above=(2==level && y>0)?reinterpret_cast<const quint32 *>(pixels+(y-1)*stride):nullptr;
+		for(int x=0; x<width; ++x) {
+			const quint32 p=row[x];
+			if(p==prev) {
+				if(++run==maxRun) {
+					*o++=OP_RUN | uchar(run-1);
+					run=0;
+				}
+				continue;
+			}
+			if(run>0) {
+				*o++=OP_RUN | uchar(run-1);
+				run=0;
+			}
+			if(nullptr!=above && above[x]==p) {
+				int n=1;
+				const int end=qMin(width, x+256);
+				while(x+n<end && row[x+n]==above[x+n]) {
+					++n;
+				}
+				if(n>=MIN_UP) {
+					*o++=OP_UP;
+					*o++=uchar(n-1);
+					x+=n-1;
+					prev=row[x];
+					index[hash(prev)]=prev;
+					continue;
+				}
+			}
+			if(level>0) {
+				const int h=hash(p);
+				if(index[h]==p) {
+					*o++=OP_INDEX | uchar(h);
+					prev=p;
+					continue;
+				}
+				index[h]=p;
+				if((p>>24)==(prev>>24)) {
+					const signed char dr=static_cast<signed char>(((p>>16)&0xff)-((prev>>16)&0xff));
+					const signed char dg=static_cast<signed char>(((p>>8)&0xff)-((prev>>8)&0xff));
+					const signed char db=static_cast<signed char>((p&0xff)-(prev&0xff));
+					const signed char drg=static_cast<signed char>(dr-dg);
+					const signed char dbg=static_cast<signed char>(db-dg);
+					if(dr>=-2 && dr<=1 && dg>=-2 && dg<=1 && db>=-2 && db<=1) {
+						*o++=OP_DIFF | uchar((dr+2)<<4) | uchar((dg+2)<<2) | uchar(db+2);
+					} else if(dg>=-32 && dg<=31 && drg>=-8 && drg<=7 && dbg>=-8 && dbg<=7) {
+						*o++=OP_LUMA | uchar(dg+32);
+						*o++=uchar((drg+8)<<4) | uchar(dbg+8);
+					} else {
+						*o++=OP_RGB;
+						*o++=uchar(p>>16);
+						*o++=uchar(p>>8);
+						*o++=uchar(p);
+					}
+					prev=p;
+					continue;
+				}
+			} else if((p>>24)==(prev>>24)) {
+				*o++=OP_RGB;
+				*o++=uchar(p>>16);
+				*o++=uchar(p>>8);
+				*o++=uchar(p);
+				prev=p;
+				continue;
+			}
+			*o++=OP_RGBA;
+			*o++=uchar(p>>16);
+			*o++=uchar(p>>8);
+			*o++=uchar(p);
+			*o++=uchar(p>>24);
+			prev=p;
+		}
+	}
+	if(run>0) {
+		*o++=OP_RUN | uchar(run-1);
+	}
+	memcpy(o, PADDING, sizeof(PADDING));
+	o+=sizeof(PADDING);
+	return int(o-out);
+}
+
+
+bool QoiCodec::readHeader(const uchar *data, int size, int &width, int &height)
+{
+	if(size<HEADER_SIZE+int(sizeof(PADDING)) || (0!=memcmp(data, "qoif", 4) && 0!=memcmp(data, "msqf", 4))) {
+		return false;
+	}
+	width=int(get32(data+4));
+	height=int(get32(data+8));
+	return width>0 && height>0 && 4==data[12];
+}
+
+
+bool QoiCodec::decode(const uchar *data, int size, uchar *pixels, int stride)
+{
+	int width=0;
+	int height=0;
+	if(!readHeader(data, size, width, height)) {
+		return false;
+	}
+	const bool up=(0==memcmp(data, "msqf", 4));
+	const uchar *in=data+HEADER_SIZE;
+	const uchar *end=data+size-sizeof(PADDING);
+	quint32 index[64]={0};
+	quint32 prev=0xff000000;
+	int run=0;
+	for(int y=0; y<height; ++y) {
+		quint32 *row=reinterpret_cast<quint32 *>(pixels+y*stride);
+		const quint32 *above=(y>0)?reinterpret_cast<const quint32 *>(pixels+(y-1)*stride):nullptr;
+		int x=0;
+		while(x<width) {
+			if(run>0) {
+				const int n=qMin(run, width-x);
+				for(int i=0; i<n; ++i) {
+					row[x+i]=prev;
+				}
+				run-=n;
+				x+=n;
+				continue;
+			}
+			if(in>=end) {
+				return false;
+			}
+			const uchar op=*in++;
+			if(OP_RGB==op) {
+				if(end-in<3) {
+					return false;
+				}
+				prev=(prev&0xff000000) | (quint32(in[0])<<16) | (quint32(in[1])<<8) | quint32(in[2]);
+				in+=3;
+			} else if(OP_RGBA==op) {
+				if(end-in<4) {
+					return false;
+				}
+				prev=(quint32(in[3])<<24) | (quint32(in[0])<<16) | (quint32(in[1])<<8) | quint32(in[2]);
+				in+=4;
+			} else if(up && OP_UP==op) {
+				if(in>=end || nullptr==above) {
+					return false;
+				}
+				const int n=int(*in++)+1;
+				if(x+n>width) {
+					return false;
+				}
+				memcpy(row+x, above+x, n*sizeof(quint32));
+				x+=n;
+				prev=row[x-1];
+				index[hash(prev)]=prev;
+				continue;
+			} else if(OP_INDEX==(op&MASK)) {
+				row[x++]=prev=index[op];
+				continue;
+			} else if(OP_DIFF==(op&MASK)) {
+				const quint32 r=((prev>>16)+((op>>4)&3)-2)&0xff;
+				const quint32 g=((prev>>8)+((op>>2)&3)-2)&0xff;
+				const quint32 b=(prev+(op&3)-2)&0xff;
+				prev=(prev&0xff000000) | (r<<16) | (g<<8) | b;
+			} else if(OP_LUMA==(op&MASK)) {
+				if(in>=end) {
+					return false;
+				}
+				const int dg=int(op&0x3f)-32;
+				const int drg=int(*in>>4)-8;
+				const int dbg=int(*in&0x0f)-8;
+				++in;
+				const quint32 r=((prev>>16)+dg+drg)&0xff;
+				const quint32 g=((prev>>8)+dg)&0xff;
+				const quint32 b=(prev+dg+dbg)&0xff;
+				prev=(prev&0xff000000) | (r<<16) | (g<<8) | b;
+			} else {
+				run=int(op&0x3f)+1;
+				continue;
+			}
+			index[hash(prev)]=prev;
+			row[x++]=prev;
+		}
+	}
+	return true;
+}
+
+
+QByteArray QoiCodec::encode(const QImage &image, int level)
+{
+	if(image.isNull() || 32!=image.depth()) {
+		return QByteArray();
+	}
+	QByteArray out;
+	out.resize(maxSize(image.width(), image.height()));
+	const int size=encode(image.constBits(), image.width(), image.height(), image.bytesPerLine(), level, reinterpret_cast<uchar *>(out.data()));
+	out.resize(size);
+	return out;
+}
+
+
+QImage QoiCodec::decode(const QByteArray &data, QImage::Format format)
+{
+	const uchar *in=reinterpret_cast<const uchar *>(data.constData());
+	int width=0;
+	int height=0;
+	if(!readHeader(in, data.size(), width, height)) {
+		return QImage();
+	}
+	QImage image(width, height, format);
+	if(image.isNull() || 32!=image.depth() || !decode(in, data.size(), image.bits(), image.bytesPerLine())) {
+		return QImage();
+	}
+	return image;
+}
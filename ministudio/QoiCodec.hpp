@@ -0,0 +1,44 @@
+#ifndef QOICODEC_HPP
+#define QOICODEC_HPP
+
+#include <QImage>
+#include <QByteArray>
+
+/*
+  Fast lossless frame codec after QOI, the "Quite OK Image" format.
+
+  One pass over the pixels with no entropy coder, which is what makes it
+  fast enough to record 1080p60 on one core where PNG can't. Levels trade
+  speed for size:
+
+	0 only runs and literal pixels
+	1 full QOI, readable by any QOI decoder
+	2 QOI plus copies from the row above, for screen content with
+	  vertical repetition. Written with the magic "msqf" as standard
+	  decoders don't know the extra op
+
+  Pixels are coded as they are in memory, so premultiplied frames decode
+  to premultiplied frames. Composited frames are opaque, for those there
+  is no difference.
+*/
+class QoiCodec
+{
+	public:
+		static const int MAX_LEVEL=2;
+
+	public:
+		// Worst case size of an encoded image
+		static int maxSize(int width, int height);
+		// Encode 32 bit pixels (stride in bytes) into out, which must hold maxSize() bytes. Returns the size
+		static int encode(const uchar *pixels, int width, int height, int stride, int level, uchar *out);
+		// Read width and height from the header of an encoded image
+		static bool readHeader(const uchar *data, int size, int &width, int &height);
+		// Decode into 32 bit pixels of the size given by the header
+		static bool decode(const uchar *data, int size, uchar *pixels, int stride);
+
+		// Image conveniences for 32 bit formats
+		static QByteArray encode(const QImage &image, int level=1);
+		static QImage decode(const QByteArray &data, QImage::Format format=QImage::Format_ARGB32_Premultiplied);
+};
+
+#endif // QOICODEC_HPP
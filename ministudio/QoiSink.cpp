@@ -0,0 +1,50 @@
+#include "QoiSink.hpp"
+
+#include "QoiCodec.hpp"
+
+#include <QDebug>
+
+
+QoiSink::QoiSink(int level)
+	: mLevel(qBound(0, level, QoiCodec::MAX_LEVEL))
+{
+
+}
+
+QoiSink::~QoiSink()
+{
+
+}
+
+
+QString QoiSink::name()
+{
+	return "qoi";
+}
+
+
+QVector<QImage::Format> QoiSink::formats()
+{
+	// Frames are coded as they are in memory, so the composited frames go straight in. RGB32 is converted
+	// first, its padding byte would otherwise be decoded as alpha
+	QVector<QImage::Format> formats;
+	formats<<QImage::Format_ARGB32_Premultiplied;
+	return formats;
+}
+
+
+bool QoiSink::encode(const Frame &frame, QByteArray &data)
+{
+	data=QoiCodec::encode(frame.image, mLevel);
+	if(data.isEmpty()) {
+		qWarning()<<"ERROR: Could not encode frame"<<frame.index<<"as qoi";
+		return false;
+	}
+	return true;
+}
+
+
+QString QoiSink::suffix()
+{
+	return "qoi";
+}
@@ -0,0 +1,29 @@
+#ifndef QOISINK_HPP
+#define QOISINK_HPP
+
+#include "PngSink.hpp"
+
+/*
+  Records one frame_NNNNNN.qoi per frame with QoiCodec, for lossless image
+  sequences at full frame rate. Writing and syncing work as for PngSink.
+*/
+class QoiSink: public PngSink
+{
+	private:
+		int mLevel;
+
+	public:
+		// level is 0..QoiCodec::MAX_LEVEL, higher is smaller
+		explicit QoiSink(int level=1);
+		virtual ~QoiSink();
+
+	public:
+		QString name() override;
+		QVector<QImage::Format> formats() override;
+
+	protected:
+		bool encode(const Frame &frame, QByteArray &data) override;
+		QString suffix() override;
+};
+
+#endif // QOISINK_HPP
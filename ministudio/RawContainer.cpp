@@ -0,0 +1,137 @@
+#include "RawContainer.hpp"
+
+#include <QDebug>
+
+#include <cstring>
+
+
+RawContainer::Header RawContainer::makeHeader(const QSize &size, QImage::Format format, quint64 capacity, qreal fps, qint64 startTime)
+{
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(header.magic));
+	header.version=VERSION;
+	header.headerSize=HEADER_SIZE;
+	header.width=size.width();
+	header.height=size.height();
+	header.stride=size.width()*4;
+	header.format=format;
+	header.capacity=capacity;
+	header.indexOffset=HEADER_SIZE;
+	const quint64 indexEnd=header.indexOffset+capacity*sizeof(IndexEntry);
+	header.dataOffset=((indexEnd+PAGE_SIZE-1)/PAGE_SIZE)*PAGE_SIZE;
+	header.frameBytes=quint64(header.stride)*header.height;
+	header.frameCount=0;
+	header.fps=fps;
+	header.startTime=startTime;
+	return header;
+}
+
+
+bool RawContainer::isValid(const Header &header)
+{
+	return 0==memcmp(header.magic, MAGIC, sizeof(header.magic))
+		   && VERSION==header.version
+		   && header.stride>=header.width*4
+		   && header.frameBytes==quint64(header.stride)*header.height
+		   && header.frameCount<=header.capacity
+		   && header.dataOffset>=header.indexOffset+header.capacity*sizeof(IndexEntry);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+RawReader::RawReader()
+	: mMap(nullptr)
+{
+
+}
+
+RawReader::~RawReader()
+{
+	close();
+}
+
+
+bool RawReader::open(const QString &filename)
+{
+	close();
+	mFile.setFileName(filename);
+	if(!mFile.open(QIODevice::ReadOnly)) {
+		mError=mFile.errorString();
+		return false;
+	}
+	if(mFile.size()<qint64(RawContainer::HEADER_SIZE)) {
+		mError="File too small for a raw container";
+		close();
+		return false;
+	}
+	mMap=mFile.map(0, mFile.size());
+	if(nullptr==mMap) {
+		mError=mFile.errorString();
+		close();
+		return false;
+	}
+	const RawContainer::Header &h=header();
+	if(!RawContainer::isValid(h)) {
+		mError="Not a raw container or unsupported version";
+		close();
+		return false;
+	}
+	if(h.dataOffset+h.frameCount*h.frameBytes>quint64(mFile.size())) {
+		mError="Raw container is truncated";
+		close();
+		return false;
+	}
+	return true;
+}
+
+
+void RawReader::close()
+{
+	if(nullptr!=mMap) {
+		mFile.unmap(mMap);
+		mMap=nullptr;
+	}
+	mFile.close();
+}
+
+
+QString RawReader::errorString()
+{
+	return mError;
+}
+
+
+const RawContainer::Header &RawReader::header()
+{
+	return *reinterpret_cast<const RawContainer::Header *>(mMap);
+}
+
+
+quint64 RawReader::frameCount()
+{
+	return (nullptr==mMap)?0:header().frameCount;
+}
+
+
+RawContainer::IndexEntry RawReader::entry(quint64 i)
+{
+	const RawContainer::Header &h=header();
+	return reinterpret_cast<const RawContainer::IndexEntry *>(mMap+h.indexOffset)[i];
+}
+
+
+QImage RawReader::frame(quint64 i)
+{
+	if(i>=frameCount()) {
+		return QImage();
+	}
+	const RawContainer::Header &h=header();
+	const RawContainer::IndexEntry e=entry(i);
+	if(e.offset+h.frameBytes>quint64(mFile.size())) {
+		return QImage();
+	}
+	return QImage(mMap+e.offset, h.width, h.height, h.stride, static_cast<QImage::Format>(h.format));
+}
@@ -0,0 +1,87 @@
+#ifndef RAWCONTAINER_HPP
+#define RAWCONTAINER_HPP
+
+#include <QImage>
+#include <QFile>
+#include <QString>
+
+/*
+  Layout of raw frame recordings (.msraw files).
+
+	[header, HEADER_SIZE bytes]
+	[index, capacity entries of IndexEntry]
+	[frame data, frameBytes per frame, starting page aligned]
+
+  Frames are stored exactly as composited, row after row with the stride
+  from the header. Numbers are in host byte order, which is little endian
+  on every machine we record on. frameCount is updated after the frame
+  and its index entry are complete, so readers only ever see whole frames.
+*/
+namespace RawContainer
+{
+	const char MAGIC[8]={'M', 'S', 'R', 'A', 'W', 'F', 'R', '1'};
+	const quint32 VERSION=2;
+	const quint32 HEADER_SIZE=4096;
+	const quint64 PAGE_SIZE=4096;
+
+	struct Header {
+		char magic[8];
+		quint32 version;
+		quint32 headerSize;
+		quint32 width;
+		quint32 height;
+		quint32 stride;
+		// QImage::Format of the frames
+		quint32 format;
+		// Number of index entries reserved
+		quint64 capacity;
+		quint64 indexOffset;
+		quint64 dataOffset;
+		quint64 frameBytes;
+		quint64 frameCount;
+		double fps;
+		// Milliseconds since epoch when the recording started
+		qint64 startTime;
+	};
+
+	struct IndexEntry {
+		quint64 id;
+		// Capture time in ns on the steady clock
+		qint64 timestamp;
+		quint64 offset;
+	};
+
+	static_assert(sizeof(Header)<=HEADER_SIZE, "Raw container header does not fit");
+	static_assert(sizeof(IndexEntry)==24, "Raw container index entry must be packed");
+
+	// Fill in a header for frames of the given size, with room for capacity index entries
+	Header makeHeader(const QSize &size, QImage::Format format, quint64 capacity, qreal fps, qint64 startTime);
+	bool isValid(const Header &header);
+}
+
+
+// Read only access to a raw container through a memory mapping
+class RawReader
+{
+	private:
+		QFile mFile;
+		uchar *mMap;
+		QString mError;
+
+	public:
+		explicit RawReader();
+		virtual ~RawReader();
+
+	public:
+		bool open(const QString &filename);
+		void close();
+		QString errorString();
+
+		const RawContainer::Header &header();
+		quint64 frameCount();
+		RawContainer::IndexEntry entry(quint64 i);
+		// The frame wraps the mapped memory, it is only valid while the reader is open
+		QImage frame(quint64 i);
+};
+
+#endif // RAWCONTAINER_HPP
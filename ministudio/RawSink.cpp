@@ -0,0 +1,218 @@
+#include "RawSink.hpp"
+
+#include "RecordingJournal.hpp"
+
+#include <QDateTime>
+#include <QDebug>
+
+#include <atomic>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+RawSink::RawSink(quint64 capacity, quint64 chunkFrames, bool journaled)
+	: mCapacity(qMax<quint64>(1, capacity))
+	, mChunkFrames(qMax<quint64>(1, chunkFrames))
+	, mIndexMap(nullptr)
+	, mChunkMap(nullptr)
+	, mChunkFirst(0)
+	, mAllocated(0)
+	, mCount(0)
+	, mJournaled(journaled)
+{
+
+}
+
+RawSink::~RawSink()
+{
+	close();
+}
+
+
+bool RawSink::open(const QString &basePath, const QSize &size, qreal fps)
+{
+	close();
+	mFile.setFileName(basePath+"/recording.msraw");
+	if(!mFile.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+		qWarning()<<"ERROR: Could not open"<<mFile.fileName()<<":"<<mFile.errorString();
+		return false;
+	}
+	const RawContainer::Header h=RawContainer::makeHeader(size, formats().first(), mCapacity, fps, QDateTime::currentMSecsSinceEpoch());
+	// The index is left sparse, only the pages actually used ever get written
+	if(!mFile.resize(h.dataOffset)) {
+		qWarning()<<"ERROR: Could not size"<<mFile.fileName()<<":"<<mFile.errorString();
+		mFile.close();
+		return false;
+	}
+	mIndexMap=mFile.map(0, h.dataOffset);
+	if(nullptr==mIndexMap) {
+		qWarning()<<"ERROR: Could not map"<<mFile.fileName()<<":"<<mFile.errorString();
+		mFile.close();
+		return false;
+	}
+	memcpy(mIndexMap, &h, sizeof(h));
+	mAllocated=0;
+	mCount=0;
+	if(mJournaled) {
+		mJournal.open(mFile.fileName());
+	}
+	return true;
+}
+
+
+RawContainer::Header &RawSink::header()
+{
+	return *reinterpret_cast<RawContainer::Header *>(mIndexMap);
+}
+
+
+bool RawSink::mapChunk(quint64 frame)
+{
+	const RawContainer::Header &h=header();
+	const quint64 first=(frame/mChunkFrames)*mChunkFrames;
+	if(nullptr!=mChunkMap && first==mChunkFirst) {
+		return true;
+	}
+	if(nullptr!=mChunkMap) {
+		mFile.unmap(mChunkMap);
+		mChunkMap=nullptr;
+	}
+	const quint64 offset=h.dataOffset+first*h.frameBytes;
+	const quint64 bytes=mChunkFrames*h.frameBytes;
+	if(first+mChunkFrames>mAllocated) {
+		const quint64 end=offset+bytes;
+#ifdef Q_OS_LINUX
+		// Reserve real blocks so writing through the mapping can't fail with SIGBUS on a full disk
+		if(0!=::posix_fallocate(mFile.handle(), static_cast<off_t>(offset), static_cast<off_t>(bytes))) {
+			qWarning()<<"ERROR: Could not allocate"<<bytes<<"bytes in"<<mFile.fileName();
+			return false;
+		}
+#endif
+		if(!mFile.resize(static_cast<qint64>(end))) {
+			qWarning()<<"ERROR: Could not grow"<<mFile.fileName()<<":"<<mFile.errorString();
+			return false;
+		}
+		mAllocated=first+mChunkFrames;
+	}
+	mChunkMap=mFile.map(static_cast<qint64>(offset), static_cast<qint64>(bytes));
+	if(nullptr==mChunkMap) {
+		qWarning()<<"ERROR: Could not map"<<mFile.fileName()<<":"<<mFile.errorString();
+		return false;
+	}
+	mChunkFirst=first;
+	return true;
+}
+
+
+bool RawSink::write(const Frame &frame)
+{
+	if(nullptr==mIndexMap) {
+		mDropped.fetchAndAddRelaxed(1);
+		return false;
+	}
+	RawContainer::Header &h=header();
+	const QImage &image=frame.image;
+	if(mCount>=h.capacity || image.width()!=int(h.width) || image.height()!=int(h.height) || !formats().contains(image.format())) {
+		mDropped.fetchAndAddRelaxed(1);
+		return false;
+	}
+	if(!mapChunk(mCount)) {
+		mDropped.fetchAndAddRelaxed(1);
+		return false;
+	}
+	uchar *dst=mChunkMap+(mCount-mChunkFirst)*h.frameBytes;
+	const int rowBytes=h.width*4;
+	if(image.bytesPerLine()==int(h.stride)) {
+		memcpy(dst, image.constBits(), h.frameBytes);
+	} else {
+		for(quint32 y=0; y<h.height; ++y) {
+			memcpy(dst+y*h.stride, image.constScanLine(y), rowBytes);
+		}
+	}
+	RawContainer::IndexEntry *index=reinterpret_cast<RawContainer::IndexEntry *>(mIndexMap+h.indexOffset);
+	index[mCount]=RawContainer::IndexEntry{frame.id, frame.timestamp, h.dataOffset+mCount*h.frameBytes};
+	mJournal.append(RecordingJournal::Entry{mCount, frame.id, frame.timestamp, h.dataOffset+mCount*h.frameBytes, h.frameBytes, 0, 0});
+	// Readers of a live file must never see the count before the frame it counts
+	std::atomic_thread_fence(std::memory_order_release);
+	h.frameCount=++mCount;
+	mWritten.fetchAndAddRelaxed(1);
+	mBytes.fetchAndAddRelaxed(h.frameBytes);
+	return true;
+}
+
+
+void RawSink::sync()
+{
+	if(!mFile.isOpen()) {
+		return;
+	}
+#if defined(Q_OS_LINUX)
+	// Shared mappings live in the page cache, so this covers them too
+	::fdatasync(mFile.handle());
+#elif defined(Q_OS_UNIX)
+	::fsync(mFile.handle());
+#endif
+	// Only now are the frames written since the last sync safe to list
+	mJournal.commit();
+}
+
+
+void RawSink::close()
+{
+	if(!mFile.isOpen()) {
+		return;
+	}
+	quint64 end=0;
+	if(nullptr!=mIndexMap) {
+		const RawContainer::Header &h=header();
+		end=h.dataOffset+mCount*h.frameBytes;
+	}
+	if(nullptr!=mChunkMap) {
+		mFile.unmap(mChunkMap);
+		mChunkMap=nullptr;
+	}
+	if(nullptr!=mIndexMap) {
+		mFile.unmap(mIndexMap);
+		mIndexMap=nullptr;
+	}
+	// Give back what was allocated ahead but never used
+	if(end>0 && !mFile.resize(static_cast<qint64>(end))) {
+		qWarning()<<"ERROR: Could not trim"<<mFile.fileName()<<":"<<mFile.errorString();
+	}
+	sync();
+	mFile.close();
+	mJournal.remove();
+	mAllocated=0;
+}
+
+
+bool RawSink::isOpen()
+{
+	return nullptr!=mIndexMap;
+}
+
+
+QString RawSink::name()
+{
+	return "raw";
+}
+
+
+QVector<QImage::Format> RawSink::formats()
+{
+	// Stored as composited, so the writer never has to convert. The header records one format, and the padding
+	// byte of RGB32 is not alpha, so RGB32 frames are left to FormatNegotiator which makes them opaque
+	QVector<QImage::Format> formats;
+	formats<<QImage::Format_ARGB32_Premultiplied;
+	return formats;
+}
+
+
+QString RawSink::filename()
+{
+	return mFile.fileName();
+}
@@ -0,0 +1,58 @@
+#ifndef RAWSINK_HPP
+#define RAWSINK_HPP
+
+#include "FrameSink.hpp"
+#include "RawContainer.hpp"
+#include "RecordingJournal.hpp"
+
+#include <QFile>
+
+/*
+  Records the composited frames untouched into one memory mapped raw
+  container (see RawContainer.hpp), for when the disk is fast and the CPU
+  is busy. Nothing is encoded while recording, frames are copied into the
+  mapping and the page cache does the writing. Use rawconvert to turn the
+  recording into PNGs or a video afterwards.
+
+  The file grows in chunks of frames that are allocated up front, so the
+  file system is not asked for space on every frame.
+
+  Journaled, every sync() also commits the frames written since to a
+  RecordingJournal, so a crash costs at most one sync interval.
+*/
+class RawSink: public FrameSink
+{
+	private:
+		QFile mFile;
+		quint64 mCapacity;
+		quint64 mChunkFrames;
+		uchar *mIndexMap;
+		uchar *mChunkMap;
+		quint64 mChunkFirst;
+		quint64 mAllocated;
+		quint64 mCount;
+		bool mJournaled;
+		RecordingJournal mJournal;
+
+	public:
+		// capacity is the maximum number of frames, chunkFrames how many frames the file grows by at a time
+		explicit RawSink(quint64 capacity=(1<<20), quint64 chunkFrames=64, bool journaled=false);
+		virtual ~RawSink();
+
+	public:
+		bool open(const QString &basePath, const QSize &size, qreal fps) override;
+		bool write(const Frame &frame) override;
+		void sync() override;
+		void close() override;
+		bool isOpen() override;
+		QString name() override;
+		QVector<QImage::Format> formats() override;
+
+		QString filename();
+
+	private:
+		RawContainer::Header &header();
+		bool mapChunk(quint64 frame);
+};
+
+#endif // RAWSINK_HPP
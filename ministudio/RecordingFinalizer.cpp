@@ -0,0 +1,141 @@
+#include "RecordingFinalizer.hpp"
+
+#include "FrameSink.hpp"
+#include "FrameWriter.hpp"
+
+#include <QThread>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QDebug>
+
+
+class RecordingFinalizerThread: public QThread
+{
+	private:
+		RecordingFinalizer *mFinalizer;
+
+	public:
+		explicit RecordingFinalizerThread(RecordingFinalizer *finalizer)
+			: mFinalizer(finalizer)
+		{
+
+		}
+
+		void run() override
+		{
+			mFinalizer->work();
+		}
+};
+
+
+RecordingFinalizer::RecordingFinalizer()
+	: mThread(new RecordingFinalizerThread(this))
+	, mBusy(false)
+	, mFinished(0)
+{
+	mThread->setObjectName("RecordingFinalizer");
+	mThread->start(QThread::LowPriority);
+}
+
+RecordingFinalizer::~RecordingFinalizer()
+{
+	waitForIdle();
+	mThread->requestInterruption();
+	{
+		QMutexLocker lock(&mMutex);
+		mWake.wakeAll();
+	}
+	mThread->wait();
+	delete mThread;
+	mThread=nullptr;
+}
+
+
+void RecordingFinalizer::finish(FrameSink *sink)
+{
+	if(nullptr==sink) {
+		return;
+	}
+	// Whatever the sink owns that has thread affinity must live where it gets closed
+	sink->moveToThread(mThread);
+	post([sink]() {
+		sink->close();
+		qDebug()<<"FINALIZER: closed segment"<<sink->stats();
+		delete sink;
+	});
+}
+
+
+void RecordingFinalizer::finish(FrameWriter *writer)
+{
+	if(nullptr==writer) {
+		return;
+	}
+	post([writer]() {
+		writer->finish();
+		delete writer;
+	});
+}
+
+
+void RecordingFinalizer::post(std::function<void()> job)
+{
+	QMutexLocker lock(&mMutex);
+	mJobs<<job;
+	mWake.wakeOne();
+}
+
+
+void RecordingFinalizer::work()
+{
+	QMutexLocker lock(&mMutex);
+	while(true) {
+		if(mJobs.isEmpty()) {
+			mBusy=false;
+			mIdle.wakeAll();
+			if(mThread->isInterruptionRequested()) {
+				break;
+			}
+			mWake.wait(&mMutex);
+			continue;
+		}
+		std::function<void()> job=mJobs.takeFirst();
+		mBusy=true;
+		lock.unlock();
+		QElapsedTimer timer;
+		timer.start();
+		job();
+		lock.relock();
+		mFinished++;
+		qDebug()<<"FINALIZER: job"<<mFinished<<"took"<<timer.elapsed()<<"ms,"<<mJobs.size()<<"left";
+	}
+}
+
+
+void RecordingFinalizer::waitForIdle()
+{
+	QMutexLocker lock(&mMutex);
+	while(mBusy || !mJobs.isEmpty()) {
+		mIdle.wait(&mMutex);
+	}
+}
+
+
+int RecordingFinalizer::pending()
+{
+	QMutexLocker lock(&mMutex);
+	return mJobs.size()+(mBusy?1:0);
+}
+
+
+QThread *RecordingFinalizer::thread()
+{
+	return mThread;
+}
+
+
+RecordingFinalizer *RecordingFinalizer::globalInstance()
+{
+	static RecordingFinalizer *finalizer=new RecordingFinalizer();
+	return finalizer;
+}
@@ -0,0 +1,56 @@
+#ifndef RECORDINGFINALIZER_HPP
+#define RECORDINGFINALIZER_HPP
+
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <functional>
+
+class QThread;
+class FrameSink;
+class FrameWriter;
+
+/*
+  Finishes recordings in the background.
+
+  Closing a recording can take seconds (encoders flushing, files being
+  synced), so finished segments and stopped writers are handed over here
+  and closed one after the other on the finalizer's own thread, while the
+  live pipeline goes on. Call waitForIdle() before the process exits.
+*/
+class RecordingFinalizer
+{
+	private:
+		QThread *mThread;
+		QMutex mMutex;
+		QWaitCondition mWake;
+		QWaitCondition mIdle;
+		QList<std::function<void()> > mJobs;
+		bool mBusy;
+		quint64 mFinished;
+
+	public:
+		explicit RecordingFinalizer();
+		virtual ~RecordingFinalizer();
+
+	public:
+		// Close and delete the sink in the background
+		void finish(FrameSink *sink);
+		// Finish and delete the writer in the background
+		void finish(FrameWriter *writer);
+		void post(std::function<void()> job);
+		// Block until everything handed over has been finished
+		void waitForIdle();
+		int pending();
+		QThread *thread();
+
+	public:
+		static RecordingFinalizer *globalInstance();
+
+	private:
+		friend class RecordingFinalizerThread;
+		void work();
+};
+
+#endif // RECORDINGFINALIZER_HPP
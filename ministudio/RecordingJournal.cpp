@@ -0,0 +1,281 @@
+#include "RecordingJournal.hpp"
+
+#include "RawContainer.hpp"
+#include "TileContainer.hpp"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <cstddef>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+	const char JOURNAL_MAGIC[8]={'M', 'S', 'J', 'R', 'N', 'L', '0', '1'};
+
+	static_assert(sizeof(RecordingJournal::Entry)==48, "Journal entries must be packed");
+
+	void syncFile(QFile &file)
+	{
+		file.flush();
+#if defined(Q_OS_LINUX)
+		::fdatasync(file.handle());
+#elif defined(Q_OS_UNIX)
+		::fsync(file.handle());
+#endif
+	}
+}
+
+
+RecordingJournal::RecordingJournal()
+	: mCommitted(0)
+{
+
+}
+
+RecordingJournal::~RecordingJournal()
+{
+	if(mFile.isOpen()) {
+		mFile.close();
+	}
+}
+
+
+bool RecordingJournal::open(const QString &container)
+{
+	if(mFile.isOpen()) {
+		mFile.close();
+	}
+	mPending.clear();
+	mCommitted=0;
+	mFile.setFileName(journalName(container));
+	if(!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qWarning()<<"ERROR: Could not create journal"<<mFile.fileName()<<":"<<mFile.errorString();
+		return false;
+	}
+	if(sizeof(JOURNAL_MAGIC)!=mFile.write(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC))) {
+		qWarning()<<"ERROR: Could not write journal"<<mFile.fileName()<<":"<<mFile.errorString();
+		mFile.close();
+		return false;
+	}
+	syncFile(mFile);
+	return true;
+}
+
+
+void RecordingJournal::append(const Entry &entry)
+{
+	if(!mFile.isOpen()) {
+		return;
+	}
+	Entry e=entry;
+	e.check=checkValue(e);
+	mPending<<e;
+}
+
+
+bool RecordingJournal::commit()
+{
+	if(!mFile.isOpen() || mPending.isEmpty()) {
+		return true;
+	}
+	const qint64 bytes=mPending.size()*qint64(sizeof(Entry));
+	if(bytes!=mFile.write(reinterpret_cast<const char *>(mPending.constData()), bytes)) {
+		qWarning()<<"ERROR: Could not write journal"<<mFile.fileName()<<":"<<mFile.errorString();
+		return false;
+	}
+	syncFile(mFile);
+	mCommitted+=quint64(mPending.size());
+	mPending.clear();
+	return true;
+}
+
+
+void RecordingJournal::remove()
+{
+	if(!mFile.isOpen()) {
+		return;
+	}
+	mFile.close();
+	mFile.remove();
+	mPending.clear();
+}
+
+
+bool RecordingJournal::isOpen()
+{
+	return mFile.isOpen();
+}
+
+
+quint64 RecordingJournal::committed()
+{
+	return mCommitted;
+}
+
+
+QString RecordingJournal::journalName(const QString &container)
+{
+	return container+".journal";
+}
+
+
+quint32 RecordingJournal::checkValue(const Entry &entry)
+{
+	// FNV-1a over everything but the check itself
+	const uchar *p=reinterpret_cast<const uchar *>(&entry);
+	quint32 hash=2166136261u;
+	for(size_t i=0; i<offsetof(Entry, check); ++i) {
+		hash=(hash^p[i])*16777619u;
+	}
+	return hash;
+}
+
+
+bool RecordingJournal::read(const QString &journal, QVector<Entry> &entries)
+{
+	entries.clear();
+	QFile file(journal);
+	if(!file.open(QIODevice::ReadOnly)) {
+		qWarning()<<"ERROR: Could not open journal"<<journal<<":"<<file.errorString();
+		return false;
+	}
+	const QByteArray data=file.readAll();
+	if(data.size()<int(sizeof(JOURNAL_MAGIC)) || 0!=memcmp(data.constData(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC))) {
+		qWarning()<<"ERROR:"<<journal<<"is not a recording journal";
+		return false;
+	}
+	const int count=(data.size()-int(sizeof(JOURNAL_MAGIC)))/int(sizeof(Entry));
+	for(int i=0; i<count; ++i) {
+		Entry e;
+		memcpy(&e, data.constData()+sizeof(JOURNAL_MAGIC)+i*sizeof(Entry), sizeof(Entry));
+		if(e.check!=checkValue(e) || e.index!=quint64(i)) {
+			break;
+		}
+		entries<<e;
+	}
+	return true;
+}
+
+
+bool RecordingJournal::recover(const QString &journal)
+{
+	QString container=journal;
+	container.chop(QString(".journal").size());
+	QVector<Entry> entries;
+	if(!read(journal, entries)) {
+		return false;
+	}
+	qDebug()<<"JOURNAL: recovering"<<container<<"with"<<entries.size()<<"frames";
+	bool ok=false;
+	if(container.endsWith(".msraw")) {
+		ok=recoverRaw(container, entries);
+	} else if(container.endsWith(".mstile")) {
+		ok=recoverTiles(container, entries);
+	} else {
+		qWarning()<<"ERROR: No recovery for"<<container;
+	}
+	if(ok) {
+		QFile::remove(journal);
+	}
+	return ok;
+}
+
+
+int RecordingJournal::recoverAll(const QString &root)
+{
+	int recovered=0;
+	QStringList dirs;
+	const QStringList recordings=QDir(root).entryList(QStringList()<<"MiniStudio_*", QDir::Dirs|QDir::NoDotAndDotDot);
+	for(const QString &recording:recordings) {
+		const QDir dir(QDir(root).filePath(recording));
+		dirs<<dir.absolutePath();
+		// Segmented recordings keep a container per segment
+		for(const QString &segment:dir.entryList(QStringList()<<"segment_*", QDir::Dirs|QDir::NoDotAndDotDot)) {
+			dirs<<dir.filePath(segment);
+		}
+	}
+	for(const QString &path:dirs) {
+		for(const QString &journal:QDir(path).entryList(QStringList()<<"*.journal", QDir::Files)) {
+			if(recover(QDir(path).filePath(journal))) {
+				recovered++;
+			}
+		}
+	}
+	return recovered;
+}
+
+
+bool RecordingJournal::recoverRaw(const QString &container, const QVector<Entry> &entries)
+{
+	QFile file(container);
+	if(!file.open(QIODevice::ReadWrite)) {
+		qWarning()<<"ERROR: Could not open"<<container<<":"<<file.errorString();
+		return false;
+	}
+	RawContainer::Header h;
+	if(sizeof(h)!=file.read(reinterpret_cast<char *>(&h), sizeof(h)) || !RawContainer::isValid(h)) {
+		qWarning()<<"ERROR:"<<container<<"has no valid header, can't recover it";
+		return false;
+	}
+	const quint64 frames=qMin<quint64>(h.capacity, quint64(entries.size()));
+	// Rebuild the index from the journal, what was mapped may not have reached the disk
+	QVector<RawContainer::IndexEntry> index;
+	for(quint64 i=0; i<frames; ++i) {
+		const Entry &e=entries[int(i)];
+		index<<RawContainer::IndexEntry{e.id, e.timestamp, e.offset};
+	}
+	const qint64 indexBytes=index.size()*qint64(sizeof(RawContainer::IndexEntry));
+	h.frameCount=frames;
+	if(!file.seek(qint64(h.indexOffset)) || indexBytes!=file.write(reinterpret_cast<const char *>(index.constData()), indexBytes)
+			|| !file.seek(0) || sizeof(h)!=file.write(reinterpret_cast<const char *>(&h), sizeof(h))
+			|| !file.resize(qint64(h.dataOffset+frames*h.frameBytes))) {
+		qWarning()<<"ERROR: Could not repair"<<container<<":"<<file.errorString();
+		return false;
+	}
+	syncFile(file);
+	return true;
+}
+
+
+bool RecordingJournal::recoverTiles(const QString &container, const QVector<Entry> &entries)
+{
+	QFile file(container);
+	if(!file.open(QIODevice::ReadWrite)) {
+		qWarning()<<"ERROR: Could not open"<<container<<":"<<file.errorString();
+		return false;
+	}
+	TileContainer::Header h;
+	if(sizeof(h)!=file.read(reinterpret_cast<char *>(&h), sizeof(h)) || !TileContainer::isValid(h)) {
+		qWarning()<<"ERROR:"<<container<<"has no valid header, can't recover it";
+		return false;
+	}
+	// Everything after the last journaled frame goes, then the index the sink would have written on close
+	QVector<TileContainer::Keyframe> keyframes;
+	for(const Entry &e:entries) {
+		if(0!=(e.flags & TileContainer::KEYFRAME)) {
+			keyframes<<TileContainer::Keyframe{e.index+1, e.offset};
+		}
+	}
+	const quint64 end=entries.isEmpty()?sizeof(h):(entries.last().offset+entries.last().bytes);
+	TileContainer::Trailer trailer;
+	trailer.frames=quint64(entries.size());
+	trailer.keyframes=quint64(keyframes.size());
+	trailer.offset=end;
+	memcpy(trailer.magic, TileContainer::TRAILER_MAGIC, sizeof(trailer.magic));
+	const qint64 bytes=keyframes.size()*qint64(sizeof(TileContainer::Keyframe));
+	if(!file.resize(qint64(end)) || !file.seek(qint64(end))
+			|| bytes!=file.write(reinterpret_cast<const char *>(keyframes.constData()), bytes)
+			|| sizeof(trailer)!=file.write(reinterpret_cast<const char *>(&trailer), sizeof(trailer))) {
+		qWarning()<<"ERROR: Could not repair"<<container<<":"<<file.errorString();
+		return false;
+	}
+	syncFile(file);
+	return true;
+}
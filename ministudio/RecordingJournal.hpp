@@ -0,0 +1,73 @@
+#ifndef RECORDINGJOURNAL_HPP
+#define RECORDINGJOURNAL_HPP
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+/*
+  Crash safety for container recordings.
+
+  Next to the container (recording.msraw or recording.mstile) an append
+  only <container>.journal lists the frames known to be on disk. Sinks
+  append() an entry per frame and commit() after syncing the container,
+  so the journal never lists a frame whose data could still be lost. The
+  writer syncs at a fixed interval, which bounds what a crash can cost.
+
+  A cleanly closed recording removes its journal. One left behind means
+  the recorder died, and recover() cuts the container back to the frames
+  in the journal and completes its index so it plays again. Entries carry
+  a check value, a torn entry at the end ends the journal.
+*/
+class RecordingJournal
+{
+	public:
+		struct Entry {
+			// Position in the container, starting at 0
+			quint64 index;
+			quint64 id;
+			qint64 timestamp;
+			// Where the frame's record starts in the container and how long it is
+			quint64 offset;
+			quint64 bytes;
+			// Container specific, TileContainer::KEYFRAME for tile recordings
+			quint32 flags;
+			quint32 check;
+		};
+
+	private:
+		QFile mFile;
+		QVector<Entry> mPending;
+		quint64 mCommitted;
+
+	public:
+		explicit RecordingJournal();
+		virtual ~RecordingJournal();
+
+	public:
+		// Start the journal of a container, replacing any old one
+		bool open(const QString &container);
+		void append(const Entry &entry);
+		// The container has been synced, write what was appended since and sync the journal
+		bool commit();
+		// The container is complete, the journal is no longer needed
+		void remove();
+		bool isOpen();
+		quint64 committed();
+
+	public:
+		static QString journalName(const QString &container);
+		// The valid entries of a journal, up to the first torn one
+		static bool read(const QString &journal, QVector<Entry> &entries);
+		// Repair the container of a journal left behind and remove the journal
+		static bool recover(const QString &journal);
+		// Recover every recording below root that still has a journal
+		static int recoverAll(const QString &root);
+
+	private:
+		static quint32 checkValue(const Entry &entry);
+		static bool recoverRaw(const QString &container, const QVector<Entry> &entries);
+		static bool recoverTiles(const QString &container, const QVector<Entry> &entries);
+};
+
+#endif // RECORDINGJOURNAL_HPP
@@ -0,0 +1,120 @@
+#include "RenderPlan.hpp"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QList>
+#include <QDebug>
+
+namespace
+{
+	// Plans of frames in flight plus a few spare, more than this are freed
+	const int MAX_FREE_PLANS=16;
+
+	QMutex sFreeMutex;
+	QList<RenderPlan *> sFreePlans;
+}
+
+
+RenderPlan::RenderPlan(int capacity)
+{
+	mRecords.reserve(capacity);
+	mImageLayers.reserve(capacity);
+	mTitleLayers.reserve(1);
+}
+
+RenderPlan::~RenderPlan()
+{
+
+}
+
+
+void RenderPlan::reset()
+{
+	// resize(0) keeps the capacity, clear() frees it on older Qt versions
+	mRecords.resize(0);
+	mImageLayers.resize(0);
+	mTitleLayers.resize(0);
+}
+
+
+void RenderPlan::addImageLayer(int id, QSharedPointer<QImage> image, qreal opacity, QTransform trans, bool retained)
+{
+	mRecords.append(Record{ImageKind, id, mImageLayers.size()});
+	mImageLayers.append(ImageLayer(image, opacity, trans, retained));
+}
+
+
+void RenderPlan::addTitleLayer(int id, QString title, QString subTitle, qreal opacity, QTransform trans)
+{
+	mRecords.append(Record{TitleKind, id, mTitleLayers.size()});
+	mTitleLayers.append(TitleLayer(title, subTitle, opacity, trans));
+}
+
+
+int RenderPlan::size() const
+{
+	return mRecords.size();
+}
+
+
+const RenderPlan::Record &RenderPlan::record(int i) const
+{
+	return mRecords.at(i);
+}
+
+
+Layer *RenderPlan::layer(int i)
+{
+	const Record &r=mRecords.at(i);
+	switch(r.kind) {
+		case ImageKind: return mImageLayers.data()+r.index;
+		case TitleKind: return mTitleLayers.data()+r.index;
+	}
+	return nullptr;
+}
+
+
+Layer *RenderPlan::layerByID(int id)
+{
+	for(int i=0; i<mRecords.size(); ++i) {
+		if(id==mRecords.at(i).id) {
+			return layer(i);
+		}
+	}
+	return nullptr;
+}
+
+
+int RenderPlan::cameraLayerID(int index)
+{
+	return (index<=0)?CameraLayerID:(ExtraCameraLayerID+index-1);
+}
+
+
+RenderPlan *RenderPlan::acquire()
+{
+	{
+		QMutexLocker lock(&sFreeMutex);
+		if(!sFreePlans.isEmpty()) {
+			return sFreePlans.takeLast();
+		}
+	}
+	return new RenderPlan();
+}
+
+
+void RenderPlan::recycle(RenderPlan *plan)
+{
+	if(nullptr==plan) {
+		return;
+	}
+	// Let go of the layer images now rather than when the plan is reused
+	plan->reset();
+	QMutexLocker lock(&sFreeMutex);
+	if(sFreePlans.size()<MAX_FREE_PLANS) {
+		sFreePlans.append(plan);
+		return;
+	}
+	lock.unlock();
+	delete plan;
+}
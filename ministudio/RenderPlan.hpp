@@ -0,0 +1,77 @@
+#ifndef RENDERPLAN_HPP
+#define RENDERPLAN_HPP
+
+#include "Layer.hpp"
+
+#include <QVector>
+
+
+/*
+  The layer stack of one frame as flat arrays.
+
+  Layers are stored by value in one contiguous array per kind, and the
+  compositing order is a contiguous array of small records pointing into
+  them. reset() destroys the layers but keeps the capacity, and plans are
+  recycled through acquire()/recycle(), so building a scene in steady state
+  does not touch the heap.
+
+  Layers are identified by integer id instead of by name.
+*/
+class RenderPlan
+{
+	public:
+		enum LayerKind {
+			ImageKind
+			, TitleKind
+		};
+
+		enum LayerID {
+			ScreenLayerID
+			, CameraLayerID
+			, MagnifierLayerID
+			, TitleLayerID
+			, LogoLayerID
+			// Cameras after the first, see cameraLayerID()
+			, ExtraCameraLayerID
+		};
+
+		struct Record {
+			LayerKind kind;
+			int id;
+			int index;
+		};
+
+	private:
+		QVector<Record> mRecords;
+		QVector<ImageLayer> mImageLayers;
+		QVector<TitleLayer> mTitleLayers;
+
+	public:
+		explicit RenderPlan(int capacity=8);
+		virtual ~RenderPlan();
+
+	public:
+		// Drop all layers, keeping the storage for the next frame
+		void reset();
+
+		void addImageLayer(int id, QSharedPointer<QImage> image, qreal opacity=1.0, QTransform trans=QTransform(), bool retained=false);
+		void addTitleLayer(int id, QString title, QString subTitle, qreal opacity=1.0, QTransform trans=QTransform());
+
+		// Layers in compositing order
+		int size() const;
+		const Record &record(int i) const;
+		Layer *layer(int i);
+		// First layer with the given id or nullptr
+		Layer *layerByID(int id);
+
+	public:
+		// Layer id of the camera source with the given index
+		static int cameraLayerID(int index);
+
+		// A reset plan, reused when one is free
+		static RenderPlan *acquire();
+		// Hand a plan back for reuse
+		static void recycle(RenderPlan *plan);
+};
+
+#endif // RENDERPLAN_HPP
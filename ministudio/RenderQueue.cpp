@@ -0,0 +1,200 @@
+#include "RenderQueue.hpp"
+
+#include "FrameScene.hpp"
+
+#include <QThreadPool>
+#include <QMutexLocker>
+#include <QDebug>
+
+
+RenderQueue::RenderQueue(QThreadPool *pool, QObject *parent)
+	: QObject(parent)
+	, mPool((nullptr!=pool)?pool:QThreadPool::globalInstance())
+	, mMaxInFlight(4)
+	, mPolicy(DropOldest)
+	, mFrameBudget(0)
+	, mAborted(false)
+	, mSubmitted(0)
+	, mDropped(0)
+	, mLate(0)
+{
+	mClock.start();
+}
+
+RenderQueue::~RenderQueue()
+{
+	abort();
+}
+
+
+bool RenderQueue::makeRoom(QList<quint64> &dropped)
+{
+	if(mInFlight.size()<mMaxInFlight) {
+		return true;
+	}
+	switch(mPolicy) {
+	case BlockCapture: {
+		while(mInFlight.size()>=mMaxInFlight && !mAborted) {
+			mSpace.wait(&mMutex, 100);
+		}
+		return (mInFlight.size()<mMaxInFlight);
+	}
+	case DropOldest: {
+		for(int i=0; i<mInFlight.size(); ++i) {
+			const Entry &e=mInFlight[i];
+			if(e.scene->cancel()) {
+				mDropped++;
+				dropped<<e.id;
+				mCancelled<<e.scene;
+				mInFlight.removeAt(i);
+				return true;
+			}
+		}
+		// Everything is already rendering, nothing to cancel
+		return false;
+	}
+	case DropNewest:
+	default:
+		return false;
+	}
+}
+
+
+bool RenderQueue::submit(FrameScene *scene)
+{
+	if(nullptr==scene) {
+		return false;
+	}
+	const quint64 id=scene->id();
+	QList<quint64> dropped;
+	bool accepted=false;
+	{
+		QMutexLocker lock(&mMutex);
+		mSubmitted++;
+		accepted=makeRoom(dropped);
+		if(accepted) {
+			mInFlight<<Entry{scene, id, mClock.elapsed()};
+		} else {
+			mDropped++;
+		}
+	}
+	for(quint64 droppedID:dropped) {
+		emit frameDropped(droppedID);
+	}
+	if(accepted) {
+		if(!connect(scene, &FrameScene::renderFinished, this, &RenderQueue::onRenderFinished, Qt::DirectConnection)) {
+			qWarning()<<"ERROR: Could not connect render finished";
+		}
+		mPool->start(scene);
+	} else {
+		// Never started so it is still ours to delete
+		delete scene;
+		emit frameDropped(id);
+	}
+	return accepted;
+}
+
+
+void RenderQueue::onRenderFinished(FrameScene *scene)
+{
+	QMutexLocker lock(&mMutex);
+	for(int i=0; i<mInFlight.size(); ++i) {
+		const Entry &e=mInFlight[i];
+		if(e.scene==scene) {
+			if(mFrameBudget>0 && (mClock.elapsed()-e.submitted)>mFrameBudget) {
+				mLate++;
+			}
+			mInFlight.removeAt(i);
+			mSpace.wakeAll();
+			return;
+		}
+	}
+	mCancelled.removeOne(scene);
+	mSpace.wakeAll();
+}
+
+
+void RenderQueue::abort()
+{
+	QMutexLocker lock(&mMutex);
+	mAborted=true;
+	mSpace.wakeAll();
+}
+
+
+bool RenderQueue::waitForIdle(qint64 ms)
+{
+	QMutexLocker lock(&mMutex);
+	QElapsedTimer timer;
+	timer.start();
+	while(!mInFlight.isEmpty() || !mCancelled.isEmpty()) {
+		if(timer.elapsed()>ms) {
+			qWarning()<<"WARNING: Timed out waiting for "<<(mInFlight.size()+mCancelled.size())<<" frames to finish rendering";
+			return false;
+		}
+		mSpace.wait(&mMutex, 100);
+	}
+	return true;
+}
+
+
+void RenderQueue::setMaxInFlight(int max)
+{
+	QMutexLocker lock(&mMutex);
+	mMaxInFlight=qMax(1, max);
+	mSpace.wakeAll();
+}
+
+
+void RenderQueue::setDropPolicy(DropPolicy policy)
+{
+	QMutexLocker lock(&mMutex);
+	mPolicy=policy;
+	mSpace.wakeAll();
+}
+
+
+void RenderQueue::setFrameBudget(qint64 ms)
+{
+	QMutexLocker lock(&mMutex);
+	mFrameBudget=ms;
+}
+
+
+int RenderQueue::inFlight()
+{
+	QMutexLocker lock(&mMutex);
+	return mInFlight.size();
+}
+
+
+quint64 RenderQueue::dropped()
+{
+	QMutexLocker lock(&mMutex);
+	return mDropped;
+}
+
+
+quint64 RenderQueue::late()
+{
+	QMutexLocker lock(&mMutex);
+	return mLate;
+}
+
+
+QString RenderQueue::stats()
+{
+	QMutexLocker lock(&mMutex);
+	return QString("submitted=%1 inFlight=%2 dropped=%3 late=%4").arg(mSubmitted).arg(mInFlight.size()).arg(mDropped).arg(mLate);
+}
+
+
+RenderQueue::DropPolicy RenderQueue::policyFromString(QString policy)
+{
+	if("newest"==policy) {
+		return DropNewest;
+	} else if("block"==policy) {
+		return BlockCapture;
+	}
+	return DropOldest;
+}
@@ -0,0 +1,94 @@
+#ifndef RENDERQUEUE_HPP
+#define RENDERQUEUE_HPP
+
+#include <QObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+#include <QElapsedTimer>
+
+class FrameScene;
+class QThreadPool;
+
+/*
+  Bounded hand-off of FrameScenes from the capture loop to the render pool.
+
+  At most maxInFlight scenes are queued or rendering at any time. When a new
+  scene arrives while the queue is full the drop policy decides what happens:
+
+  DropNewest    The new scene is discarded
+  DropOldest    The oldest scene that has not started rendering is cancelled
+                to make room (falls back to DropNewest if all are rendering)
+  BlockCapture  submit() blocks until a scene finishes
+
+  Frames that take longer than the frame budget from submit to finish are
+  counted as late.
+*/
+class RenderQueue : public QObject
+{
+		Q_OBJECT
+	public:
+		enum DropPolicy {
+			DropNewest
+			, DropOldest
+			, BlockCapture
+		};
+
+	private:
+		struct Entry {
+			FrameScene *scene;
+			quint64 id;
+			qint64 submitted;
+		};
+
+		QThreadPool *mPool;
+		QMutex mMutex;
+		QWaitCondition mSpace;
+		QList<Entry> mInFlight;
+		// Cancelled scenes hold no images but still sit in the pool until a worker discards them
+		QList<FrameScene *> mCancelled;
+		int mMaxInFlight;
+		DropPolicy mPolicy;
+		qint64 mFrameBudget;
+		bool mAborted;
+		QElapsedTimer mClock;
+		quint64 mSubmitted;
+		quint64 mDropped;
+		quint64 mLate;
+
+	public:
+		explicit RenderQueue(QThreadPool *pool=nullptr, QObject *parent=nullptr);
+		virtual ~RenderQueue();
+
+	public:
+		// Takes ownership of the scene. Returns false if it was dropped
+		bool submit(FrameScene *scene);
+		// Wake up and refuse a blocked submit(), used when the capture loop is stopping
+		void abort();
+		// Wait until every submitted scene, including cancelled ones, left the pool
+		bool waitForIdle(qint64 ms=5000);
+
+		void setMaxInFlight(int max);
+		void setDropPolicy(DropPolicy policy);
+		void setFrameBudget(qint64 ms);
+
+		int inFlight();
+		quint64 dropped();
+		quint64 late();
+		QString stats();
+
+	public:
+		static DropPolicy policyFromString(QString policy);
+
+	private:
+		bool makeRoom(QList<quint64> &dropped);
+
+	private slots:
+		void onRenderFinished(FrameScene *scene);
+
+	signals:
+		// A frame id that will never reach renderComplete
+		void frameDropped(quint64 id);
+};
+
+#endif // RENDERQUEUE_HPP
@@ -0,0 +1,104 @@
+#include "ReorderBuffer.hpp"
+
+#include <QDebug>
+
+
+ReorderBuffer::ReorderBuffer(quint64 firstID, int window, qint64 maxLatency)
+	: mNext(firstID)
+	, mWindow(qMax(1, window))
+	, mMaxLatency(maxLatency)
+	, mReleased(0)
+	, mSkipped(0)
+	, mLate(0)
+{
+	mClock.start();
+}
+
+ReorderBuffer::~ReorderBuffer()
+{
+
+}
+
+
+QList<ReorderBuffer::Frame> ReorderBuffer::push(quint64 id, QSharedPointer<QImage> image, qint64 captured, const QRegion &damage)
+{
+	if(id<mNext) {
+		// We already gave up on this one
+		mLate++;
+		return QList<Frame>();
+	}
+	mPending.insert(id, Pending{image, captured, damage, mClock.elapsed(), false});
+	return release();
+}
+
+
+QList<ReorderBuffer::Frame> ReorderBuffer::drop(quint64 id)
+{
+	if(id>=mNext) {
+		mPending.insert(id, Pending{QSharedPointer<QImage>(), 0, QRegion(), mClock.elapsed(), true});
+	}
+	return release();
+}
+
+
+QList<ReorderBuffer::Frame> ReorderBuffer::poll()
+{
+	return release();
+}
+
+
+QList<ReorderBuffer::Frame> ReorderBuffer::release()
+{
+	QList<Frame> out;
+	const qint64 now=mClock.elapsed();
+	while(!mPending.isEmpty()) {
+		auto it=mPending.begin();
+		if(it.key()==mNext) {
+			if(!it.value().dropped) {
+				out<<Frame{it.key(), it.value().image, it.value().captured, it.value().damage};
+				mReleased++;
+			}
+			mPending.erase(it);
+			mNext++;
+			continue;
+		}
+		// There is a gap at mNext, see if we waited long enough for it
+		const bool overdue=(mPending.size()>mWindow) || ((now-it.value().arrived)>mMaxLatency);
+		if(!overdue) {
+			break;
+		}
+		mSkipped+=it.key()-mNext;
+		mNext=it.key();
+	}
+	return out;
+}
+
+
+void ReorderBuffer::setWindow(int window)
+{
+	mWindow=qMax(1, window);
+}
+
+
+void ReorderBuffer::setMaxLatency(qint64 ms)
+{
+	mMaxLatency=ms;
+}
+
+
+quint64 ReorderBuffer::skipped()
+{
+	return mSkipped;
+}
+
+
+quint64 ReorderBuffer::late()
+{
+	return mLate;
+}
+
+
+QString ReorderBuffer::stats()
+{
+	return QString("released=%1 waiting=%2 skipped=%3 late=%4").arg(mReleased).arg(mPending.size()).arg(mSkipped).arg(mLate);
+}
@@ -0,0 +1,75 @@
+#ifndef REORDERBUFFER_HPP
+#define REORDERBUFFER_HPP
+
+#include <QImage>
+#include <QRegion>
+#include <QSharedPointer>
+#include <QMap>
+#include <QList>
+#include <QElapsedTimer>
+
+/*
+  Puts frames that finished rendering out of order back in sequence.
+
+  Completed frames are held by id until every frame before them has either
+  arrived or been reported dropped. A missing frame is given up on (skipped)
+  when more than window frames are waiting behind it, or when the oldest
+  waiting frame has waited longer than the latency bound. Frames arriving
+  after they were skipped are discarded and counted as late.
+
+  Not thread safe, meant to be used from the thread that receives renderComplete.
+*/
+class ReorderBuffer
+{
+	public:
+		struct Frame {
+			quint64 id;
+			QSharedPointer<QImage> image;
+			// Capture time, see FrameClock
+			qint64 captured;
+			// What may differ from the frame with the id before
+			QRegion damage;
+		};
+
+	private:
+		struct Pending {
+			QSharedPointer<QImage> image;
+			qint64 captured;
+			QRegion damage;
+			qint64 arrived;
+			bool dropped;
+		};
+
+		QMap<quint64, Pending> mPending;
+		quint64 mNext;
+		int mWindow;
+		qint64 mMaxLatency;
+		QElapsedTimer mClock;
+		quint64 mReleased;
+		quint64 mSkipped;
+		quint64 mLate;
+
+	public:
+		explicit ReorderBuffer(quint64 firstID=1, int window=8, qint64 maxLatency=100);
+		virtual ~ReorderBuffer();
+
+	public:
+		// Add a completed frame and return the frames that are now ready, in order
+		QList<Frame> push(quint64 id, QSharedPointer<QImage> image, qint64 captured, const QRegion &damage=QRegion());
+		// Report a frame that will never complete so nothing waits for it
+		QList<Frame> drop(quint64 id);
+		// Release frames whose predecessors are overdue, call this periodically
+		QList<Frame> poll();
+
+		void setWindow(int window);
+		void setMaxLatency(qint64 ms);
+
+		quint64 skipped();
+		quint64 late();
+		QString stats();
+
+	private:
+		QList<Frame> release();
+};
+
+#endif // REORDERBUFFER_HPP
@@ -0,0 +1,107 @@
+#include "ScreenGrabber.hpp"
+
+#include "FormatNegotiator.hpp"
+
+#ifdef USE_FEATURE_XSHM
+#include "ShmScreenGrabber.hpp"
+#endif
+#ifdef USE_FEATURE_XDAMAGE
+#include "DamageScreenGrabber.hpp"
+#endif
+
+#include <QScreen>
+#include <QPixmap>
+#include <QDebug>
+
+
+ScreenGrabber::ScreenGrabber()
+	: mScreen(nullptr)
+{
+
+}
+
+ScreenGrabber::~ScreenGrabber()
+{
+
+}
+
+
+bool ScreenGrabber::init(QScreen *screen)
+{
+	mScreen=screen;
+	return (nullptr!=mScreen);
+}
+
+
+QRegion ScreenGrabber::damage()
+{
+	return mDamage;
+}
+
+
+ScreenGrabber *ScreenGrabber::create(QScreen *screen, QString preferred)
+{
+	ScreenGrabber *grabber=nullptr;
+#ifdef USE_FEATURE_XDAMAGE
+	if("xdamage"==preferred) {
+		grabber=new DamageScreenGrabber();
+		if(!grabber->init(screen)) {
+			qWarning()<<"ERROR: Could not initialize "<<grabber->name()<<" screen grabber, falling back to xshm";
+			delete grabber;
+			grabber=nullptr;
+			preferred="xshm";
+		}
+	}
+#endif
+#ifdef USE_FEATURE_XSHM
+	if(nullptr==grabber && "xshm"==preferred) {
+		grabber=new ShmScreenGrabber();
+		if(!grabber->init(screen)) {
+			qWarning()<<"ERROR: Could not initialize "<<grabber->name()<<" screen grabber, falling back to qt";
+			delete grabber;
+			grabber=nullptr;
+		}
+	}
+#endif
+	if(nullptr==grabber) {
+		grabber=new QtScreenGrabber();
+		grabber->init(screen);
+	}
+	qDebug()<<"Using "<<grabber->name()<<" screen grabber";
+	return grabber;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+QtScreenGrabber::QtScreenGrabber()
+	: ScreenGrabber()
+{
+
+}
+
+QtScreenGrabber::~QtScreenGrabber()
+{
+
+}
+
+
+QSharedPointer<QImage> QtScreenGrabber::grab()
+{
+	QSharedPointer<QImage> out;
+	if(nullptr!=mScreen) {
+		QPixmap grabPixmap = mScreen->grabWindow(0);
+		if(!grabPixmap.isNull()) {
+			// toImage() returns whatever the platform pixmap holds
+			out=QSharedPointer<QImage>(new QImage(FormatNegotiator::globalInstance()->convert(grabPixmap.toImage(), FormatNegotiator::CaptureStage)));
+			mDamage=QRegion(out->rect());
+		}
+	}
+	return out;
+}
+
+
+QString QtScreenGrabber::name()
+{
+	return "qt";
+}
@@ -0,0 +1,56 @@
+#ifndef SCREENGRABBER_HPP
+#define SCREENGRABBER_HPP
+
+#include <QImage>
+#include <QRegion>
+#include <QSharedPointer>
+#include <QString>
+
+class QScreen;
+
+/*
+  Pluggable screen capture backend used by LiveThread.
+
+  A grabber is created, initialized and used from the live thread only.
+  The images it returns may reference backend owned memory and stay valid
+  for as long as any QImage (or copy of it) referencing them is alive.
+*/
+class ScreenGrabber
+{
+	protected:
+		QScreen *mScreen;
+		QRegion mDamage;
+
+	public:
+		explicit ScreenGrabber();
+		virtual ~ScreenGrabber();
+
+	public:
+		// Prepare the backend for grabbing the given screen. Returns false if the backend is not usable
+		virtual bool init(QScreen *screen);
+		// Grab the current content of the screen. Returns a null pointer on failure
+		virtual QSharedPointer<QImage> grab() = 0;
+		virtual QString name() = 0;
+		// The part of the screen that changed between the two last grabs
+		QRegion damage();
+
+	public:
+		// Create the preferred backend ("xdamage", "xshm" or "qt"), falling back to "qt" when the preferred one is unavailable
+		static ScreenGrabber *create(QScreen *screen, QString preferred="xshm");
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Fallback backend based on QScreen::grabWindow()
+class QtScreenGrabber: public ScreenGrabber
+{
+	public:
+		explicit QtScreenGrabber();
+		virtual ~QtScreenGrabber();
+
+	public:
+		QSharedPointer<QImage> grab() override;
+		QString name() override;
+};
+
+#endif // SCREENGRABBER_HPP
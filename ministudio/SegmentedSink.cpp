@@ -0,0 +1,157 @@
+#include "SegmentedSink.hpp"
+
+#include "RecordingFinalizer.hpp"
+
+#include <QDir>
+#include <QDebug>
+
+
+SegmentedSink::SegmentedSink(Factory factory, qreal seconds, int megabytes)
+	: mFactory(factory)
+	, mSegmentNs(qMax<qint64>(0, qint64(seconds*1000000000.0)))
+	, mSegmentBytes(qMax<qint64>(0, qint64(megabytes)*1024*1024))
+	, mCurrent(mFactory())
+	, mFps(0.0)
+	, mSegment(0)
+	, mFirstIndex(1)
+	, mSegmentStart(0)
+	, mStarted(false)
+	, mRolloverBytes(mSegmentBytes)
+	, mOpen(false)
+{
+
+}
+
+SegmentedSink::~SegmentedSink()
+{
+	close();
+	delete mCurrent;
+	mCurrent=nullptr;
+}
+
+
+bool SegmentedSink::open(const QString &basePath, const QSize &size, qreal fps)
+{
+	mBasePath=basePath;
+	mSize=size;
+	mFps=fps;
+	mSegment=0;
+	mStarted=false;
+	mRolloverBytes=mSegmentBytes;
+	mOpen=openSegment(1);
+	return mOpen;
+}
+
+
+bool SegmentedSink::openSegment(quint64 firstIndex)
+{
+	mSegment++;
+	const QString path=mBasePath+QString("/segment_%1").arg(mSegment, 4, 10, QChar('0'));
+	if(!QDir().mkpath(path)) {
+		qWarning()<<"ERROR: Could not create segment directory"<<path;
+		return false;
+	}
+	if(nullptr==mCurrent) {
+		mCurrent=mFactory();
+	}
+	if(!mCurrent->open(path, mSize, mFps)) {
+		qWarning()<<"ERROR: Could not open segment"<<path;
+		return false;
+	}
+	mFirstIndex=firstIndex;
+	return true;
+}
+
+
+bool SegmentedSink::write(const Frame &frame)
+{
+	if(!mOpen) {
+		mDropped.fetchAndAddRelaxed(1);
+		return false;
+	}
+	if(!mStarted) {
+		mSegmentStart=frame.timestamp;
+		mStarted=true;
+	}
+	const bool full=(mSegmentNs>0 && frame.timestamp-mSegmentStart>=mSegmentNs)
+					|| (mSegmentBytes>0 && qint64(mCurrent->bytes())>=mRolloverBytes);
+	if(full) {
+		// Open the next segment first, the old one is closed in the background
+		FrameSink *old=mCurrent;
+		mCurrent=nullptr;
+		if(!openSegment(frame.index)) {
+			delete mCurrent;
+			mCurrent=old;
+			mSegment--;
+			// Keep recording into the old segment rather than losing frames. Trying again on every frame would
+			// stall the writer, so the next try waits for another segment's worth of time or bytes
+			mRolloverBytes=qint64(mCurrent->bytes())+mSegmentBytes;
+		} else {
+			qDebug()<<"SEGMENT: started segment"<<mSegment<<"at frame"<<frame.index;
+			mRolloverBytes=mSegmentBytes;
+			RecordingFinalizer::globalInstance()->finish(old);
+		}
+		mSegmentStart=frame.timestamp;
+	}
+	Frame local=frame;
+	local.index=frame.index-mFirstIndex+1;
+	const quint64 before=mCurrent->bytes();
+	const bool ok=mCurrent->write(local);
+	if(ok) {
+		mWritten.fetchAndAddRelaxed(1);
+		mBytes.fetchAndAddRelaxed(mCurrent->bytes()-before);
+	} else {
+		mDropped.fetchAndAddRelaxed(1);
+	}
+	return ok;
+}
+
+
+void SegmentedSink::sync()
+{
+	if(nullptr!=mCurrent) {
+		mCurrent->sync();
+	}
+}
+
+
+void SegmentedSink::close()
+{
+	if(!mOpen) {
+		return;
+	}
+	mOpen=false;
+	if(nullptr!=mCurrent) {
+		mCurrent->close();
+	}
+}
+
+
+bool SegmentedSink::isOpen()
+{
+	return mOpen;
+}
+
+
+QString SegmentedSink::name()
+{
+	return mCurrent->name();
+}
+
+
+QVector<QImage::Format> SegmentedSink::formats()
+{
+	return mCurrent->formats();
+}
+
+
+QString SegmentedSink::stats()
+{
+	return QString("%1 segments=%2").arg(FrameSink::stats()).arg(mSegment);
+}
+
+
+int SegmentedSink::segment()
+{
+	return mSegment;
+}
@@ -0,0 +1,64 @@
+#ifndef SEGMENTEDSINK_HPP
+#define SEGMENTEDSINK_HPP
+
+#include "FrameSink.hpp"
+
+#include <functional>
+
+/*
+  Splits a recording into segments, each written by its own sink into a
+  segment_NNNN directory below the recording.
+
+  A new segment is started when the current one is older than the segment
+  duration or has grown past the segment size, whichever comes first. The
+  next sink is opened before the old one is let go, and the old one is
+  closed by the RecordingFinalizer, so rotating never holds up frames.
+  Frame numbers start over in every segment.
+
+  Segments are written one frame at a time, so sinks that could write from
+  several threads only get one when segmenting.
+*/
+class SegmentedSink: public FrameSink
+{
+	public:
+		typedef std::function<FrameSink *()> Factory;
+
+	private:
+		Factory mFactory;
+		qint64 mSegmentNs;
+		qint64 mSegmentBytes;
+		FrameSink *mCurrent;
+		QString mBasePath;
+		QSize mSize;
+		qreal mFps;
+		int mSegment;
+		quint64 mFirstIndex;
+		// When the current segment got its first frame, once mStarted
+		qint64 mSegmentStart;
+		bool mStarted;
+		// What the current sink may grow to before the next segment is started
+		qint64 mRolloverBytes;
+		bool mOpen;
+
+	public:
+		// seconds or megabytes of 0 means no limit of that kind
+		explicit SegmentedSink(Factory factory, qreal seconds, int megabytes);
+		virtual ~SegmentedSink();
+
+	public:
+		bool open(const QString &basePath, const QSize &size, qreal fps) override;
+		bool write(const Frame &frame) override;
+		void sync() override;
+		void close() override;
+		bool isOpen() override;
+		QString name() override;
+		QVector<QImage::Format> formats() override;
+		QString stats() override;
+
+		int segment();
+
+	private:
+		bool openSegment(quint64 firstIndex);
+};
+
+#endif // SEGMENTEDSINK_HPP
@@ -0,0 +1,184 @@
+#include "ShmScreenGrabber.hpp"
+
+#include <QScreen>
+#include <QAtomicInt>
+#include <QDebug>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+
+struct ShmSegment
+{
+	XShmSegmentInfo info;
+	XImage *image;
+	// One reference for the owning grabber plus one per QImage wrapping the segment
+	QAtomicInt refs;
+};
+
+
+static void releaseSegment(void *data)
+{
+	ShmSegment *seg=static_cast<ShmSegment *>(data);
+	if(!seg->refs.deref()) {
+		shmdt(seg->info.shmaddr);
+		delete seg;
+	}
+}
+
+
+static void releaseUnsharedImage(void *data)
+{
+	XDestroyImage(static_cast<XImage *>(data));
+}
+
+
+ShmScreenGrabber::ShmScreenGrabber(int ringSize)
+	: ScreenGrabber()
+	, mDisplay(nullptr)
+	, mRoot(0)
+	, mRingSize(qMax(2, ringSize))
+	, mNext(0)
+	, mRingMisses(0)
+{
+
+}
+
+ShmScreenGrabber::~ShmScreenGrabber()
+{
+	release();
+}
+
+
+bool ShmScreenGrabber::init(QScreen *screen)
+{
+	release();
+	if(!ScreenGrabber::init(screen)) {
+		return false;
+	}
+	// Use a private connection so the grab never competes with the GUI thread for Qt's connection
+	mDisplay=XOpenDisplay(nullptr);
+	if(nullptr==mDisplay) {
+		qWarning()<<"ERROR: Could not open X display for shm grabber";
+		return false;
+	}
+	if(!XShmQueryExtension(mDisplay)) {
+		qWarning()<<"ERROR: X server does not support MIT-SHM";
+		release();
+		return false;
+	}
+	mRoot=DefaultRootWindow(mDisplay);
+	const qreal dpr=screen->devicePixelRatio();
+	const QRect geometry=screen->geometry();
+	mOrigin=QPoint(geometry.x()*dpr, geometry.y()*dpr);
+	mSize=QSize(geometry.width()*dpr, geometry.height()*dpr);
+	// Without damage tracking every grab is a full refresh
+	mDamage=QRegion(QRect(QPoint(0,0), mSize));
+	const int scr=DefaultScreen(mDisplay);
+	Visual *visual=DefaultVisual(mDisplay, scr);
+	const int depth=DefaultDepth(mDisplay, scr);
+	for(int i=0; i<mRingSize; ++i) {
+		ShmSegment *seg=new ShmSegment;
+		seg->refs.store(1);
+		seg->image=XShmCreateImage(mDisplay, visual, depth, ZPixmap, nullptr, &seg->info, mSize.width(), mSize.height());
+		if(nullptr==seg->image || 32!=seg->image->bits_per_pixel) {
+			qWarning()<<"ERROR: Unsupported X visual for shm grabber";
+			if(nullptr!=seg->image) {
+				XDestroyImage(seg->image);
+			}
+			delete seg;
+			release();
+			return false;
+		}
+		seg->info.shmid=shmget(IPC_PRIVATE, seg->image->bytes_per_line*seg->image->height, IPC_CREAT | 0600);
+		seg->info.shmaddr=seg->image->data=static_cast<char *>(shmat(seg->info.shmid, nullptr, 0));
+		seg->info.readOnly=False;
+		if(reinterpret_cast<char *>(-1)==seg->info.shmaddr || !XShmAttach(mDisplay, &seg->info)) {
+			qWarning()<<"ERROR: Could not attach shm segment";
+			if(reinterpret_cast<char *>(-1)!=seg->info.shmaddr) {
+				shmdt(seg->info.shmaddr);
+			}
+			shmctl(seg->info.shmid, IPC_RMID, nullptr);
+			XDestroyImage(seg->image);
+			delete seg;
+			release();
+			return false;
+		}
+		XSync(mDisplay, False);
+		// Mark for removal now so the segment is reclaimed even if we crash; it lives on until the last detach
+		shmctl(seg->info.shmid, IPC_RMID, nullptr);
+		mRing<<seg;
+	}
+	qDebug()<<"SHM grabber ready with"<<mRingSize<<"segments of"<<mSize;
+	return true;
+}
+
+
+void ShmScreenGrabber::release()
+{
+	for(ShmSegment *seg:mRing) {
+		if(nullptr!=mDisplay) {
+			XShmDetach(mDisplay, &seg->info);
+		}
+		// Only frees the XImage header, the pixels stay in the segment until the last QImage lets go
+		XDestroyImage(seg->image);
+		seg->image=nullptr;
+		releaseSegment(seg);
+	}
+	mRing.clear();
+	if(nullptr!=mDisplay) {
+		XCloseDisplay(mDisplay);
+		mDisplay=nullptr;
+	}
+	if(mRingMisses>0) {
+		qDebug()<<"SHM grabber ring was exhausted"<<mRingMisses<<"times";
+		mRingMisses=0;
+	}
+}
+
+
+QSharedPointer<QImage> ShmScreenGrabber::grab()
+{
+	QSharedPointer<QImage> out;
+	if(nullptr==mDisplay) {
+		return out;
+	}
+	const int sz=mRing.size();
+	for(int i=0; i<sz; ++i) {
+		ShmSegment *seg=mRing[(mNext+i)%sz];
+		// Only the grabber holds a reference so nobody downstream is looking at these pixels anymore
+		if(1==seg->refs.load()) {
+			mNext=(mNext+i+1)%sz;
+			if(!XShmGetImage(mDisplay, mRoot, seg->image, mOrigin.x(), mOrigin.y(), AllPlanes)) {
+				qWarning()<<"ERROR: XShmGetImage failed";
+				return out;
+			}
+			seg->refs.ref();
+			out=QSharedPointer<QImage>(new QImage(reinterpret_cast<uchar *>(seg->image->data), seg->image->width, seg->image->height, seg->image->bytes_per_line, QImage::Format_RGB32, releaseSegment, seg));
+			return out;
+		}
+	}
+	mRingMisses++;
+	return grabUnshared();
+}
+
+
+QSharedPointer<QImage> ShmScreenGrabber::grabUnshared()
+{
+	QSharedPointer<QImage> out;
+	XImage *image=XGetImage(mDisplay, mRoot, mOrigin.x(), mOrigin.y(), mSize.width(), mSize.height(), AllPlanes, ZPixmap);
+	if(nullptr!=image) {
+		out=QSharedPointer<QImage>(new QImage(reinterpret_cast<uchar *>(image->data), image->width, image->height, image->bytes_per_line, QImage::Format_RGB32, releaseUnsharedImage, image));
+	}
+	return out;
+}
+
+
+QString ShmScreenGrabber::name()
+{
+	return "xshm";
+}
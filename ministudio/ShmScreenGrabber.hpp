@@ -0,0 +1,51 @@
+#ifndef SHMSCREENGRABBER_HPP
+#define SHMSCREENGRABBER_HPP
+
+#include "ScreenGrabber.hpp"
+
+#include <QVector>
+#include <QSize>
+#include <QPoint>
+
+struct _XDisplay;
+struct ShmSegment;
+
+/*
+  X11 MIT-SHM screen grabber.
+
+  Grabs the root window with XShmGetImage() into a preallocated ring of
+  shared memory segments. The returned QImage wraps the segment memory
+  directly, so there is no intermediate QPixmap and no copy on the client
+  side. A segment is handed out again only once every QImage referencing
+  it is gone. When the whole ring is in use the grab falls back to a plain
+  XGetImage() for that frame.
+
+  Works with any X server that has MIT-SHM, including Xvfb.
+*/
+class ShmScreenGrabber: public ScreenGrabber
+{
+	private:
+		_XDisplay *mDisplay;
+		unsigned long mRoot;
+		QPoint mOrigin;
+		QSize mSize;
+		int mRingSize;
+		int mNext;
+		QVector<ShmSegment *> mRing;
+		quint64 mRingMisses;
+
+	public:
+		explicit ShmScreenGrabber(int ringSize=6);
+		virtual ~ShmScreenGrabber();
+
+	public:
+		bool init(QScreen *screen) override;
+		QSharedPointer<QImage> grab() override;
+		QString name() override;
+
+	private:
+		void release();
+		QSharedPointer<QImage> grabUnshared();
+};
+
+#endif // SHMSCREENGRABBER_HPP
@@ -1,9 +1,12 @@
 #include "StudioConfig.hpp"
 #include "ui_StudioConfig.h"
 
+#include "FormatNegotiator.hpp"
+
 #include <QDesktopWidget>
 #include <QDebug>
 #include <QLineEdit>
+#include <QListWidget>
 #include <QSettings>
 
 StudioConfig::StudioConfig(QWidget*parent)
@@ -24,6 +27,9 @@ StudioConfig::StudioConfig(QWidget*parent)
 
 	setWindowFlags(windowFlags() | Qt::WindowStaysOnTopHint);
 	connect(ui->widgetSlideContent, &RichEdit::textChanged, this, &StudioConfig::textChanged);
+	if(!connect(ui->listWidgetCameras, &QListWidget::itemChanged, this, &StudioConfig::onCameraItemChanged)) {
+		qWarning()<<"ERROR: could not connect camera list";
+	}
 }
 
 
@@ -65,6 +71,9 @@ void StudioConfig::onPreviewUpdated(quint64 id, QSharedPointer<QImage> img)
 	//qDebug()<<"conf:preview updated "<<id;
 	QSize oldSize = mLastPreviewPixmap.size();
 
+	if(!FormatNegotiator::globalInstance()->accepts(FormatNegotiator::PreviewStage, img->format())) {
+		FormatNegotiator::globalInstance()->noteImplicit(FormatNegotiator::PreviewStage, img->format());
+	}
 	QPixmap newPixmap=QPixmap::fromImage(*img);
 	QSize newSize = newPixmap.size();
 	mLastPreviewPixmap=newPixmap;
@@ -136,6 +145,48 @@ QSettings *StudioConfig::settings()
 	return mSettings;
 }
 
+
+void StudioConfig::setCameraDevices(const QList<CameraList::Device> &devices, const QStringList &selected)
+{
+	mSelectedCameras=selected;
+	// Filling the list is no choice of the user's
+	const bool blocked=ui->listWidgetCameras->blockSignals(true);
+	ui->listWidgetCameras->clear();
+	for(const CameraList::Device &device:devices) {
+		QListWidgetItem *item=new QListWidgetItem(device.description.isEmpty()?device.name:(device.description+" ("+device.name+")"), ui->listWidgetCameras);
+		item->setData(Qt::UserRole, device.name);
+		item->setData(Qt::UserRole+1, device.description);
+		item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+		const bool checked=selected.contains(device.name) || (!device.description.isEmpty() && selected.contains(device.description));
+		item->setCheckState(checked?Qt::Checked:Qt::Unchecked);
+	}
+	ui->listWidgetCameras->blockSignals(blocked);
+}
+
+
+void StudioConfig::onCameraItemChanged(QListWidgetItem *)
+{
+	QStringList selected;
+	QListWidget *list=ui->listWidgetCameras;
+	// Selections of cameras that are unplugged right now are kept for when they come back
+	for(const QString &device:mSelectedCameras) {
+		bool listed=false;
+		for(int i=0; !listed && i<list->count(); ++i) {
+			listed=(list->item(i)->data(Qt::UserRole).toString()==device || list->item(i)->data(Qt::UserRole+1).toString()==device);
+		}
+		if(!listed) {
+			selected<<device;
+		}
+	}
+	for(int i=0; i<list->count(); ++i) {
+		if(Qt::Checked==list->item(i)->checkState()) {
+			selected<<list->item(i)->data(Qt::UserRole).toString();
+		}
+	}
+	mSelectedCameras=selected;
+	emit camerasSelected(selected);
+}
+
 void StudioConfig::on_pushButtonSimulator_clicked()
 {
 	emit showSimulator();
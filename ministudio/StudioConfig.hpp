@@ -1,6 +1,8 @@
 #ifndef STUDIOCONFIG_HPP
 #define STUDIOCONFIG_HPP
 
+#include "CameraList.hpp"
+
 #include <QWidget>
 
 
@@ -11,6 +13,7 @@ class StudioConfig;
 
 class QLineEdit;
 class QSettings;
+class QListWidgetItem;
 
 class StudioConfig : public QWidget
 {
@@ -20,6 +23,7 @@ private:
 	QPixmap mLastPreviewPixmap;
 	bool mDidFirstPlay;
 	QSettings *mSettings;
+	QStringList mSelectedCameras;
 
 
 public:
@@ -33,6 +37,9 @@ public:
 
 	QSettings *settings();
 
+	// List the cameras there are, checking the ones selected by device name or description
+	void setCameraDevices(const QList<CameraList::Device> &devices, const QStringList &selected);
+
 protected:
 	void resizeEvent(QResizeEvent *) override;
 
@@ -47,6 +54,8 @@ private slots:
 
 	void on_pushButtonLog_toggled(bool checked);
 
+	void onCameraItemChanged(QListWidgetItem *item);
+
 private:
 
 	void saveLineEdit(QLineEdit &le);
@@ -61,6 +70,8 @@ signals:
 	void showSimulator();
 
 	void verbosity(bool );
+	// The cameras checked, plus any selected earlier that are not plugged in right now
+	void camerasSelected(QStringList devices);
 };
 
 #endif // STUDIOCONFIG_HPP
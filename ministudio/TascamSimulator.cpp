@@ -200,6 +200,54 @@ void TascamSimulator::on_pushButtonF3_released()
 }
 
 
+void TascamSimulator::on_pushButtonSelectChannel_5_pressed()
+{
+	emit buttonEvent(36, "Select5", true);
+}
+
+
+void TascamSimulator::on_pushButtonSelectChannel_5_released()
+{
+	emit buttonEvent(36, "Select5", false);
+}
+
+
+void TascamSimulator::on_pushButtonSelectChannel_6_pressed()
+{
+	emit buttonEvent(37, "Select6", true);
+}
+
+
+void TascamSimulator::on_pushButtonSelectChannel_6_released()
+{
+	emit buttonEvent(37, "Select6", false);
+}
+
+
+void TascamSimulator::on_pushButtonSelectChannel_7_pressed()
+{
+	emit buttonEvent(38, "Select7", true);
+}
+
+
+void TascamSimulator::on_pushButtonSelectChannel_7_released()
+{
+	emit buttonEvent(38, "Select7", false);
+}
+
+
+void TascamSimulator::on_pushButtonSelectChannel_8_pressed()
+{
+	emit buttonEvent(39, "Select8", true);
+}
+
+
+void TascamSimulator::on_pushButtonSelectChannel_8_released()
+{
+	emit buttonEvent(39, "Select8", false);
+}
+
+
 
 
 
@@ -59,6 +59,18 @@ private slots:
 
 	void on_pushButtonF3_pressed();
 	void on_pushButtonF3_released();
+
+	void on_pushButtonSelectChannel_5_pressed();
+	void on_pushButtonSelectChannel_5_released();
+
+	void on_pushButtonSelectChannel_6_pressed();
+	void on_pushButtonSelectChannel_6_released();
+
+	void on_pushButtonSelectChannel_7_pressed();
+	void on_pushButtonSelectChannel_7_released();
+
+	void on_pushButtonSelectChannel_8_pressed();
+	void on_pushButtonSelectChannel_8_released();
 	void on_dialBig_valueChanged(int value);
 };
 
@@ -0,0 +1,274 @@
+#include "TileContainer.hpp"
+
+#include "QoiCodec.hpp"
+
+#include <QDebug>
+
+#include <cstring>
+
+namespace
+{
+	const quint64 PRIME1=0x9e3779b185ebca87ULL;
+	const quint64 PRIME2=0xc2b2ae3d27d4eb4fULL;
+
+	inline quint64 rotl(quint64 x, int r)
+	{
+		return (x<<r) | (x>>(64-r));
+	}
+
+	inline quint64 mix(quint64 h, quint64 v)
+	{
+		return rotl(h^(v*PRIME2), 31)*PRIME1;
+	}
+}
+
+
+TileContainer::Header TileContainer::makeHeader(const QSize &size, QImage::Format format, int tileSize, int keyframeInterval, qreal fps, qint64 startTime)
+{
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(header.magic));
+	header.version=VERSION;
+	header.width=size.width();
+	header.height=size.height();
+	header.format=format;
+	header.tileSize=tileSize;
+	header.keyframeInterval=keyframeInterval;
+	header.fps=fps;
+	header.startTime=startTime;
+	return header;
+}
+
+
+bool TileContainer::isValid(const Header &header)
+{
+	return 0==memcmp(header.magic, MAGIC, sizeof(header.magic))
+		   && VERSION==header.version
+		   && header.width>0 && header.height>0
+		   && header.tileSize>0;
+}
+
+
+quint64 TileContainer::hashTile(const uchar *pixels, int width, int height, int stride)
+{
+	// Two independent lanes so the multiplies overlap
+	quint64 a=PRIME1;
+	quint64 b=PRIME2;
+	const int bytes=width*4;
+	for(int y=0; y<height; ++y) {
+		const uchar *row=pixels+y*stride;
+		int i=0;
+		for(; i+16<=bytes; i+=16) {
+			quint64 v0;
+			quint64 v1;
+			memcpy(&v0, row+i, 8);
+			memcpy(&v1, row+i+8, 8);
+			a=mix(a, v0);
+			b=mix(b, v1);
+		}
+		for(; i<bytes; i+=4) {
+			quint32 v;
+			memcpy(&v, row+i, 4);
+			a=mix(a, v);
+		}
+	}
+	quint64 h=a^rotl(b, 17);
+	h^=h>>33;
+	h*=PRIME2;
+	h^=h>>29;
+	return h;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+TileReader::TileReader()
+	: mFrames(0)
+	, mNext(1)
+{
+	memset(&mHeader, 0, sizeof(mHeader));
+}
+
+TileReader::~TileReader()
+{
+	close();
+}
+
+
+bool TileReader::open(const QString &filename)
+{
+	close();
+	mFile.setFileName(filename);
+	if(!mFile.open(QIODevice::ReadOnly)) {
+		mError=mFile.errorString();
+		return false;
+	}
+	if(sizeof(mHeader)!=mFile.read(reinterpret_cast<char *>(&mHeader), sizeof(mHeader)) || !TileContainer::isValid(mHeader)) {
+		mError="Not a tile recording or unsupported version";
+		close();
+		return false;
+	}
+	if(!readTrailer() && !scan()) {
+		close();
+		return false;
+	}
+	mCanvas=QImage(mHeader.width, mHeader.height, static_cast<QImage::Format>(mHeader.format));
+	mCanvas.fill(0);
+	return seek(1);
+}
+
+
+bool TileReader::readTrailer()
+{
+	TileContainer::Trailer trailer;
+	const qint64 size=mFile.size();
+	if(size<qint64(sizeof(mHeader)+sizeof(trailer)) || !mFile.seek(size-sizeof(trailer))
+			|| sizeof(trailer)!=mFile.read(reinterpret_cast<char *>(&trailer), sizeof(trailer))
+			|| 0!=memcmp(trailer.magic, TileContainer::TRAILER_MAGIC, sizeof(trailer.magic))) {
+		return false;
+	}
+	mKeyframes.resize(trailer.keyframes);
+	const qint64 bytes=trailer.keyframes*sizeof(TileContainer::Keyframe);
+	if(!mFile.seek(trailer.offset) || bytes!=mFile.read(reinterpret_cast<char *>(mKeyframes.data()), bytes)) {
+		mKeyframes.clear();
+		return false;
+	}
+	mFrames=trailer.frames;
+	return true;
+}
+
+
+bool TileReader::scan()
+{
+	// No trailer, walk the frame headers to find the keyframes and the last complete frame
+	qWarning()<<"Tile recording"<<mFile.fileName()<<"has no index, scanning";
+	mKeyframes.clear();
+	mFrames=0;
+	qint64 offset=sizeof(mHeader);
+	const qint64 size=mFile.size();
+	TileContainer::FrameHeader fh;
+	while(offset+qint64(sizeof(fh))<=size && mFile.seek(offset) && sizeof(fh)==mFile.read(reinterpret_cast<char *>(&fh), sizeof(fh))) {
+		const qint64 end=offset+sizeof(fh)+fh.bytes;
+		if(TileContainer::FRAME_MAGIC!=fh.magic || end>size) {
+			break;
+		}
+		if(fh.flags & TileContainer::KEYFRAME) {
+			mKeyframes<<TileContainer::Keyframe{fh.index, quint64(offset)};
+		}
+		mFrames=fh.index;
+		offset=end;
+	}
+	if(mKeyframes.isEmpty()) {
+		mError="Tile recording has no complete keyframe";
+		return false;
+	}
+	return true;
+}
+
+
+void TileReader::close()
+{
+	mFile.close();
+	mKeyframes.clear();
+	mFrames=0;
+	mNext=1;
+	mCanvas=QImage();
+}
+
+
+QString TileReader::errorString()
+{
+	return mError;
+}
+
+
+const TileContainer::Header &TileReader::header()
+{
+	return mHeader;
+}
+
+
+quint64 TileReader::frameCount()
+{
+	return mFrames;
+}
+
+
+quint64 TileReader::keyframeCount()
+{
+	return mKeyframes.size();
+}
+
+
+bool TileReader::seek(quint64 index)
+{
+	if(mKeyframes.isEmpty() || index<1 || index>mFrames) {
+		return false;
+	}
+	int k=0;
+	while(k+1<mKeyframes.size() && mKeyframes[k+1].index<=index) {
+		++k;
+	}
+	if(!mFile.seek(mKeyframes[k].offset)) {
+		return false;
+	}
+	mNext=mKeyframes[k].index;
+	QImage frame;
+	TileContainer::FrameHeader info;
+	while(mNext<index) {
+		if(!next(frame, info)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+bool TileReader::next(QImage &frame, TileContainer::FrameHeader &info)
+{
+	// Let go of the previous frame so decoding into the canvas doesn't copy it
+	frame=QImage();
+	if(mNext>mFrames) {
+		return false;
+	}
+	if(sizeof(info)!=mFile.read(reinterpret_cast<char *>(&info), sizeof(info)) || TileContainer::FRAME_MAGIC!=info.magic) {
+		mError="Corrupt frame header";
+		return false;
+	}
+	mBuffer.resize(info.bytes);
+	if(qint64(info.bytes)!=mFile.read(mBuffer.data(), info.bytes)) {
+		mError="Truncated frame";
+		return false;
+	}
+	const int ts=mHeader.tileSize;
+	const int columns=(mHeader.width+ts-1)/ts;
+	const int rows=(mHeader.height+ts-1)/ts;
+	const uchar *in=reinterpret_cast<const uchar *>(mBuffer.constData());
+	const uchar *end=in+mBuffer.size();
+	uchar *bits=mCanvas.bits();
+	const int stride=mCanvas.bytesPerLine();
+	for(quint32 i=0; i<info.tiles; ++i) {
+		TileContainer::TileHeader th;
+		if(end-in<qint64(sizeof(th))) {
+			mError="Truncated tile";
+			return false;
+		}
+		memcpy(&th, in, sizeof(th));
+		in+=sizeof(th);
+		int w=0;
+		int h=0;
+		const int x=(th.tile%columns)*ts;
+		const int y=(th.tile/columns)*ts;
+		if(end-in<qint64(th.bytes) || int(th.tile)>=columns*rows || !QoiCodec::readHeader(in, th.bytes, w, h)
+				|| x+w>int(mHeader.width) || y+h>int(mHeader.height)
+				|| !QoiCodec::decode(in, th.bytes, bits+y*stride+x*4, stride)) {
+			mError="Corrupt tile";
+			return false;
+		}
+		in+=th.bytes;
+	}
+	mNext=info.index+1;
+	frame=mCanvas;
+	return true;
+}
@@ -0,0 +1,122 @@
+#ifndef TILECONTAINER_HPP
+#define TILECONTAINER_HPP
+
+#include <QImage>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+/*
+  Layout of tile delta recordings (.mstile files).
+
+	[Header]
+	per frame: [FrameHeader] then per changed tile [TileHeader][QOI data]
+	[Keyframe entries][Trailer], written when the recording is closed
+
+  Frames are cut into tileSize square tiles, numbered row by row. Keyframes
+  carry every tile, other frames only the tiles that changed since the
+  frame before, so a frame is rebuilt by decoding forward from the
+  keyframe before it. A file without trailer (the recorder died) is still
+  readable, the reader then finds the keyframes by walking the frames.
+  Numbers are in host byte order, like the raw container.
+*/
+namespace TileContainer
+{
+	const char MAGIC[8]={'M', 'S', 'T', 'I', 'L', 'E', '0', '1'};
+	const char TRAILER_MAGIC[8]={'M', 'S', 'T', 'I', 'L', 'E', 'I', 'X'};
+	const quint32 FRAME_MAGIC=0x4d415246; // "FRAM"
+	const quint32 VERSION=2;
+	const quint32 KEYFRAME=1;
+
+	struct Header {
+		char magic[8];
+		quint32 version;
+		quint32 width;
+		quint32 height;
+		// QImage::Format of the frames
+		quint32 format;
+		quint32 tileSize;
+		quint32 keyframeInterval;
+		double fps;
+		// Milliseconds since epoch when the recording started
+		qint64 startTime;
+	};
+
+	struct FrameHeader {
+		quint32 magic;
+		quint32 flags;
+		quint64 index;
+		quint64 id;
+		// Capture time in ns on the steady clock
+		qint64 timestamp;
+		quint32 tiles;
+		// Bytes of tile headers and data following this header
+		quint32 bytes;
+	};
+
+	struct TileHeader {
+		quint32 tile;
+		quint32 bytes;
+	};
+
+	struct Keyframe {
+		quint64 index;
+		quint64 offset;
+	};
+
+	struct Trailer {
+		quint64 frames;
+		quint64 keyframes;
+		quint64 offset;
+		char magic[8];
+	};
+
+	static_assert(sizeof(Header)==48, "Tile container header must be packed");
+	static_assert(sizeof(FrameHeader)==40, "Tile container frame header must be packed");
+	static_assert(sizeof(TileHeader)==8, "Tile container tile header must be packed");
+	static_assert(sizeof(Trailer)==32, "Tile container trailer must be packed");
+
+	Header makeHeader(const QSize &size, QImage::Format format, int tileSize, int keyframeInterval, qreal fps, qint64 startTime);
+	bool isValid(const Header &header);
+
+	// Fast non cryptographic 64 bit hash of a rectangle of 32 bit pixels
+	quint64 hashTile(const uchar *pixels, int width, int height, int stride);
+}
+
+
+// Rebuilds the frames of a tile delta recording, reading forward from keyframes
+class TileReader
+{
+	private:
+		QFile mFile;
+		TileContainer::Header mHeader;
+		QVector<TileContainer::Keyframe> mKeyframes;
+		quint64 mFrames;
+		quint64 mNext;
+		QImage mCanvas;
+		QByteArray mBuffer;
+		QString mError;
+
+	public:
+		explicit TileReader();
+		virtual ~TileReader();
+
+	public:
+		bool open(const QString &filename);
+		void close();
+		QString errorString();
+
+		const TileContainer::Header &header();
+		quint64 frameCount();
+		quint64 keyframeCount();
+		// Position the reader so next() returns the frame with the given index (starting at 1)
+		bool seek(quint64 index);
+		// Decode the next frame. The image shares the reader's canvas, keeping it around makes the next call copy
+		bool next(QImage &frame, TileContainer::FrameHeader &info);
+
+	private:
+		bool readTrailer();
+		bool scan();
+};
+
+#endif // TILECONTAINER_HPP
@@ -0,0 +1,205 @@
+#include "TileSink.hpp"
+
+#include "QoiCodec.hpp"
+
+#include <QDateTime>
+#include <QDebug>
+
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+
+TileSink::TileSink(int tileSize, int keyframeInterval, int level, bool journaled)
+	: mTileSize(qBound(8, tileSize, 1024))
+	, mKeyframeInterval(qMax(1, keyframeInterval))
+	, mLevel(level)
+	, mColumns(0)
+	, mRows(0)
+	, mFrames(0)
+	, mLastID(0)
+	, mSinceKeyframe(0)
+	, mTilesWritten(0)
+	, mTilesTotal(0)
+	, mTilesSkipped(0)
+	, mJournaled(journaled)
+{
+	memset(&mHeader, 0, sizeof(mHeader));
+}
+
+TileSink::~TileSink()
+{
+	close();
+}
+
+
+bool TileSink::open(const QString &basePath, const QSize &size, qreal fps)
+{
+	close();
+	mFile.setFileName(basePath+"/recording.mstile");
+	if(!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qWarning()<<"ERROR: Could not open"<<mFile.fileName()<<":"<<mFile.errorString();
+		return false;
+	}
+	mHeader=TileContainer::makeHeader(size, formats().first(), mTileSize, mKeyframeInterval, fps, QDateTime::currentMSecsSinceEpoch());
+	if(sizeof(mHeader)!=mFile.write(reinterpret_cast<const char *>(&mHeader), sizeof(mHeader))) {
+		qWarning()<<"ERROR: Could not write"<<mFile.fileName()<<":"<<mFile.errorString();
+		mFile.close();
+		return false;
+	}
+	mColumns=(size.width()+mTileSize-1)/mTileSize;
+	mRows=(size.height()+mTileSize-1)/mTileSize;
+	mHashes.fill(0, mColumns*mRows);
+	mKeyframes.clear();
+	mScratch.resize(QoiCodec::maxSize(mTileSize, mTileSize));
+	mFrames=0;
+	mLastID=0;
+	mSinceKeyframe=0;
+	mTilesWritten=0;
+	mTilesTotal=0;
+	mTilesSkipped=0;
+	if(mJournaled) {
+		mJournal.open(mFile.fileName());
+	}
+	return true;
+}
+
+
+bool TileSink::write(const Frame &frame)
+{
+	const QImage &image=frame.image;
+	if(!mFile.isOpen() || image.width()!=int(mHeader.width) || image.height()!=int(mHeader.height) || !formats().contains(image.format())) {
+		mDropped.fetchAndAddRelaxed(1);
+		return false;
+	}
+	const bool keyframe=(0==mFrames || mSinceKeyframe>=quint64(mKeyframeInterval));
+	// The damage is relative to the frame with the id before, which has to be the last one written for the hashes to hold
+	const bool damaged=!keyframe && frame.hasDamage && mLastID+1==frame.id;
+	const uchar *bits=image.constBits();
+	const int stride=image.bytesPerLine();
+	TileContainer::FrameHeader fh{TileContainer::FRAME_MAGIC, keyframe?TileContainer::KEYFRAME:0, mFrames+1, frame.id, frame.timestamp, 0, 0};
+	mRecord.resize(sizeof(fh));
+	for(int row=0; row<mRows; ++row) {
+		const int y=row*mTileSize;
+		const int h=qMin(mTileSize, int(mHeader.height)-y);
+		for(int column=0; column<mColumns; ++column) {
+			const int x=column*mTileSize;
+			const int w=qMin(mTileSize, int(mHeader.width)-x);
+			const int tile=row*mColumns+column;
+			if(damaged && !frame.damage.intersects(QRect(x, y, w, h))) {
+				mTilesSkipped++;
+				continue;
+			}
+			const uchar *pixels=bits+y*stride+x*4;
+			const quint64 hash=TileContainer::hashTile(pixels, w, h, stride);
+			if(!keyframe && hash==mHashes[tile]) {
+				continue;
+			}
+			mHashes[tile]=hash;
+			const int size=QoiCodec::encode(pixels, w, h, stride, mLevel, reinterpret_cast<uchar *>(mScratch.data()));
+			const TileContainer::TileHeader th{quint32(tile), quint32(size)};
+			mRecord.append(reinterpret_cast<const char *>(&th), sizeof(th));
+			mRecord.append(mScratch.constData(), size);
+			fh.tiles++;
+		}
+	}
+	fh.bytes=mRecord.size()-sizeof(fh);
+	memcpy(mRecord.data(), &fh, sizeof(fh));
+	const qint64 offset=mFile.pos();
+	// One write per frame, so a frame is either all there or cut off at the end of the file
+	if(mRecord.size()!=mFile.write(mRecord)) {
+		qWarning()<<"ERROR: Could not write"<<mFile.fileName()<<":"<<mFile.errorString();
+		mDropped.fetchAndAddRelaxed(1);
+		// Make the next frame a keyframe, the hashes no longer match what is on disk
+		mSinceKeyframe=mKeyframeInterval;
+		mFile.seek(offset);
+		return false;
+	}
+	mJournal.append(RecordingJournal::Entry{mFrames, frame.id, frame.timestamp, quint64(offset), quint64(mRecord.size()), fh.flags, 0});
+	if(keyframe) {
+		mKeyframes<<TileContainer::Keyframe{fh.index, quint64(offset)};
+		mSinceKeyframe=0;
+	}
+	mSinceKeyframe++;
+	mFrames++;
+	mLastID=frame.id;
+	mTilesWritten+=fh.tiles;
+	mTilesTotal+=mHashes.size();
+	mWritten.fetchAndAddRelaxed(1);
+	mBytes.fetchAndAddRelaxed(mRecord.size());
+	return true;
+}
+
+
+void TileSink::sync()
+{
+	if(!mFile.isOpen()) {
+		return;
+	}
+	mFile.flush();
+#if defined(Q_OS_LINUX)
+	::fdatasync(mFile.handle());
+#elif defined(Q_OS_UNIX)
+	::fsync(mFile.handle());
+#endif
+	mJournal.commit();
+}
+
+
+void TileSink::close()
+{
+	if(!mFile.isOpen()) {
+		return;
+	}
+	TileContainer::Trailer trailer;
+	trailer.frames=mFrames;
+	trailer.keyframes=mKeyframes.size();
+	trailer.offset=mFile.pos();
+	memcpy(trailer.magic, TileContainer::TRAILER_MAGIC, sizeof(trailer.magic));
+	const qint64 bytes=mKeyframes.size()*sizeof(TileContainer::Keyframe);
+	if(bytes!=mFile.write(reinterpret_cast<const char *>(mKeyframes.constData()), bytes)
+			|| sizeof(trailer)!=mFile.write(reinterpret_cast<const char *>(&trailer), sizeof(trailer))) {
+		qWarning()<<"ERROR: Could not write the index of"<<mFile.fileName()<<":"<<mFile.errorString();
+	}
+	sync();
+	mFile.close();
+	mJournal.remove();
+	qDebug()<<"TILES: closed"<<stats();
+}
+
+
+bool TileSink::isOpen()
+{
+	return mFile.isOpen();
+}
+
+
+QString TileSink::name()
+{
+	return "tiles";
+}
+
+
+QVector<QImage::Format> TileSink::formats()
+{
+	// Tiles are coded as they are in memory, like QoiSink, so only the format in the header is taken
+	QVector<QImage::Format> formats;
+	formats<<QImage::Format_ARGB32_Premultiplied;
+	return formats;
+}
+
+
+QString TileSink::stats()
+{
+	const qreal changed=(mTilesTotal>0)?(100.0*mTilesWritten/mTilesTotal):0.0;
+	const qreal skipped=(mTilesTotal>0)?(100.0*mTilesSkipped/mTilesTotal):0.0;
+	return QString("%1 keyframes=%2 tilesChanged=%3% tilesUndamaged=%4%").arg(FrameSink::stats()).arg(mKeyframes.size()).arg(changed, 0, 'f', 1).arg(skipped, 0, 'f', 1);
+}
+
+
+QString TileSink::filename()
+{
+	return mFile.fileName();
+}
@@ -0,0 +1,68 @@
+#ifndef TILESINK_HPP
+#define TILESINK_HPP
+
+#include "FrameSink.hpp"
+#include "TileContainer.hpp"
+#include "RecordingJournal.hpp"
+
+#include <QFile>
+#include <QVector>
+#include <QByteArray>
+
+/*
+  Records only what changed. Each frame is cut into tiles which are hashed
+  and compared with the hashes of the frame before, and only the changed
+  tiles are QOI coded and written (see TileContainer.hpp). When the frame
+  follows the one written before and says where it is damaged, tiles
+  outside the damage are not even hashed. Every
+  keyframeInterval frames all tiles are written so the recording can be
+  seeked without decoding it from the start.
+
+  Screen recordings where little moves shrink to a fraction of the raw
+  size. Use rawconvert to rebuild the frames.
+
+  Journaled, every sync() also commits the frames written since to a
+  RecordingJournal, so a crash costs at most one sync interval.
+*/
+class TileSink: public FrameSink
+{
+	private:
+		QFile mFile;
+		TileContainer::Header mHeader;
+		int mTileSize;
+		int mKeyframeInterval;
+		int mLevel;
+		int mColumns;
+		int mRows;
+		QVector<quint64> mHashes;
+		QVector<TileContainer::Keyframe> mKeyframes;
+		QByteArray mRecord;
+		QByteArray mScratch;
+		quint64 mFrames;
+		quint64 mLastID;
+		quint64 mSinceKeyframe;
+		quint64 mTilesWritten;
+		quint64 mTilesTotal;
+		quint64 mTilesSkipped;
+		bool mJournaled;
+		RecordingJournal mJournal;
+
+	public:
+		// tileSize in pixels, keyframeInterval in frames, level as for QoiCodec
+		explicit TileSink(int tileSize=64, int keyframeInterval=300, int level=1, bool journaled=false);
+		virtual ~TileSink();
+
+	public:
+		bool open(const QString &basePath, const QSize &size, qreal fps) override;
+		bool write(const Frame &frame) override;
+		void sync() override;
+		void close() override;
+		bool isOpen() override;
+		QString name() override;
+		QVector<QImage::Format> formats() override;
+		QString stats() override;
+
+		QString filename();
+};
+
+#endif // TILESINK_HPP
@@ -0,0 +1,196 @@
+#include "VideoDeviceWatcher.hpp"
+
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QDebug>
+
+#if defined(Q_OS_LINUX)
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace
+{
+	const char *DEVICE_DIR="/dev";
+	const char *DEVICE_PREFIX="video";
+}
+
+
+VideoDeviceWatcher::VideoDeviceWatcher(QObject *parent)
+	: QObject(parent)
+	, mFd(-1)
+	, mNetlink(false)
+	, mNotifier(nullptr)
+{
+}
+
+VideoDeviceWatcher::~VideoDeviceWatcher()
+{
+	stop();
+}
+
+
+bool VideoDeviceWatcher::start()
+{
+	if(isRunning()) {
+		return true;
+	}
+	if(!startInotify() && !startNetlink()) {
+		return false;
+	}
+	mNotifier=new QSocketNotifier(mFd, QSocketNotifier::Read, this);
+	if(!connect(mNotifier, &QSocketNotifier::activated, this, &VideoDeviceWatcher::onReadable)) {
+		qWarning()<<"ERROR: Could not connect device watcher";
+	}
+	qDebug()<<"DEVICE WATCHER: watching"<<DEVICE_DIR<<"with"<<method();
+	return true;
+}
+
+
+void VideoDeviceWatcher::stop()
+{
+	delete mNotifier;
+	mNotifier=nullptr;
+#if defined(Q_OS_LINUX)
+	if(mFd>=0) {
+		::close(mFd);
+	}
+#endif
+	mFd=-1;
+}
+
+
+bool VideoDeviceWatcher::isRunning() const
+{
+	return mFd>=0;
+}
+
+
+QString VideoDeviceWatcher::method() const
+{
+	if(!isRunning()) {
+		return "none";
+	}
+	return mNetlink?"netlink":"inotify";
+}
+
+
+bool VideoDeviceWatcher::startInotify()
+{
+#if defined(Q_OS_LINUX)
+	const int fd=inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(fd<0) {
+		qWarning()<<"ERROR: inotify unavailable:"<<strerror(errno);
+		return false;
+	}
+	// Attribute changes are udev setting owner and mode, after which the node can be opened
+	if(inotify_add_watch(fd, DEVICE_DIR, IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO)<0) {
+		qWarning()<<"ERROR: Could not watch"<<DEVICE_DIR<<strerror(errno);
+		::close(fd);
+		return false;
+	}
+	mFd=fd;
+	mNetlink=false;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+bool VideoDeviceWatcher::startNetlink()
+{
+#if defined(Q_OS_LINUX)
+	const int fd=socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if(fd<0) {
+		qWarning()<<"ERROR: uevent socket unavailable:"<<strerror(errno);
+		return false;
+	}
+	struct sockaddr_nl address;
+	memset(&address, 0, sizeof(address));
+	address.nl_family=AF_NETLINK;
+	// The kernel's own uevents, which unprivileged processes may listen to
+	address.nl_groups=1;
+	if(bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address))<0) {
+		qWarning()<<"ERROR: Could not bind uevent socket:"<<strerror(errno);
+		::close(fd);
+		return false;
+	}
+	mFd=fd;
+	mNetlink=true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void VideoDeviceWatcher::onReadable()
+{
+#if defined(Q_OS_LINUX)
+	// Everything waiting is read in one go, so a burst of events for one node is reported once
+	QStringList changed;
+	bool overflowed=false;
+	char buffer[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+	while(true) {
+		const ssize_t got=read(mFd, buffer, sizeof(buffer));
+		if(got<=0) {
+			if(got<0 && ENOBUFS==errno) {
+				// The uevent socket's buffer overran
+				qWarning()<<"ERROR: Device watcher missed events";
+				overflowed=true;
+				continue;
+			}
+			if(got<0 && EAGAIN!=errno && EWOULDBLOCK!=errno && EINTR!=errno) {
+				qWarning()<<"ERROR: Device watcher read failed:"<<strerror(errno);
+			}
+			break;
+		}
+		if(mNetlink) {
+			// "action@devpath" followed by KEY=value strings, all NUL terminated
+			QString subsystem;
+			QString name;
+			// The last field of a truncated datagram has no NUL, so nothing may be read past what arrived
+			for(ssize_t i=0; i<got;) {
+				const size_t length=strnlen(buffer+i, static_cast<size_t>(got-i));
+				const QString field=QString::fromLocal8Bit(buffer+i, static_cast<int>(length));
+				i+=static_cast<ssize_t>(length)+1;
+				if(field.startsWith("SUBSYSTEM=")) {
+					subsystem=field.mid(10);
+				} else if(field.startsWith("DEVNAME=")) {
+					name=field.mid(8);
+				}
+			}
+			// DEVNAME is relative to /dev, except when it isn't
+			if("video4linux"==subsystem && !name.isEmpty()) {
+				changed<<(name.startsWith('/')?name:(QString(DEVICE_DIR)+"/"+name));
+			}
+		} else {
+			for(ssize_t i=0; i<got;) {
+				const struct inotify_event *event=reinterpret_cast<const struct inotify_event *>(buffer+i);
+				if(event->len>0 && 0==strncmp(event->name, DEVICE_PREFIX, strlen(DEVICE_PREFIX))) {
+					changed<<(QString(DEVICE_DIR)+"/"+QString::fromLocal8Bit(event->name));
+				}
+				if(0!=(event->mask & IN_Q_OVERFLOW)) {
+					qWarning()<<"ERROR: Device watcher missed events";
+					overflowed=true;
+				}
+				i+=sizeof(struct inotify_event)+event->len;
+			}
+		}
+	}
+	if(overflowed) {
+		emit eventsLost();
+		return;
+	}
+	changed.removeDuplicates();
+	for(const QString &path:changed) {
+		emit deviceChanged(path);
+	}
+#endif
+}
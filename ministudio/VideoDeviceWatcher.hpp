@@ -0,0 +1,54 @@
+#ifndef VIDEODEVICEWATCHER_HPP
+#define VIDEODEVICEWATCHER_HPP
+
+#include <QObject>
+#include <QString>
+
+class QSocketNotifier;
+
+/*
+  Tells when video device nodes (/dev/video*) come and go, as it happens.
+
+  Watches /dev with inotify, which also sees udev fixing up the node's
+  permissions after it was created. Without inotify it listens to the
+  kernel's uevents on a netlink socket instead. Either way it sits on a
+  socket notifier in the owner's event loop and costs nothing while
+  nothing changes.
+
+  start() returns false where neither is available (or off Linux), and the
+  owner has to poll.
+*/
+class VideoDeviceWatcher: public QObject
+{
+		Q_OBJECT
+	private:
+		int mFd;
+		bool mNetlink;
+		QSocketNotifier *mNotifier;
+
+	public:
+		explicit VideoDeviceWatcher(QObject *parent=nullptr);
+		virtual ~VideoDeviceWatcher();
+
+	public:
+		bool start();
+		void stop();
+		bool isRunning() const;
+		// "inotify", "netlink" or "none"
+		QString method() const;
+
+	private:
+		bool startInotify();
+		bool startNetlink();
+
+	private slots:
+		void onReadable();
+
+	signals:
+		// The node at path was added, removed or changed. Several events for the same node may arrive in a row
+		void deviceChanged(QString path);
+		// Events were lost, anything may have changed
+		void eventsLost();
+};
+
+#endif // VIDEODEVICEWATCHER_HPP
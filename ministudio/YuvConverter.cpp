@@ -0,0 +1,407 @@
+#include "YuvConverter.hpp"
+
+#include <QAtomicInt>
+#include <QDebug>
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define YUV_X86
+#include <immintrin.h>
+#define YUV_TARGET(T) __attribute__((target(T)))
+#endif
+
+namespace
+{
+	QAtomicInt sPath(-1);
+
+	YuvConverter::Path bestPath()
+	{
+#ifdef YUV_X86
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2")) {
+			return YuvConverter::AVX2;
+		}
+		if(__builtin_cpu_supports("sse2")) {
+			return YuvConverter::SSE2;
+		}
+#endif
+		return YuvConverter::Scalar;
+	}
+
+	inline quint32 clampByte(int x)
+	{
+		return static_cast<quint32>((x<0)?0:((x>255)?255:x));
+	}
+
+	// The same steps as the vector kernels. Intermediates stay inside 16 bits except where those saturate, which clamps to the same result
+	inline quint32 pixel(int y, int u, int v, const YuvConverter::Coefficients &k)
+	{
+		const int yy=(y-k.yOffset)*k.y+32;
+		u-=128;
+		v-=128;
+		const quint32 r=clampByte((yy+v*k.rv)>>6);
+		const quint32 g=clampByte((yy-u*k.gu-v*k.gv)>>6);
+		const quint32 b=clampByte((yy+u*k.bu)>>6);
+		return 0xff000000 | (r<<16) | (g<<8) | b;
+	}
+
+	void planarRowScalar(quint32 *dst, const uchar *y, const uchar *u, const uchar *v, int count, const YuvConverter::Coefficients &k)
+	{
+		for(int i=0; i<count; ++i) {
+			dst[i]=pixel(y[i], u[i>>1], v[i>>1], k);
+		}
+	}
+
+	void semiPlanarRowScalar(quint32 *dst, const uchar *y, const uchar *uv, int count, const YuvConverter::Coefficients &k, bool swapped)
+	{
+		const int ui=swapped?1:0;
+		for(int i=0; i<count; ++i) {
+			const uchar *c=uv+(i>>1)*2;
+			dst[i]=pixel(y[i], c[ui], c[1-ui], k);
+		}
+	}
+
+	void packedRowScalar(quint32 *dst, const uchar *yuv, int count, const YuvConverter::Coefficients &k, bool yFirst)
+	{
+		const int yi=yFirst?0:1;
+		const int ci=yFirst?1:0;
+		for(int i=0; i<count; ++i) {
+			const uchar *p=yuv+(i>>1)*4;
+			dst[i]=pixel(p[yi+(i&1)*2], p[ci], p[ci+2], k);
+		}
+	}
+
+#ifdef YUV_X86
+	struct Constants {
+		__m128i yOffset;
+		__m128i y;
+		__m128i rv;
+		__m128i gu;
+		__m128i gv;
+		__m128i bu;
+	};
+
+	YUV_TARGET("sse2") Constants constants(const YuvConverter::Coefficients &k)
+	{
+		return Constants{_mm_set1_epi16(k.yOffset), _mm_set1_epi16(k.y), _mm_set1_epi16(k.rv), _mm_set1_epi16(k.gu), _mm_set1_epi16(k.gv), _mm_set1_epi16(k.bu)};
+	}
+
+	// Eight pixels from 16 bit Y, U and V with chroma already duplicated per pixel
+	YUV_TARGET("sse2") inline void store8(quint32 *dst, __m128i y, __m128i u, __m128i v, const Constants &c)
+	{
+		const __m128i bias=_mm_set1_epi16(128);
+		const __m128i round=_mm_set1_epi16(32);
+		y=_mm_adds_epi16(_mm_mullo_epi16(_mm_sub_epi16(y, c.yOffset), c.y), round);
+		u=_mm_sub_epi16(u, bias);
+		v=_mm_sub_epi16(v, bias);
+		const __m128i r=_mm_srai_epi16(_mm_adds_epi16(y, _mm_mullo_epi16(v, c.rv)), 6);
+		const __m128i g=_mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(y, _mm_mullo_epi16(u, c.gu)), _mm_mullo_epi16(v, c.gv)), 6);
+		const __m128i b=_mm_srai_epi16(_mm_adds_epi16(y, _mm_mullo_epi16(u, c.bu)), 6);
+		const __m128i bg=_mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+		const __m128i ra=_mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_set1_epi8(-1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst+4), _mm_unpackhi_epi16(bg, ra));
+	}
+
+	YUV_TARGET("sse2") void planarRowSSE2(quint32 *dst, const uchar *y, const uchar *u, const uchar *v, int count, const YuvConverter::Coefficients &k)
+	{
+		const Constants c=constants(k);
+		const __m128i zero=_mm_setzero_si128();
+		int i=0;
+		for(; i+8<=count; i+=8) {
+			qint32 u4;
+			qint32 v4;
+			memcpy(&u4, u+i/2, 4);
+			memcpy(&v4, v+i/2, 4);
+			const __m128i yy=_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(y+i)), zero);
+			const __m128i uu=_mm_unpacklo_epi8(_mm_cvtsi32_si128(u4), zero);
+			const __m128i vv=_mm_unpacklo_epi8(_mm_cvtsi32_si128(v4), zero);
+			store8(dst+i, yy, _mm_unpacklo_epi16(uu, uu), _mm_unpacklo_epi16(vv, vv), c);
+		}
+		planarRowScalar(dst+i, y+i, u+i/2, v+i/2, count-i, k);
+	}
+
+	YUV_TARGET("sse2") void semiPlanarRowSSE2(quint32 *dst, const uchar *y, const uchar *uv, int count, const YuvConverter::Coefficients &k, bool swapped)
+	{
+		const Constants c=constants(k);
+		const __m128i zero=_mm_setzero_si128();
+		const __m128i low=_mm_set1_epi16(0x00ff);
+		int i=0;
+		for(; i+8<=count; i+=8) {
+			// Four chroma pairs as 16 bit lanes, first byte low
+			const __m128i pairs=_mm_loadl_epi64(reinterpret_cast<const __m128i *>(uv+i));
+			__m128i uu=_mm_and_si128(pairs, low);
+			__m128i vv=_mm_srli_epi16(pairs, 8);
+			if(swapped) {
+				const __m128i t=uu;
+				uu=vv;
+				vv=t;
+			}
+			const __m128i yy=_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(y+i)), zero);
+			store8(dst+i, yy, _mm_unpacklo_epi16(uu, uu), _mm_unpacklo_epi16(vv, vv), c);
+		}
+		semiPlanarRowScalar(dst+i, y+i, uv+i, count-i, k, swapped);
+	}
+
+	YUV_TARGET("sse2") void packedRowSSE2(quint32 *dst, const uchar *yuv, int count, const YuvConverter::Coefficients &k, bool yFirst)
+	{
+		const Constants c=constants(k);
+		const __m128i low=_mm_set1_epi16(0x00ff);
+		const __m128i low32=_mm_set1_epi32(0x0000ffff);
+		int i=0;
+		for(; i+8<=count; i+=8) {
+			const __m128i x=_mm_loadu_si128(reinterpret_cast<const __m128i *>(yuv+i*2));
+			const __m128i yy=yFirst?_mm_and_si128(x, low):_mm_srli_epi16(x, 8);
+			// U0 V0 U1 V1 ... as 16 bit lanes, then each into both lanes of its pixel pair
+			const __m128i chroma=yFirst?_mm_srli_epi16(x, 8):_mm_and_si128(x, low);
+			const __m128i uu=_mm_and_si128(chroma, low32);
+			const __m128i vv=_mm_srli_epi32(chroma, 16);
+			store8(dst+i, yy, _mm_or_si128(uu, _mm_slli_epi32(uu, 16)), _mm_or_si128(vv, _mm_slli_epi32(vv, 16)), c);
+		}
+		packedRowScalar(dst+i, yuv+i*2, count-i, k, yFirst);
+	}
+
+	struct Constants256 {
+		__m256i yOffset;
+		__m256i y;
+		__m256i rv;
+		__m256i gu;
+		__m256i gv;
+		__m256i bu;
+	};
+
+	YUV_TARGET("avx2") Constants256 constants256(const YuvConverter::Coefficients &k)
+	{
+		return Constants256{_mm256_set1_epi16(k.yOffset), _mm256_set1_epi16(k.y), _mm256_set1_epi16(k.rv), _mm256_set1_epi16(k.gu), _mm256_set1_epi16(k.gv), _mm256_set1_epi16(k.bu)};
+	}
+
+	// Sixteen pixels, lanes in pixel order
+	YUV_TARGET("avx2") inline void store16(quint32 *dst, __m256i y, __m256i u, __m256i v, const Constants256 &c)
+	{
+		const __m256i bias=_mm256_set1_epi16(128);
+		const __m256i round=_mm256_set1_epi16(32);
+		y=_mm256_adds_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(y, c.yOffset), c.y), round);
+		u=_mm256_sub_epi16(u, bias);
+		v=_mm256_sub_epi16(v, bias);
+		const __m256i r=_mm256_srai_epi16(_mm256_adds_epi16(y, _mm256_mullo_epi16(v, c.rv)), 6);
+		const __m256i g=_mm256_srai_epi16(_mm256_subs_epi16(_mm256_subs_epi16(y, _mm256_mullo_epi16(u, c.gu)), _mm256_mullo_epi16(v, c.gv)), 6);
+		const __m256i b=_mm256_srai_epi16(_mm256_adds_epi16(y, _mm256_mullo_epi16(u, c.bu)), 6);
+		// Packing and unpacking work per 128 bit lane, which leaves pixels 0-3 and 8-11 in lo, 4-7 and 12-15 in hi
+		const __m256i bg=_mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), _mm256_packus_epi16(g, g));
+		const __m256i ra=_mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), _mm256_set1_epi8(-1));
+		const __m256i lo=_mm256_unpacklo_epi16(bg, ra);
+		const __m256i hi=_mm256_unpackhi_epi16(bg, ra);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst+8), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	// Eight chroma bytes, each widened into both 16 bit lanes of its pixel pair
+	YUV_TARGET("avx2") inline __m256i duplicateChroma(const uchar *c)
+	{
+		const __m256i x=_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(c)));
+		return _mm256_or_si256(x, _mm256_slli_epi32(x, 16));
+	}
+
+	YUV_TARGET("avx2") void planarRowAVX2(quint32 *dst, const uchar *y, const uchar *u, const uchar *v, int count, const YuvConverter::Coefficients &k)
+	{
+		const Constants256 c=constants256(k);
+		int i=0;
+		for(; i+16<=count; i+=16) {
+			const __m256i yy=_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y+i)));
+			store16(dst+i, yy, duplicateChroma(u+i/2), duplicateChroma(v+i/2), c);
+		}
+		planarRowSSE2(dst+i, y+i, u+i/2, v+i/2, count-i, k);
+	}
+
+	YUV_TARGET("avx2") void semiPlanarRowAVX2(quint32 *dst, const uchar *y, const uchar *uv, int count, const YuvConverter::Coefficients &k, bool swapped)
+	{
+		const Constants256 c=constants256(k);
+		const __m256i low=_mm256_set1_epi32(0x000000ff);
+		int i=0;
+		for(; i+16<=count; i+=16) {
+			// Eight chroma pairs, one per 32 bit lane
+			const __m256i pairs=_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(uv+i)));
+			__m256i uu=_mm256_and_si256(pairs, low);
+			__m256i vv=_mm256_srli_epi32(pairs, 8);
+			if(swapped) {
+				const __m256i t=uu;
+				uu=vv;
+				vv=t;
+			}
+			const __m256i yy=_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y+i)));
+			store16(dst+i, yy, _mm256_or_si256(uu, _mm256_slli_epi32(uu, 16)), _mm256_or_si256(vv, _mm256_slli_epi32(vv, 16)), c);
+		}
+		semiPlanarRowSSE2(dst+i, y+i, uv+i, count-i, k, swapped);
+	}
+
+	YUV_TARGET("avx2") void packedRowAVX2(quint32 *dst, const uchar *yuv, int count, const YuvConverter::Coefficients &k, bool yFirst)
+	{
+		const Constants256 c=constants256(k);
+		const __m256i low=_mm256_set1_epi16(0x00ff);
+		const __m256i low32=_mm256_set1_epi32(0x0000ffff);
+		int i=0;
+		for(; i+16<=count; i+=16) {
+			// Everything here stays within pixel pairs, so lane boundaries don't matter
+			const __m256i x=_mm256_loadu_si256(reinterpret_cast<const __m256i *>(yuv+i*2));
+			const __m256i yy=yFirst?_mm256_and_si256(x, low):_mm256_srli_epi16(x, 8);
+			const __m256i chroma=yFirst?_mm256_srli_epi16(x, 8):_mm256_and_si256(x, low);
+			const __m256i uu=_mm256_and_si256(chroma, low32);
+			const __m256i vv=_mm256_srli_epi32(chroma, 16);
+			store16(dst+i, yy, _mm256_or_si256(uu, _mm256_slli_epi32(uu, 16)), _mm256_or_si256(vv, _mm256_slli_epi32(vv, 16)), c);
+		}
+		packedRowSSE2(dst+i, yuv+i*2, count-i, k, yFirst);
+	}
+#endif
+}
+
+
+bool YuvConverter::convert(Layout layout, Matrix matrix, const uchar *const planes[3], const int strides[3], QImage &dst)
+{
+	if(dst.isNull() || QImage::Format_ARGB32_Premultiplied!=dst.format()) {
+		qWarning()<<"ERROR: YUV conversion needs an ARGB32_Premultiplied target";
+		return false;
+	}
+	for(int i=0; i<planeCount(layout); ++i) {
+		if(nullptr==planes[i]) {
+			return false;
+		}
+	}
+	const Coefficients k=coefficients(matrix);
+	const int w=dst.width();
+	const int h=dst.height();
+	for(int row=0; row<h; ++row) {
+		quint32 *out=reinterpret_cast<quint32 *>(dst.scanLine(row));
+		const uchar *y=planes[0]+row*strides[0];
+		switch(layout) {
+			case NV12:
+			case NV21:
+				semiPlanarRow(out, y, planes[1]+(row>>1)*strides[1], w, k, NV21==layout);
+				break;
+			case YUYV:
+			case UYVY:
+				packedRow(out, y, w, k, YUYV==layout);
+				break;
+			case I420:
+				planarRow(out, y, planes[1]+(row>>1)*strides[1], planes[2]+(row>>1)*strides[2], w, k);
+				break;
+			case YV12:
+				// V comes before U in memory
+				planarRow(out, y, planes[2]+(row>>1)*strides[2], planes[1]+(row>>1)*strides[1], w, k);
+				break;
+		}
+	}
+	return true;
+}
+
+
+YuvConverter::Coefficients YuvConverter::coefficients(Matrix matrix)
+{
+	// Scaled by 64. Limited range stretches Y by 255/219 and chroma by 255/224
+	switch(matrix) {
+		case BT709: return Coefficients{16, 75, 115, 14, 34, 135};
+		case BT601Full: return Coefficients{0, 64, 90, 22, 46, 113};
+		default: return Coefficients{16, 75, 102, 25, 52, 129};
+	}
+}
+
+
+int YuvConverter::planeCount(Layout layout)
+{
+	switch(layout) {
+		case NV12:
+		case NV21: return 2;
+		case YUYV:
+		case UYVY: return 1;
+		default: return 3;
+	}
+}
+
+
+QString YuvConverter::layoutName(Layout layout)
+{
+	switch(layout) {
+		case NV12: return "nv12";
+		case NV21: return "nv21";
+		case YUYV: return "yuyv";
+		case UYVY: return "uyvy";
+		case I420: return "i420";
+		case YV12: return "yv12";
+		default: return "unknown";
+	}
+}
+
+
+QString YuvConverter::matrixName(Matrix matrix)
+{
+	switch(matrix) {
+		case BT709: return "bt709";
+		case BT601Full: return "bt601full";
+		default: return "bt601";
+	}
+}
+
+
+YuvConverter::Path YuvConverter::path()
+{
+	int p=sPath.load();
+	if(p<0) {
+		p=bestPath();
+		sPath.testAndSetOrdered(-1, p);
+		qDebug()<<"YUV CONVERTER: using"<<pathName();
+	}
+	return static_cast<Path>(sPath.load());
+}
+
+
+QString YuvConverter::pathName()
+{
+	switch(path()) {
+		case AVX2: return "avx2";
+		case SSE2: return "sse2";
+		default: return "scalar";
+	}
+}
+
+
+void YuvConverter::setPath(Path p)
+{
+	const Path best=bestPath();
+	sPath.store((p<=best)?p:Scalar);
+}
+
+
+void YuvConverter::planarRow(quint32 *dst, const uchar *y, const uchar *u, const uchar *v, int count, const Coefficients &k)
+{
+	switch(path()) {
+#ifdef YUV_X86
+		case AVX2: planarRowAVX2(dst, y, u, v, count, k); break;
+		case SSE2: planarRowSSE2(dst, y, u, v, count, k); break;
+#endif
+		default: planarRowScalar(dst, y, u, v, count, k); break;
+	}
+}
+
+
+void YuvConverter::semiPlanarRow(quint32 *dst, const uchar *y, const uchar *uv, int count, const Coefficients &k, bool swapped)
+{
+	switch(path()) {
+#ifdef YUV_X86
+		case AVX2: semiPlanarRowAVX2(dst, y, uv, count, k, swapped); break;
+		case SSE2: semiPlanarRowSSE2(dst, y, uv, count, k, swapped); break;
+#endif
+		default: semiPlanarRowScalar(dst, y, uv, count, k, swapped); break;
+	}
+}
+
+
+void YuvConverter::packedRow(quint32 *dst, const uchar *yuv, int count, const Coefficients &k, bool yFirst)
+{
+	switch(path()) {
+#ifdef YUV_X86
+		case AVX2: packedRowAVX2(dst, yuv, count, k, yFirst); break;
+		case SSE2: packedRowSSE2(dst, yuv, count, k, yFirst); break;
+#endif
+		default: packedRowScalar(dst, yuv, count, k, yFirst); break;
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef YUVCONVERTER_HPP
+#define YUVCONVERTER_HPP
+
+#include <QImage>
+#include <QString>
+
+/*
+  CPU conversion of camera YUV frames into premultiplied ARGB32, which is
+  B,G,R,A in memory and what the compositor takes without converting.
+
+  Handles the layouts webcams deliver: NV12/NV21 (Y plane plus
+  interleaved chroma), YUYV/UYVY (packed 4:2:2) and I420/YV12 (three
+  planes). Chroma is subsampled by two horizontally and, for the planar
+  layouts, vertically, and is used as is for both pixels it covers.
+
+  The maths is 16 bit fixed point with 6 fractional bits, so the scalar,
+  SSE2 and AVX2 row kernels give identical results. Like BlendEngine the
+  best kernel the CPU supports is picked at runtime.
+*/
+class YuvConverter
+{
+	public:
+		enum Layout {
+			NV12
+			, NV21
+			, YUYV
+			, UYVY
+			, I420
+			, YV12
+		};
+
+		enum Matrix {
+			// Limited range (16..235)
+			BT601
+			, BT709
+			// Full range BT.601, as used by JPEG and many MJPEG webcams
+			, BT601Full
+		};
+
+		enum Path {
+			Scalar
+			, SSE2
+			, AVX2
+		};
+
+		struct Coefficients {
+			short yOffset;
+			short y;
+			short rv;
+			short gu;
+			short gv;
+			short bu;
+		};
+
+	public:
+		// Convert a frame. planes and strides are in memory order, as mapped from the video frame.
+		// dst must be width x height ARGB32_Premultiplied. Returns false for a layout with too few planes
+		static bool convert(Layout layout, Matrix matrix, const uchar *const planes[3], const int strides[3], QImage &dst);
+
+		static Coefficients coefficients(Matrix matrix);
+		static int planeCount(Layout layout);
+		static QString layoutName(Layout layout);
+		static QString matrixName(Matrix matrix);
+
+		static Path path();
+		static QString pathName();
+		// Force a specific kernel, for comparing them. Falls back to scalar if the CPU lacks support
+		static void setPath(Path path);
+
+	public:
+		// One row each. Chroma pointers point at the chroma for the row, count is in pixels
+		static void planarRow(quint32 *dst, const uchar *y, const uchar *u, const uchar *v, int count, const Coefficients &k);
+		static void semiPlanarRow(quint32 *dst, const uchar *y, const uchar *uv, int count, const Coefficients &k, bool swapped);
+		// yFirst for YUYV, false for UYVY
+		static void packedRow(quint32 *dst, const uchar *yuv, int count, const Coefficients &k, bool yFirst);
+};
+
+#endif // YUVCONVERTER_HPP
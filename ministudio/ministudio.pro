@@ -6,44 +6,115 @@ include(../libs/libs.pri)
 
 HEADERS += \
 	AnimatedSwitch.hpp \
+	AudioCapture.hpp \
+	AudioRing.hpp \
+	AudioWriter.hpp \
+	BlendEngine.hpp \
 	CameraGrabber.hpp \
 	CameraList.hpp \
+	CameraMailbox.hpp \
+	CameraSource.hpp \
+	EncoderSink.hpp \
+	FormatNegotiator.hpp \
+	FrameBufferPool.hpp \
+	FrameClock.hpp \
 	FrameScene.hpp \
+	FrameSink.hpp \
+	FrameWriter.hpp \
+	ImageScaler.hpp \
+	LatencyMeter.hpp \
 	Layer.hpp \
+	LayerCache.hpp \
 	LiveThread.hpp \
 	MiniStudio.hpp \
+	PngSink.hpp \
 	PoorMansProbe.hpp \
+	PrerollRing.hpp \
 	Presentation.hpp \
+	QoiCodec.hpp \
+	QoiSink.hpp \
+	RawContainer.hpp \
+	RawSink.hpp \
+	RecordingFinalizer.hpp \
+	RecordingJournal.hpp \
+	RenderPlan.hpp \
+	RenderQueue.hpp \
+	ReorderBuffer.hpp \
 	RichEdit.hpp \
 	RunGuard.hpp \
+	ScreenGrabber.hpp \
+	SegmentedSink.hpp \
 	StudioConfig.hpp \
 	Tascam.hpp \
 	TascamSimulator.hpp \
+	TileContainer.hpp \
+	TileSink.hpp \
+	VideoDeviceWatcher.hpp \
+	YuvConverter.hpp \
 	widgets/LightWidget.hpp \
 
 
 SOURCES += \
 	AnimatedSwitch.cpp \
+	AudioCapture.cpp \
+	AudioRing.cpp \
+	AudioWriter.cpp \
+	BlendEngine.cpp \
 	CameraGrabber.cpp \
 	CameraList.cpp \
+	CameraMailbox.cpp \
+	CameraSource.cpp \
+	EncoderSink.cpp \
+	FormatNegotiator.cpp \
+	FrameBufferPool.cpp \
+	FrameClock.cpp \
 	FrameScene.cpp \
+	FrameSink.cpp \
+	FrameWriter.cpp \
+	ImageScaler.cpp \
+	LatencyMeter.cpp \
 	Layer.cpp \
+	LayerCache.cpp \
 	LiveThread.cpp \
 	main.cpp \
 	MiniStudio.cpp \
+	PngSink.cpp \
 	PoorMansProbe.cpp \
+	PrerollRing.cpp \
 	Presentation.cpp \
+	QoiCodec.cpp \
+	QoiSink.cpp \
+	RawContainer.cpp \
+	RawSink.cpp \
+	RecordingFinalizer.cpp \
+	RecordingJournal.cpp \
+	RenderPlan.cpp \
+	RenderQueue.cpp \
+	ReorderBuffer.cpp \
 	RichEdit.cpp \
 	RunGuard.cpp \
+	ScreenGrabber.cpp \
+	SegmentedSink.cpp \
 	StudioConfig.cpp \
 	Tascam.cpp \
 	TascamSimulator.cpp \
+	TileContainer.cpp \
+	TileSink.cpp \
+	VideoDeviceWatcher.cpp \
+	YuvConverter.cpp \
 	widgets/LightWidget.cpp \
 
 
 RESOURCES += \
 	resources/icons.qrc \
 
+linux {
+	DEFINES += USE_FEATURE_XSHM USE_FEATURE_XDAMAGE
+	LIBS += -lX11 -lXext -lXdamage -lXfixes -lasound
+	HEADERS += ShmScreenGrabber.hpp DamageScreenGrabber.hpp
+	SOURCES += ShmScreenGrabber.cpp DamageScreenGrabber.cpp
+}
+
 FORMS += \
 	ui/StudioConfig.ui \
 	ui/Presentation.ui \
@@ -0,0 +1,387 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QFile>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include "RawContainer.hpp"
+#include "TileContainer.hpp"
+#include "TileSink.hpp"
+#include "FormatNegotiator.hpp"
+#include "PngSink.hpp"
+#include "QoiSink.hpp"
+#include "QoiCodec.hpp"
+#include "EncoderSink.hpp"
+#include "RecordingJournal.hpp"
+
+#include <cstdio>
+
+/*
+  Offline converter for recordings made with recordingFormat "raw" or
+  "tiles". Tile recordings are rebuilt frame by frame from their keyframes.
+
+	rawconvert <recording> info
+	rawconvert <recording> png <directory>
+	rawconvert <recording> qoi <directory> [level]
+	rawconvert <recording> tiles <directory> [tileSize [keyframeInterval]]
+	rawconvert <recording> video <directory> [codec [bitrate [preset]]]
+	rawconvert <recording> bench [frames]
+	rawconvert <recording> recover
+	rawconvert <file.qoi> decode <file.png>
+
+  Output goes through the same sinks the live recorder uses, so the result
+  is identical to what recording straight to PNG or video would give.
+
+  bench encodes recorded frames with each image sequence codec on one core
+  and reports speed and size, to pick a codec for the machine at hand.
+
+  recover repairs a journaled recording the recorder left behind, the same
+  way MiniStudio does on its next start.
+*/
+
+// Frames written between syncs of the output, as FrameWriter does by default
+static const int SYNC_FRAMES=16;
+
+
+static int usage()
+{
+	fprintf(stderr, "Usage: rawconvert <recording> info\n");
+	fprintf(stderr, "       rawconvert <recording> png <directory>\n");
+	fprintf(stderr, "       rawconvert <recording> qoi <directory> [level]\n");
+	fprintf(stderr, "       rawconvert <recording> tiles <directory> [tileSize [keyframeInterval]]\n");
+	fprintf(stderr, "       rawconvert <recording> video <directory> [codec [bitrate [preset]]]\n");
+	fprintf(stderr, "       rawconvert <recording> bench [frames]\n");
+	fprintf(stderr, "       rawconvert <recording> recover\n");
+	fprintf(stderr, "Recordings are .msraw or .mstile files\n");
+	fprintf(stderr, "       rawconvert <file.qoi> decode <file.png>\n");
+	return 1;
+}
+
+
+// Reads the frames of a recording in order, whatever its container
+class FrameSource
+{
+	public:
+		virtual ~FrameSource() {}
+
+		virtual QSize size() = 0;
+		virtual qreal fps() = 0;
+		virtual quint64 frameCount() = 0;
+		virtual bool rewind() = 0;
+		// The frame's image is only valid until the next call
+		virtual bool next(FrameSink::Frame &frame) = 0;
+		virtual void info() = 0;
+};
+
+
+class RawSource: public FrameSource
+{
+	private:
+		RawReader mReader;
+		quint64 mNext;
+
+	public:
+		bool open(const QString &filename)
+		{
+			mNext=0;
+			if(!mReader.open(filename)) {
+				qWarning()<<"ERROR: Could not open"<<filename<<":"<<mReader.errorString();
+				return false;
+			}
+			return true;
+		}
+
+		QSize size() override
+		{
+			return QSize(mReader.header().width, mReader.header().height);
+		}
+
+		qreal fps() override
+		{
+			return mReader.header().fps;
+		}
+
+		quint64 frameCount() override
+		{
+			return mReader.frameCount();
+		}
+
+		bool rewind() override
+		{
+			mNext=0;
+			return true;
+		}
+
+		bool next(FrameSink::Frame &frame) override
+		{
+			if(mNext>=mReader.frameCount()) {
+				return false;
+			}
+			const RawContainer::IndexEntry e=mReader.entry(mNext);
+			frame=FrameSink::Frame{mNext+1, e.id, e.timestamp, mReader.frame(mNext), QRegion(), false};
+			mNext++;
+			return true;
+		}
+
+		void info() override
+		{
+			const RawContainer::Header &h=mReader.header();
+			printf("raw recording\n");
+			printf("size: %ux%u stride %u format %u\n", h.width, h.height, h.stride, h.format);
+			printf("frames: %llu of %llu, %.2f fps\n", static_cast<unsigned long long>(h.frameCount), static_cast<unsigned long long>(h.capacity), h.fps);
+			if(h.frameCount>0) {
+				const RawContainer::IndexEntry first=mReader.entry(0);
+				const RawContainer::IndexEntry last=mReader.entry(h.frameCount-1);
+				printf("ids: %llu..%llu, %.1f ms\n", static_cast<unsigned long long>(first.id), static_cast<unsigned long long>(last.id), (last.timestamp-first.timestamp)/1e6);
+			}
+		}
+};
+
+
+class TileSource: public FrameSource
+{
+	private:
+		TileReader mReader;
+		QString mFilename;
+
+	public:
+		bool open(const QString &filename)
+		{
+			mFilename=filename;
+			if(!mReader.open(filename)) {
+				qWarning()<<"ERROR: Could not open"<<filename<<":"<<mReader.errorString();
+				return false;
+			}
+			return true;
+		}
+
+		QSize size() override
+		{
+			return QSize(mReader.header().width, mReader.header().height);
+		}
+
+		qreal fps() override
+		{
+			return mReader.header().fps;
+		}
+
+		quint64 frameCount() override
+		{
+			return mReader.frameCount();
+		}
+
+		bool rewind() override
+		{
+			return mReader.seek(1);
+		}
+
+		bool next(FrameSink::Frame &frame) override
+		{
+			TileContainer::FrameHeader fh;
+			if(!mReader.next(frame.image, fh)) {
+				return false;
+			}
+			frame.index=fh.index;
+			frame.id=fh.id;
+			frame.timestamp=fh.timestamp;
+			frame.hasDamage=false;
+			return true;
+		}
+
+		void info() override
+		{
+			const TileContainer::Header &h=mReader.header();
+			const qint64 bytes=QFile(mFilename).size();
+			const qreal rawBytes=qreal(h.width)*h.height*4*qMax<quint64>(1, mReader.frameCount());
+			printf("tile recording\n");
+			printf("size: %ux%u tile %u format %u\n", h.width, h.height, h.tileSize, h.format);
+			printf("frames: %llu, %llu keyframes, %.2f fps\n", static_cast<unsigned long long>(mReader.frameCount()), static_cast<unsigned long long>(mReader.keyframeCount()), h.fps);
+			printf("bytes: %lld, %.1f%% of raw\n", static_cast<long long>(bytes), 100.0*bytes/rawBytes);
+		}
+};
+
+
+static FrameSource *openSource(const QString &filename)
+{
+	if(filename.endsWith(".mstile")) {
+		TileSource *source=new TileSource();
+		if(source->open(filename)) {
+			return source;
+		}
+		delete source;
+	} else {
+		RawSource *source=new RawSource();
+		if(source->open(filename)) {
+			return source;
+		}
+		delete source;
+	}
+	return nullptr;
+}
+
+
+static int convert(FrameSource &source, FrameSink *sink, const QString &directory)
+{
+	FormatNegotiator *negotiator=FormatNegotiator::globalInstance();
+	negotiator->declare(FormatNegotiator::RecorderStage, sink->formats());
+	if(!QDir().mkpath(directory) || !sink->open(directory, source.size(), source.fps())) {
+		qWarning()<<"ERROR: Could not open"<<sink->name()<<"output in"<<directory;
+		return 1;
+	}
+	QElapsedTimer timer;
+	timer.start();
+	const quint64 count=source.frameCount();
+	FrameSink::Frame frame;
+	for(quint64 i=0; source.next(frame); ++i) {
+		frame.image=negotiator->convert(frame.image, FormatNegotiator::RecorderStage);
+		sink->write(frame);
+		// Sync in batches like FrameWriter does, image sequence sinks hold every file open until then
+		if(0==(i+1)%SYNC_FRAMES) {
+			sink->sync();
+		}
+		if(0==(i+1)%100) {
+			fprintf(stderr, "\r%llu/%llu", static_cast<unsigned long long>(i+1), static_cast<unsigned long long>(count));
+		}
+	}
+	sink->sync();
+	sink->close();
+	fprintf(stderr, "\n");
+	qDebug()<<"Converted in"<<timer.elapsed()<<"ms:"<<sink->stats();
+	return (sink->dropped()>0)?1:0;
+}
+
+
+static int decode(const QString &input, const QString &output)
+{
+	QFile file(input);
+	if(!file.open(QIODevice::ReadOnly)) {
+		qWarning()<<"ERROR: Could not open"<<input<<":"<<file.errorString();
+		return 1;
+	}
+	const QImage image=QoiCodec::decode(file.readAll());
+	if(image.isNull()) {
+		qWarning()<<"ERROR: Could not decode"<<input;
+		return 1;
+	}
+	if(!image.save(output)) {
+		qWarning()<<"ERROR: Could not save"<<output;
+		return 1;
+	}
+	return 0;
+}
+
+
+static int bench(FrameSource &source, quint64 frames)
+{
+	const quint64 count=qMin(frames, source.frameCount());
+	if(0==count) {
+		qWarning()<<"ERROR: No frames to benchmark";
+		return 1;
+	}
+	const QSize size=source.size();
+	const qreal rawBytes=qreal(size.width())*size.height()*4*count;
+	FrameSink::Frame frame;
+	QElapsedTimer timer;
+	// PNG as PngSink writes it, which has to unpremultiply first
+	{
+		qint64 bytes=0;
+		qint64 ns=0;
+		source.rewind();
+		for(quint64 i=0; i<count && source.next(frame); ++i) {
+			timer.start();
+			const QByteArray data=PngSink::encodeImage(FormatNegotiator::globalInstance()->convert(frame.image, FormatNegotiator::RecorderStage));
+			ns+=timer.nsecsElapsed();
+			bytes+=data.size();
+		}
+		const qreal ms=qMax<qint64>(1, ns)/1e6;
+		printf("png:     %7.2f ms/frame %7.1f fps  %5.1f%% of raw\n", ms/count, count*1000.0/ms, 100.0*bytes/rawBytes);
+	}
+	QByteArray out;
+	out.resize(QoiCodec::maxSize(size.width(), size.height()));
+	QImage decoded;
+	for(int level=0; level<=QoiCodec::MAX_LEVEL; ++level) {
+		qint64 bytes=0;
+		qint64 encodeNs=0;
+		qint64 decodeNs=0;
+		bool identical=true;
+		source.rewind();
+		for(quint64 i=0; i<count && source.next(frame); ++i) {
+			const QImage &image=frame.image;
+			if(decoded.size()!=image.size() || decoded.format()!=image.format()) {
+				decoded=QImage(image.size(), image.format());
+			}
+			timer.start();
+			const int encoded=QoiCodec::encode(image.constBits(), image.width(), image.height(), image.bytesPerLine(), level, reinterpret_cast<uchar *>(out.data()));
+			encodeNs+=timer.nsecsElapsed();
+			bytes+=encoded;
+			timer.start();
+			identical=QoiCodec::decode(reinterpret_cast<const uchar *>(out.constData()), encoded, decoded.bits(), decoded.bytesPerLine()) && identical;
+			decodeNs+=timer.nsecsElapsed();
+			identical=identical && decoded==image;
+		}
+		const qreal ms=qMax<qint64>(1, encodeNs)/1e6;
+		printf("qoi %d:   %7.2f ms/frame %7.1f fps  %5.1f%% of raw, decode %.2f ms/frame%s\n", level, ms/count, count*1000.0/ms, 100.0*bytes/rawBytes, decodeNs/1e6/count, identical?"":" MISMATCH");
+	}
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	const QStringList args=app.arguments();
+	if(args.size()<3) {
+		return usage();
+	}
+	if("decode"==args[2]) {
+		return (args.size()<4)?usage():decode(args[1], args[3]);
+	}
+	if("recover"==args[2]) {
+		const QString journal=RecordingJournal::journalName(args[1]);
+		if(!QFile::exists(journal)) {
+			printf("%s has no journal, nothing to recover\n", qPrintable(args[1]));
+			return 0;
+		}
+		return RecordingJournal::recover(journal)?0:1;
+	}
+	FrameSource *source=openSource(args[1]);
+	if(nullptr==source) {
+		return 1;
+	}
+	const QString mode=args[2];
+	if("info"==mode) {
+		source->info();
+		delete source;
+		return 0;
+	}
+	if("bench"==mode) {
+		const int ret=bench(*source, (args.size()>3)?args[3].toULongLong():60);
+		delete source;
+		return ret;
+	}
+	if(args.size()<4) {
+		delete source;
+		return usage();
+	}
+	FrameSink *sink=nullptr;
+	if("png"==mode) {
+		sink=new PngSink();
+	} else if("qoi"==mode) {
+		sink=new QoiSink((args.size()>4)?args[4].toInt():1);
+	} else if("tiles"==mode) {
+		sink=new TileSink((args.size()>4)?args[4].toInt():64, (args.size()>5)?args[5].toInt():300);
+	} else if("video"==mode) {
+		const QString codec=(args.size()>4)?args[4]:QString("libx264");
+		const int bitrate=(args.size()>5)?args[5].toInt():8000;
+		const QString preset=(args.size()>6)?args[6]:QString("medium");
+		sink=new EncoderSink(codec, bitrate, preset);
+	} else {
+		delete source;
+		return usage();
+	}
+	const int ret=convert(*source, sink, args[3]);
+	delete sink;
+	delete source;
+	return ret;
+}
@@ -0,0 +1,36 @@
+TEMPLATE = app
+TARGET = rawconvert
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../common.pri)
+
+# The container format and the sinks are shared with the recorder
+INCLUDEPATH += ../ministudio
+
+HEADERS += \
+	../ministudio/EncoderSink.hpp \
+	../ministudio/FormatNegotiator.hpp \
+	../ministudio/FrameSink.hpp \
+	../ministudio/PngSink.hpp \
+	../ministudio/QoiCodec.hpp \
+	../ministudio/QoiSink.hpp \
+	../ministudio/RawContainer.hpp \
+	../ministudio/RecordingJournal.hpp \
+	../ministudio/TileContainer.hpp \
+	../ministudio/TileSink.hpp \
+
+
+SOURCES += \
+	../ministudio/EncoderSink.cpp \
+	../ministudio/FormatNegotiator.cpp \
+	../ministudio/FrameSink.cpp \
+	../ministudio/PngSink.cpp \
+	../ministudio/QoiCodec.cpp \
+	../ministudio/QoiSink.cpp \
+	../ministudio/RawContainer.cpp \
+	../ministudio/RecordingJournal.cpp \
+	../ministudio/TileContainer.cpp \
+	../ministudio/TileSink.cpp \
+	main.cpp \
+
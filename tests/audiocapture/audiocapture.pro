@@ -0,0 +1,22 @@
+TARGET = tst_audiocapture
+
+include(../tests.pri)
+
+LIBS += -lasound
+
+HEADERS += \
+	../../ministudio/AudioCapture.hpp \
+	../../ministudio/AudioRing.hpp \
+	../../ministudio/AudioWriter.hpp \
+	../../ministudio/FrameClock.hpp \
+	../../ministudio/LatencyMeter.hpp \
+
+
+SOURCES += \
+	../../ministudio/AudioCapture.cpp \
+	../../ministudio/AudioRing.cpp \
+	../../ministudio/AudioWriter.cpp \
+	../../ministudio/FrameClock.cpp \
+	../../ministudio/LatencyMeter.cpp \
+	tst_audiocapture.cpp \
+
@@ -0,0 +1,84 @@
+#include "AudioCapture.hpp"
+#include "AudioWriter.hpp"
+#include "FrameClock.hpp"
+
+#include <QtTest>
+#include <QThread>
+#include <QDir>
+
+/*
+  The recorder's audio path against a real ALSA device: capture idles with
+  a preroll for a while, then records into a WAV the way a recording with a
+  video preroll does. Needs a device to capture from, such as "null" or the
+  capture side of snd-aloop, and is skipped without one:
+
+	MINISTUDIO_AUDIO_DEVICE=hw:Loopback,1 tst_audiocapture
+*/
+class TestAudioCapture: public QObject
+{
+		Q_OBJECT
+	private:
+		QString mDevice;
+
+	private slots:
+		void initTestCase();
+
+		void record_data();
+		void record();
+};
+
+
+void TestAudioCapture::initTestCase()
+{
+	mDevice=QString::fromLocal8Bit(qgetenv("MINISTUDIO_AUDIO_DEVICE"));
+	if(mDevice.isEmpty()) {
+		QSKIP("Set MINISTUDIO_AUDIO_DEVICE to an ALSA capture device to run");
+	}
+}
+
+
+void TestAudioCapture::record_data()
+{
+	QTest::addColumn<int>("prerollMs");
+	QTest::addColumn<qreal>("seconds");
+	QTest::newRow("no preroll")<<0<<2.0;
+	QTest::newRow("preroll")<<1000<<3.0;
+}
+
+
+void TestAudioCapture::record()
+{
+	QFETCH(int, prerollMs);
+	QFETCH(qreal, seconds);
+	AudioCapture capture(mDevice);
+	capture.setPreroll(prerollMs);
+	QVERIFY(capture.start());
+	// Idle long enough for the ring to have to trim the oldest periods
+	QThread::msleep(static_cast<unsigned long>(prerollMs*2+200));
+	const QString filename=QDir::temp().filePath(QString("tst_audiocapture-%1.wav").arg(QCoreApplication::applicationPid()));
+	// Like a recording whose first frame is the oldest of the video preroll
+	const qint64 start=FrameClock::now()-qint64(prerollMs)*1000000;
+	AudioWriter *writer=new AudioWriter(&capture, filename, start);
+	QThread::msleep(static_cast<unsigned long>(seconds*1000));
+	writer->finish();
+	const qreal expected=FrameClock::since(start)/1e9;
+	const qreal duration=writer->duration();
+	const qreal padded=qreal(writer->padded())/capture.rate();
+	qDebug()<<"capture:"<<capture.stats();
+	qDebug()<<"writer:"<<writer->stats();
+	delete writer;
+	capture.stop();
+	QFile::remove(filename);
+	QVERIFY2(capture.latency().count()>0, "nothing was captured");
+	// The capture thread may not have handed over the last period or two yet
+	QVERIFY2(qAbs(duration-expected)<=0.1+expected*0.02, qPrintable(QString("%1 s of audio for %2 s of recording").arg(duration, 0, 'f', 3).arg(expected, 0, 'f', 3)));
+	// A few periods at the start and after a startup xrun are fine, a missing preroll is not
+	if(prerollMs>0) {
+		QVERIFY2(padded<=prerollMs/2000.0, qPrintable(QString("%1 s of the %2 s preroll is padding").arg(padded, 0, 'f', 3).arg(prerollMs/1000.0, 0, 'f', 3)));
+	}
+}
+
+
+QTEST_MAIN(TestAudioCapture)
+
+#include "tst_audiocapture.moc"
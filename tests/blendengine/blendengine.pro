@@ -0,0 +1,12 @@
+TARGET = tst_blendengine
+
+include(../tests.pri)
+
+HEADERS += \
+	../../ministudio/BlendEngine.hpp \
+
+
+SOURCES += \
+	../../ministudio/BlendEngine.cpp \
+	tst_blendengine.cpp \
+
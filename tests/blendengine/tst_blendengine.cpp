@@ -0,0 +1,329 @@
+#include "BlendEngine.hpp"
+
+#include <QtTest>
+#include <QPainter>
+
+#include <cstring>
+
+Q_DECLARE_METATYPE(BlendEngine::Path)
+
+/*
+  BlendEngine against known results, and every kernel the CPU has against
+  the scalar one. The benchmark times the layers the live view has with
+  QPainter and with each kernel:
+
+	tst_blendengine benchmark
+*/
+class TestBlendEngine: public QObject
+{
+		Q_OBJECT
+	private:
+		BlendEngine::Path mBest;
+
+	private:
+		// Switch to path, or skip when the CPU lacks it
+		static bool usePath(BlendEngine::Path path);
+		static void addPaths();
+
+	private slots:
+		void initTestCase();
+		void cleanup();
+
+		void sourceOver_data();
+		void sourceOver();
+		void kernels_data();
+		void kernels();
+		void paddingIsOpaque();
+		void placement();
+		void clip();
+		void canBlend_data();
+		void canBlend();
+
+		void benchmark_data();
+		void benchmark();
+};
+
+
+// Every alpha from transparent to opaque across a row, premultiplied, with colour changing down the rows
+static QImage alphaRamp(const QSize &size)
+{
+	QImage image(size, QImage::Format_ARGB32_Premultiplied);
+	for(int y=0; y<image.height(); ++y) {
+		quint32 *row=reinterpret_cast<quint32 *>(image.scanLine(y));
+		for(int x=0; x<image.width(); ++x) {
+			const quint32 a=(image.width()>1)?quint32(x*255/(image.width()-1)):255;
+			const quint32 r=quint32(y*37)&0xff, g=quint32(x*11+y)&0xff, b=quint32(255-y*5)&0xff;
+			row[x]=(a<<24)|((r*a/255)<<16)|((g*a/255)<<8)|(b*a/255);
+		}
+	}
+	return image;
+}
+
+
+// Opaque, each pixel different from its neighbours
+static QImage background(const QSize &size)
+{
+	QImage image(size, QImage::Format_ARGB32_Premultiplied);
+	for(int y=0; y<image.height(); ++y) {
+		quint32 *row=reinterpret_cast<quint32 *>(image.scanLine(y));
+		for(int x=0; x<image.width(); ++x) {
+			row[x]=0xff000000|(quint32(x*7)&0xff)<<16|(quint32(y*13)&0xff)<<8|(quint32(x^y)&0xff);
+		}
+	}
+	return image;
+}
+
+
+bool TestBlendEngine::usePath(BlendEngine::Path path)
+{
+	BlendEngine::setPath(path);
+	return BlendEngine::path()==path;
+}
+
+
+void TestBlendEngine::addPaths()
+{
+	QTest::addColumn<BlendEngine::Path>("path");
+	QTest::newRow("scalar")<<BlendEngine::Scalar;
+	QTest::newRow("sse2")<<BlendEngine::SSE2;
+	QTest::newRow("avx2")<<BlendEngine::AVX2;
+}
+
+
+void TestBlendEngine::initTestCase()
+{
+	mBest=BlendEngine::path();
+}
+
+
+void TestBlendEngine::cleanup()
+{
+	BlendEngine::setPath(mBest);
+}
+
+
+void TestBlendEngine::sourceOver_data()
+{
+	QTest::addColumn<quint32>("dst");
+	QTest::addColumn<quint32>("src");
+	QTest::addColumn<quint32>("alpha");
+	QTest::addColumn<quint32>("expected");
+	QTest::newRow("opaque")<<0xff123456u<<0xff654321u<<255u<<0xff654321u;
+	QTest::newRow("transparent")<<0xff123456u<<0x00000000u<<255u<<0xff123456u;
+	QTest::newRow("invisible")<<0xff123456u<<0xff654321u<<0u<<0xff123456u;
+	QTest::newRow("half alpha")<<0xff0000ffu<<0x80400000u<<255u<<0xff40007fu;
+	QTest::newRow("half opacity")<<0xff000000u<<0xffffffffu<<128u<<0xff808080u;
+	QTest::newRow("both")<<0xffffffffu<<0x40201008u<<200u<<0xffe6dad3u;
+}
+
+
+void TestBlendEngine::sourceOver()
+{
+	QFETCH(quint32, dst);
+	QFETCH(quint32, src);
+	QFETCH(quint32, alpha);
+	QFETCH(quint32, expected);
+	// Long enough for the vector loops and a tail
+	const int count=19;
+	for(int p=BlendEngine::Scalar; p<=mBest; ++p) {
+		BlendEngine::setPath(static_cast<BlendEngine::Path>(p));
+		QVector<quint32> out(count, dst);
+		const QVector<quint32> in(count, src);
+		BlendEngine::blendRow(out.data(), in.constData(), count, alpha);
+		for(int i=0; i<count; ++i) {
+			QVERIFY2(expected==out[i], qPrintable(QString("%1 pixel %2 is %3").arg(BlendEngine::pathName()).arg(i).arg(out[i], 8, 16, QChar('0'))));
+		}
+	}
+}
+
+
+void TestBlendEngine::kernels_data()
+{
+	addPaths();
+}
+
+
+void TestBlendEngine::kernels()
+{
+	QFETCH(BlendEngine::Path, path);
+	if(!usePath(path)) {
+		QSKIP("Not supported by this CPU");
+	}
+	const QImage src=alphaRamp(QSize(256, 4));
+	const QImage dst=background(src.size());
+	// Every count up to a few vectors long, so each kernel's tail handling is hit
+	for(int count=1; count<=67; ++count) {
+		for(quint32 alpha:{1u, 77u, 128u, 254u, 255u}) {
+			for(int y=0; y<src.height(); ++y) {
+				const quint32 *s=reinterpret_cast<const quint32 *>(src.constScanLine(y))+256-count;
+				QVector<quint32> expected(count);
+				QVector<quint32> out(count);
+				memcpy(expected.data(), dst.constScanLine(y), count*4);
+				memcpy(out.data(), dst.constScanLine(y), count*4);
+				BlendEngine::blendRowScalar(expected.data(), s, count, alpha);
+				BlendEngine::blendRow(out.data(), s, count, alpha);
+				QVERIFY2(expected==out, qPrintable(QString("count %1 alpha %2 row %3").arg(count).arg(alpha).arg(y)));
+			}
+		}
+	}
+}
+
+
+void TestBlendEngine::paddingIsOpaque()
+{
+	// Like the X11 grabbers leave it, padding byte 0
+	QImage screen(33, 9, QImage::Format_RGB32);
+	QImage expected(screen.size(), QImage::Format_ARGB32_Premultiplied);
+	for(int y=0; y<screen.height(); ++y) {
+		quint32 *row=reinterpret_cast<quint32 *>(screen.scanLine(y));
+		quint32 *out=reinterpret_cast<quint32 *>(expected.scanLine(y));
+		for(int x=0; x<screen.width(); ++x) {
+			row[x]=quint32(x*0x030507+y*0x110000)&0x00ffffff;
+			out[x]=row[x]|0xff000000;
+		}
+	}
+	for(int p=BlendEngine::Scalar; p<=mBest; ++p) {
+		BlendEngine::setPath(static_cast<BlendEngine::Path>(p));
+		QImage dst=background(screen.size());
+		QVERIFY(BlendEngine::blend(dst, screen, QTransform(), 1.0));
+		QCOMPARE(dst, expected);
+	}
+}
+
+
+void TestBlendEngine::placement()
+{
+	// Each source pixel its own opaque colour, doubled and moved to 5,3
+	QImage src(3, 2, QImage::Format_ARGB32_Premultiplied);
+	for(int y=0; y<src.height(); ++y) {
+		for(int x=0; x<src.width(); ++x) {
+			reinterpret_cast<quint32 *>(src.scanLine(y))[x]=0xff000000|quint32(y*3+x+1)*0x102030;
+		}
+	}
+	const QImage before=background(QSize(16, 10));
+	QImage dst=before.copy();
+	QVERIFY(BlendEngine::blend(dst, src, QTransform::fromScale(2.0, 2.0)*QTransform::fromTranslate(5, 3), 1.0));
+	for(int y=0; y<dst.height(); ++y) {
+		for(int x=0; x<dst.width(); ++x) {
+			const bool inside=(x>=5 && x<11 && y>=3 && y<7);
+			const quint32 expected=inside?src.pixel((x-5)/2, (y-3)/2):before.pixel(x, y);
+			QVERIFY2(expected==dst.pixel(x, y), qPrintable(QString("pixel %1,%2").arg(x).arg(y)));
+		}
+	}
+}
+
+
+void TestBlendEngine::clip()
+{
+	const QImage src=alphaRamp(QSize(23, 13));
+	const QImage before=background(QSize(40, 30));
+	const QRect clip(10, 5, 9, 20);
+	QImage unclipped=before.copy();
+	QVERIFY(BlendEngine::blend(unclipped, src, QTransform::fromTranslate(5, 3), 0.9));
+	QImage clipped=before.copy();
+	QVERIFY(BlendEngine::blend(clipped, src, QTransform::fromTranslate(5, 3), 0.9, clip));
+	// Inside the clip as if there was none, outside as if nothing was drawn
+	for(int y=0; y<before.height(); ++y) {
+		for(int x=0; x<before.width(); ++x) {
+			const QImage &expected=clip.contains(x, y)?unclipped:before;
+			QVERIFY2(expected.pixel(x, y)==clipped.pixel(x, y), qPrintable(QString("pixel %1,%2").arg(x).arg(y)));
+		}
+	}
+}
+
+
+void TestBlendEngine::canBlend_data()
+{
+	QTest::addColumn<int>("dstFormat");
+	QTest::addColumn<int>("srcFormat");
+	QTest::addColumn<QTransform>("transform");
+	QTest::addColumn<bool>("expected");
+	const int premultiplied=QImage::Format_ARGB32_Premultiplied;
+	QTransform rotated;
+	rotated.rotate(30);
+	QTest::newRow("translated")<<premultiplied<<premultiplied<<QTransform::fromTranslate(-3.5, 7)<<true;
+	QTest::newRow("scaled")<<premultiplied<<premultiplied<<QTransform::fromScale(0.4, 0.4)<<true;
+	QTest::newRow("rgb32 source")<<premultiplied<<int(QImage::Format_RGB32)<<QTransform()<<true;
+	QTest::newRow("straight alpha source")<<premultiplied<<int(QImage::Format_ARGB32)<<QTransform()<<false;
+	QTest::newRow("rgb32 target")<<int(QImage::Format_RGB32)<<premultiplied<<QTransform()<<false;
+	QTest::newRow("mirrored")<<premultiplied<<premultiplied<<QTransform::fromScale(-1.0, 1.0)<<false;
+	QTest::newRow("rotated")<<premultiplied<<premultiplied<<rotated<<false;
+}
+
+
+void TestBlendEngine::canBlend()
+{
+	QFETCH(int, dstFormat);
+	QFETCH(int, srcFormat);
+	QFETCH(QTransform, transform);
+	QFETCH(bool, expected);
+	QImage dst(8, 8, static_cast<QImage::Format>(dstFormat));
+	const QImage src(4, 4, static_cast<QImage::Format>(srcFormat));
+	QCOMPARE(BlendEngine::canBlend(dst, src, transform), expected);
+	if(!expected) {
+		// Left for QPainter, untouched
+		dst.fill(0xff102030);
+		const QImage before=dst.copy();
+		QVERIFY(!BlendEngine::blend(dst, src, transform, 1.0));
+		QCOMPARE(dst, before);
+	}
+}
+
+
+void TestBlendEngine::benchmark_data()
+{
+	QTest::addColumn<QString>("layer");
+	QTest::addColumn<int>("path");
+	const QStringList layers=QStringList()<<"screen"<<"logo"<<"fade"<<"pip";
+	// -1 is QPainter
+	const QStringList paths=QStringList()<<"qpainter"<<"scalar"<<"sse2"<<"avx2";
+	for(const QString &layer:layers) {
+		for(int p=-1; p<=BlendEngine::AVX2; ++p) {
+			QTest::newRow(qPrintable(layer+" "+paths[p+1]))<<layer<<p;
+		}
+	}
+}
+
+
+void TestBlendEngine::benchmark()
+{
+	QFETCH(QString, layer);
+	QFETCH(int, path);
+	if(path>=0 && !usePath(static_cast<BlendEngine::Path>(path))) {
+		QSKIP("Not supported by this CPU");
+	}
+	// The layers of a 1080p live view
+	const QSize size(1920, 1080);
+	QImage src;
+	QTransform transform=QTransform::fromTranslate(240, 135);
+	qreal opacity=1.0;
+	if("screen"==layer) {
+		src=background(size).convertToFormat(QImage::Format_RGB32);
+		transform=QTransform();
+	} else if("pip"==layer) {
+		src=background(QSize(256, 144));
+		transform=QTransform::fromScale(2.0, 2.0)*transform;
+		opacity=0.8;
+	} else {
+		src=alphaRamp(QSize(480, 270));
+		opacity=("fade"==layer)?0.5:1.0;
+	}
+	QImage dst=background(size);
+	if(path<0) {
+		QBENCHMARK {
+			QPainter painter(&dst);
+			painter.setTransform(transform);
+			painter.setOpacity(opacity);
+			painter.drawImage(QPointF(0, 0), src);
+		}
+	} else {
+		QBENCHMARK {
+			BlendEngine::blend(dst, src, transform, opacity);
+		}
+	}
+}
+
+
+QTEST_MAIN(TestBlendEngine)
+
+#include "tst_blendengine.moc"
@@ -0,0 +1,12 @@
+TARGET = tst_cameramailbox
+
+include(../tests.pri)
+
+HEADERS += \
+	../../ministudio/CameraMailbox.hpp \
+
+
+SOURCES += \
+	../../ministudio/CameraMailbox.cpp \
+	tst_cameramailbox.cpp \
+
@@ -0,0 +1,154 @@
+#include "CameraMailbox.hpp"
+
+#include <QtTest>
+#include <QThread>
+
+/*
+  CameraMailbox hands over the newest frame without copying it, lets go of
+  frames it no longer needs, and never tears a frame when hammered from a
+  second thread.
+*/
+class TestCameraMailbox: public QObject
+{
+		Q_OBJECT
+	private slots:
+		void empty();
+		void latestWins();
+		void zeroCopy();
+		void releasesStale();
+		void handoff();
+};
+
+
+// A 1x1 frame whose pixel is n
+static QSharedPointer<QImage> frame(quint64 n)
+{
+	QSharedPointer<QImage> image(new QImage(1, 1, QImage::Format_ARGB32_Premultiplied));
+	*reinterpret_cast<quint32 *>(image->bits())=quint32(n);
+	return image;
+}
+
+
+// Publishes frames as fast as it can, everything in frame n set from n so a torn handoff shows
+class MailboxProducer: public QThread
+{
+	private:
+		CameraMailbox *mMailbox;
+		quint64 mFrames;
+
+	public:
+		explicit MailboxProducer(CameraMailbox *mailbox, quint64 frames)
+			: mMailbox(mailbox)
+			, mFrames(frames)
+		{
+
+		}
+
+		void run() override
+		{
+			for(quint64 n=1; n<=mFrames; ++n) {
+				mMailbox->publish(frame(n), qint64(n)*10, qreal(n));
+			}
+		}
+};
+
+
+void TestCameraMailbox::empty()
+{
+	CameraMailbox mailbox;
+	const CameraMailbox::Frame taken=mailbox.take();
+	QCOMPARE(taken.sequence, quint64(0));
+	QVERIFY(taken.image.isNull());
+	QCOMPARE(mailbox.published(), quint64(0));
+	QCOMPARE(mailbox.taken(), quint64(0));
+}
+
+
+void TestCameraMailbox::latestWins()
+{
+	CameraMailbox mailbox;
+	for(quint64 n=1; n<=3; ++n) {
+		mailbox.publish(frame(n), qint64(n)*10, 0.5);
+	}
+	CameraMailbox::Frame taken=mailbox.take();
+	QCOMPARE(taken.sequence, quint64(3));
+	QCOMPARE(taken.captured, qint64(30));
+	QCOMPARE(taken.scale, 0.5);
+	QCOMPARE(mailbox.overwritten(), quint64(2));
+	// Nothing new, so the same frame again without counting it twice
+	taken=mailbox.take();
+	QCOMPARE(taken.sequence, quint64(3));
+	QCOMPARE(mailbox.taken(), quint64(1));
+	QCOMPARE(mailbox.published(), quint64(3));
+}
+
+
+void TestCameraMailbox::zeroCopy()
+{
+	CameraMailbox mailbox;
+	const QSharedPointer<QImage> image=frame(1);
+	const uchar *pixels=image->constBits();
+	mailbox.publish(image, 10);
+	const CameraMailbox::Frame taken=mailbox.take();
+	QCOMPARE(taken.image.data(), image.data());
+	QCOMPARE(taken.image->constBits(), pixels);
+}
+
+
+void TestCameraMailbox::releasesStale()
+{
+	CameraMailbox mailbox;
+	QWeakPointer<QImage> first;
+	{
+		const QSharedPointer<QImage> image=frame(1);
+		first=image;
+		mailbox.publish(image, 10);
+	}
+	QCOMPARE(mailbox.take().sequence, quint64(1));
+	mailbox.publish(frame(2), 20);
+	QCOMPARE(mailbox.take().sequence, quint64(2));
+	// The consumer moved on from frame 1, so its slot is the next the producer reuses
+	QVERIFY(!first.toStrongRef().isNull());
+	mailbox.publish(frame(3), 30);
+	QVERIFY(first.toStrongRef().isNull());
+}
+
+
+void TestCameraMailbox::handoff()
+{
+	const quint64 frames=200000;
+	CameraMailbox mailbox;
+	MailboxProducer producer(&mailbox, frames);
+	producer.start();
+	quint64 last=0;
+	quint64 distinct=0;
+	bool finished=false;
+	while(!finished) {
+		// Checked after taking, so the last take sees the last frame
+		finished=producer.isFinished();
+		const CameraMailbox::Frame taken=mailbox.take();
+		if(taken.sequence<last) {
+			producer.wait();
+			QFAIL(qPrintable(QString("frame %1 taken after frame %2").arg(taken.sequence).arg(last)));
+		}
+		if(taken.sequence!=last) {
+			const quint32 pixel=*reinterpret_cast<const quint32 *>(taken.image->constBits());
+			if(taken.captured!=qint64(taken.sequence)*10 || taken.scale!=qreal(taken.sequence) || pixel!=quint32(taken.sequence)) {
+				producer.wait();
+				QFAIL(qPrintable(QString("frame %1 came with the parts of another").arg(taken.sequence)));
+			}
+			distinct++;
+		}
+		last=taken.sequence;
+	}
+	producer.wait();
+	QCOMPARE(last, frames);
+	QCOMPARE(mailbox.published(), frames);
+	QVERIFY2(mailbox.taken()+mailbox.overwritten()==frames, qPrintable(mailbox.stats()));
+	QCOMPARE(mailbox.taken(), distinct);
+}
+
+
+QTEST_MAIN(TestCameraMailbox)
+
+#include "tst_cameramailbox.moc"
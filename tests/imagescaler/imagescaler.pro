@@ -0,0 +1,12 @@
+TARGET = tst_imagescaler
+
+include(../tests.pri)
+
+HEADERS += \
+	../../ministudio/ImageScaler.hpp \
+
+
+SOURCES += \
+	../../ministudio/ImageScaler.cpp \
+	tst_imagescaler.cpp \
+
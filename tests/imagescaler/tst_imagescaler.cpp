@@ -0,0 +1,220 @@
+#include "ImageScaler.hpp"
+
+#include <QtTest>
+
+#include <cstring>
+
+Q_DECLARE_METATYPE(ImageScaler::Path)
+
+/*
+  ImageScaler against known results, and every kernel the CPU has against
+  the scalar one. The benchmark scales a 1080p frame down to the sizes the
+  live view uses with QImage::scaled and with each kernel:
+
+	tst_imagescaler benchmark
+*/
+class TestImageScaler: public QObject
+{
+		Q_OBJECT
+	private:
+		ImageScaler::Path mBest;
+
+	private:
+		// Switch to path, or skip when the CPU lacks it
+		static bool usePath(ImageScaler::Path path);
+		static void addSizes();
+
+	private slots:
+		void initTestCase();
+		void cleanup();
+
+		void kernels_data();
+		void kernels();
+		void flatColour_data();
+		void flatColour();
+		void halving();
+		void rejects();
+
+		void benchmark_data();
+		void benchmark();
+};
+
+
+// Premultiplied noise in format, with every alpha unless opaque is set
+static QImage noise(const QSize &size, QImage::Format format, bool opaque)
+{
+	QImage image(size, format);
+	quint32 seed=quint32(size.width()*size.height());
+	for(int y=0; y<image.height(); ++y) {
+		quint32 *row=reinterpret_cast<quint32 *>(image.scanLine(y));
+		for(int x=0; x<image.width(); ++x) {
+			seed=seed*1664525+1013904223;
+			const quint32 a=opaque?255:(seed>>24);
+			row[x]=(a<<24)|((((seed>>16)&0xff)*a/255)<<16)|((((seed>>8)&0xff)*a/255)<<8)|((seed&0xff)*a/255);
+		}
+	}
+	return image;
+}
+
+
+bool TestImageScaler::usePath(ImageScaler::Path path)
+{
+	ImageScaler::setPath(path);
+	return ImageScaler::path()==path;
+}
+
+
+void TestImageScaler::addSizes()
+{
+	QTest::addColumn<QSize>("from");
+	QTest::addColumn<QSize>("to");
+	// Halving and bilinear, halving only, bilinear only, no scaling, and odd sizes all round
+	QTest::newRow("640x480 to 256x192")<<QSize(640, 480)<<QSize(256, 192);
+	QTest::newRow("100x50 to 50x25")<<QSize(100, 50)<<QSize(50, 25);
+	QTest::newRow("64x64 to 63x63")<<QSize(64, 64)<<QSize(63, 63);
+	QTest::newRow("40x30 to 40x30")<<QSize(40, 30)<<QSize(40, 30);
+	QTest::newRow("333x177 to 41x29")<<QSize(333, 177)<<QSize(41, 29);
+	QTest::newRow("7x5 to 3x2")<<QSize(7, 5)<<QSize(3, 2);
+}
+
+
+void TestImageScaler::initTestCase()
+{
+	mBest=ImageScaler::path();
+}
+
+
+void TestImageScaler::cleanup()
+{
+	ImageScaler::setPath(mBest);
+}
+
+
+void TestImageScaler::kernels_data()
+{
+	addSizes();
+}
+
+
+void TestImageScaler::kernels()
+{
+	QFETCH(QSize, from);
+	QFETCH(QSize, to);
+	const ImageScaler::Path paths[]={ImageScaler::SSE2, ImageScaler::AVX2};
+	const QImage sources[]={
+		noise(from, QImage::Format_ARGB32_Premultiplied, false)
+		, noise(from, QImage::Format_RGB32, true)
+	};
+	for(const QImage &src:sources) {
+		QImage reference(to, src.format());
+		ImageScaler::setPath(ImageScaler::Scalar);
+		QVERIFY(ImageScaler().scale(src, reference));
+		for(ImageScaler::Path path:paths) {
+			if(!usePath(path)) {
+				continue;
+			}
+			QImage out(to, src.format());
+			QVERIFY(ImageScaler().scale(src, out));
+			QVERIFY2(out==reference, qPrintable(ImageScaler::pathName()+" differs from scalar"));
+		}
+	}
+}
+
+
+void TestImageScaler::flatColour_data()
+{
+	addSizes();
+}
+
+
+void TestImageScaler::flatColour()
+{
+	QFETCH(QSize, from);
+	QFETCH(QSize, to);
+	// Averaging a colour with itself must not drift, however often and whatever the weights
+	QImage flat(from, QImage::Format_ARGB32_Premultiplied);
+	flat.fill(0x80402010);
+	QImage scaled(to, flat.format());
+	QVERIFY(ImageScaler().scale(flat, scaled));
+	QImage expected(to, flat.format());
+	expected.fill(0x80402010);
+	QCOMPARE(scaled, expected);
+}
+
+
+void TestImageScaler::halving()
+{
+	QImage src(4, 2, QImage::Format_ARGB32_Premultiplied);
+	const quint32 top[]={0x00000000, 0x01010101, 0xffff0000, 0xff00ff00};
+	const quint32 bottom[]={0x02020202, 0x03030303, 0xff0000ff, 0xffffffff};
+	memcpy(src.scanLine(0), top, sizeof(top));
+	memcpy(src.scanLine(1), bottom, sizeof(bottom));
+	QImage dst(2, 1, src.format());
+	// One instance scales frame after frame, so scale twice to check nothing left from the first call leaks into the second
+	ImageScaler scaler;
+	for(int i=0; i<2; ++i) {
+		QVERIFY(scaler.scale(src, dst));
+		// An average of 1.5 rounds up, as pavgb does
+		const quint32 *row=reinterpret_cast<const quint32 *>(dst.constScanLine(0));
+		QCOMPARE(row[0], 0x02020202u);
+		QCOMPARE(row[1], 0xff808080u);
+	}
+}
+
+
+void TestImageScaler::rejects()
+{
+	ImageScaler scaler;
+	const QImage src=noise(QSize(32, 32), QImage::Format_ARGB32_Premultiplied, false);
+	QImage larger(64, 64, src.format());
+	QVERIFY(!scaler.scale(src, larger));
+	QImage rgb(16, 16, QImage::Format_RGB32);
+	QVERIFY(!scaler.scale(src, rgb));
+	QImage rgb16(16, 16, QImage::Format_RGB16);
+	QVERIFY(!scaler.scale(src.convertToFormat(QImage::Format_RGB16), rgb16));
+	QImage null;
+	QVERIFY(!scaler.scale(src, null));
+}
+
+
+void TestImageScaler::benchmark_data()
+{
+	QTest::addColumn<QSize>("to");
+	QTest::addColumn<int>("path");
+	// Halving once and twice, and halving then bilinear as for a picture in picture
+	const QSize sizes[]={QSize(960, 540), QSize(480, 270), QSize(400, 225)};
+	// -1 is QImage::scaled
+	const QStringList paths=QStringList()<<"qimage"<<"scalar"<<"sse2"<<"avx2";
+	for(const QSize &size:sizes) {
+		for(int p=-1; p<=ImageScaler::AVX2; ++p) {
+			QTest::newRow(qPrintable(QString("%1x%2 %3").arg(size.width()).arg(size.height()).arg(paths[p+1])))<<size<<p;
+		}
+	}
+}
+
+
+void TestImageScaler::benchmark()
+{
+	QFETCH(QSize, to);
+	QFETCH(int, path);
+	if(path>=0 && !usePath(static_cast<ImageScaler::Path>(path))) {
+		QSKIP("Not supported by this CPU");
+	}
+	const QImage src=noise(QSize(1920, 1080), QImage::Format_RGB32, true);
+	QImage dst(to, src.format());
+	if(path<0) {
+		QBENCHMARK {
+			dst=src.scaled(to, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+		}
+	} else {
+		ImageScaler scaler;
+		QBENCHMARK {
+			scaler.scale(src, dst);
+		}
+	}
+}
+
+
+QTEST_MAIN(TestImageScaler)
+
+#include "tst_imagescaler.moc"
@@ -0,0 +1,24 @@
+TARGET = tst_prerollring
+
+include(../tests.pri)
+
+HEADERS += \
+	../../ministudio/FormatNegotiator.hpp \
+	../../ministudio/FrameClock.hpp \
+	../../ministudio/FrameSink.hpp \
+	../../ministudio/FrameWriter.hpp \
+	../../ministudio/LatencyMeter.hpp \
+	../../ministudio/PrerollRing.hpp \
+	../../ministudio/QoiCodec.hpp \
+
+
+SOURCES += \
+	../../ministudio/FormatNegotiator.cpp \
+	../../ministudio/FrameClock.cpp \
+	../../ministudio/FrameSink.cpp \
+	../../ministudio/FrameWriter.cpp \
+	../../ministudio/LatencyMeter.cpp \
+	../../ministudio/PrerollRing.cpp \
+	../../ministudio/QoiCodec.cpp \
+	tst_prerollring.cpp \
+
@@ -0,0 +1,215 @@
+#include "PrerollRing.hpp"
+#include "FrameWriter.hpp"
+#include "FrameSink.hpp"
+#include "FormatNegotiator.hpp"
+
+#include <QtTest>
+#include <QDir>
+
+/*
+  PrerollRing keeps the right frames by age and by memory, and drains them
+  into a FrameWriter ahead of the live frames that arrive meanwhile.
+*/
+class TestPrerollRing: public QObject
+{
+		Q_OBJECT
+	private slots:
+		void empty();
+		void keepsSeconds();
+		void keepsMemory();
+		void dropsOversized();
+		void drainsAheadOfLive();
+};
+
+
+// Keeps the frames it is given, to check what a FrameWriter wrote
+class MemorySink: public FrameSink
+{
+	private:
+		bool mOpen;
+
+	public:
+		QList<FrameSink::Frame> frames;
+
+	public:
+		explicit MemorySink()
+			: mOpen(false)
+		{
+
+		}
+
+		bool open(const QString &, const QSize &, qreal) override
+		{
+			mOpen=true;
+			return true;
+		}
+
+		bool write(const Frame &frame) override
+		{
+			frames<<frame;
+			mWritten.fetchAndAddRelaxed(1);
+			return true;
+		}
+
+		void close() override
+		{
+			mOpen=false;
+		}
+
+		bool isOpen() override
+		{
+			return mOpen;
+		}
+
+		QString name() override
+		{
+			return "memory";
+		}
+
+		QVector<QImage::Format> formats() override
+		{
+			return QVector<QImage::Format>()<<QImage::Format_ARGB32_Premultiplied;
+		}
+
+		bool ordered() override
+		{
+			return true;
+		}
+};
+
+
+// Frames 10 ms apart
+static qint64 frameTime(quint64 id)
+{
+	return 1000000000LL+qint64(id)*10000000LL;
+}
+
+
+// Noise seeded by id, so a frame written in place of another shows. It hardly compresses, so large frames fill the ring fast
+static QSharedPointer<QImage> frame(quint64 id, const QSize &size)
+{
+	QSharedPointer<QImage> image(new QImage(size, QImage::Format_ARGB32_Premultiplied));
+	quint32 seed=quint32(id);
+	for(int y=0; y<size.height(); ++y) {
+		quint32 *row=reinterpret_cast<quint32 *>(image->scanLine(y));
+		for(int x=0; x<size.width(); ++x) {
+			seed=seed*1664525+1013904223;
+			row[x]=0xff000000|(seed>>8);
+		}
+	}
+	return image;
+}
+
+
+// Push a frame and wait for the ring to store it, as the ring drops frames rather than wait for compression to catch up
+static bool pushStored(PrerollRing &ring, quint64 id, const QSize &size)
+{
+	ring.push(id, frame(id, size), frameTime(id));
+	QElapsedTimer timer;
+	timer.start();
+	while(ring.pending()>0) {
+		if(timer.elapsed()>5000) {
+			return false;
+		}
+		QThread::msleep(1);
+	}
+	return true;
+}
+
+
+void TestPrerollRing::empty()
+{
+	PrerollRing ring(1.0, 2*1024*1024);
+	QCOMPARE(ring.frames(), 0);
+	QCOMPARE(ring.bytes(), qint64(0));
+	QCOMPARE(ring.span(), qint64(0));
+	QCOMPARE(ring.oldest(), qint64(-1));
+	QCOMPARE(ring.capacity(), qint64(2*1024*1024));
+}
+
+
+void TestPrerollRing::keepsSeconds()
+{
+	PrerollRing ring(0.5, 1024*1024);
+	for(quint64 id=1; id<=100; ++id) {
+		QVERIFY(pushStored(ring, id, QSize(32, 24)));
+	}
+	// Frame 50 is exactly half a second older than frame 100, so it stays and the ones before it go
+	QCOMPARE(ring.frames(), 51);
+	QCOMPARE(ring.span(), qint64(500));
+	QCOMPARE(ring.oldest(), frameTime(50));
+}
+
+
+void TestPrerollRing::keepsMemory()
+{
+	// All of them fit in ten seconds, only about a dozen in a megabyte
+	PrerollRing ring(10.0, 1024*1024);
+	const int pushed=40;
+	for(quint64 id=1; id<=quint64(pushed); ++id) {
+		QVERIFY(pushStored(ring, id, QSize(128, 128)));
+		QVERIFY(ring.bytes()<=ring.capacity());
+	}
+	QCOMPARE(ring.capacity(), qint64(1024*1024));
+	const int kept=ring.frames();
+	QVERIFY(kept>0 && kept<pushed);
+	// The newest that fit, none missing between them
+	QCOMPARE(ring.oldest(), frameTime(quint64(pushed-kept+1)));
+	QCOMPARE(ring.span(), qint64(kept-1)*10);
+}
+
+
+void TestPrerollRing::dropsOversized()
+{
+	PrerollRing ring(10.0, 1024*1024);
+	for(quint64 id=1; id<=3; ++id) {
+		QVERIFY(pushStored(ring, id, QSize(32, 24)));
+	}
+	// Two megabytes of noise after compression, which can't fit however much is evicted
+	QVERIFY(pushStored(ring, 4, QSize(1024, 512)));
+	QCOMPARE(ring.frames(), 3);
+	QCOMPARE(ring.oldest(), frameTime(1));
+}
+
+
+void TestPrerollRing::drainsAheadOfLive()
+{
+	const QSize size(32, 24);
+	PrerollRing ring(0.5, 1024*1024);
+	for(quint64 id=1; id<=100; ++id) {
+		QVERIFY(pushStored(ring, id, size));
+	}
+	MemorySink *sink=new MemorySink();
+	FormatNegotiator::globalInstance()->declare(FormatNegotiator::RecorderStage, sink->formats());
+	FrameWriter *writer=new FrameWriter(sink, QDir::tempPath(), size, 100.0, 1, 16);
+	ring.startDrain(writer);
+	// Like LiveThread: live frames go to the ring until it has caught up, then straight to the writer
+	for(quint64 id=101; id<=110; ++id) {
+		if(ring.push(id, frame(id, size), frameTime(id))) {
+			QTRY_COMPARE(ring.pending(), 0);
+		} else {
+			// LiveThread would drop the frame on a full queue, here only the order matters
+			QVERIFY(writer->submitWait(id, frame(id, size), frameTime(id)));
+		}
+	}
+	QTRY_COMPARE(ring.frames(), 0);
+	ring.stopDrain();
+	writer->finish();
+	QCOMPARE(sink->frames.size(), 61);
+	for(int i=0; i<sink->frames.size(); ++i) {
+		const FrameSink::Frame &written=sink->frames[i];
+		const quint64 id=50+quint64(i);
+		QCOMPARE(written.id, id);
+		QCOMPARE(written.timestamp, frameTime(id));
+		QCOMPARE(written.image, *frame(id, size));
+	}
+	delete writer;
+	// Back to keeping a preroll for the next recording
+	QVERIFY(ring.push(111, frame(111, size), frameTime(111)));
+	QTRY_COMPARE(ring.frames(), 1);
+}
+
+
+QTEST_MAIN(TestPrerollRing)
+
+#include "tst_prerollring.moc"
@@ -0,0 +1,16 @@
+TARGET = tst_qoicodec
+
+include(../tests.pri)
+
+HEADERS += \
+	../../ministudio/FrameSink.hpp \
+	../../ministudio/PngSink.hpp \
+	../../ministudio/QoiCodec.hpp \
+
+
+SOURCES += \
+	../../ministudio/FrameSink.cpp \
+	../../ministudio/PngSink.cpp \
+	../../ministudio/QoiCodec.cpp \
+	tst_qoicodec.cpp \
+
@@ -0,0 +1,217 @@
+#include "QoiCodec.hpp"
+#include "PngSink.hpp"
+
+#include <QtTest>
+
+#include <cstring>
+
+/*
+  QoiCodec round trips, its output format and what it does with damaged
+  input. The benchmark encodes a desktop sized frame with PNG, the way
+  PngSink does, and with each QOI level:
+
+	tst_qoicodec benchmark
+*/
+class TestQoiCodec: public QObject
+{
+		Q_OBJECT
+	private slots:
+		void roundTrip_data();
+		void roundTrip();
+		void header();
+		void levels();
+		void damaged_data();
+		void damaged();
+
+		void benchmark_data();
+		void benchmark();
+};
+
+
+// A window with a title bar and lines of text on a coloured desktop
+static QImage desktop(const QSize &size)
+{
+	const int w=size.width(), h=size.height();
+	const QRect window(w/10, h/10, w*6/10, h*7/10);
+	QImage image(size, QImage::Format_ARGB32_Premultiplied);
+	for(int y=0; y<h; ++y) {
+		quint32 *row=reinterpret_cast<quint32 *>(image.scanLine(y));
+		for(int x=0; x<w; ++x) {
+			quint32 c=0xff3070c0;
+			if(window.contains(x, y)) {
+				c=(y<window.top()+30)?0xff202020:0xffffffff;
+				const int line=(y-window.top()-40)/20;
+				if(y>=window.top()+40 && (y-window.top()-40)%20<12 && x>=window.left()+20 && x<window.right()-20 && (x*7+line*13)%23<9) {
+					c=0xff000000;
+				}
+			}
+			row[x]=c;
+		}
+	}
+	return image;
+}
+
+
+// Premultiplied noise, opaque or with every alpha
+static QImage noise(const QSize &size, bool opaque)
+{
+	QImage image(size, QImage::Format_ARGB32_Premultiplied);
+	quint32 seed=quint32(size.width()*size.height());
+	for(int y=0; y<image.height(); ++y) {
+		quint32 *row=reinterpret_cast<quint32 *>(image.scanLine(y));
+		for(int x=0; x<image.width(); ++x) {
+			seed=seed*1664525+1013904223;
+			const quint32 a=opaque?255:(seed>>24);
+			row[x]=(a<<24)|((((seed>>16)&0xff)*a/255)<<16)|((((seed>>8)&0xff)*a/255)<<8)|((seed&0xff)*a/255);
+		}
+	}
+	return image;
+}
+
+
+// Small steps between neighbours, which QOI codes as differences
+static QImage gradient(const QSize &size)
+{
+	QImage image(size, QImage::Format_ARGB32_Premultiplied);
+	for(int y=0; y<image.height(); ++y) {
+		quint32 *row=reinterpret_cast<quint32 *>(image.scanLine(y));
+		for(int x=0; x<image.width(); ++x) {
+			row[x]=0xff000000|(quint32(x)&0xff)<<16|(quint32(y*2)&0xff)<<8|(quint32(x+y)&0xff);
+		}
+	}
+	return image;
+}
+
+
+void TestQoiCodec::roundTrip_data()
+{
+	QTest::addColumn<QImage>("image");
+	QTest::addColumn<int>("level");
+	// Sizes with no row a multiple of anything, and a single pixel
+	const QSize sizes[]={QSize(1, 1), QSize(37, 19), QSize(321, 203)};
+	for(const QSize &size:sizes) {
+		const QString name=QString("%1x%2").arg(size.width()).arg(size.height());
+		for(int level=0; level<=QoiCodec::MAX_LEVEL; ++level) {
+			const QString suffix=QString(" %1 level %2").arg(name).arg(level);
+			QTest::newRow(qPrintable("desktop"+suffix))<<desktop(size)<<level;
+			QTest::newRow(qPrintable("noise"+suffix))<<noise(size, true)<<level;
+			QTest::newRow(qPrintable("alpha"+suffix))<<noise(size, false)<<level;
+			QTest::newRow(qPrintable("gradient"+suffix))<<gradient(size)<<level;
+		}
+	}
+}
+
+
+void TestQoiCodec::roundTrip()
+{
+	QFETCH(QImage, image);
+	QFETCH(int, level);
+	const QByteArray data=QoiCodec::encode(image, level);
+	QVERIFY(!data.isEmpty());
+	QVERIFY(data.size()<=QoiCodec::maxSize(image.width(), image.height()));
+	QCOMPARE(QoiCodec::decode(data, image.format()), image);
+	// Into a buffer with a wider stride, as the decoder may be handed one
+	const int stride=image.width()*4+12;
+	QByteArray pixels(stride*image.height(), Qt::Uninitialized);
+	QVERIFY(QoiCodec::decode(reinterpret_cast<const uchar *>(data.constData()), data.size(), reinterpret_cast<uchar *>(pixels.data()), stride));
+	for(int y=0; y<image.height(); ++y) {
+		QVERIFY(0==memcmp(pixels.constData()+y*stride, image.constScanLine(y), image.width()*4));
+	}
+}
+
+
+void TestQoiCodec::header()
+{
+	const QImage image=gradient(QSize(300, 2));
+	for(int level=0; level<=QoiCodec::MAX_LEVEL; ++level) {
+		const QByteArray data=QoiCodec::encode(image, level);
+		QVERIFY(data.size()>22);
+		// Up to level 1 any QOI decoder reads it, so it must be QOI to the letter: big endian size, 4 channels, end marker
+		QCOMPARE(data.left(4), QByteArray((level<2)?"qoif":"msqf"));
+		QCOMPARE(data.mid(4, 8), QByteArray::fromHex("0000012c00000002"));
+		QCOMPARE(int(data[12]), 4);
+		QCOMPARE(data.right(8), QByteArray::fromHex("0000000000000001"));
+		int width=0;
+		int height=0;
+		QVERIFY(QoiCodec::readHeader(reinterpret_cast<const uchar *>(data.constData()), data.size(), width, height));
+		QCOMPARE(QSize(width, height), image.size());
+	}
+}
+
+
+void TestQoiCodec::levels()
+{
+	// Each level must pay for itself on what is recorded most
+	const QImage image=desktop(QSize(640, 360));
+	const int raw=image.width()*image.height()*4;
+	int last=raw;
+	for(int level=0; level<=QoiCodec::MAX_LEVEL; ++level) {
+		const int size=QoiCodec::encode(image, level).size();
+		QVERIFY2(size<last, qPrintable(QString("level %1 is %2 bytes, the level below %3").arg(level).arg(size).arg(last)));
+		last=size;
+	}
+	QVERIFY2(QoiCodec::encode(image, 1).size()<raw/8, "full QOI should take a desktop to under an eighth");
+}
+
+
+void TestQoiCodec::damaged_data()
+{
+	QTest::addColumn<QByteArray>("data");
+	const QByteArray good=QoiCodec::encode(noise(QSize(64, 48), false), 1);
+	QByteArray badMagic=good;
+	badMagic[0]='x';
+	QByteArray noChannels=good;
+	noChannels[12]=3;
+	QByteArray zeroWidth=good;
+	zeroWidth[4]=zeroWidth[5]=zeroWidth[6]=zeroWidth[7]=0;
+	QTest::newRow("empty")<<QByteArray();
+	QTest::newRow("header only")<<good.left(14);
+	QTest::newRow("truncated")<<good.left(good.size()/2);
+	QTest::newRow("bad magic")<<badMagic;
+	QTest::newRow("3 channels")<<noChannels;
+	QTest::newRow("zero width")<<zeroWidth;
+}
+
+
+void TestQoiCodec::damaged()
+{
+	QFETCH(QByteArray, data);
+	// Rejected, never read past the end or written past the image
+	QVERIFY(QoiCodec::decode(data).isNull());
+}
+
+
+void TestQoiCodec::benchmark_data()
+{
+	QTest::addColumn<int>("level");
+	// -1 is PNG
+	QTest::newRow("png")<<-1;
+	for(int level=0; level<=QoiCodec::MAX_LEVEL; ++level) {
+		QTest::newRow(qPrintable(QString("qoi %1").arg(level)))<<level;
+	}
+}
+
+
+void TestQoiCodec::benchmark()
+{
+	QFETCH(int, level);
+	const QImage image=desktop(QSize(1920, 1080));
+	QByteArray data;
+	if(level<0) {
+		// What the recorder hands PngSink for an opaque frame
+		const QImage opaque=image.convertToFormat(QImage::Format_RGB32);
+		QBENCHMARK {
+			data=PngSink::encodeImage(opaque);
+		}
+	} else {
+		QBENCHMARK {
+			data=QoiCodec::encode(image, level);
+		}
+	}
+	qDebug()<<QTest::currentDataTag()<<":"<<data.size()<<"bytes,"<<QString::number(100.0*data.size()/(image.width()*image.height()*4), 'f', 2)<<"% of raw";
+}
+
+
+QTEST_MAIN(TestQoiCodec)
+
+#include "tst_qoicodec.moc"
@@ -0,0 +1,9 @@
+# Shared by the tests. Each builds the component it tests straight from ../ministudio
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+QT += testlib
+
+include($$PWD/../common.pri)
+
+INCLUDEPATH += $$PWD/../ministudio
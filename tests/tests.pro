@@ -0,0 +1,17 @@
+TEMPLATE = subdirs
+TARGET = tests
+
+# One test per component, run with "make check"
+
+SUBDIRS += \
+	blendengine \
+	cameramailbox \
+	imagescaler \
+	prerollring \
+	qoicodec \
+	yuvconverter \
+
+# Captures with ALSA, like the recorder
+linux {
+	SUBDIRS += audiocapture
+}
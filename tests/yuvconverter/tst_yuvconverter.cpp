@@ -0,0 +1,320 @@
+#include "YuvConverter.hpp"
+
+#include <QtTest>
+
+#include <cstring>
+
+Q_DECLARE_METATYPE(YuvConverter::Layout)
+Q_DECLARE_METATYPE(YuvConverter::Matrix)
+Q_DECLARE_METATYPE(YuvConverter::Path)
+
+/*
+  YuvConverter against known colours in every layout, and every kernel the
+  CPU has against the scalar one. The benchmark converts a camera frame of
+  each layout with each kernel:
+
+	tst_yuvconverter benchmark
+*/
+class TestYuvConverter: public QObject
+{
+		Q_OBJECT
+	private:
+		YuvConverter::Path mBest;
+
+	private:
+		// Switch to path, or skip when the CPU lacks it
+		static bool usePath(YuvConverter::Path path);
+
+	private slots:
+		void initTestCase();
+		void cleanup();
+
+		void kernels_data();
+		void kernels();
+		void colours_data();
+		void colours();
+		void rejects();
+
+		void benchmark_data();
+		void benchmark();
+};
+
+
+// A frame of one layout laid out the way a camera maps it, each row padded by a few bytes
+class YuvFrame
+{
+	private:
+		YuvConverter::Layout mLayout;
+		QSize mSize;
+		int mOffsets[3];
+		int mStrides[3];
+		QByteArray mData;
+
+	public:
+		explicit YuvFrame(YuvConverter::Layout layout, const QSize &size, int padding=0)
+			: mLayout(layout)
+			, mSize(size)
+		{
+			const int cw=(size.width()+1)/2;
+			const int ch=(size.height()+1)/2;
+			mOffsets[0]=0;
+			mOffsets[1]=mOffsets[2]=0;
+			mStrides[1]=mStrides[2]=0;
+			if(1==YuvConverter::planeCount(layout)) {
+				mStrides[0]=cw*4+padding;
+			} else {
+				mStrides[0]=size.width()+padding;
+				mOffsets[1]=mStrides[0]*size.height();
+				if(2==YuvConverter::planeCount(layout)) {
+					mStrides[1]=cw*2+padding;
+				} else {
+					mStrides[1]=mStrides[2]=cw+padding;
+					mOffsets[2]=mOffsets[1]+mStrides[1]*ch;
+				}
+			}
+			const int last=YuvConverter::planeCount(layout)-1;
+			mData=QByteArray(mOffsets[last]+mStrides[last]*((0==last)?size.height():ch), '\0');
+		}
+
+		void planes(const uchar *planes[3], int strides[3]) const
+		{
+			for(int i=0; i<3; ++i) {
+				planes[i]=(i<YuvConverter::planeCount(mLayout))?reinterpret_cast<const uchar *>(mData.constData())+mOffsets[i]:nullptr;
+				strides[i]=mStrides[i];
+			}
+		}
+
+		// Every byte random, padding included
+		void fillNoise(quint32 seed)
+		{
+			for(int i=0; i<mData.size(); ++i) {
+				seed=seed*1664525+1013904223;
+				mData[i]=static_cast<char>(seed>>24);
+			}
+		}
+
+		// One colour, each byte where the layout puts it
+		void fill(uchar y, uchar u, uchar v)
+		{
+			uchar *base=reinterpret_cast<uchar *>(mData.data());
+			const int cw=(mSize.width()+1)/2;
+			const int ch=(mSize.height()+1)/2;
+			for(int row=0; row<mSize.height(); ++row) {
+				uchar *line=base+row*mStrides[0];
+				if(YuvConverter::YUYV==mLayout || YuvConverter::UYVY==mLayout) {
+					const bool yFirst=(YuvConverter::YUYV==mLayout);
+					for(int i=0; i<cw; ++i) {
+						line[i*4+0]=yFirst?y:u;
+						line[i*4+1]=yFirst?u:y;
+						line[i*4+2]=yFirst?y:v;
+						line[i*4+3]=yFirst?v:y;
+					}
+				} else {
+					memset(line, y, static_cast<size_t>(mSize.width()));
+				}
+			}
+			for(int row=0; row<ch; ++row) {
+				uchar *first=base+mOffsets[1]+row*mStrides[1];
+				switch(mLayout) {
+					case YuvConverter::NV12:
+					case YuvConverter::NV21:
+						for(int i=0; i<cw; ++i) {
+							first[i*2]=(YuvConverter::NV12==mLayout)?u:v;
+							first[i*2+1]=(YuvConverter::NV12==mLayout)?v:u;
+						}
+						break;
+					case YuvConverter::I420:
+					case YuvConverter::YV12:
+						memset(first, (YuvConverter::I420==mLayout)?u:v, static_cast<size_t>(cw));
+						memset(base+mOffsets[2]+row*mStrides[2], (YuvConverter::I420==mLayout)?v:u, static_cast<size_t>(cw));
+						break;
+					default:
+						break;
+				}
+			}
+		}
+};
+
+
+static const YuvConverter::Layout LAYOUTS[]={YuvConverter::NV12, YuvConverter::NV21, YuvConverter::YUYV, YuvConverter::UYVY, YuvConverter::I420, YuvConverter::YV12};
+
+
+bool TestYuvConverter::usePath(YuvConverter::Path path)
+{
+	YuvConverter::setPath(path);
+	return YuvConverter::path()==path;
+}
+
+
+void TestYuvConverter::initTestCase()
+{
+	mBest=YuvConverter::path();
+}
+
+
+void TestYuvConverter::cleanup()
+{
+	YuvConverter::setPath(mBest);
+}
+
+
+void TestYuvConverter::kernels_data()
+{
+	QTest::addColumn<YuvConverter::Layout>("layout");
+	QTest::addColumn<YuvConverter::Matrix>("matrix");
+	QTest::addColumn<YuvConverter::Path>("path");
+	const YuvConverter::Matrix matrices[]={YuvConverter::BT601, YuvConverter::BT709, YuvConverter::BT601Full};
+	const YuvConverter::Path paths[]={YuvConverter::SSE2, YuvConverter::AVX2};
+	for(YuvConverter::Layout layout:LAYOUTS) {
+		for(YuvConverter::Matrix matrix:matrices) {
+			for(YuvConverter::Path path:paths) {
+				QTest::newRow(qPrintable(YuvConverter::layoutName(layout)+" "+YuvConverter::matrixName(matrix)+" "+QString((YuvConverter::SSE2==path)?"sse2":"avx2")))<<layout<<matrix<<path;
+			}
+		}
+	}
+}
+
+
+void TestYuvConverter::kernels()
+{
+	QFETCH(YuvConverter::Layout, layout);
+	QFETCH(YuvConverter::Matrix, matrix);
+	QFETCH(YuvConverter::Path, path);
+	if(!usePath(path)) {
+		QSKIP("Not supported by this CPU");
+	}
+	// Odd sizes and sizes that leave tails after the vector loops
+	const QSize sizes[]={QSize(2, 2), QSize(33, 17), QSize(130, 66)};
+	for(const QSize &size:sizes) {
+		YuvFrame frame(layout, size, 5);
+		frame.fillNoise(quint32(size.width()*size.height()));
+		const uchar *planes[3];
+		int strides[3];
+		frame.planes(planes, strides);
+		QImage reference(size, QImage::Format_ARGB32_Premultiplied);
+		QImage out(size, QImage::Format_ARGB32_Premultiplied);
+		YuvConverter::setPath(YuvConverter::Scalar);
+		QVERIFY(YuvConverter::convert(layout, matrix, planes, strides, reference));
+		YuvConverter::setPath(path);
+		QVERIFY(YuvConverter::convert(layout, matrix, planes, strides, out));
+		QCOMPARE(out, reference);
+	}
+}
+
+
+void TestYuvConverter::colours_data()
+{
+	QTest::addColumn<YuvConverter::Layout>("layout");
+	QTest::addColumn<YuvConverter::Matrix>("matrix");
+	QTest::addColumn<int>("y");
+	QTest::addColumn<int>("u");
+	QTest::addColumn<int>("v");
+	QTest::addColumn<quint32>("expected");
+	// U and V differ in all but the greys, so a layout with them swapped comes out the wrong colour
+	for(YuvConverter::Layout layout:LAYOUTS) {
+		const QString name=YuvConverter::layoutName(layout);
+		QTest::newRow(qPrintable(name+" black"))<<layout<<YuvConverter::BT601<<16<<128<<128<<0xff000000u;
+		QTest::newRow(qPrintable(name+" white"))<<layout<<YuvConverter::BT601<<235<<128<<128<<0xffffffffu;
+		// (128-16)*255/219, about 130.4
+		QTest::newRow(qPrintable(name+" grey"))<<layout<<YuvConverter::BT601<<128<<128<<128<<0xff828282u;
+		QTest::newRow(qPrintable(name+" red"))<<layout<<YuvConverter::BT601<<81<<90<<240<<0xffff0000u;
+		QTest::newRow(qPrintable(name+" green"))<<layout<<YuvConverter::BT601<<145<<54<<34<<0xff00ff00u;
+		QTest::newRow(qPrintable(name+" blue"))<<layout<<YuvConverter::BT601<<41<<240<<110<<0xff0000ffu;
+		QTest::newRow(qPrintable(name+" BT.709 red"))<<layout<<YuvConverter::BT709<<63<<102<<240<<0xffff0000u;
+		QTest::newRow(qPrintable(name+" full black"))<<layout<<YuvConverter::BT601Full<<0<<128<<128<<0xff000000u;
+		QTest::newRow(qPrintable(name+" full white"))<<layout<<YuvConverter::BT601Full<<255<<128<<128<<0xffffffffu;
+		QTest::newRow(qPrintable(name+" full grey"))<<layout<<YuvConverter::BT601Full<<128<<128<<128<<0xff808080u;
+		QTest::newRow(qPrintable(name+" full red"))<<layout<<YuvConverter::BT601Full<<76<<85<<255<<0xffff0000u;
+	}
+}
+
+
+void TestYuvConverter::colours()
+{
+	QFETCH(YuvConverter::Layout, layout);
+	QFETCH(YuvConverter::Matrix, matrix);
+	QFETCH(int, y);
+	QFETCH(int, u);
+	QFETCH(int, v);
+	QFETCH(quint32, expected);
+	const QSize size(19, 7);
+	YuvFrame frame(layout, size, 3);
+	frame.fill(static_cast<uchar>(y), static_cast<uchar>(u), static_cast<uchar>(v));
+	const uchar *planes[3];
+	int strides[3];
+	frame.planes(planes, strides);
+	QImage out(size, QImage::Format_ARGB32_Premultiplied);
+	QVERIFY(YuvConverter::convert(layout, matrix, planes, strides, out));
+	for(int row=0; row<size.height(); ++row) {
+		const quint32 *line=reinterpret_cast<const quint32 *>(out.constScanLine(row));
+		for(int x=0; x<size.width(); ++x) {
+			const quint32 pixel=line[x];
+			// The fixed point maths is a step or two off the exact colour
+			bool close=(0xff==(pixel>>24));
+			for(int shift=0; shift<24; shift+=8) {
+				close=close && qAbs(int((pixel>>shift)&0xff)-int((expected>>shift)&0xff))<=2;
+			}
+			QVERIFY2(close, qPrintable(QString("%1 at %2,%3, expected %4").arg(pixel, 8, 16, QChar('0')).arg(x).arg(row).arg(expected, 8, 16, QChar('0'))));
+		}
+	}
+}
+
+
+void TestYuvConverter::rejects()
+{
+	YuvFrame frame(YuvConverter::I420, QSize(16, 16));
+	const uchar *planes[3];
+	int strides[3];
+	frame.planes(planes, strides);
+	QImage rgb(16, 16, QImage::Format_RGB32);
+	QVERIFY(!YuvConverter::convert(YuvConverter::I420, YuvConverter::BT601, planes, strides, rgb));
+	QImage out(16, 16, QImage::Format_ARGB32_Premultiplied);
+	QVERIFY(YuvConverter::convert(YuvConverter::I420, YuvConverter::BT601, planes, strides, out));
+	// A frame that mapped fewer planes than its layout has
+	planes[2]=nullptr;
+	QVERIFY(!YuvConverter::convert(YuvConverter::I420, YuvConverter::BT601, planes, strides, out));
+}
+
+
+void TestYuvConverter::benchmark_data()
+{
+	QTest::addColumn<YuvConverter::Layout>("layout");
+	QTest::addColumn<QSize>("size");
+	QTest::addColumn<YuvConverter::Path>("path");
+	const QSize sizes[]={QSize(640, 480), QSize(1280, 720), QSize(1920, 1080)};
+	const QStringList paths=QStringList()<<"scalar"<<"sse2"<<"avx2";
+	for(YuvConverter::Layout layout:LAYOUTS) {
+		for(const QSize &size:sizes) {
+			for(int p=YuvConverter::Scalar; p<=YuvConverter::AVX2; ++p) {
+				QTest::newRow(qPrintable(QString("%1 %2p %3").arg(YuvConverter::layoutName(layout)).arg(size.height()).arg(paths[p])))<<layout<<size<<static_cast<YuvConverter::Path>(p);
+			}
+		}
+	}
+}
+
+
+void TestYuvConverter::benchmark()
+{
+	QFETCH(YuvConverter::Layout, layout);
+	QFETCH(QSize, size);
+	QFETCH(YuvConverter::Path, path);
+	if(!usePath(path)) {
+		QSKIP("Not supported by this CPU");
+	}
+	// Noise is as hard as anything a camera delivers, and the same for every kernel
+	YuvFrame frame(layout, size);
+	frame.fillNoise(1);
+	const uchar *planes[3];
+	int strides[3];
+	frame.planes(planes, strides);
+	const YuvConverter::Matrix matrix=(size.height()>=720)?YuvConverter::BT709:YuvConverter::BT601;
+	QImage out(size, QImage::Format_ARGB32_Premultiplied);
+	QBENCHMARK {
+		YuvConverter::convert(layout, matrix, planes, strides, out);
+	}
+}
+
+
+QTEST_MAIN(TestYuvConverter)
+
+#include "tst_yuvconverter.moc"
@@ -0,0 +1,12 @@
+TARGET = tst_yuvconverter
+
+include(../tests.pri)
+
+HEADERS += \
+	../../ministudio/YuvConverter.hpp \
+
+
+SOURCES += \
+	../../ministudio/YuvConverter.cpp \
+	tst_yuvconverter.cpp \
+